@@ -0,0 +1,97 @@
+#-------------------------------------------------
+#
+# Project created by QtCreator 2019-09-01T10:51:49
+#
+#-------------------------------------------------
+
+QT       += core gui
+
+greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
+
+TARGET = IdTool
+TEMPLATE = app
+
+# The following define makes your compiler emit warnings if you use
+# any feature of Qt which has been marked as deprecated (the exact warnings
+# depend on your compiler). Please consult the documentation of the
+# deprecated API in order to know how to port your code away from it.
+DEFINES += QT_DEPRECATED_WARNINGS
+
+# You can also make your code fail to compile if you use deprecated APIs.
+# In order to do so, uncomment the following line.
+# You can also select to disable deprecated APIs only up to a certain version of Qt.
+#DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
+
+CONFIG += c++11
+
+# Copy the "blockdef" directory to the build directory
+copyblockdef.commands = $(COPY_DIR) \"$$shell_path($$PWD\\..\\blockdef)\" \"$$shell_path($$OUT_PWD\\blockdef)\"
+first.depends = $(first) copyblockdef
+export(first.depends)
+export(copyblockdef.commands)
+QMAKE_EXTRA_TARGETS += first copyblockdef
+
+
+SOURCES += \
+        ../src/blockdesignerdialog.cpp \
+        ../src/diffdialog.cpp \
+        ../src/diffitemmodel.cpp \
+        ../src/identityclipboard.cpp \
+        ../src/identityitemmodel.cpp \
+        ../src/identitytreeview.cpp \
+        ../src/idsetdialog.cpp \
+        ../src/itemeditordialog.cpp \
+        ../src/main.cpp \
+        ../src/mainwindow.cpp \
+        ../src/progressdialog.cpp \
+        ../src/tabmanager.cpp \
+        ../src/uibuilder.cpp
+
+HEADERS += \
+        ../src/blockdesignerdialog.h \
+        ../src/common.h \
+        ../src/diffdialog.h \
+        ../src/diffitemmodel.h \
+        ../src/identityclipboard.h \
+        ../src/identityitemmodel.h \
+        ../src/identitytreeview.h \
+        ../src/idsetdialog.h \
+        ../src/itemeditordialog.h \
+        ../src/mainwindow.h \
+        ../src/progressdialog.h \
+        ../src/tabmanager.h \
+        ../src/uibuilder.h
+
+FORMS += \
+        ../ui/blockdesignerdialog.ui \
+        ../ui/diffdialog.ui \
+        ../ui/idsetdialog.ui \
+        ../ui/itemeditordialog.ui \
+        ../ui/mainwindow.ui
+
+# Default rules for deployment.
+qnx: target.path = /tmp/$${TARGET}/bin
+else: unix:!android: target.path = /opt/$${TARGET}/bin
+!isEmpty(target.path): INSTALLS += target
+
+RESOURCES += \
+    ../res.qrc
+
+RC_FILE = ../IdTool.rc
+RC_INCLUDEPATH += $$PWD/..
+
+VERSION = 0.5.0    # major.minor.patch
+DEFINES += APP_VERSION=\\\"$$VERSION\\\"
+
+DISTFILES += \
+    ../CHANGELOG \
+    ../README.md \
+    ../blockdef/1.json \
+    ../blockdef/2.json \
+    ../blockdef/3.json \
+    ../lib/sodium/lib/libsodium.lib \
+    ../lib/sodium/lib/libsodium.so \
+    ../lib/sodium/lib/libsodiumd.lib
+
+include(../core/idtoolcore.pri)
+
@@ -0,0 +1,268 @@
+/*
+ * This file is part of the "IdTool" utility app.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Alexander Hauser
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Microbenchmarks for the parser, codecs and crypto hot paths.
+ *
+ * Results can be written in a machine-readable format using the
+ * QtTest output options, e.g.
+ *
+ *   ./benchcore -o results.xml,xml
+ *   ./benchcore -o results.csv,csv
+ *
+ * Use -tickcounter or -callgrind for other measurement backends, and
+ * release builds of both idtoolcore and this target for meaningful
+ * numbers.
+ */
+
+#include "benchcore.h"
+#include "../src/cryptutil.h"
+#include "../src/identitygenerator.h"
+#include "../src/identityparser.h"
+#include "../src/keycontext.h"
+
+/*
+ * Returns the raw benchmark identity with \a blockCount blocks. Counts
+ * above three are filled up with unknown blocks of 64 data bytes.
+ */
+
+QByteArray BenchCore::createRawIdentity(int blockCount)
+{
+    QByteArray result = IdentityParser::HEADER.toLatin1();
+    QByteArray unknownBlock = QByteArray::fromHex("4400e803") + QByteArray(64, 'x');
+
+    for (int i=0; i<qMin(blockCount, m_Identity.blocks.size()); i++)
+        result.append(m_Identity.blocks[i].toByteArray());
+
+    for (int i=m_Identity.blocks.size(); i<blockCount; i++)
+        result.append(unknownBlock);
+
+    return result;
+}
+
+void BenchCore::initTestCase()
+{
+    // Block definitions are looked up relative to the working
+    // directory, so fall back to the application directory if needed
+    if (!IdentityParser::hasBlockDefinition(2))
+        QDir::setCurrent(QCoreApplication::applicationDirPath());
+
+    QVERIFY(IdentityParser::hasBlockDefinition(3));
+
+    // A reproducible identity with blocks 1, 2 and 3
+    IdentityGenerator generator(DeterministicRandom::createSeed("benchcore"), 9, 1);
+    generator.setPassword("benchmark");
+    generator.setPreviousIukCount(IdentityGenerator::MAX_PREVIOUS_IUKS);
+    IdentityGenerator::Identity identity = generator.generateIdentity(0);
+    QVERIFY(identity.errorMessage.isEmpty());
+
+    m_RawIdentity = identity.rawIdentity;
+    IdentityParser parser;
+    parser.parseIdentityData(m_RawIdentity, &m_Identity);
+    QCOMPARE(m_Identity.blocks.size(), 3);
+
+    QByteArray ilk;
+    QVERIFY(CryptUtil::createKeyFromPassword(m_Block1Key, *m_Identity.getBlock(1), "benchmark"));
+    QVERIFY(CryptUtil::decryptBlock1(m_Imk, ilk, m_Identity.getBlock(1), m_Block1Key));
+}
+
+void BenchCore::parseIdentityData_data()
+{
+    QTest::addColumn<int>("blockCount");
+    QTest::addColumn<bool>("cached");
+
+    for (int blockCount : { 1, 2, 3, 16, 64 })
+    {
+        QTest::newRow(qPrintable(QString("%1 blocks").arg(blockCount))) << blockCount << false;
+        QTest::newRow(qPrintable(QString("%1 blocks, cached").arg(blockCount))) << blockCount << true;
+    }
+}
+
+void BenchCore::parseIdentityData()
+{
+    QFETCH(int, blockCount);
+    QFETCH(bool, cached);
+
+    QByteArray data = createRawIdentity(blockCount);
+    IdentityParser parser;
+    IdentityParser::setBlockDefinitionCacheEnabled(cached);
+
+    QBENCHMARK
+    {
+        IdentityModel identity;
+        parser.parseIdentityData(data, &identity);
+    }
+
+    IdentityParser::setBlockDefinitionCacheEnabled(false);
+}
+
+void BenchCore::getRawBytes_data()
+{
+    QTest::addColumn<int>("blockCount");
+
+    for (int blockCount : { 1, 3, 16, 64 })
+        QTest::newRow(qPrintable(QString("%1 blocks").arg(blockCount))) << blockCount;
+}
+
+void BenchCore::getRawBytes()
+{
+    QFETCH(int, blockCount);
+
+    IdentityModel identity;
+    IdentityParser parser;
+    parser.parseIdentityData(createRawIdentity(blockCount), &identity);
+
+    QBENCHMARK
+    {
+        identity.getRawBytes();
+    }
+}
+
+void BenchCore::base56EncodeIdentity_data()
+{
+    QTest::addColumn<QByteArray>("data");
+
+    DeterministicRandom random(DeterministicRandom::createSeed("base56"));
+    for (int size : { 32, 73, 128, 512 })
+        QTest::newRow(qPrintable(QString("%1 bytes").arg(size))) << random.getBytes(size);
+}
+
+void BenchCore::base56EncodeIdentity()
+{
+    QFETCH(QByteArray, data);
+
+    QBENCHMARK
+    {
+        CryptUtil::base56EncodeIdentity(data);
+    }
+}
+
+void BenchCore::base56DecodeIdentity_data()
+{
+    base56EncodeIdentity_data();
+}
+
+void BenchCore::base56DecodeIdentity()
+{
+    QFETCH(QByteArray, data);
+
+    QString textualIdentity = CryptUtil::base56EncodeIdentity(data);
+    QCOMPARE(CryptUtil::base56DecodeIdentity(textualIdentity), data);
+
+    QBENCHMARK
+    {
+        CryptUtil::base56DecodeIdentity(textualIdentity);
+    }
+}
+
+void BenchCore::verifyTextualIdentity()
+{
+    QString textualIdentity = m_Identity.getTextualVersionFormatted();
+    QVERIFY(CryptUtil::verifyTextualIdentity(textualIdentity));
+
+    QBENCHMARK
+    {
+        CryptUtil::verifyTextualIdentity(textualIdentity);
+    }
+}
+
+void BenchCore::enHash()
+{
+    QByteArray data = m_Imk;
+
+    QBENCHMARK
+    {
+        CryptUtil::enHash(data);
+    }
+}
+
+void BenchCore::enScryptIteration_data()
+{
+    QTest::addColumn<int>("logNFactor");
+
+    for (int logNFactor : { 9, 10, 12, 14 })
+        QTest::newRow(qPrintable(QString("logN %1").arg(logNFactor))) << logNFactor;
+}
+
+void BenchCore::enScryptIteration()
+{
+    QFETCH(int, logNFactor);
+
+    QByteArray result(32, 0);
+    QByteArray salt(16, 0);
+
+    QBENCHMARK
+    {
+        CryptUtil::enScryptIterations(result, "password", salt, logNFactor, 1);
+    }
+}
+
+void BenchCore::createSiteKeys()
+{
+    QByteArray publicKey(crypto_sign_PUBLICKEYBYTES, 0);
+    QByteArray privateKey(crypto_sign_SECRETKEYBYTES, 0);
+
+    QBENCHMARK
+    {
+        CryptUtil::createSiteKeys(publicKey, privateKey, "sqrl.grc.com", "", m_Imk);
+    }
+}
+
+void BenchCore::createSiteKeysKeyContext()
+{
+    QByteArray publicKey(crypto_sign_PUBLICKEYBYTES, 0);
+    QByteArray privateKey(crypto_sign_SECRETKEYBYTES, 0);
+    KeyContext imkContext(m_Imk);
+
+    QBENCHMARK
+    {
+        CryptUtil::createSiteKeys(publicKey, privateKey, "sqrl.grc.com", "", imkContext);
+    }
+}
+
+void BenchCore::decryptBlock1()
+{
+    QByteArray imk, ilk;
+    IdentityBlock* pBlock1 = m_Identity.getBlock(1);
+
+    QBENCHMARK
+    {
+        CryptUtil::decryptBlock1(imk, ilk, pBlock1, m_Block1Key);
+    }
+}
+
+void BenchCore::decryptBlock3()
+{
+    IdentityBlock* pBlock3 = m_Identity.getBlock(3);
+
+    QBENCHMARK
+    {
+        QList<QByteArray> previousIuks;
+        CryptUtil::decryptBlock3(previousIuks, pBlock3, m_Imk);
+    }
+}
+
+QTEST_MAIN(BenchCore)
@@ -0,0 +1,60 @@
+/*
+ * This file is part of the "IdTool" utility app.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Alexander Hauser
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <QtTest/QtTest>
+#include "../src/identitymodel.h"
+
+class BenchCore: public QObject
+{
+    Q_OBJECT
+
+private:
+    IdentityModel m_Identity;
+    QByteArray m_RawIdentity;
+    QByteArray m_Block1Key;
+    QByteArray m_Imk;
+
+    QByteArray createRawIdentity(int blockCount);
+
+private slots:
+    void initTestCase();
+    void parseIdentityData_data();
+    void parseIdentityData();
+    void getRawBytes_data();
+    void getRawBytes();
+    void base56EncodeIdentity_data();
+    void base56EncodeIdentity();
+    void base56DecodeIdentity_data();
+    void base56DecodeIdentity();
+    void verifyTextualIdentity();
+    void enHash();
+    void enScryptIteration_data();
+    void enScryptIteration();
+    void createSiteKeys();
+    void createSiteKeysKeyContext();
+    void decryptBlock1();
+    void decryptBlock3();
+};
@@ -0,0 +1,112 @@
+######################################################################
+# idtoolcore - identity parsing and crypto library (QtCore only)
+#
+# Shared by the IdTool application, the tests and the command line
+# tools. Builds a static library by default, run qmake with
+# "CONFIG+=idtoolcore_shared" to build a shared library instead
+# (not supported on Windows, since no symbols are being exported).
+######################################################################
+
+QT = core
+
+TEMPLATE = lib
+CONFIG += c++11
+TARGET = idtoolcore
+
+idtoolcore_shared:!win32 {
+    CONFIG += shared
+} else {
+    CONFIG += staticlib
+}
+
+# You can make your code fail to compile if you use deprecated APIs.
+# In order to do so, uncomment the following line.
+# Please consult the documentation of the deprecated API in order to know
+# how to port your code away from it.
+# You can also select to disable deprecated APIs only up to a certain version of Qt.
+#DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
+
+DEFINES += QT_DEPRECATED_WARNINGS \
+    SODIUM_STATIC
+
+# Input
+SOURCES += \
+    ../inc/bigint/BigInteger.cc \
+    ../inc/bigint/BigIntegerAlgorithms.cc \
+    ../inc/bigint/BigIntegerUtils.cc \
+    ../inc/bigint/BigUnsigned.cc \
+    ../inc/bigint/BigUnsignedInABase.cc \
+    ../src/allocationtracker.cpp \
+    ../src/consoleprogresssink.cpp \
+    ../src/cryptutil.cpp \
+    ../src/enscryptcalibration.cpp \
+    ../src/identityconverter.cpp \
+    ../src/identitydiff.cpp \
+    ../src/identitygenerator.cpp \
+    ../src/identityhistory.cpp \
+    ../src/identityjson.cpp \
+    ../src/identitylineage.cpp \
+    ../src/identityloader.cpp \
+    ../src/identitymodel.cpp \
+    ../src/identityparser.cpp \
+    ../src/identityservice.cpp \
+    ../src/kdfexecutor.cpp \
+    ../src/keycontext.cpp \
+    ../src/progresssink.cpp \
+    ../src/rescuecoderecovery.cpp \
+    ../src/scryptkernel.cpp \
+    ../src/tracer.cpp
+
+HEADERS += \
+    ../inc/bigint/BigInteger.hh \
+    ../inc/bigint/BigIntegerAlgorithms.hh \
+    ../inc/bigint/BigIntegerLibrary.hh \
+    ../inc/bigint/BigIntegerUtils.hh \
+    ../inc/bigint/BigUnsigned.hh \
+    ../inc/bigint/BigUnsignedInABase.hh \
+    ../inc/bigint/NumberlikeArray.hh \
+    ../src/allocationtracker.h \
+    ../src/consoleprogresssink.h \
+    ../src/corecommon.h \
+    ../src/cryptutil.h \
+    ../src/enscryptcalibration.h \
+    ../src/identityconverter.h \
+    ../src/identitydiff.h \
+    ../src/identitygenerator.h \
+    ../src/identityhistory.h \
+    ../src/identityjson.h \
+    ../src/identitylineage.h \
+    ../src/identityloader.h \
+    ../src/identitymodel.h \
+    ../src/identityparser.h \
+    ../src/identityservice.h \
+    ../src/kdfexecutor.h \
+    ../src/keycontext.h \
+    ../src/progresssink.h \
+    ../src/rescuecoderecovery.h \
+    ../src/scryptkernel.h \
+    ../src/scryptkernel_p.h \
+    ../src/tracer.h
+
+# SIMD kernels for batch EnScrypt operations, see ../src/scryptkernel.cpp.
+# These must not be part of SOURCES, since they need to be compiled
+# with support for the respective instruction set enabled.
+CONFIG += simd
+AVX2_SOURCES += ../src/scryptkernel_avx2.cpp
+AVX512F_SOURCES += ../src/scryptkernel_avx512.cpp
+
+# The fallback block definition for unknown block types is part of
+# the library, so that consumers don't need to ship IdTool's res.qrc.
+RESOURCES += \
+    idtoolcore.qrc
+
+DISTFILES += \
+    ../src/allocationhook.cpp \
+    idtoolcore.pri
+
+# Only needed for shared builds, static consumers link libsodium
+# themselves through idtoolcore.pri.
+idtoolcore_shared:!win32: LIBS += -L$$PWD/../lib/sodium/lib/ -lsodium
+
+INCLUDEPATH += $$PWD/../lib/sodium/include
+DEPENDPATH += $$PWD/../lib/sodium/include
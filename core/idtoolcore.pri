@@ -0,0 +1,40 @@
+######################################################################
+# Include this file from any project that links against idtoolcore,
+# the library must be built first (see the top level IdTool.pro).
+######################################################################
+
+CONFIG += c++11
+
+DEFINES += \
+    SODIUM_STATIC
+
+INCLUDEPATH += $$PWD/../src
+DEPENDPATH += $$PWD/../src
+
+IDTOOLCORE_LIBDIR = $$shadowed($$PWD)
+win32:CONFIG(release, debug|release): IDTOOLCORE_LIBDIR = $$IDTOOLCORE_LIBDIR/release
+else:win32:CONFIG(debug, debug|release): IDTOOLCORE_LIBDIR = $$IDTOOLCORE_LIBDIR/debug
+
+LIBS += -L$$IDTOOLCORE_LIBDIR -lidtoolcore
+
+!idtoolcore_shared|win32 {
+    win32-g++: PRE_TARGETDEPS += $$IDTOOLCORE_LIBDIR/libidtoolcore.a
+    else:win32: PRE_TARGETDEPS += $$IDTOOLCORE_LIBDIR/idtoolcore.lib
+    else: PRE_TARGETDEPS += $$IDTOOLCORE_LIBDIR/libidtoolcore.a
+}
+
+win32:CONFIG(release, debug|release): LIBS += -L$$PWD/../lib/sodium/lib/ -llibsodium
+else:win32:CONFIG(debug, debug|release): LIBS += -L$$PWD/../lib/sodium/lib/ -llibsodiumd
+else:unix: LIBS += -L$$PWD/../lib/sodium/lib/ -lsodium
+
+INCLUDEPATH += $$PWD/../lib/sodium/include
+DEPENDPATH += $$PWD/../lib/sodium/include
+
+# Allocation accounting (see AllocationTracker). The hook replaces the
+# global allocation functions, so it is built into the executable.
+idtool_alloc_hook {
+    SOURCES += $$PWD/../src/allocationhook.cpp
+}
+
+QMAKE_LFLAGS_WINDOWS += /NODEFAULTLIB:LIBCMTD \
+    /NODEFAULTLIB:LIBCMT
@@ -0,0 +1,268 @@
+/*
+ * This file is part of the "IdTool" utility app.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Alexander Hauser
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+// Allocation hook maintaining the counters of AllocationTracker. This
+// file replaces the global allocation functions, so it must be compiled
+// into the executable itself and is therefore not part of idtoolcore.
+// Add CONFIG+=idtool_alloc_hook to a project including idtoolcore.pri
+// to get it.
+
+#include "allocationtracker.h"
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#include <unistd.h>
+
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+void* __libc_memalign(size_t alignment, size_t size);
+void __libc_free(void* ptr);
+}
+#endif
+
+// Plain data only, so that accessing it never allocates
+static thread_local AllocationTracker::Counters t_Counters = { 0, 0, 0, 0 };
+
+static AllocationTracker::Counters* getThreadCounters()
+{
+    return &t_Counters;
+}
+
+static inline void recordAllocation(size_t size)
+{
+    t_Counters.allocations++;
+    t_Counters.allocatedBytes += static_cast<qint64>(size);
+    t_Counters.currentBytes += static_cast<qint64>(size);
+    if (t_Counters.currentBytes > t_Counters.peakBytes)
+        t_Counters.peakBytes = t_Counters.currentBytes;
+}
+
+static inline void recordFree(size_t size)
+{
+    t_Counters.currentBytes -= static_cast<qint64>(size);
+}
+
+#if defined(__GLIBC__)
+static const bool COUNTS_MALLOC = true;
+#else
+static const bool COUNTS_MALLOC = false;
+#endif
+
+Q_DECL_UNUSED static const bool registered =
+        (AllocationTracker::setCounterFunction(getThreadCounters, COUNTS_MALLOC), true);
+
+#if defined(__GLIBC__)
+
+// Replacing malloc() also catches Qt's containers, which don't use
+// operator new. libstdc++'s operator new is based on malloc(). Every
+// allocating entry point of glibc is replaced, since free() deducts the
+// usable size of any block it is given, counted or not.
+extern "C" {
+
+void* malloc(size_t size)
+{
+    void* ptr = __libc_malloc(size);
+    if (ptr) recordAllocation(malloc_usable_size(ptr));
+    return ptr;
+}
+
+void* calloc(size_t count, size_t size)
+{
+    void* ptr = __libc_calloc(count, size);
+    if (ptr) recordAllocation(malloc_usable_size(ptr));
+    return ptr;
+}
+
+// The old and the new usable size are both taken from the allocator, so
+// growing or shrinking in place is accounted for just like moving
+void* realloc(void* ptr, size_t size)
+{
+    size_t oldSize = ptr ? malloc_usable_size(ptr) : 0;
+    void* newPtr = __libc_realloc(ptr, size);
+
+    if (newPtr)
+    {
+        recordFree(oldSize);
+        recordAllocation(malloc_usable_size(newPtr));
+    }
+    else if (size == 0)
+    {
+        recordFree(oldSize);
+    }
+
+    return newPtr;
+}
+
+void* reallocarray(void* ptr, size_t count, size_t size)
+{
+    if (size != 0 && count > SIZE_MAX / size)
+    {
+        errno = ENOMEM;
+        return nullptr;
+    }
+
+    return realloc(ptr, count * size);
+}
+
+void* memalign(size_t alignment, size_t size)
+{
+    void* ptr = __libc_memalign(alignment, size);
+    if (ptr) recordAllocation(malloc_usable_size(ptr));
+    return ptr;
+}
+
+void* aligned_alloc(size_t alignment, size_t size)
+{
+    return memalign(alignment, size);
+}
+
+int posix_memalign(void** result, size_t alignment, size_t size)
+{
+    if (alignment % sizeof(void*) != 0 || (alignment & (alignment - 1)) != 0) return EINVAL;
+
+    void* ptr = memalign(alignment, size);
+    if (!ptr) return ENOMEM;
+
+    *result = ptr;
+    return 0;
+}
+
+void* valloc(size_t size)
+{
+    return memalign(static_cast<size_t>(sysconf(_SC_PAGESIZE)), size);
+}
+
+void* pvalloc(size_t size)
+{
+    size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+
+    if (size > SIZE_MAX - pageSize)
+    {
+        errno = ENOMEM;
+        return nullptr;
+    }
+
+    // Like glibc, round up to whole pages, allocating at least one
+    size_t roundedSize = size == 0 ? pageSize : (size + pageSize - 1) & ~(pageSize - 1);
+    return memalign(pageSize, roundedSize);
+}
+
+void free(void* ptr)
+{
+    if (!ptr) return;
+
+    recordFree(malloc_usable_size(ptr));
+    __libc_free(ptr);
+}
+
+}
+
+#else
+
+// Only the replaceable global operator new and delete can be hooked
+// portably. The size of each allocation is kept in front of it.
+static const size_t HEADER_SIZE = 16;
+
+static void* allocate(size_t size)
+{
+    char* ptr = static_cast<char*>(std::malloc(size + HEADER_SIZE));
+    if (!ptr) return nullptr;
+
+    *reinterpret_cast<size_t*>(ptr) = size;
+    recordAllocation(size);
+    return ptr + HEADER_SIZE;
+}
+
+static void deallocate(void* ptr)
+{
+    if (!ptr) return;
+
+    char* start = static_cast<char*>(ptr) - HEADER_SIZE;
+    recordFree(*reinterpret_cast<size_t*>(start));
+    std::free(start);
+}
+
+void* operator new(size_t size)
+{
+    void* ptr = allocate(size);
+    if (!ptr) throw std::bad_alloc();
+    return ptr;
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    return allocate(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+    return allocate(size);
+}
+
+void operator delete(void* ptr) noexcept
+{
+    deallocate(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+    deallocate(ptr);
+}
+
+void operator delete(void* ptr, const std::nothrow_t&) noexcept
+{
+    deallocate(ptr);
+}
+
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept
+{
+    deallocate(ptr);
+}
+
+#if defined(__cpp_sized_deallocation)
+void operator delete(void* ptr, size_t) noexcept
+{
+    deallocate(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept
+{
+    deallocate(ptr);
+}
+#endif
+
+#endif
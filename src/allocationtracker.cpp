@@ -0,0 +1,140 @@
+/*
+ * This file is part of the "IdTool" utility app.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Alexander Hauser
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "allocationtracker.h"
+
+Q_LOGGING_CATEGORY(idtoolAllocations, "idtool.allocations", QtWarningMsg)
+
+AllocationTracker::CounterFunction AllocationTracker::m_pCounterFunction = nullptr;
+bool AllocationTracker::m_bCountsMalloc = false;
+
+/*!
+ *
+ * \class AllocationTracker
+ * \brief Provides access to the heap allocation counters of the
+ * current thread.
+ *
+ * The counters are maintained by the allocation hook in
+ * "allocationhook.cpp", which replaces the global allocation functions
+ * and must therefore be compiled into the executable itself. qmake
+ * projects including "idtoolcore.pri" get it by adding
+ * \c CONFIG+=idtool_alloc_hook. The hook registers its counters using
+ * \c setCounterFunction(). Without the hook, \c isAvailable() returns
+ * \c false and all \c AllocationScope objects are no-ops.
+ *
+ * On glibc, \c malloc() and friends are replaced, so that allocations
+ * of Qt's containers are counted as well. Elsewhere, only the global
+ * \c operator \c new and \c operator \c delete can be replaced, which
+ * misses the containers' allocations. Use \c isCountingMalloc() to find
+ * out which of both hooks is in place.
+ *
+ * Counters are kept per thread, so allocations on worker threads are not
+ * attributed to the scope that started them, and memory freed on another
+ * thread than the one it was allocated on skews the current and peak
+ * byte counts of both threads.
+ *
+ * \sa AllocationScope
+ *
+*/
+
+/*!
+ * Sets the function returning the allocation counters of the current
+ * thread to \a counterFunction. \a countsMalloc tells whether the
+ * counters include \c malloc() allocations, or only those made through
+ * \c operator \c new. Called by the allocation hook.
+ */
+
+void AllocationTracker::setCounterFunction(CounterFunction counterFunction, bool countsMalloc)
+{
+    m_pCounterFunction = counterFunction;
+    m_bCountsMalloc = countsMalloc;
+}
+
+
+
+/*!
+ *
+ * \class AllocationScope
+ * \brief Counts the heap allocations, allocated bytes and peak heap usage
+ * of the current thread while the scope is alive.
+ *
+ * Use the \c ALLOC_SCOPE(name) macro to account for an operation, or
+ * create an \c AllocationScope directly and call \c getResult() to check
+ * allocation budgets within tests. Scopes may be nested, the allocations
+ * of inner scopes count towards the outer ones.
+ *
+ * The result of each scope is logged to the "idtool.allocations" logging
+ * category, which can be enabled using
+ * \c QT_LOGGING_RULES="idtool.allocations.debug=true". If tracing is
+ * enabled, the spans written by the \c Tracer contain allocation counts
+ * as well.
+ *
+ * \sa AllocationTracker, Tracer
+ *
+*/
+
+/*!
+ * Returns the allocations of the current thread since the scope was
+ * created. The peak is measured relative to the heap usage at the time
+ * of creation. Returns an empty result if no allocation hook is installed.
+ */
+
+AllocationTracker::Result AllocationScope::getResult() const
+{
+    AllocationTracker::Result result;
+    if (!m_pCounters) return result;
+
+    result.allocations = m_pCounters->allocations - m_StartAllocations;
+    result.allocatedBytes = m_pCounters->allocatedBytes - m_StartAllocatedBytes;
+    result.peakBytes = qMax(Q_INT64_C(0), m_pCounters->peakBytes - m_StartCurrentBytes);
+    return result;
+}
+
+/*!
+ * Takes a snapshot of the counters and restarts measuring the peak.
+ */
+
+void AllocationScope::begin()
+{
+    m_StartAllocations = m_pCounters->allocations;
+    m_StartAllocatedBytes = m_pCounters->allocatedBytes;
+    m_StartCurrentBytes = m_pCounters->currentBytes;
+    m_SavedPeakBytes = m_pCounters->peakBytes;
+    m_pCounters->peakBytes = m_pCounters->currentBytes;
+}
+
+/*!
+ * Logs the result and restores the peak of any enclosing scope.
+ */
+
+void AllocationScope::end()
+{
+    AllocationTracker::Result result = getResult();
+    m_pCounters->peakBytes = qMax(m_SavedPeakBytes, m_pCounters->peakBytes);
+
+    qCDebug(idtoolAllocations, "%s: %lld allocations, %lld bytes, %lld bytes peak",
+            m_Name, result.allocations, result.allocatedBytes, result.peakBytes);
+}
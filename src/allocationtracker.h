@@ -0,0 +1,111 @@
+/*
+ * This file is part of the "IdTool" utility app.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Alexander Hauser
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef ALLOCATIONTRACKER_H
+#define ALLOCATIONTRACKER_H
+
+#include "corecommon.h"
+#include <QLoggingCategory>
+
+Q_DECLARE_LOGGING_CATEGORY(idtoolAllocations)
+
+/**********************************************
+ *    class AllocationTracker                 *
+ *********************************************/
+
+class AllocationTracker
+{
+public:
+    struct Counters
+    {
+        qint64 allocations;
+        qint64 allocatedBytes;
+        qint64 currentBytes;
+        qint64 peakBytes;
+    };
+
+    struct Result
+    {
+        qint64 allocations = 0;
+        qint64 allocatedBytes = 0;
+        qint64 peakBytes = 0;
+    };
+
+    typedef Counters* (*CounterFunction)();
+
+private:
+    static CounterFunction m_pCounterFunction;
+    static bool m_bCountsMalloc;
+
+public:
+    static void setCounterFunction(CounterFunction counterFunction, bool countsMalloc);
+    static inline bool isAvailable() { return m_pCounterFunction != nullptr; }
+    static inline bool isCountingMalloc() { return m_bCountsMalloc; }
+    static inline Counters* getCounters() { return m_pCounterFunction ? m_pCounterFunction() : nullptr; }
+};
+
+/**********************************************
+ *    class AllocationScope                   *
+ *********************************************/
+
+class AllocationScope
+{
+private:
+    const char* m_Name;
+    AllocationTracker::Counters* m_pCounters;
+    qint64 m_StartAllocations = 0;
+    qint64 m_StartAllocatedBytes = 0;
+    qint64 m_StartCurrentBytes = 0;
+    qint64 m_SavedPeakBytes = 0;
+
+public:
+    inline explicit AllocationScope(const char* name) :
+        m_Name(name),
+        m_pCounters(AllocationTracker::getCounters())
+    {
+        if (m_pCounters) begin();
+    }
+
+    inline ~AllocationScope()
+    {
+        if (m_pCounters) end();
+    }
+
+    AllocationTracker::Result getResult() const;
+
+private:
+    void begin();
+    void end();
+
+    Q_DISABLE_COPY(AllocationScope)
+};
+
+// Accounts for the allocations until the end of the enclosing scope.
+#define ALLOC_CONCAT_(a, b) a##b
+#define ALLOC_CONCAT(a, b) ALLOC_CONCAT_(a, b)
+#define ALLOC_SCOPE(name) AllocationScope ALLOC_CONCAT(allocationScope, __LINE__)(name)
+
+#endif // ALLOCATIONTRACKER_H
@@ -102,6 +102,31 @@ BlockDesignerDialog::~BlockDesignerDialog()
     if (m_pBlockDesign != nullptr) delete m_pBlockDesign;
 }
 
+/*!
+ * Converts \a item into a number of \c QStandardItem objects and returns
+ * a list of pointers to those objects.
+ *
+ * This is used to display block items in a UI view using the view/model paradigm.
+ */
+
+QList<QStandardItem*> BlockDesignerDialog::toStandardItems(QJsonObject *item)
+{
+    QList<QStandardItem*> result;
+
+    int nrOfBytes = (*item)["bytes"].toInt(0);
+    int repeatIndex = (*item)["repeat_index"].toInt(-1);
+    int repeatCount = (*item)["repeat_count"].toInt(1);
+
+    result.append(new QStandardItem((*item)["name"].toString("")));
+    result.append(new QStandardItem((*item)["description"].toString("")));
+    result.append(new QStandardItem((*item)["type"].toString("UNDEFINED")));
+    result.append(new QStandardItem(QString::number(nrOfBytes)));
+    result.append(new QStandardItem(QString::number(repeatIndex)));
+    result.append(new QStandardItem(QString::number(repeatCount)));
+
+    return result;
+}
+
 /*!
  * Creates a new \c QStandardItemModel, sets the correct header
  * labels and puts a pointer to the model into \c m_pItemModel.
@@ -236,8 +261,7 @@ void BlockDesignerDialog::reload(bool reloadBlockDefinition)
     for (QJsonValue item: items)
     {
         QJsonObject itemObj = item.toObject();
-        QList<QStandardItem*> stdItemList = IdentityParser::toStandardItems(
-                    &itemObj);
+        QList<QStandardItem*> stdItemList = toStandardItems(&itemObj);
 
         m_pItemModel->appendRow(stdItemList);
 
@@ -66,6 +66,7 @@ private:
     void createBlockDefinition();
     bool loadBlockDefinition();
     void reload(bool reloadBlockDefinition);
+    static QList<QStandardItem*> toStandardItems(QJsonObject* item);
 
 public slots:
     void onAddItemClicked();
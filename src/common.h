@@ -27,7 +27,15 @@
 #ifndef COMMON_H
 #define COMMON_H
 
-#include <sodium.h>
+#include "corecommon.h"
+
+#include <QtGui>
+#include <QClipboard>
+#include <QPicture>
+#include <QStandardItemModel>
+#include <QStandardItem>
+#include <QCloseEvent>
+#include <QTextFormat>
 
 #include <QMainWindow>
 #include <QScrollArea>
@@ -36,39 +44,16 @@
 #include <QLineEdit>
 #include <QPushButton>
 #include <QSizePolicy>
-#include <QUuid>
-#include <QObjectUserData>
 #include <QMessageBox>
 #include <QInputDialog>
 #include <QApplication>
-#include <QClipboard>
 #include <QToolTip>
-#include <QPicture>
 #include <QMenu>
-#include <QMetaType>
-#include <QVariant>
-#include <QDir>
 #include <QDialog>
-#include <QStandardItemModel>
-#include <QSaveFile>
-#include <QJsonObject>
-#include <QString>
-#include <QByteArray>
 #include <QProgressDialog>
-#include <QObject>
-#include <QFile>
-#include <QDataStream>
-#include <QDebug>
-#include <QList>
-#include <QStandardItem>
-#include <QJsonDocument>
-#include <QJsonArray>
-#include <QtGui>
 #include <QDesktopWidget>
-#include <QElapsedTimer>
-#include <QCloseEvent>
-#include <QTextFormat>
-
-#include "../inc/bigint/BigIntegerLibrary.hh"
+#include <QTreeView>
+#include <QHeaderView>
+#include <QStyledItemDelegate>
 
 #endif // COMMON_H
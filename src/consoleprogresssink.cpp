@@ -0,0 +1,128 @@
+/*
+ * This file is part of the "IdTool" utility app.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Alexander Hauser
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "consoleprogresssink.h"
+
+/*!
+ *
+ * \class ConsoleProgressSink
+ * \brief A \c ProgressSink printing the progress of an operation to a
+ * console stream.
+ *
+ * The progress text and percentage are printed on a single line, which
+ * is overwritten in place (using a carriage return) as the operation
+ * progresses. Multi-line progress texts are joined into a single line.
+ * Progress values are throttled like with any \c ThrottledProgressSink.
+ *
+ * Command line tools and batch jobs can use \c requestCancellation() to
+ * abort the operation from another thread, e.g. from a watchdog or when
+ * receiving a termination request.
+ *
+ * \sa ProgressSink, ThrottledProgressSink
+ *
+*/
+
+/*!
+ * Creates a new \c ConsoleProgressSink printing to \a stream (\c std::cerr
+ * by default), and updating the printed progress at most once every
+ * \a intervalMs milliseconds.
+ */
+
+ConsoleProgressSink::ConsoleProgressSink(std::ostream& stream, int intervalMs) :
+    ThrottledProgressSink(intervalMs),
+    m_Stream(stream)
+{
+}
+
+/*!
+ * Finishes the progress line, see \c finish().
+ */
+
+ConsoleProgressSink::~ConsoleProgressSink()
+{
+    finish();
+}
+
+void ConsoleProgressSink::setProgressText(const QString& text)
+{
+    m_Text = text;
+    printLine(getProgressValue());
+}
+
+QString ConsoleProgressSink::getProgressText() const
+{
+    return m_Text;
+}
+
+/*!
+ * Prints the latest progress value and terminates the progress line, so
+ * that further output starts on a new line. Does nothing if no progress
+ * was printed since the last call.
+ */
+
+void ConsoleProgressSink::finish()
+{
+    if (m_LineLength == 0) return;
+
+    flushProgress();
+    m_Stream << "\n" << std::flush;
+    m_LineLength = 0;
+}
+
+void ConsoleProgressSink::reportProgressMaximum(int maximum)
+{
+    Q_UNUSED(maximum);
+    printLine(getProgressValue());
+}
+
+void ConsoleProgressSink::reportProgressValue(int value)
+{
+    printLine(value);
+}
+
+/*!
+ * Overwrites the current progress line with the progress text and
+ * \a value as a percentage of the progress maximum.
+ */
+
+void ConsoleProgressSink::printLine(int value)
+{
+    QString line = m_Text.simplified();
+    int maximum = getProgressMaximum();
+
+    if (maximum > 0)
+    {
+        int percent = static_cast<int>(qBound<qint64>(0, qint64(value) * 100 / maximum, 100));
+        line += QString(" %1%").arg(percent);
+    }
+
+    // Pad with spaces to erase the remains of a longer previous line
+    int length = line.length();
+    if (length < m_LineLength) line += QString(m_LineLength - length, ' ');
+    m_LineLength = std::max(length, 1);
+
+    m_Stream << "\r" << line.toStdString() << std::flush;
+}
@@ -0,0 +1,65 @@
+/*
+ * This file is part of the "IdTool" utility app.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Alexander Hauser
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef CONSOLEPROGRESSSINK_H
+#define CONSOLEPROGRESSSINK_H
+
+#include "corecommon.h"
+#include "progresssink.h"
+#include <iostream>
+
+/**********************************************
+ *    class ConsoleProgressSink               *
+ *********************************************/
+
+class ConsoleProgressSink : public ThrottledProgressSink
+{
+public:
+    explicit ConsoleProgressSink(std::ostream& stream = std::cerr,
+                                 int intervalMs = DEFAULT_INTERVAL_MS);
+    ~ConsoleProgressSink() override;
+
+    // ProgressSink
+    void setProgressText(const QString& text) override;
+    QString getProgressText() const override;
+
+    void finish();
+
+protected:
+    // ThrottledProgressSink
+    void reportProgressMaximum(int maximum) override;
+    void reportProgressValue(int value) override;
+
+private:
+    void printLine(int value);
+
+private:
+    std::ostream& m_Stream;
+    QString m_Text;
+    int m_LineLength = 0;
+};
+
+#endif // CONSOLEPROGRESSSINK_H
@@ -25,6 +25,9 @@
  */
 
 #include "cryptutil.h"
+#include "enscryptcalibration.h"
+#include "scryptkernel.h"
+#include "tracer.h"
 
 /*!
  *
@@ -41,6 +44,8 @@
 const QByteArray CryptUtil::BASE56_ALPHABET = "23456789ABCDEFGHJKLMNPQRSTUVWXYZabcdefghijkmnpqrstuvwxyz";
 const int CryptUtil::BASE56_LINE_MAX_CHARS = 19;
 const int CryptUtil::BASE56_BASE_NUM = 56;
+const int CryptUtil::KDF_PROGRESS_INTERVAL_MS = 50;
+const int CryptUtil::BLOCK_ENSCRYPT_SECONDS = 5;
 
 CryptUtil::CryptUtil() {}
 
@@ -105,7 +110,11 @@ bool CryptUtil::getRandomByte(unsigned char &byte)
  * Runs \a iterationCount number of scrypt iterations on \a password,
  * using the scrypt parameters \a randomSalt and \a logNFactor.
  *
- * If a valid \a progressDialog pointer is given, the operation will use it
+ * The operation runs on the shared \c KdfExecutor (using its default
+ * priority), so that it stays within the executor's memory budget, while
+ * the calling thread waits for it.
+ *
+ * If a valid \a progressSink pointer is given, the operation will use it
  * to publish its progress. Otherwise, it will be ignored.
  *
  * When successful, the result of the operation will be stored in \a result.
@@ -115,60 +124,166 @@ bool CryptUtil::getRandomByte(unsigned char &byte)
  */
 
 bool CryptUtil::enScryptIterations(QByteArray& result, QString password, QByteArray randomSalt,
-                        int logNFactor, int iterationCount, QProgressDialog* progressDialog)
+                        int logNFactor, int iterationCount, ProgressSink* progressSink)
 {
-    const int KEYLENGTH = 32;
+    TRACE_SPAN("CryptUtil::enScryptIterations", "crypto");
+
     QByteArray pwdBytes = password.toLocal8Bit();
-    QByteArray key(KEYLENGTH, 0);
+    QAtomicInt progress;
+    qint64 runMilliseconds = 0;
 
     if (sodium_init() < 0) return false;
 
-    if (progressDialog != nullptr)
+    QElapsedTimer timer;
+    QString baseLabelText;
+    qint64 lastShownSeconds = -1;
+    timer.start();
+
+    if (progressSink != nullptr)
     {
-        if (progressDialog->labelText() == "")
-            progressDialog->setLabelText(QObject::tr("Running PBKDF..."));
-        progressDialog->setMaximum(iterationCount);
+        if (progressSink->getProgressText() == "")
+            progressSink->setProgressText(QObject::tr("Running PBKDF..."));
+        progressSink->setProgressMaximum(iterationCount);
+
+        baseLabelText = progressSink->getProgressText();
+        updateProgressEta(progressSink, baseLabelText,
+                          EnScryptCalibration::estimateMilliseconds(logNFactor, iterationCount, false),
+                          lastShownSeconds);
     }
 
-    int ret = crypto_pwhash_scryptsalsa208sha256_ll(
-                reinterpret_cast<const unsigned char*>(pwdBytes.constData()),
-                static_cast<size_t>(pwdBytes.length()),
-                reinterpret_cast<const unsigned char*>(randomSalt.constData()),
-                static_cast<size_t>(randomSalt.length()),
-                1ULL << logNFactor,
-                256,
-                1,
-                reinterpret_cast<uint8_t*>(key.data()),
-                static_cast<size_t>(key.length()));
+    KdfExecutor::Task task = [&](QByteArray& key, const QAtomicInt& cancelFlag)
+    {
+        QElapsedTimer runTimer;
+        runTimer.start();
+
+        if (!ScryptKernel::enScryptChain(key, pwdBytes, randomSalt, logNFactor,
+                                         iterationCount, &cancelFlag, &progress))
+        {
+            return false;
+        }
+
+        runMilliseconds = runTimer.elapsed();
+        return true;
+    };
+
+    auto reportProgress = [&]()
+    {
+        int completed = progress.loadAcquire();
+        if (completed < 1) return;
+
+        progressSink->setProgressValue(completed);
+        updateProgressEta(progressSink, baseLabelText,
+                          timer.elapsed() * (iterationCount - completed) / completed,
+                          lastShownSeconds);
+    };
+
+    QByteArray key;
+    bool measurable = false;
+    if (!runKdfTask(key, task, logNFactor, progressSink, reportProgress, measurable)) return false;
+
+    if (measurable) EnScryptCalibration::addMeasurement(logNFactor, iterationCount, runMilliseconds);
+    if (progressSink != nullptr) progressSink->setProgressText(baseLabelText);
+
+    result = key;
+    return true;
+}
+
+/*!
+ * Runs a batch of independent EnScrypt operations, one for each entry in
+ * \a passwords, using the corresponding entries of \a randomSalts and
+ * \a iterationCounts and the common scrypt parameter \a logNFactor.
+ *
+ * The operations are split into groups matching the lane count of
+ * \c ScryptKernel, which advances all operations of a group at once using
+ * the SIMD instruction sets supported by the CPU. The groups are run in
+ * parallel by the shared \c KdfExecutor, within its memory budget. Each
+ * result is identical to the result of \c enScryptIterations() for the
+ * same parameters.
+ *
+ * When successful, the results are placed in \a results in the same order
+ * as the inputs.
+ *
+ * If \a cancelFlag is given and becomes non-zero, all pending and running
+ * operations of the batch are cancelled.
+ *
+ * \return Returns \c true on success, \c false otherwise (e.g. if the input
+ * lists differ in length, initializing the crypto library failed or the
+ * batch was cancelled).
+ *
+ * \sa ScryptKernel, KdfExecutor
+ */
 
-    if (progressDialog != nullptr) progressDialog->setValue(1);
+bool CryptUtil::enScryptIterationsBatch(QList<QByteArray> &results, QStringList passwords,
+                                        QList<QByteArray> randomSalts, int logNFactor,
+                                        QList<int> iterationCounts, const QAtomicInt* cancelFlag)
+{
+    TRACE_SPAN("CryptUtil::enScryptIterationsBatch", "crypto");
 
-    QByteArray xorKey(key);
+    if (passwords.count() != randomSalts.count() ||
+            passwords.count() != iterationCounts.count() || sodium_init() < 0)
+    {
+        return false;
+    }
+
+    ScryptKernel::Implementation implementation = ScryptKernel::detectImplementation();
+    int laneCount = ScryptKernel::getLaneCount(implementation);
+    qint64 memoryRequirement = ScryptKernel::getScratchMemorySize(implementation, logNFactor);
+    KdfExecutor* pExecutor = KdfExecutor::getInstance();
+    QList<quint64> jobIds;
 
-    for(int i = 1; i < iterationCount; i++)
+    for (int i=0; i<passwords.count(); i+=laneCount)
     {
-        ret = crypto_pwhash_scryptsalsa208sha256_ll(
-                    reinterpret_cast<const unsigned char*>(pwdBytes.constData()),
-                    static_cast<size_t>(pwdBytes.length()),
-                    reinterpret_cast<const unsigned char*>(key.constData()),
-                    static_cast<size_t>(key.length()),
-                    1ULL << logNFactor,
-                    256,
-                    1,
-                    reinterpret_cast<uint8_t*>(key.data()),
-                    static_cast<size_t>(key.length()));
-
-        if (progressDialog != nullptr)
+        QList<ScryptKernel::Job> jobs;
+        for (int j=i; j<std::min(i + laneCount, passwords.count()); j++)
         {
-            progressDialog->setValue(i);
-            if (progressDialog->wasCanceled()) return false;
+            ScryptKernel::Job job;
+            job.password = passwords[j].toLocal8Bit();
+            job.salt = randomSalts[j];
+            job.iterationCount = iterationCounts[j];
+            jobs.append(job);
         }
 
-        xorKey = xorByteArrays(key, xorKey);
+        // Every group yields the concatenation of its 32 byte results
+        KdfExecutor::Task task = [jobs, logNFactor, implementation]
+                (QByteArray& result, const QAtomicInt& cancelFlag) mutable
+        {
+            if (!ScryptKernel::enScryptBatch(jobs, logNFactor, implementation, &cancelFlag))
+                return false;
+
+            for (const ScryptKernel::Job& job : jobs) result.append(job.result);
+            return true;
+        };
+
+        jobIds.append(pExecutor->submit(task, memoryRequirement, KdfExecutor::BATCH));
     }
 
-    result = xorKey;
-    return true;
+    bool ok = true;
+    bool cancelled = false;
+    results.clear();
+
+    for (quint64 jobId : jobIds)
+    {
+        QByteArray groupResult;
+        unsigned long timeout = cancelFlag != nullptr ? KDF_PROGRESS_INTERVAL_MS : ULONG_MAX;
+
+        for (;;)
+        {
+            if (cancelFlag != nullptr && !cancelled && cancelFlag->loadAcquire())
+            {
+                for (quint64 id : jobIds) pExecutor->cancel(id);
+                cancelled = true;
+            }
+
+            if (pExecutor->waitForJob(jobId, timeout)) break;
+        }
+
+        if (pExecutor->takeResult(jobId, groupResult) != KdfExecutor::FINISHED) ok = false;
+
+        for (int i=0; i<groupResult.length(); i+=32) results.append(groupResult.mid(i, 32));
+    }
+
+    if (!ok) results.clear();
+    return ok;
 }
 
 /*!
@@ -176,7 +291,10 @@ bool CryptUtil::enScryptIterations(QByteArray& result, QString password, QByteAr
  * \a secondsToRun seconds, using the the scrypt parameters \a randomSalt
  * and \a logNFactor.
  *
- * If a valid \a progressDialog pointer is given, the operation will use it
+ * Like \c enScryptIterations(), the operation runs on the shared
+ * \c KdfExecutor while the calling thread waits for it.
+ *
+ * If a valid \a progressSink pointer is given, the operation will use it
  * to publish its progress. Otherwise, it will be ignored.
  *
  * When successful, the result of the operation will be stored in \a result
@@ -188,66 +306,155 @@ bool CryptUtil::enScryptIterations(QByteArray& result, QString password, QByteAr
 
 bool CryptUtil::enScryptTime(QByteArray &result, int &iterationCount, QString password,
                              QByteArray randomSalt, int logNFactor, int secondsToRun,
-                             QProgressDialog *progressDialog)
+                             ProgressSink* progressSink)
 {
+    TRACE_SPAN("CryptUtil::enScryptTime", "crypto");
+
     const int KEYLENGTH = 32;
     QByteArray pwdBytes = password.toLocal8Bit();
-    QByteArray key(KEYLENGTH, 0);
+    QAtomicInt progress;
+    int iterationsRun = 0;
+    qint64 runMilliseconds = 0;
 
     if (sodium_init() < 0) return false;
 
-    if (progressDialog != nullptr)
+    if (progressSink != nullptr)
     {
-        if (progressDialog->labelText() == "")
-            progressDialog->setLabelText(QObject::tr("Running PBKDF..."));
-        progressDialog->setMaximum(secondsToRun*1000);
+        if (progressSink->getProgressText() == "")
+            progressSink->setProgressText(QObject::tr("Running PBKDF..."));
+        progressSink->setProgressMaximum(secondsToRun*1000);
     }
 
-    QElapsedTimer timer;
-    timer.start();
-
-    int ret = crypto_pwhash_scryptsalsa208sha256_ll(
-                reinterpret_cast<const unsigned char*>(pwdBytes.constData()),
-                static_cast<size_t>(pwdBytes.length()),
-                reinterpret_cast<const unsigned char*>(randomSalt.constData()),
-                static_cast<size_t>(randomSalt.length()),
-                1ULL << logNFactor,
-                256,
-                1,
-                reinterpret_cast<uint8_t*>(key.data()),
-                static_cast<size_t>(key.length()));
-
-    if (progressDialog != nullptr) progressDialog->setValue(static_cast<int>(timer.elapsed()));
-    iterationCount = 1;
+    QString baseLabelText;
+    qint64 lastShownSeconds = -1;
 
-    QByteArray xorKey(key);
+    if (progressSink != nullptr)
+    {
+        baseLabelText = progressSink->getProgressText();
+        updateProgressEta(progressSink, baseLabelText, secondsToRun*1000, lastShownSeconds);
+    }
 
-    for(int i = 1; ; i++)
+    // Runs at least two iterations, and keeps going until the time is up
+    KdfExecutor::Task task = [&](QByteArray& xorKey, const QAtomicInt& cancelFlag)
     {
-        ret = crypto_pwhash_scryptsalsa208sha256_ll(
-                    reinterpret_cast<const unsigned char*>(pwdBytes.constData()),
-                    static_cast<size_t>(pwdBytes.length()),
-                    reinterpret_cast<const unsigned char*>(key.constData()),
-                    static_cast<size_t>(key.length()),
-                    1ULL << logNFactor,
-                    256,
-                    1,
-                    reinterpret_cast<uint8_t*>(key.data()),
-                    static_cast<size_t>(key.length()));
-
-        if (progressDialog != nullptr)
+        QElapsedTimer runTimer;
+        QByteArray key(KEYLENGTH, 0);
+        QByteArray salt = randomSalt;
+        runTimer.start();
+
+        for (int i = 0; i < 2 || runMilliseconds < secondsToRun*1000; i++)
         {
-            progressDialog->setValue(static_cast<int>(timer.elapsed()));
-            if (progressDialog->wasCanceled()) return false;
+            if (cancelFlag.loadAcquire()) return false;
+
+            int ret = crypto_pwhash_scryptsalsa208sha256_ll(
+                        reinterpret_cast<const unsigned char*>(pwdBytes.constData()),
+                        static_cast<size_t>(pwdBytes.length()),
+                        reinterpret_cast<const unsigned char*>(salt.constData()),
+                        static_cast<size_t>(salt.length()),
+                        1ULL << logNFactor,
+                        256,
+                        1,
+                        reinterpret_cast<uint8_t*>(key.data()),
+                        static_cast<size_t>(key.length()));
+
+            if (ret != 0) return false;
+
+            xorKey = (i == 0) ? key : xorByteArrays(key, xorKey);
+            salt = key;
+
+            iterationsRun = i + 1;
+            runMilliseconds = runTimer.elapsed();
+            progress.storeRelease(static_cast<int>(runMilliseconds));
         }
 
-        xorKey = xorByteArrays(key, xorKey);
+        return true;
+    };
+
+    auto reportProgress = [&]()
+    {
+        int elapsed = progress.loadAcquire();
 
-        iterationCount++;
-        if (timer.elapsed() >= secondsToRun*1000) break;
+        progressSink->setProgressValue(elapsed);
+        updateProgressEta(progressSink, baseLabelText,
+                          std::max<qint64>(0, secondsToRun*1000 - elapsed),
+                          lastShownSeconds);
+    };
+
+    QByteArray key;
+    bool measurable = false;
+    if (!runKdfTask(key, task, logNFactor, progressSink, reportProgress, measurable)) return false;
+
+    iterationCount = iterationsRun;
+    if (measurable) EnScryptCalibration::addMeasurement(logNFactor, iterationCount, runMilliseconds);
+    if (progressSink != nullptr) progressSink->setProgressText(baseLabelText);
+
+    result = key;
+    return true;
+}
+
+/*!
+ * Runs the EnScrypt \a task using \a logNFactor on the shared
+ * \c KdfExecutor with its default priority, and blocks until the
+ * task is done.
+ *
+ * While waiting, \a reportProgress is called regularly if \a progressSink
+ * is given, and the job gets cancelled once \a progressSink is canceled.
+ * Since the progress sink is only accessed from the calling thread, modal
+ * progress dialogs keep processing events while the task is running.
+ *
+ * \a measurable is set to \c true if the task ran with interactive
+ * priority and no other job of the executor ran alongside it. Only the
+ * timings of such runs reflect the speed of an uncontended interactive
+ * run and may be passed on to \c EnScryptCalibration.
+ *
+ * \return Returns \c true and places the task's result into \a result if
+ * the task finished, or \c false if it failed or was cancelled.
+ */
+
+bool CryptUtil::runKdfTask(QByteArray &result, KdfExecutor::Task task, int logNFactor,
+                           ProgressSink *progressSink, std::function<void()> reportProgress,
+                           bool& measurable)
+{
+    KdfExecutor* pExecutor = KdfExecutor::getInstance();
+    KdfExecutor::Priority priority = KdfExecutor::getDefaultPriority();
+    bool ranAlone = false;
+
+    // Any job overlapping this one is either running when it starts or
+    // ends, or has been completed in the meantime
+    KdfExecutor::Task measuredTask = [&](QByteArray& key, const QAtomicInt& cancelFlag)
+    {
+        KdfExecutor::Counters before = pExecutor->getCounters();
+        bool ok = task(key, cancelFlag);
+        KdfExecutor::Counters after = pExecutor->getCounters();
+
+        ranAlone = before.runningJobs == 1 && after.runningJobs == 1 &&
+                before.finishedJobs + before.failedJobs + before.cancelledJobs ==
+                after.finishedJobs + after.failedJobs + after.cancelledJobs;
+        return ok;
+    };
+
+    quint64 jobId = pExecutor->submit(measuredTask,
+                                      KdfExecutor::getEnScryptMemoryRequirement(logNFactor),
+                                      priority);
+    bool cancelled = false;
+
+    // The task refers to the caller's stack, so wait for it even if cancelled
+    while (!pExecutor->waitForJob(jobId, KDF_PROGRESS_INTERVAL_MS))
+    {
+        if (progressSink == nullptr || cancelled) continue;
+
+        reportProgress();
+
+        if (progressSink->isCanceled())
+        {
+            pExecutor->cancel(jobId);
+            cancelled = true;
+        }
     }
 
-    result = xorKey;
+    if (pExecutor->takeResult(jobId, result) != KdfExecutor::FINISHED) return false;
+
+    measurable = ranAlone && priority == KdfExecutor::INTERACTIVE;
     return true;
 }
 
@@ -262,10 +469,30 @@ bool CryptUtil::enScryptTime(QByteArray &result, int &iterationCount, QString pa
 bool CryptUtil::decryptBlock1(QByteArray& decryptedImk, QByteArray& decryptedIlk,
                 IdentityBlock *block, QByteArray key)
 {
-    QByteArray decryptedIdentityKeys(64, 0);
+    KeyContext keyContext(key);
+    return decryptBlock1(decryptedImk, decryptedIlk, block, keyContext);
+}
+
+/*!
+ * \overload
+ *
+ * Decrypts the IMK and ILK contained within \a block using the precomputed
+ * \a keyContext, and upon success places them into \a decryptedImk and
+ * \a decryptedIlk.
+ *
+ * \sa KeyContext
+ */
+
+bool CryptUtil::decryptBlock1(QByteArray& decryptedImk, QByteArray& decryptedIlk,
+                IdentityBlock *block, KeyContext& keyContext)
+{
+    TRACE_SPAN("CryptUtil::decryptBlock1", "crypto");
+    ALLOC_SCOPE("CryptUtil::decryptBlock1");
+
+    QByteArray decryptedIdentityKeys;
 
     if (decryptedImk == nullptr || decryptedIlk == nullptr || block == nullptr ||
-            sodium_init() < 0 || crypto_aead_aes256gcm_is_available() == 0)
+            !keyContext.hasAesGcm())
     {
         return false;
     }
@@ -278,18 +505,14 @@ bool CryptUtil::decryptBlock1(QByteArray& decryptedImk, QByteArray& decryptedIlk
     QByteArray plainText;
     for (int i=0; i<11; i++) plainText.append(block->items[i].toByteArray());
 
-    int ret = crypto_aead_aes256gcm_decrypt_detached(
-                reinterpret_cast<unsigned char*>(decryptedIdentityKeys.data()),
-                nullptr,
-                reinterpret_cast<const unsigned char*>(encryptedIdentityKeys.constData()),
-                static_cast<unsigned long long>(encryptedIdentityKeys.length()),
-                reinterpret_cast<const unsigned char*>(verificationTag.constData()),
-                reinterpret_cast<const unsigned char*>(plainText.constData()),
-                static_cast<unsigned long long>(plainText.length()),
-                reinterpret_cast<const unsigned char*>(aesGcmIV.constData()),
-                reinterpret_cast<const unsigned char*>(key.constData()));
+    bool ok = keyContext.aesGcmDecrypt(
+                decryptedIdentityKeys,
+                encryptedIdentityKeys,
+                verificationTag,
+                plainText,
+                aesGcmIV);
 
-    if (ret != 0) return false;
+    if (!ok) return false;
 
     decryptedImk = decryptedIdentityKeys.left(32);
     decryptedIlk = decryptedIdentityKeys.mid(32);
@@ -301,7 +524,7 @@ bool CryptUtil::decryptBlock1(QByteArray& decryptedImk, QByteArray& decryptedIlk
  * Decrypts the IUK contained within \a block using \a rescueCode, and
  * upon success places it into \a decryptedIuk.
  *
- * If a valid \a progressDialog pointer is given, the operation will use it
+ * If a valid \a progressSink pointer is given, the operation will use it
  * to publish its progress. Otherwise, it will be ignored.
  *
  * \return Returns \c true on success, \c false otherwise (e.g. if initializing
@@ -309,8 +532,11 @@ bool CryptUtil::decryptBlock1(QByteArray& decryptedImk, QByteArray& decryptedIlk
  */
 
 bool CryptUtil::decryptBlock2(QByteArray &decryptedIuk, IdentityBlock *block, QString rescueCode,
-                              QProgressDialog *progressDialog)
+                              ProgressSink* progressSink)
 {
+    TRACE_SPAN("CryptUtil::decryptBlock2", "crypto");
+    ALLOC_SCOPE("CryptUtil::decryptBlock2");
+
     if (decryptedIuk == nullptr || block == nullptr ||
             sodium_init() < 0 || crypto_aead_aes256gcm_is_available() == 0)
     {
@@ -337,24 +563,17 @@ bool CryptUtil::decryptBlock2(QByteArray &decryptedIuk, IdentityBlock *block, QS
                 scryptSalt,
                 scryptLogNFactor,
                 scryptIterationCount,
-                progressDialog);
+                progressSink);
 
     if (!ok) return false;
 
-    int ret = crypto_aead_aes256gcm_decrypt_detached(
-                reinterpret_cast<unsigned char*>(decryptedIuk.data()),
-                nullptr,
-                reinterpret_cast<const unsigned char*>(encryptedIuk.constData()),
-                static_cast<unsigned long long>(encryptedIuk.length()),
-                reinterpret_cast<const unsigned char*>(verificationTag.constData()),
-                reinterpret_cast<const unsigned char*>(plainText.constData()),
-                static_cast<unsigned long long>(plainText.length()),
-                reinterpret_cast<const unsigned char*>(aesGcmIV.constData()),
-                reinterpret_cast<const unsigned char*>(key.constData()));
-
-    if (ret != 0) return false;
-
-    return true;
+    KeyContext keyContext(key);
+    return keyContext.aesGcmDecrypt(
+                decryptedIuk,
+                encryptedIuk,
+                verificationTag,
+                plainText,
+                aesGcmIV);
 }
 
 /*!
@@ -367,10 +586,28 @@ bool CryptUtil::decryptBlock2(QByteArray &decryptedIuk, IdentityBlock *block, QS
 
 bool CryptUtil::decryptBlock3(QList<QByteArray> &decryptedPreviousIuks, IdentityBlock *block, QByteArray imk)
 {
+    KeyContext imkContext(imk);
+    return decryptBlock3(decryptedPreviousIuks, block, imkContext);
+}
+
+/*!
+ * \overload
+ *
+ * Decrypts a list of previous IUKs contained within \a block using the
+ * precomputed \a imkContext, and upon success places them into
+ * \a decryptedPreviousIuks.
+ *
+ * \sa KeyContext
+ */
+
+bool CryptUtil::decryptBlock3(QList<QByteArray> &decryptedPreviousIuks, IdentityBlock *block, KeyContext& imkContext)
+{
+    TRACE_SPAN("CryptUtil::decryptBlock3", "crypto");
+    ALLOC_SCOPE("CryptUtil::decryptBlock3");
+
     bool ok = false;
 
-    if (block == nullptr || sodium_init() < 0 ||
-            crypto_aead_aes256gcm_is_available() == 0)
+    if (block == nullptr || !imkContext.hasAesGcm())
     {
         return false;
     }
@@ -395,20 +632,16 @@ bool CryptUtil::decryptBlock3(QList<QByteArray> &decryptedPreviousIuks, Identity
                 );
     }
 
-    QByteArray decryptedData(encryptedData.size(), 0);
+    QByteArray decryptedData;
 
-    int ret = crypto_aead_aes256gcm_decrypt_detached(
-                reinterpret_cast<unsigned char*>(decryptedData.data()),
-                nullptr,
-                reinterpret_cast<const unsigned char*>(encryptedData.constData()),
-                static_cast<unsigned long long>(encryptedData.length()),
-                reinterpret_cast<const unsigned char*>(verificationTag.constData()),
-                reinterpret_cast<const unsigned char*>(plainText.constData()),
-                static_cast<unsigned long long>(plainText.length()),
-                reinterpret_cast<const unsigned char*>(aesGcmIV.constData()),
-                reinterpret_cast<const unsigned char*>(imk.constData()));
+    ok = imkContext.aesGcmDecrypt(
+                decryptedData,
+                encryptedData,
+                verificationTag,
+                plainText,
+                aesGcmIV);
 
-    if (ret != 0) return false;
+    if (!ok) return false;
 
     for (int i=0; i<nrOfPreviousIuks; i++)
     {
@@ -434,25 +667,34 @@ bool CryptUtil::decryptBlock3(QList<QByteArray> &decryptedPreviousIuks, Identity
 bool CryptUtil::createSiteKeys(QByteArray& publicKey, QByteArray& privateKey,
                         QString domain, QString altId, QByteArray imk)
 {
-    // Turn the host/domain part of the url to lowercase
-    QByteArray domainBytes = makeHostLowercase(domain).toLocal8Bit();
+    KeyContext imkContext(imk);
+    return createSiteKeys(publicKey, privateKey, domain, altId, imkContext);
+}
 
-    // Append Alt-Id if present
-    if (altId != "") domainBytes = domainBytes.append('\0').append(altId);
+/*!
+ * \overload
+ *
+ * Creates a public- and private-key pair for \a domain and \a altId using
+ * the precomputed \a imkContext. Use this overload when creating site keys
+ * for many domains using the same identity master key.
+ *
+ * \sa KeyContext
+ */
 
-    unsigned char seed[crypto_sign_SEEDBYTES];
-    int ret = crypto_auth_hmacsha256(
-                seed,
-                reinterpret_cast<const unsigned char*>(domainBytes.constData()),
-                static_cast<unsigned long long>(domainBytes.length()),
-                reinterpret_cast<const unsigned char*>(imk.constData()));
+bool CryptUtil::createSiteKeys(QByteArray& publicKey, QByteArray& privateKey,
+                        QString domain, QString altId, KeyContext& imkContext)
+{
+    TRACE_SPAN("CryptUtil::createSiteKeys", "crypto");
 
-    if (ret != 0) return false;
+    QByteArray seed = createSiteSeed(imkContext, domain, altId);
+    if (seed.length() != crypto_sign_SEEDBYTES) return false;
 
-    ret = crypto_sign_seed_keypair(
+    int ret = crypto_sign_seed_keypair(
                 reinterpret_cast<unsigned char*>(publicKey.data()),
                 reinterpret_cast<unsigned char*>(privateKey.data()),
-                seed);
+                reinterpret_cast<const unsigned char*>(seed.constData()));
+
+    sodium_memzero(seed.data(), static_cast<size_t>(seed.length()));
 
     if (ret != 0) return false;
 
@@ -463,7 +705,7 @@ bool CryptUtil::createSiteKeys(QByteArray& publicKey, QByteArray& privateKey,
  * Derives a key from the given \a password using the scrypt parameters
  * stored within \a block.
  *
- * If a valid \a progressDialog pointer is given, the operation will use it
+ * If a valid \a progressSink pointer is given, the operation will use it
  * to publish its progress. Otherwise, it will be ignored.
  *
  * Upon success, the key is put into \a key.
@@ -471,8 +713,10 @@ bool CryptUtil::createSiteKeys(QByteArray& publicKey, QByteArray& privateKey,
  * \return Returns \c true on success, and \c false otherwise.
  */
 
-bool CryptUtil::createKeyFromPassword(QByteArray& key, IdentityBlock& block, QString password, QProgressDialog* progressDialog)
+bool CryptUtil::createKeyFromPassword(QByteArray& key, IdentityBlock& block, QString password, ProgressSink* progressSink)
 {
+    TRACE_SPAN("CryptUtil::createKeyFromPassword", "crypto");
+
     QByteArray scryptSalt = QByteArray::fromHex(block.items[4].value.toLocal8Bit());
     int scryptLogNFactor = block.items[5].value.toInt();
     int scryptIterationCount = block.items[6].value.toInt();
@@ -484,7 +728,7 @@ bool CryptUtil::createKeyFromPassword(QByteArray& key, IdentityBlock& block, QSt
                 scryptSalt,
                 scryptLogNFactor,
                 scryptIterationCount,
-                progressDialog);
+                progressSink);
 
     if (!ok) return false;
 
@@ -580,21 +824,26 @@ QByteArray CryptUtil::createIlkFromIuk(QByteArray decryptedIuk)
 
 QByteArray CryptUtil::createIndexedSecret(QByteArray imk, QString domain, QString altId, QByteArray secretIndex)
 {
-    // Turn the host/domain part of the url to lowercase
-    QByteArray domainBytes = makeHostLowercase(domain).toLocal8Bit();
+    KeyContext imkContext(imk);
+    return createIndexedSecret(imkContext, domain, altId, secretIndex);
+}
 
-    // Append Alt-Id if present
-    if (altId != "") domainBytes = domainBytes.append('\0').append(altId);
+/*!
+ * \overload
+ *
+ * Creates and returns the "indexed secret" (INS) using the precomputed
+ * \a imkContext instead of the raw identity master key.
+ *
+ * \sa KeyContext
+ */
 
-    QByteArray seed(crypto_sign_SEEDBYTES, 0);
-    int ret = crypto_auth_hmacsha256(
-                reinterpret_cast<unsigned char*>(seed.data()),
-                reinterpret_cast<const unsigned char*>(domainBytes.constData()),
-                static_cast<unsigned long long>(domainBytes.length()),
-                reinterpret_cast<const unsigned char*>(imk.constData()));
-    if (ret != 0) return QByteArray();
+QByteArray CryptUtil::createIndexedSecret(KeyContext& imkContext, QString domain, QString altId, QByteArray secretIndex)
+{
+    QByteArray seed = createSiteSeed(imkContext, domain, altId);
+    if (seed.length() != crypto_sign_SEEDBYTES) return QByteArray();
 
     QByteArray hmacKey = enHash(seed);
+    sodium_memzero(seed.data(), static_cast<size_t>(seed.length()));
 
     QByteArray result(32, 0);
     crypto_auth_hmacsha256(
@@ -606,6 +855,25 @@ QByteArray CryptUtil::createIndexedSecret(QByteArray imk, QString domain, QStrin
     return result;
 }
 
+/*!
+ * Creates the site-specific seed (the HMAC-SHA256 of \a domain and the
+ * optional \a altId under the identity master key held by \a imkContext),
+ * from which the site keys and the indexed secret are being derived.
+ *
+ * In case of an error, an empty byte array is returned.
+ */
+
+QByteArray CryptUtil::createSiteSeed(KeyContext& imkContext, QString domain, QString altId)
+{
+    // Turn the host/domain part of the url to lowercase
+    QByteArray domainBytes = makeHostLowercase(domain).toLocal8Bit();
+
+    // Append Alt-Id if present
+    if (altId != "") domainBytes = domainBytes.append('\0').append(altId);
+
+    return imkContext.hmacSha256(domainBytes);
+}
+
 /*!
  * Performs 16 iterations of the SHA256 hash on \a data, with each successive
  * output XORed to form a 1’s complement sum to produce the final result,
@@ -616,6 +884,8 @@ QByteArray CryptUtil::createIndexedSecret(QByteArray imk, QString domain, QStrin
 
 QByteArray CryptUtil::enHash(QByteArray data)
 {
+    TRACE_SPAN("CryptUtil::enHash", "crypto");
+
     QByteArray output(data);
     QByteArray result(32, 0);
 
@@ -638,106 +908,178 @@ QByteArray CryptUtil::enHash(QByteArray data)
  * Creates an \c IdentityBlock of type 1, where the identity keys
  * are being derived from \a iuk and encrypted under \a password.
  *
- * If a valid \a progressDialog pointer is given, the operation will use it
+ * The EnScrypt parameters are chosen by \c EnScryptCalibration to take
+ * about \c BLOCK_ENSCRYPT_SECONDS seconds on the current machine. If the
+ * machine's throughput cannot be determined, EnScrypt is run for that
+ * duration with a log-n-factor of 9 instead.
+ *
+ * If a valid \a progressSink pointer is given, the operation will use it
  * to publish its progress. Otherwise, it will be ignored.
  */
 
 IdentityBlock CryptUtil::createBlock1(QByteArray iuk, QString password,
-                                      QProgressDialog* progressDialog)
+                                      ProgressSink* progressSink)
 {
-    bool ok = false;
     QByteArray initVec(12, 0);
     QByteArray randomSalt(16, 0);
     QByteArray key(32, 0);
+    int logNFactor;
     int iterationCount;
 
     // Generate the random values we'll need
     getRandomBytes(initVec);
     getRandomBytes(randomSalt);
 
-    // Generate IMK, ILK and rescue code
-    QByteArray imk = createImkFromIuk(iuk);
-    QByteArray ilk = createIlkFromIuk(iuk);
+    if (EnScryptCalibration::recommendParameters(logNFactor, iterationCount,
+                                                 BLOCK_ENSCRYPT_SECONDS))
+    {
+        return createBlock1(iuk, password, initVec, randomSalt, logNFactor,
+                            iterationCount, progressSink);
+    }
 
     //TODO: Add error handling
 
     // Derive key from password
-    if (progressDialog != nullptr) progressDialog->setLabelText(
+    if (progressSink != nullptr) progressSink->setProgressText(
                 QObject::tr("Encrypting block 1..."));
-    ok = enScryptTime(key, iterationCount, password, randomSalt, 9, 5, progressDialog);
+    enScryptTime(key, iterationCount, password, randomSalt, 9, BLOCK_ENSCRYPT_SECONDS, progressSink);
 
-    IdentityBlock block1 = IdentityParser::createEmptyBlock(1);
-    block1.items[0].value = "125"; // Length
-    block1.items[1].value = "1";   // Type
-    block1.items[2].value = "45";  // Plain text length
-    block1.items[3].value = initVec.toHex();  // AES GCM initialization vector
-    block1.items[4].value = randomSalt.toHex();  // Scrypt random salt
-    block1.items[5].value = "9";  // Scrypt log-n-factor
-    block1.items[6].value = QString::number(iterationCount);  // Scrypt iterations
-    block1.items[7].value = "499";  // Option flags
-    block1.items[8].value = "4";  // QuickPass length
-    block1.items[9].value = "5";  // Password verify seconds
-    block1.items[10].value = "15";  // QuickPass timeout
+    return encryptBlock1(iuk, key, initVec, randomSalt, 9, iterationCount);
+}
 
-    // Encrypt identity keys
-    QByteArray unencryptedKeys = imk + ilk;
-    QByteArray additionalData;
-    for (int i=0; i<11; i++) additionalData.append(block1.items[i].toByteArray());
-    QByteArray encryptedData = aesGcmEncrypt(unencryptedKeys, additionalData, initVec, key);
-    QByteArray encryptedImk = encryptedData.left(32);
-    QByteArray encryptedIlk = encryptedData.mid(32, 32);
-    QByteArray authTag = encryptedData.right(16);
+/*!
+ * \overload
+ *
+ * Creates an \c IdentityBlock of type 1 using the given \a initVec and
+ * \a randomSalt, where the key is derived from \a password by running
+ * exactly \a iterationCount EnScrypt iterations with \a logNFactor,
+ * instead of running EnScrypt for a fixed amount of time.
+ *
+ * Returns an empty block if the block definition is missing or if
+ * EnScrypt fails.
+ */
 
-    block1.items[11].value = encryptedImk.toHex();  // IMK
-    block1.items[12].value = encryptedIlk.toHex();  // ILK
-    block1.items[13].value = authTag.toHex();  // Authentication tag
+IdentityBlock CryptUtil::createBlock1(QByteArray iuk, QString password, QByteArray initVec,
+                                      QByteArray randomSalt, int logNFactor, int iterationCount,
+                                      ProgressSink* progressSink)
+{
+    QByteArray key(32, 0);
 
-    return block1;
+    if (progressSink != nullptr) progressSink->setProgressText(
+                QObject::tr("Encrypting block 1..."));
+
+    if (!enScryptIterations(key, password, randomSalt, logNFactor, iterationCount, progressSink))
+        return IdentityBlock();
+
+    return encryptBlock1(iuk, key, initVec, randomSalt, logNFactor, iterationCount);
 }
 
 /*!
  * Creates an \c IdentityBlock of type 2 using \a iuk as the identity
  * unlock key and encrypted under \a rescueCode.
  *
- * If a valid \a progressDialog pointer is given, the operation will use it
+ * The EnScrypt parameters are chosen by \c EnScryptCalibration to take
+ * about \c BLOCK_ENSCRYPT_SECONDS seconds on the current machine. If the
+ * machine's throughput cannot be determined, EnScrypt is run for that
+ * duration with a log-n-factor of 9 instead.
+ *
+ * If a valid \a progressSink pointer is given, the operation will use it
  * to publish its progress. Otherwise, it will be ignored.
  */
 
-IdentityBlock CryptUtil::createBlock2(QByteArray iuk, QString rescueCode, QProgressDialog *progressDialog)
+IdentityBlock CryptUtil::createBlock2(QByteArray iuk, QString rescueCode, ProgressSink* progressSink)
 {
-    bool ok = false;
-    QByteArray initVec(12, 0);
     QByteArray randomSalt(16, 0);
     QByteArray key(32, 0);
-    QByteArray additionalData;
+    int logNFactor;
     int iterationCount;
 
     getRandomBytes(randomSalt);
 
-    IdentityBlock block2 = IdentityParser::createEmptyBlock(2);
-    block2.items[0].value = "73"; // Length
-    block2.items[1].value = "2";   // Type
-    block2.items[2].value = randomSalt.toHex();  // Scrypt random salt
-    block2.items[3].value = "9";  // Scrypt log-n-factor
+    if (EnScryptCalibration::recommendParameters(logNFactor, iterationCount,
+                                                 BLOCK_ENSCRYPT_SECONDS))
+    {
+        return createBlock2(iuk, rescueCode, randomSalt, logNFactor,
+                            iterationCount, progressSink);
+    }
 
     // Derive key from rescue code
-    if (progressDialog != nullptr) progressDialog->setLabelText(
+    if (progressSink != nullptr) progressSink->setProgressText(
                 QObject::tr("Encrypting block 2..."));
 
-    ok = enScryptTime(key, iterationCount, rescueCode, randomSalt, 9, 5, progressDialog);
+    enScryptTime(key, iterationCount, rescueCode, randomSalt, 9, BLOCK_ENSCRYPT_SECONDS, progressSink);
 
-    block2.items[4].value = QString::number(iterationCount);
+    return encryptBlock2(iuk, key, randomSalt, 9, iterationCount);
+}
 
-    // Encrypt IUK
-    for (int i=0; i<5; i++) additionalData.append(block2.items[i].toByteArray());
-    QByteArray encryptedData = aesGcmEncrypt(iuk, additionalData, initVec, key);
-    QByteArray encryptedIuk = encryptedData.left(32);
-    QByteArray authTag = encryptedData.right(16);
+/*!
+ * \overload
+ *
+ * Creates an \c IdentityBlock of type 2 using the given \a randomSalt,
+ * where the key is derived from \a rescueCode by running exactly
+ * \a iterationCount EnScrypt iterations with \a logNFactor.
+ *
+ * Returns an empty block if the block definition is missing or if
+ * EnScrypt fails.
+ */
 
-    block2.items[5].value = encryptedIuk.toHex();  // Encrypted IUK
-    block2.items[6].value = authTag.toHex();  // Verification tag
+IdentityBlock CryptUtil::createBlock2(QByteArray iuk, QString rescueCode, QByteArray randomSalt,
+                                      int logNFactor, int iterationCount, ProgressSink* progressSink)
+{
+    QByteArray key(32, 0);
 
-    return block2;
+    if (progressSink != nullptr) progressSink->setProgressText(
+                QObject::tr("Encrypting block 2..."));
+
+    if (!enScryptIterations(key, rescueCode, randomSalt, logNFactor, iterationCount, progressSink))
+        return IdentityBlock();
+
+    return encryptBlock2(iuk, key, randomSalt, logNFactor, iterationCount);
+}
+
+/*!
+ * Creates an \c IdentityBlock of type 3 containing the (up to four)
+ * \a previousIuks, which are encrypted under the identity master
+ * key \a imk.
+ *
+ * Returns an empty block if the block definition is missing or if the
+ * number of previous IUKs is out of range.
+ */
+
+IdentityBlock CryptUtil::createBlock3(QList<QByteArray> previousIuks, QByteArray imk)
+{
+    IdentityBlock block3 = IdentityParser::createEmptyBlock(3);
+    if (block3.items.size() < 5 || previousIuks.isEmpty() || previousIuks.size() > 4)
+        return IdentityBlock();
+
+    // The definition holds a single, repeated "previous IUK" item
+    IdentityBlockItem previousIukItem = block3.items[3];
+    IdentityBlockItem verificationTagItem = block3.items[4];
+    block3.items = block3.items.mid(0, 3);
+
+    block3.items[0].value = QString::number(22 + 32 * previousIuks.size()); // Length
+    block3.items[1].value = "3";  // Type
+    block3.items[2].value = QString::number(previousIuks.size());  // Previous key count
+
+    QByteArray additionalData;
+    QByteArray unencryptedIuks;
+    for (int i=0; i<3; i++) additionalData.append(block3.items[i].toByteArray());
+    for (const QByteArray& previousIuk : previousIuks) unencryptedIuks.append(previousIuk);
+
+    QByteArray encryptedData = aesGcmEncrypt(unencryptedIuks, additionalData,
+                                             QByteArray(12, 0), imk);
+    if (encryptedData.isEmpty()) return IdentityBlock();
+
+    for (int i=0; i<previousIuks.size(); i++)
+    {
+        previousIukItem.value = encryptedData.mid(i * 32, 32).toHex();  // Encrypted previous IUK
+        block3.items.append(previousIukItem);
+    }
+
+    verificationTagItem.value = encryptedData.right(16).toHex();  // Verification tag
+    block3.items.append(verificationTagItem);
+
+    return block3;
 }
 
 /*!
@@ -757,7 +1099,7 @@ IdentityBlock CryptUtil::createBlock2(QByteArray iuk, QString rescueCode, QProgr
  * initialization vector as well as a new scrypt random salt and replace the
  * existing values in \a updatedBlock.
  *
- * If a valid \a progressDialog pointer is given, the operation will use it
+ * If a valid \a progressSink pointer is given, the operation will use it
  * to publish its progress. Otherwise, it will be ignored.
  *
  * If successful, \a updatedBlock will contain the re-encrypted and
@@ -767,24 +1109,24 @@ IdentityBlock CryptUtil::createBlock2(QByteArray iuk, QString rescueCode, QProgr
  */
 
 bool CryptUtil::updateBlock1WithPassword(IdentityBlock *oldBlock, IdentityBlock* updatedBlock,
-                    QString oldPassword, QString newPassword, QProgressDialog* progressDialog)
+                    QString oldPassword, QString newPassword, ProgressSink* progressSink)
 {
     QByteArray unencryptedImk(32, 0);
     QByteArray unencryptedIlk(32, 0);
 
     if (sodium_init() < 0) return false;
 
-    if (progressDialog != nullptr)
-        progressDialog->setLabelText(QObject::tr("Decrypting identity keys..."));
+    if (progressSink != nullptr)
+        progressSink->setProgressText(QObject::tr("Decrypting identity keys..."));
 
     QByteArray key;
-    bool ok = CryptUtil::createKeyFromPassword(key, *oldBlock, oldPassword, progressDialog);
+    bool ok = CryptUtil::createKeyFromPassword(key, *oldBlock, oldPassword, progressSink);
     if (!ok) return false;
 
     ok = decryptBlock1(unencryptedImk, unencryptedIlk, oldBlock, key);
     if (!ok) return false;
 
-    return updateBlock1(updatedBlock, unencryptedImk, unencryptedIlk, newPassword, progressDialog);
+    return updateBlock1(updatedBlock, unencryptedImk, unencryptedIlk, newPassword, progressSink);
 }
 
 /*!
@@ -796,7 +1138,7 @@ bool CryptUtil::updateBlock1WithPassword(IdentityBlock *oldBlock, IdentityBlock*
  * This function will create a new AES-GCM initialization vector as well as a
  * new scrypt random salt and replace the existing values in \a block1.
  *
- * If a valid \a progressDialog pointer is given, the operation will use it
+ * If a valid \a progressSink pointer is given, the operation will use it
  * to publish its progress. Otherwise, it will be ignored.
  *
  * If successful, \a block1 will contain the re-encrypted and
@@ -806,8 +1148,10 @@ bool CryptUtil::updateBlock1WithPassword(IdentityBlock *oldBlock, IdentityBlock*
  */
 
 bool CryptUtil::updateBlock1(IdentityBlock *block1, QByteArray unencryptedImk,
-        QByteArray unencryptedIlk, QString newPassword, QProgressDialog *progressDialog)
+        QByteArray unencryptedIlk, QString newPassword, ProgressSink* progressSink)
 {
+    TRACE_SPAN("CryptUtil::updateBlock1", "crypto");
+
     QByteArray encryptedImk(32, 0);
     QByteArray encryptedIlk(32, 0);
     QByteArray newIv(12, 0);
@@ -824,8 +1168,8 @@ bool CryptUtil::updateBlock1(IdentityBlock *block1, QByteArray unencryptedImk,
     int scryptLogNFactor = block1->items[5].value.toInt();
     int passwordVerifySeconds = block1->items[9].value.toInt();
 
-    if (progressDialog != nullptr)
-        progressDialog->setLabelText(QObject::tr("Running PBKDF and re-encrypting identity..."));
+    if (progressSink != nullptr)
+        progressSink->setProgressText(QObject::tr("Running PBKDF and re-encrypting identity..."));
 
     // Run the PBKDF
     ok = enScryptTime(newKey,
@@ -834,7 +1178,7 @@ bool CryptUtil::updateBlock1(IdentityBlock *block1, QByteArray unencryptedImk,
                       newRandomSalt,
                       scryptLogNFactor,
                       passwordVerifySeconds,
-                      progressDialog);
+                      progressSink);
 
     if (!ok) return false;
 
@@ -845,22 +1189,19 @@ bool CryptUtil::updateBlock1(IdentityBlock *block1, QByteArray unencryptedImk,
     block1->items[6].value = QString::number(newIterationCount);
 
     QByteArray unencryptedKeys = unencryptedImk + unencryptedIlk;
-    QByteArray encryptedKeys(unencryptedKeys.length(), 0);
-    QByteArray authTag(16, 0);
+    QByteArray encryptedKeys;
+    QByteArray authTag;
     for (int i=0; i<11; i++) newPlainText.append(block1->items[i].toByteArray());
-    unsigned long long authTagLen;
-
-    crypto_aead_aes256gcm_encrypt_detached(
-                reinterpret_cast<unsigned char*>(encryptedKeys.data()),
-                reinterpret_cast<unsigned char*>(authTag.data()),
-                &authTagLen,
-                reinterpret_cast<const unsigned char*>(unencryptedKeys.constData()),
-                static_cast<size_t>(unencryptedKeys.length()),
-                reinterpret_cast<const unsigned char*>(newPlainText.constData()),
-                static_cast<size_t>(newPlainText.length()),
-                nullptr,
-                reinterpret_cast<const unsigned char*>(newIv.constData()),
-                reinterpret_cast<const unsigned char*>(newKey.constData()));
+
+    KeyContext keyContext(newKey);
+    ok = keyContext.aesGcmEncryptDetached(
+                encryptedKeys,
+                authTag,
+                unencryptedKeys,
+                newPlainText,
+                newIv);
+
+    if (!ok) return false;
 
     encryptedImk = encryptedKeys.left(32);
     encryptedIlk = encryptedKeys.right(32);
@@ -886,7 +1227,7 @@ bool CryptUtil::updateBlock1(IdentityBlock *block1, QByteArray unencryptedImk,
  * positive integer is provided, EnScrypt will be run for the given amount 
  * of seconds, and the resulting iteration count will be written to \a block2.
  *
- * If a valid \a progressDialog pointer is given, the operation will use it
+ * If a valid \a progressSink pointer is given, the operation will use it
  * to publish its progress. Otherwise, it will be ignored.
  *
  * If successful, \a block2 will contain the re-encrypted and
@@ -896,8 +1237,10 @@ bool CryptUtil::updateBlock1(IdentityBlock *block1, QByteArray unencryptedImk,
  */
 
 bool CryptUtil::updateBlock2(IdentityBlock *block2, QByteArray unencryptedIuk, 
-        QString rescueCode, int secondsToRunScrypt, QProgressDialog *progressDialog)
+        QString rescueCode, int secondsToRunScrypt, ProgressSink* progressSink)
 {
+    TRACE_SPAN("CryptUtil::updateBlock2", "crypto");
+
     bool ok = false;
     QByteArray initVec(12, 0);
     QByteArray randomSalt(16, 0);
@@ -910,7 +1253,7 @@ bool CryptUtil::updateBlock2(IdentityBlock *block2, QByteArray unencryptedIuk,
     int iterationCount;
 
     // Derive key from rescue code
-    if (progressDialog != nullptr) progressDialog->setLabelText(
+    if (progressSink != nullptr) progressSink->setProgressText(
                 QObject::tr("Encrypting block 2..."));
     
     // If secondsToRunScrypt is a positive integer, run EnScrypt
@@ -918,7 +1261,7 @@ bool CryptUtil::updateBlock2(IdentityBlock *block2, QByteArray unencryptedIuk,
     // iteration count within the block
     if (secondsToRunScrypt > 0)
     {
-        ok = enScryptTime(key, iterationCount, rescueCode, randomSalt, logNFactor, secondsToRunScrypt, progressDialog);
+        ok = enScryptTime(key, iterationCount, rescueCode, randomSalt, logNFactor, secondsToRunScrypt, progressSink);
         block2->items[4].value = QString::number(iterationCount);
     }
     // Otherwise, just use the existing iteration count within
@@ -926,7 +1269,7 @@ bool CryptUtil::updateBlock2(IdentityBlock *block2, QByteArray unencryptedIuk,
     else
     {
         iterationCount = block2->items[4].value.toInt();
-        ok = enScryptIterations(key, rescueCode, randomSalt, logNFactor, iterationCount, progressDialog);
+        ok = enScryptIterations(key, rescueCode, randomSalt, logNFactor, iterationCount, progressSink);
     }
 
     // Encrypt IUK
@@ -954,21 +1297,27 @@ bool CryptUtil::updateBlock2(IdentityBlock *block2, QByteArray unencryptedIuk,
 QByteArray CryptUtil::aesGcmEncrypt(QByteArray message, QByteArray additionalData,
                                     QByteArray iv, QByteArray key)
 {
-    unsigned long long len = static_cast<unsigned long long>(message.length() + 16);
-    QByteArray cipherText(static_cast<int>(len), 0);
-
-    crypto_aead_aes256gcm_encrypt(
-                reinterpret_cast<unsigned char*>(cipherText.data()),
-                &len,
-                reinterpret_cast<const unsigned char*>(message.constData()),
-                static_cast<unsigned long long>(message.length()),
-                reinterpret_cast<const unsigned char*>(additionalData.constData()),
-                static_cast<unsigned long long>(additionalData.length()),
-                nullptr,
-                reinterpret_cast<const unsigned char*>(iv.constData()),
-                reinterpret_cast<const unsigned char*>(key.constData()));
-
-    return cipherText;
+    KeyContext keyContext(key);
+    return aesGcmEncrypt(message, additionalData, iv, keyContext);
+}
+
+/*!
+ * \overload
+ *
+ * Encrypts \a message using the precomputed \a keyContext. Use this
+ * overload when encrypting multiple messages under the same key.
+ *
+ * In case of an error, an empty byte array is returned.
+ *
+ * \sa KeyContext
+ */
+
+QByteArray CryptUtil::aesGcmEncrypt(QByteArray message, QByteArray additionalData,
+                                    QByteArray iv, KeyContext& keyContext)
+{
+    TRACE_SPAN("CryptUtil::aesGcmEncrypt", "crypto");
+
+    return keyContext.aesGcmEncrypt(message, additionalData, iv);
 }
 
 /*!
@@ -1034,7 +1383,7 @@ QString CryptUtil::formatRescueCode(QString rescueCode)
 /*!
  * Creates a new SQRL identity, which is encrypted using \a password.
  *
- * If a valid \a progressDialog pointer is given, the operation will use it
+ * If a valid \a progressSink pointer is given, the operation will use it
  * to publish its progress. Otherwise, it will be ignored.
  *
  * If successful, a valid \c IdentityModel is placed in \a identity and the
@@ -1042,26 +1391,112 @@ QString CryptUtil::formatRescueCode(QString rescueCode)
  *
  * \return Returns \c true on success, \c false otherwise (e.g. if any of
  * the crypotgraphic operations failed or the operation was cancelled by the
- * user using the \c QProgressDialog 's "Cancel" button).
+ * user through \a progressSink).
  */
 
 bool CryptUtil::createIdentity(IdentityModel& identity, QString &rescueCode,
-                               QString password, QProgressDialog *progressDialog)
+                               QString password, ProgressSink* progressSink)
 {
+    TRACE_SPAN("CryptUtil::createIdentity", "crypto");
+
     rescueCode = createNewRescueCode();
     QByteArray iuk = createIuk();
 
     // Block 1
-    IdentityBlock block1 = createBlock1(iuk, password, progressDialog);
+    IdentityBlock block1 = createBlock1(iuk, password, progressSink);
     identity.blocks.push_back(block1);
 
     // Block 2
-    IdentityBlock block2 = createBlock2(iuk, rescueCode, progressDialog);
+    IdentityBlock block2 = createBlock2(iuk, rescueCode, progressSink);
     identity.blocks.push_back(block2);
 
     return true;
 }
 
+/*!
+ * Fills a new \c IdentityBlock of type 1 with the given scrypt parameters
+ * and \a initVec and encrypts the IMK and ILK derived from \a iuk under
+ * \a key.
+ *
+ * \a key must have been derived using exactly these parameters, e.g.
+ * for many blocks at once using \c enScryptIterationsBatch().
+ *
+ * Returns an empty block if the block definition is missing.
+ */
+
+IdentityBlock CryptUtil::encryptBlock1(QByteArray iuk, QByteArray key, QByteArray initVec,
+                                       QByteArray randomSalt, int logNFactor, int iterationCount)
+{
+    IdentityBlock block1 = IdentityParser::createEmptyBlock(1);
+    if (block1.items.size() < 14) return IdentityBlock();
+
+    // Generate IMK and ILK
+    QByteArray imk = createImkFromIuk(iuk);
+    QByteArray ilk = createIlkFromIuk(iuk);
+
+    block1.items[0].value = "125"; // Length
+    block1.items[1].value = "1";   // Type
+    block1.items[2].value = "45";  // Plain text length
+    block1.items[3].value = initVec.toHex();  // AES GCM initialization vector
+    block1.items[4].value = randomSalt.toHex();  // Scrypt random salt
+    block1.items[5].value = QString::number(logNFactor);  // Scrypt log-n-factor
+    block1.items[6].value = QString::number(iterationCount);  // Scrypt iterations
+    block1.items[7].value = "499";  // Option flags
+    block1.items[8].value = "4";  // QuickPass length
+    block1.items[9].value = "5";  // Password verify seconds
+    block1.items[10].value = "15";  // QuickPass timeout
+
+    // Encrypt identity keys
+    QByteArray unencryptedKeys = imk + ilk;
+    QByteArray additionalData;
+    for (int i=0; i<11; i++) additionalData.append(block1.items[i].toByteArray());
+    QByteArray encryptedData = aesGcmEncrypt(unencryptedKeys, additionalData, initVec, key);
+    QByteArray encryptedImk = encryptedData.left(32);
+    QByteArray encryptedIlk = encryptedData.mid(32, 32);
+    QByteArray authTag = encryptedData.right(16);
+
+    block1.items[11].value = encryptedImk.toHex();  // IMK
+    block1.items[12].value = encryptedIlk.toHex();  // ILK
+    block1.items[13].value = authTag.toHex();  // Authentication tag
+
+    return block1;
+}
+
+/*!
+ * Fills a new \c IdentityBlock of type 2 with the given scrypt parameters
+ * and encrypts \a iuk under \a key, which must have been derived using
+ * exactly these parameters.
+ *
+ * Returns an empty block if the block definition is missing.
+ */
+
+IdentityBlock CryptUtil::encryptBlock2(QByteArray iuk, QByteArray key, QByteArray randomSalt,
+                                       int logNFactor, int iterationCount)
+{
+    QByteArray initVec(12, 0);
+    QByteArray additionalData;
+
+    IdentityBlock block2 = IdentityParser::createEmptyBlock(2);
+    if (block2.items.size() < 7) return IdentityBlock();
+
+    block2.items[0].value = "73"; // Length
+    block2.items[1].value = "2";   // Type
+    block2.items[2].value = randomSalt.toHex();  // Scrypt random salt
+    block2.items[3].value = QString::number(logNFactor);  // Scrypt log-n-factor
+    block2.items[4].value = QString::number(iterationCount);  // Scrypt iterations
+
+    // Encrypt IUK
+    for (int i=0; i<5; i++) additionalData.append(block2.items[i].toByteArray());
+    QByteArray encryptedData = aesGcmEncrypt(iuk, additionalData, initVec, key);
+    QByteArray encryptedIuk = encryptedData.left(32);
+    QByteArray authTag = encryptedData.right(16);
+
+    block2.items[5].value = encryptedIuk.toHex();  // Encrypted IUK
+    block2.items[6].value = authTag.toHex();  // Verification tag
+
+    return block2;
+}
+
 /*!
  * Reversers the given byte array and returns the result.
  * e.g \c "\0x00\0xFF" becomes \c "\0xFF\0x00"
@@ -1148,6 +1583,9 @@ QByteArray CryptUtil::convertBigUnsignedToByteArray(BigUnsigned bigNum)
 
 QString CryptUtil::base56EncodeIdentity(QByteArray identityData)
 {
+    TRACE_SPAN("CryptUtil::base56EncodeIdentity", "codec");
+    ALLOC_SCOPE("CryptUtil::base56EncodeIdentity");
+
     QByteArray textualId;
     QByteArray checksumBytes;
     int charsOnLine = 0;
@@ -1233,6 +1671,9 @@ char CryptUtil::createBase56CheckSumChar(QByteArray dataBytes)
 
 QByteArray CryptUtil::base56DecodeIdentity(QString textualIdentity)
 {
+    TRACE_SPAN("CryptUtil::base56DecodeIdentity", "codec");
+    ALLOC_SCOPE("CryptUtil::base56DecodeIdentity");
+
     if (!verifyTextualIdentity(textualIdentity))
         return QByteArray("");
 
@@ -1320,6 +1761,8 @@ QString CryptUtil::formatTextualIdentity(QString textualIdentity, bool escapeNew
 
 bool CryptUtil::verifyTextualIdentity(QString textualIdentity)
 {
+    TRACE_SPAN("CryptUtil::verifyTextualIdentity", "codec");
+
     textualIdentity = stripWhitespace(textualIdentity);
 
     char lineNr = 0;
@@ -1367,3 +1810,27 @@ QString CryptUtil::stripWhitespace(QString source)
 
     return source;
 }
+
+/*!
+ * Appends the estimated remaining time \a remainingMilliseconds of a running
+ * PBKDF operation to \a baseLabelText and reports it to \a progressSink.
+ *
+ * To avoid needless repaints, the label is only updated if the displayed
+ * number of seconds differs from \a lastShownSeconds, which gets updated
+ * accordingly. A negative \a remainingMilliseconds means that no estimate
+ * is available, in which case the label is left untouched.
+ */
+
+void CryptUtil::updateProgressEta(ProgressSink* progressSink, const QString &baseLabelText,
+                                  qint64 remainingMilliseconds, qint64 &lastShownSeconds)
+{
+    if (progressSink == nullptr || remainingMilliseconds < 0) return;
+
+    qint64 remainingSeconds = (remainingMilliseconds + 500) / 1000;
+    if (remainingSeconds == lastShownSeconds) return;
+    lastShownSeconds = remainingSeconds;
+
+    progressSink->setProgressText(QObject::tr("%1\nRemaining: %2")
+                                  .arg(baseLabelText)
+                                  .arg(EnScryptCalibration::formatDuration(remainingMilliseconds)));
+}
@@ -27,9 +27,12 @@
 #ifndef CRYPTUTIL_H
 #define CRYPTUTIL_H
 
-#include "common.h"
+#include "corecommon.h"
 #include "identitymodel.h"
 #include "identityparser.h"
+#include "kdfexecutor.h"
+#include "keycontext.h"
+#include "progresssink.h"
 #include "sodium.h"
 
 /**********************************************
@@ -48,29 +51,40 @@ public:
     static QByteArray xorByteArrays(QByteArray a, QByteArray b);
     static bool getRandomBytes(QByteArray& buffer);
     static bool getRandomByte(unsigned char& byte);
-    static bool enScryptIterations(QByteArray& result, QString password, QByteArray randomSalt, int logNFactor, int iterationCount, QProgressDialog* progressDialog = nullptr);
-    static bool enScryptTime(QByteArray& result, int& iterationCount, QString password, QByteArray randomSalt, int logNFactor, int secondsToRun, QProgressDialog* progressDialog = nullptr);
+    static bool enScryptIterations(QByteArray& result, QString password, QByteArray randomSalt, int logNFactor, int iterationCount, ProgressSink* progressSink = nullptr);
+    static bool enScryptIterationsBatch(QList<QByteArray>& results, QStringList passwords, QList<QByteArray> randomSalts, int logNFactor, QList<int> iterationCounts, const QAtomicInt* cancelFlag = nullptr);
+    static bool enScryptTime(QByteArray& result, int& iterationCount, QString password, QByteArray randomSalt, int logNFactor, int secondsToRun, ProgressSink* progressSink = nullptr);
     static bool decryptBlock1(QByteArray& decryptedImk, QByteArray& decryptedIlk, IdentityBlock *block, QByteArray key);
-    static bool decryptBlock2(QByteArray& decryptedIuk, IdentityBlock *block, QString rescueCode, QProgressDialog* progressDialog = nullptr);
+    static bool decryptBlock1(QByteArray& decryptedImk, QByteArray& decryptedIlk, IdentityBlock *block, KeyContext& keyContext);
+    static bool decryptBlock2(QByteArray& decryptedIuk, IdentityBlock *block, QString rescueCode, ProgressSink* progressSink = nullptr);
     static bool decryptBlock3(QList<QByteArray>& decryptedPreviousIuks, IdentityBlock *block, QByteArray imk);
+    static bool decryptBlock3(QList<QByteArray>& decryptedPreviousIuks, IdentityBlock *block, KeyContext& imkContext);
     static bool createSiteKeys(QByteArray& publicKey, QByteArray& privateKey, QString domain, QString altId, QByteArray imk);
-    static bool createKeyFromPassword(QByteArray& key, IdentityBlock& block, QString password, QProgressDialog* progressDialog = nullptr);
+    static bool createSiteKeys(QByteArray& publicKey, QByteArray& privateKey, QString domain, QString altId, KeyContext& imkContext);
+    static bool createKeyFromPassword(QByteArray& key, IdentityBlock& block, QString password, ProgressSink* progressSink = nullptr);
     static QString getHostLowercase(QString url);
     static QString makeHostLowercase(QString url);
     static QByteArray createImkFromIuk(QByteArray decryptedIuk);
     static QByteArray createIlkFromIuk(QByteArray decryptedIuk);
     static QByteArray createIndexedSecret(QByteArray imk, QString domain, QString altId, QByteArray secretIndex);
+    static QByteArray createIndexedSecret(KeyContext& imkContext, QString domain, QString altId, QByteArray secretIndex);
     static QByteArray enHash(QByteArray data);
-    static IdentityBlock createBlock1(QByteArray iuk, QString password, QProgressDialog* progressDialog = nullptr);
-    static IdentityBlock createBlock2(QByteArray iuk, QString rescueCode, QProgressDialog* progressDialog = nullptr);
-    static bool updateBlock1WithPassword(IdentityBlock* oldBlock, IdentityBlock* updatedBlock, QString password, QString newPassword, QProgressDialog* progressDialog = nullptr);
-    static bool updateBlock1(IdentityBlock* block1, QByteArray unencryptedImk, QByteArray unencryptedIlk, QString newPassword, QProgressDialog* progressDialog = nullptr);
-    static bool updateBlock2(IdentityBlock* block2, QByteArray unencryptedIuk, QString rescueCode, int secondsToRunScrypt = -1, QProgressDialog* progressDialog = nullptr);
+    static IdentityBlock createBlock1(QByteArray iuk, QString password, ProgressSink* progressSink = nullptr);
+    static IdentityBlock createBlock1(QByteArray iuk, QString password, QByteArray initVec, QByteArray randomSalt, int logNFactor, int iterationCount, ProgressSink* progressSink = nullptr);
+    static IdentityBlock createBlock2(QByteArray iuk, QString rescueCode, ProgressSink* progressSink = nullptr);
+    static IdentityBlock createBlock2(QByteArray iuk, QString rescueCode, QByteArray randomSalt, int logNFactor, int iterationCount, ProgressSink* progressSink = nullptr);
+    static IdentityBlock createBlock3(QList<QByteArray> previousIuks, QByteArray imk);
+    static IdentityBlock encryptBlock1(QByteArray iuk, QByteArray key, QByteArray initVec, QByteArray randomSalt, int logNFactor, int iterationCount);
+    static IdentityBlock encryptBlock2(QByteArray iuk, QByteArray key, QByteArray randomSalt, int logNFactor, int iterationCount);
+    static bool updateBlock1WithPassword(IdentityBlock* oldBlock, IdentityBlock* updatedBlock, QString password, QString newPassword, ProgressSink* progressSink = nullptr);
+    static bool updateBlock1(IdentityBlock* block1, QByteArray unencryptedImk, QByteArray unencryptedIlk, QString newPassword, ProgressSink* progressSink = nullptr);
+    static bool updateBlock2(IdentityBlock* block2, QByteArray unencryptedIuk, QString rescueCode, int secondsToRunScrypt = -1, ProgressSink* progressSink = nullptr);
     static QByteArray aesGcmEncrypt(QByteArray message, QByteArray additionalData, QByteArray iv, QByteArray key);
+    static QByteArray aesGcmEncrypt(QByteArray message, QByteArray additionalData, QByteArray iv, KeyContext& keyContext);
     static QByteArray createIuk();
     static QString createNewRescueCode();
     static QString formatRescueCode(QString rescueCode);
-    static bool createIdentity(IdentityModel& identity, QString &rescueCode, QString password, QProgressDialog *progressDialog = nullptr);
+    static bool createIdentity(IdentityModel& identity, QString &rescueCode, QString password, ProgressSink* progressSink = nullptr);
     static QByteArray reverseByteArray(QByteArray source);
     static BigUnsigned convertByteArrayToBigUnsigned(QByteArray data);
     static QByteArray convertBigUnsignedToByteArray(BigUnsigned bigNum);
@@ -80,6 +94,14 @@ public:
     static QString formatTextualIdentity(QString textualIdentity, bool escapeNewline = false);
     static bool verifyTextualIdentity(QString textualIdentity);
     static QString stripWhitespace(QString source);
+
+private:
+    static const int KDF_PROGRESS_INTERVAL_MS;
+    static const int BLOCK_ENSCRYPT_SECONDS;
+
+    static QByteArray createSiteSeed(KeyContext& imkContext, QString domain, QString altId);
+    static void updateProgressEta(ProgressSink* progressSink, const QString& baseLabelText, qint64 remainingMilliseconds, qint64& lastShownSeconds);
+    static bool runKdfTask(QByteArray& result, KdfExecutor::Task task, int logNFactor, ProgressSink* progressSink, std::function<void()> reportProgress, bool& measurable);
 };
 
 #endif // CRYPTUTIL_H
@@ -1,6 +1,9 @@
 #include "diffdialog.h"
 #include "ui_diffdialog.h"
 #include "mainwindow.h"
+#include "progressdialog.h"
+#include "tracer.h"
+#include <QScrollBar>
 
 DiffDialog::DiffDialog(QWidget *parent) :
     QDialog(parent),
@@ -9,16 +12,6 @@ DiffDialog::DiffDialog(QWidget *parent) :
     this->setWindowFlags(Qt::Window);
     ui->setupUi(this);
     
-    m_Ids = QList<IdentityModel*>();
-    m_ImkId1 = QByteArray(32, 0);
-    m_IlkId1 = QByteArray(32, 0);
-    m_ImkId2 = QByteArray(32, 0);
-    m_IlkId2 = QByteArray(32, 0);
-    m_IukId1 = QByteArray(32, 0);
-    m_IukId2 = QByteArray(32, 0);
-    m_prevImksId1 = QList<QByteArray>();
-    m_prevImksId2 = QList<QByteArray>();
-    
     connect(ui->btn_Identity1, &QPushButton::clicked, this, &DiffDialog::onChooseIdentityFile);
     connect(ui->btn_Identity2, &QPushButton::clicked, this, &DiffDialog::onChooseIdentityFile);
     connect(ui->btn_StartDiff, &QPushButton::clicked, this, &DiffDialog::onStartDiff);
@@ -26,6 +19,35 @@ DiffDialog::DiffDialog(QWidget *parent) :
     connect(ui->chk_DecryptBlock1, SIGNAL(toggled(bool)), ui->txt_PassId2, SLOT(setEnabled(bool)));
     connect(ui->chk_DecryptBlock2, SIGNAL(toggled(bool)), ui->txt_RescueCodeId1, SLOT(setEnabled(bool)));
     connect(ui->chk_DecryptBlock2, SIGNAL(toggled(bool)), ui->txt_RescueCodeId2, SLOT(setEnabled(bool)));
+    connect(ui->chk_ShortenKeys, &QCheckBox::toggled, this, &DiffDialog::onShortenKeysToggled);
+    connect(ui->btn_NextDifference, &QPushButton::clicked, this, &DiffDialog::onNextDifference);
+    connect(ui->btn_PreviousDifference, &QPushButton::clicked, this, &DiffDialog::onPreviousDifference);
+
+    ui->btn_NextDifference->setShortcut(QKeySequence(Qt::Key_F3));
+    ui->btn_PreviousDifference->setShortcut(QKeySequence(Qt::SHIFT + Qt::Key_F3));
+    ui->btn_NextDifference->setEnabled(false);
+    ui->btn_PreviousDifference->setEnabled(false);
+    ui->lbl_Summary->hide();
+
+    // Both identities are shown side by side in separate views of the
+    // same model, which share their selection and scroll in sync
+    m_pDiffModel = new DiffItemModel(this);
+    m_pDiffModel->setShortenValues(ui->chk_ShortenKeys->isChecked());
+    setupDiffView(ui->tbl_Diff1, DiffItemModel::VALUE2_COLUMN);
+    setupDiffView(ui->tbl_Diff2, DiffItemModel::VALUE1_COLUMN);
+
+    QItemSelectionModel* pSelectionModel = ui->tbl_Diff2->selectionModel();
+    ui->tbl_Diff2->setSelectionModel(ui->tbl_Diff1->selectionModel());
+    delete pSelectionModel;
+
+    connect(ui->tbl_Diff1->verticalScrollBar(), &QScrollBar::valueChanged,
+            ui->tbl_Diff2->verticalScrollBar(), &QScrollBar::setValue);
+    connect(ui->tbl_Diff2->verticalScrollBar(), &QScrollBar::valueChanged,
+            ui->tbl_Diff1->verticalScrollBar(), &QScrollBar::setValue);
+    connect(ui->tbl_Diff1->horizontalScrollBar(), &QScrollBar::valueChanged,
+            ui->tbl_Diff2->horizontalScrollBar(), &QScrollBar::setValue);
+    connect(ui->tbl_Diff2->horizontalScrollBar(), &QScrollBar::valueChanged,
+            ui->tbl_Diff1->horizontalScrollBar(), &QScrollBar::setValue);
     
     /* These are just test identies, nothing to hide here
     ui->txt_Identity1->setText("C:\\Users\\alexh\\Documents\\SQRL\\AlexDev3_.sqrl");
@@ -42,369 +64,207 @@ DiffDialog::~DiffDialog()
     delete ui;
 }
 
-QList<int> DiffDialog::calculateColumnWidths(QList<IdentityModel*> ids)
-{
-    QList<int> result {0,0};
-
-    for (IdentityModel* id : ids)
-    {
-        for (IdentityBlock block : id->blocks)
-        {
-            for (IdentityBlockItem item : block.items)
-            {
-                if (item.name.length() > result[0]) result[0] = item.name.length();
-                
-                int itemlength = 0;
-                
-                if (ui->chk_ShortenKeys->isChecked()) itemlength = 23;
-                else itemlength = item.value.length();
-                if (itemlength > result[1]) result[1] = itemlength;
-            }
-        }
-    }
-
-    return result;
-}
-
-QTextCharFormat DiffDialog::getItemFormat(int diffType)
-{
-    QTextCharFormat result;
-    QColor bgColor = QColor::fromRgb(255,255,255,0);
-
-    if (diffType == 1) bgColor = QColor::fromRgb(156,219,156,255);
-    if (diffType == 2) bgColor = QColor::fromRgb(255,135,135,255);
-    if (diffType == 3) bgColor = QColor::fromRgb(255,255,224,255);
-
-    result.setBackground(bgColor);
-    result.setFont(QFont("Courier", 9));
-
-    return result;
-}
-
-QTextCharFormat DiffDialog::getBlockHeaderFormat()
+void DiffDialog::setupDiffView(QTableView* view, int hiddenColumn)
 {
-    QTextCharFormat result;
-
-    result.setFont(QFont("Courier", 16, QFont::Bold));
-    return result;
+    view->setModel(m_pDiffModel);
+    view->setColumnHidden(hiddenColumn, true);
+    view->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    view->setSelectionBehavior(QAbstractItemView::SelectRows);
+    view->setSelectionMode(QAbstractItemView::SingleSelection);
+    view->setHorizontalScrollMode(QAbstractItemView::ScrollPerPixel);
+    view->setWordWrap(false);
+    view->setShowGrid(false);
+
+    // Fixed section sizes keep the view from measuring any rows
+    // which are not visible
+    view->verticalHeader()->hide();
+    view->verticalHeader()->setSectionResizeMode(QHeaderView::Fixed);
+    view->horizontalHeader()->setSectionResizeMode(QHeaderView::Fixed);
+    view->horizontalHeader()->setStretchLastSection(false);
 }
 
-QTextCharFormat DiffDialog::getSummaryTextFormat()
+void DiffDialog::updateColumnWidths()
 {
-    QTextCharFormat result;
+    int charWidth = QFontMetrics(QFont("Courier", 9)).averageCharWidth();
+    int nameWidth = (m_pDiffModel->getMaxTextLength(DiffItemModel::NAME_COLUMN) + 2) * charWidth;
+    int valueWidth = (std::max(m_pDiffModel->getMaxTextLength(DiffItemModel::VALUE1_COLUMN),
+                               m_pDiffModel->getMaxTextLength(DiffItemModel::VALUE2_COLUMN)) + 2) * charWidth;
 
-    result.setFont(QFont("Courier", 10));
-    return result;
+    for (QTableView* pView : { ui->tbl_Diff1, ui->tbl_Diff2 })
+    {
+        pView->setColumnWidth(DiffItemModel::NAME_COLUMN, nameWidth);
+        pView->setColumnWidth(DiffItemModel::VALUE1_COLUMN, valueWidth);
+        pView->setColumnWidth(DiffItemModel::VALUE2_COLUMN, valueWidth);
+    }
 }
 
-QTextCharFormat DiffDialog::getSummarySuccessTextFormat()
+void DiffDialog::updateSpans()
 {
-    QTextCharFormat result = getSummaryTextFormat();
-    result.setBackground(QBrush(QColor(156,219,156,255)));
-    return result;
-}
+    ui->tbl_Diff1->clearSpans();
+    ui->tbl_Diff2->clearSpans();
 
-QTextCharFormat DiffDialog::getSummaryNeutralTextFormat()
-{
-    QTextCharFormat result = getSummaryTextFormat();
-    result.setBackground(QBrush(QColor(255,255,224,255)));
-    return result;
+    // Block headers span the whole width of both views
+    for (int i=0; i<m_pDiffModel->rowCount(); i++)
+    {
+        if (!m_pDiffModel->getRow(i).isBlockHeader) continue;
+        ui->tbl_Diff1->setSpan(i, 0, 1, DiffItemModel::COLUMN_COUNT);
+        ui->tbl_Diff2->setSpan(i, 0, 1, DiffItemModel::COLUMN_COUNT);
+    }
 }
 
-QTextCharFormat DiffDialog::getSummaryFailureTextFormat()
+void DiffDialog::showDifference(bool forward)
 {
-    QTextCharFormat result = getSummaryTextFormat();
-    result.setBackground(QBrush(QColor(255,135,135,255)));
-    return result;
-}
+    int row = m_pDiffModel->findDifference(ui->tbl_Diff1->currentIndex().row(), forward);
+    if (row < 0) return;
 
-QTextFrameFormat DiffDialog::getBlockFrameFormat()
-{
-    QTextFrameFormat frameFormat;
-    frameFormat.setMargin(5);
-    frameFormat.setPadding(5);
-    return frameFormat;
+    QModelIndex index = m_pDiffModel->index(row, DiffItemModel::NAME_COLUMN);
+    ui->tbl_Diff1->setCurrentIndex(index);
+    ui->tbl_Diff1->scrollTo(index, QAbstractItemView::PositionAtCenter);
 }
 
-QTextTableFormat DiffDialog::getTableFormat()
+bool DiffDialog::decryptKeys()
 {
-    QTextTableFormat tableFormat;
-    tableFormat.setCellPadding(3);
-    tableFormat.setCellSpacing(1);
-    tableFormat.setBorder(0);
-    return tableFormat;
-}
+    TRACE_SPAN("DiffDialog::decryptKeys", "ui");
 
-QString DiffDialog::shortenValue(QString value)
-{
-    if (value.length() <= 23) return value;
-    
-    value = value.remove(10, value.length() - 20);
-    value = value.insert(10, QString("..."));
-    return value;
-}
+    m_KeysId1 = IdentityDiff::KeyInfo();
+    m_KeysId2 = IdentityDiff::KeyInfo();
 
-bool DiffDialog::DecryptBlocks(QList<IdentityModel*>& ids)
-{
     QString passwordId1, passwordId2, rescueCodeId1, rescueCodeId2;
-    bool ok = false;
-    
+
     if (ui->chk_DecryptBlock1->isChecked())
     {
-        // Block 1
-        
         passwordId1 = ui->txt_PassId1->text();
         passwordId2 = ui->txt_PassId2->text();
-        
-        IdentityBlock* pBlock1Id1 = ids[0]->getBlock(1);
-        IdentityBlock* pBlock1Id2 = ids[1]->getBlock(1);
-        
-        QProgressDialog progressDialog(tr("Decrypting identity 1 block 1..."), tr("Abort"), 0, 0, this);
-        progressDialog.setWindowModality(Qt::WindowModal);
-        
-        QByteArray keyId1(32, 0);
-        QByteArray keyId2(32, 0);
-        ok = CryptUtil::createKeyFromPassword(keyId1, *pBlock1Id1, passwordId1, &progressDialog);
-        if (!ok) return false;
-        progressDialog.setLabelText(tr("Decrypting identity 2 block 1..."));
-        ok = CryptUtil::createKeyFromPassword(keyId2, *pBlock1Id2, passwordId2, &progressDialog);
-        if (!ok) return false;
-                       
-        ok = CryptUtil::decryptBlock1(m_ImkId1, m_IlkId1, pBlock1Id1, keyId1);
-        if (!ok) 
-        {
-            QMessageBox::critical(this, tr("Error"), tr("Decryption of block 1 of identity 1 failed!"));
-            return false;
-        }
-        
-        ok = CryptUtil::decryptBlock1(m_ImkId2, m_IlkId2, pBlock1Id2, keyId2);
-        if (!ok) 
-        {
-            QMessageBox::critical(this, tr("Error"), tr("Decryption block 1 of identity 2 failed!"));
-            return false;
-        }
-        
-        // Insert the decrypted keys as block items so that they get displayed in the diff table
-        IdentityBlockItem imkItem = IdentityBlockItem();
-        imkItem.name = "  └ decrypted";
-        imkItem.description = "The decrypted identity master key";
-        imkItem.dataType = ItemDataType::BYTE_ARRAY;
-        imkItem.nrOfBytes = 32;
-        imkItem.value = m_ImkId1.toHex();
-        m_Ids[0]->getBlock(1)->items.insert(12, imkItem);
-        imkItem.value = m_ImkId2.toHex();
-        m_Ids[1]->getBlock(1)->items.insert(12, imkItem);
-        
-        IdentityBlockItem ilkItem = IdentityBlockItem();
-        ilkItem.name = "  └ decrypted";
-        ilkItem.description = "The decrypted identity lock key";
-        ilkItem.dataType = ItemDataType::BYTE_ARRAY;
-        ilkItem.nrOfBytes = 32;
-        ilkItem.value = m_IlkId1.toHex();
-        m_Ids[0]->getBlock(1)->items.insert(14, ilkItem);
-        ilkItem.value = m_IlkId2.toHex();
-        m_Ids[1]->getBlock(1)->items.insert(14, ilkItem);
-        
-        // Block 3
-
-        IdentityBlock* pBlock3Id1 = ids[0]->getBlock(3);
-        IdentityBlock* pBlock3Id2 = ids[1]->getBlock(3);
-        QList<QByteArray> prevIuksId1 = QList<QByteArray>();
-        QList<QByteArray> prevIuksId2 = QList<QByteArray>();
-
-        if (pBlock3Id1 != nullptr)
-        {
-            
-            ok = CryptUtil::decryptBlock3(prevIuksId1, pBlock3Id1, m_ImkId1);
-            if (!ok)
-            {
-                QMessageBox::critical(this, tr("Error"), tr("Decryption of block 3 of identity 1 failed!"));
-                return false;
-            }
-            
-            for (QByteArray iuk : prevIuksId1) m_prevImksId1.append(CryptUtil::createImkFromIuk(iuk));
-        }
-
-        if (pBlock3Id2 != nullptr)
-        {
-            ok = CryptUtil::decryptBlock3(prevIuksId2, pBlock3Id2, m_ImkId2);
-            if (!ok)
-            {
-                QMessageBox::critical(this, tr("Error"), tr("Decryption of block 3 of identity 2 failed!"));
-                return false;
-            }
-            
-            for (QByteArray iuk : prevIuksId2) m_prevImksId2.append(CryptUtil::createImkFromIuk(iuk));
-        }
-        
-        // Insert the decrypted previous keys as block items so that they get displayed in the diff table
-        int maxPrevIuks = std::max(prevIuksId1.count(), prevIuksId2.count());
-        for (int i=0; i<maxPrevIuks; i++)
-        {
-            IdentityBlockItem prevIukItem = IdentityBlockItem();
-            prevIukItem.name = "  └ decrypted";
-            prevIukItem.description = "The decrypted previous identity unlock key";
-            prevIukItem.dataType = ItemDataType::BYTE_ARRAY;
-            prevIukItem.nrOfBytes = 32;
-            if (i < prevIuksId1.count())
-            {
-                prevIukItem.value = prevIuksId1[i].toHex();
-                m_Ids[0]->getBlock(3)->items.insert(4+(i*2), prevIukItem);
-            }
-            if (i < prevIuksId2.count())
-            {
-                prevIukItem.value = prevIuksId2[i].toHex();
-                m_Ids[1]->getBlock(3)->items.insert(4+(i*2), prevIukItem);    
-            }
-        }
     }
-    
-    // Block 2
-    
+
     if (ui->chk_DecryptBlock2->isChecked())
     {
         rescueCodeId1 = ui->txt_RescueCodeId1->text();
         rescueCodeId2 = ui->txt_RescueCodeId2->text();
+    }
+
+    if (passwordId1.isEmpty() && passwordId2.isEmpty() &&
+            rescueCodeId1.isEmpty() && rescueCodeId2.isEmpty())
+    {
+        return true;
+    }
+
+    ProgressDialog progressDialog(tr("Decrypting identity 1..."), tr("Abort"), 0, 0, this);
+    progressDialog.setWindowModality(Qt::WindowModal);
+    QString errorMessage;
+
+    if (!IdentityDiff::decryptKeys(m_KeysId1, m_Id1, passwordId1, rescueCodeId1,
+                                   &progressDialog, &errorMessage))
+    {
+        QMessageBox::critical(this, tr("Error"), tr("Identity 1: %1").arg(errorMessage));
+        return false;
+    }
+
+    progressDialog.setLabelText(tr("Decrypting identity 2..."));
+
+    if (!IdentityDiff::decryptKeys(m_KeysId2, m_Id2, passwordId2, rescueCodeId2,
+                                   &progressDialog, &errorMessage))
+    {
+        QMessageBox::critical(this, tr("Error"), tr("Identity 2: %1").arg(errorMessage));
+        return false;
+    }
+
+    return true;
+}
 
-        // Block 2
-        
-        IdentityBlock* pBlock2Id1 = ids[0]->getBlock(2);
-        IdentityBlock* pBlock2Id2 = ids[1]->getBlock(2);
-        
-        QProgressDialog progressDialog(tr("Decrypting identity 1 block 2..."), tr("Abort"), 0, 0, this);
-        progressDialog.setWindowModality(Qt::WindowModal);
-                       
-        ok = CryptUtil::decryptBlock2(m_IukId1, pBlock2Id1, rescueCodeId1, &progressDialog);
-        if (!ok) 
+QVector<DiffItemModel::Row> DiffDialog::buildRows(int blockIndex)
+{
+    TRACE_SPAN("DiffDialog::buildRows", "ui");
+
+    QVector<DiffItemModel::Row> rows;
+    const IdentityDiff::BlockDiff& blockDiff = m_Result.blocks.at(blockIndex);
+
+    const QList<IdentityBlockItem> noItems;
+    const QList<IdentityBlockItem>& items1 = blockDiff.blockIndex1 < 0 ? noItems :
+            m_Id1.blocks.at(blockDiff.blockIndex1).items;
+    const QList<IdentityBlockItem>& items2 = blockDiff.blockIndex2 < 0 ? noItems :
+            m_Id2.blocks.at(blockDiff.blockIndex2).items;
+    int itemCount = std::max(items1.size(), items2.size());
+
+    DiffItemModel::Row header;
+    header.name = tr("Block type %0").arg(blockDiff.blockType);
+    header.diffType = blockDiff.diffType;
+    header.isBlockHeader = true;
+    rows.append(header);
+
+    // Decrypted keys are displayed right after their encrypted counterparts
+    QList<IdentityDiff::KeyDiff> keyDiffs;
+    for (const IdentityDiff::KeyDiff& keyDiff : m_Result.keys)
+        if (keyDiff.blockType == blockDiff.blockType) keyDiffs.append(keyDiff);
+
+    for (int i=0; i<itemCount || !keyDiffs.isEmpty(); i++)
+    {
+        if (i < itemCount)
         {
-            QMessageBox::critical(this, tr("Error"), tr("Decryption of block 2 of identity 1 failed!"));
-            return false;
+            DiffItemModel::Row row;
+            row.name = (i < items1.size() ? items1 : items2).at(i).name;
+            row.value1 = i < items1.size() ? items1.at(i).value : "";
+            row.value2 = i < items2.size() ? items2.at(i).value : "";
+            row.diffType = m_Result.itemDiffType(blockIndex, i);
+            row.isBlockHeader = false;
+            rows.append(row);
         }
-        
-        progressDialog.setLabelText(tr("Decrypting identity 2 block 2..."));
-        ok = CryptUtil::decryptBlock2(m_IukId2, pBlock2Id2, rescueCodeId2, &progressDialog);
-        if (!ok) 
+
+        while (!keyDiffs.isEmpty() &&
+               (keyDiffs.first().afterItemIndex <= i || i >= itemCount - 1))
         {
-            QMessageBox::critical(this, tr("Error"), tr("Decryption of block 2 of identity 2 failed!"));
-            return false;
+            IdentityDiff::KeyDiff keyDiff = keyDiffs.takeFirst();
+            DiffItemModel::Row row;
+            row.name = "  └ decrypted";
+            row.value1 = IdentityDiff::getKey(m_KeysId1, keyDiff.keyType, keyDiff.keyIndex).toHex();
+            row.value2 = IdentityDiff::getKey(m_KeysId2, keyDiff.keyType, keyDiff.keyIndex).toHex();
+            row.diffType = keyDiff.diffType;
+            row.isBlockHeader = false;
+            rows.append(row);
         }
-        
-        // Insert the decrypted IUK as block item so that it gets displayed in the diff table
-        IdentityBlockItem iukItem = IdentityBlockItem();
-        iukItem.name = "  └ decrypted";
-        iukItem.description = "The decrypted identity unlock key";
-        iukItem.dataType = ItemDataType::BYTE_ARRAY;
-        iukItem.nrOfBytes = 32;
-        iukItem.value = m_IukId1.toHex();
-        m_Ids[0]->getBlock(2)->items.insert(6, iukItem);
-        iukItem.value = m_IukId2.toHex();
-        m_Ids[1]->getBlock(2)->items.insert(6, iukItem);
     }
 
-    return true;
+    return rows;
 }
 
-void DiffDialog::writeSummary(QTextCursor &cursor)
+void DiffDialog::writeSummary()
 {
-    if (!ui->chk_DecryptBlock1->isChecked()) return;
+    TRACE_SPAN("DiffDialog::writeSummary", "ui");
 
-    QTextDocument* textDoc = ui->txt_Diff->document();
-    cursor = textDoc->rootFrame()->lastCursorPosition();
+    if (m_Result.relationship == IdentityDiff::UNKNOWN_RELATIONSHIP)
+    {
+        ui->lbl_Summary->hide();
+        return;
+    }
 
-    cursor.insertFrame(getBlockFrameFormat());
-    cursor.setCharFormat(getBlockHeaderFormat());
-    cursor.insertText(tr("Summary:"));
-    
-    cursor.insertBlock();
+    QString text;
+    QColor bgColor;
 
-    if (m_ImkId1 == m_ImkId2)
+    if (m_Result.relationship == IdentityDiff::SAME_IDENTITY)
     {
-        cursor.setCharFormat(getSummarySuccessTextFormat());
-        cursor.insertText(tr("Both files represent the same identity (decrypted IMKs match)!"));
+        bgColor = QColor(156,219,156,255);
+        text = tr("Both files represent the same identity (decrypted IMKs match)!");
     }
-    else if (m_prevImksId2.contains(m_ImkId1) || m_prevImksId1.contains(m_ImkId2))
+    else if (m_Result.relationship == IdentityDiff::SAME_LINEAGE)
     {
-        cursor.setCharFormat(getSummaryNeutralTextFormat());
-        cursor.insertText(tr("Both files represent the same identity, but are not the same edition!\n"));
-        if (m_prevImksId2.contains(m_ImkId1))
-            cursor.insertText(tr("The IUK of Identity 1 is a previous IUK of Identity 2."));
-        if (m_prevImksId1.contains(m_ImkId2))
-            cursor.insertText(tr("The IUK of Identity 2 is a previous IUK of Identity 1."));
+        bgColor = QColor(255,255,224,255);
+        text = tr("Both files represent the same identity, but are not the same edition!\n");
+        if (m_Result.firstPrecedesSecond)
+            text += tr("The IUK of Identity 1 is a previous IUK of Identity 2.");
+        else if (m_Result.secondPrecedesFirst)
+            text += tr("The IUK of Identity 2 is a previous IUK of Identity 1.");
+        else
+            text += tr("Both identities share a previous IUK.");
     }
     else
     {
-        cursor.setCharFormat(getSummaryFailureTextFormat());
-        cursor.insertText(tr("The files do NOT represent the same identity!"));
+        bgColor = QColor(255,135,135,255);
+        text = tr("The files do NOT represent the same identity!");
     }
-}
-    
-
-void DiffDialog::writeDiffTable(QTextCursor &cursor, QList<int> &allBlockTypes)
-{
-    QTextDocument* textDoc = ui->txt_Diff->document();
 
-    for (int blockType : allBlockTypes)
-    {
-        QList<int> columnWidths = calculateColumnWidths(m_Ids);
-
-        cursor = textDoc->rootFrame()->lastCursorPosition();
-        cursor.insertFrame(getBlockFrameFormat());
-
-        cursor.setCharFormat(getBlockHeaderFormat());
-        cursor.insertText(QString("Block type %0").arg(blockType));
-
-        // Create a dummy block of the given block type as a
-        // reference for the block type's items, since either
-        // block 1 or block 2 could be missing a block that the
-        // other one has.
-        IdentityBlock* pDummyBlock = m_Ids[0]->getBlock(blockType) != nullptr ? 
-                m_Ids[0]->getBlock(blockType) : m_Ids[1]->getBlock(blockType);
-        int nrOfItems = pDummyBlock->items.count();
-
-        QTextTable* pTable = cursor.insertTable(nrOfItems, 3, getTableFormat());
-
-        for (int i=0; i<nrOfItems; i++)
-        {
-            IdentityBlock* pBlockOfId1 = m_Ids[0]->getBlock(blockType);
-            IdentityBlock* pBlockOfId2 = m_Ids[1]->getBlock(blockType);
-
-            QString name = pDummyBlock->items.at(i).name.leftJustified(columnWidths[0]);
-            
-            QString value1;
-            QString value2;
-            if (ui->chk_ShortenKeys->isChecked())
-            {
-                value1 = pBlockOfId1 == nullptr ? "" : shortenValue(pBlockOfId1->items.at(i).value);
-                value2 = pBlockOfId2 == nullptr ? "" : shortenValue(pBlockOfId2->items.at(i).value);
-            }
-            else
-            {
-                value1 = pBlockOfId1 == nullptr ? "" : pBlockOfId1->items.at(i).value;
-                value2 = pBlockOfId2 == nullptr ? "" : pBlockOfId2->items.at(i).value;
-            }
-
-            int diffType = 1;
-            if (value1 != value2) diffType = 2;
-
-            value1 = value1.rightJustified(columnWidths[1]);
-            value2 = value2.leftJustified(columnWidths[1]);
-
-            QTextTableCell nameCell = pTable->cellAt(i, 0);
-            nameCell.setFormat(getItemFormat());
-            cursor = nameCell.firstCursorPosition();
-            cursor.insertText(name);
-
-            QTextTableCell value1Cell = pTable->cellAt(i, 1);
-            value1Cell.setFormat(getItemFormat(diffType));
-            cursor = value1Cell.firstCursorPosition();
-            cursor.insertText(value1);
-
-            QTextTableCell value2Cell = pTable->cellAt(i, 2);
-            value2Cell.setFormat(getItemFormat(diffType));
-            cursor = value2Cell.firstCursorPosition();
-            cursor.insertText(value2);
-        }
-    }
+    ui->lbl_Summary->setText(text);
+    ui->lbl_Summary->setStyleSheet(QString("background-color: %1; padding: 5px;").arg(bgColor.name()));
+    ui->lbl_Summary->show();
 }
 
 void DiffDialog::onChooseIdentityFile()
@@ -421,42 +281,66 @@ void DiffDialog::onChooseIdentityFile()
 
 void DiffDialog::onStartDiff()
 {
+    TRACE_SPAN("DiffDialog::onStartDiff", "ui");
+
     IdentityParser parser;
 
-    ui->txt_Diff->clear();
-    m_prevImksId1.clear();
-    m_prevImksId2.clear();
+    m_pDiffModel->setRows(QVector<DiffItemModel::Row>());
+    m_Result = IdentityDiff::Result();
+    ui->lbl_Summary->hide();
+    ui->lbl_DifferenceCount->clear();
+    ui->btn_NextDifference->setEnabled(false);
+    ui->btn_PreviousDifference->setEnabled(false);
 
-    m_Ids.clear();
-    m_Ids.append(new IdentityModel());
-    m_Ids.append(new IdentityModel());
+    IdentityModel id1;
+    IdentityModel id2;
 
     try
     {
-        parser.parseFile(ui->txt_Identity1->text(), m_Ids[0]);
-        parser.parseFile(ui->txt_Identity2->text(), m_Ids[1]);
+        parser.parseFile(ui->txt_Identity1->text(), &id1);
+        parser.parseFile(ui->txt_Identity2->text(), &id2);
     }
     catch (std::exception& e)
     {
         QMessageBox::critical(this, tr("Error"), e.what());
+        return;
     }
-    
-    // Decrypt blocks if requested
-    if (!DecryptBlocks(m_Ids)) return;
 
-    // Get a sorted list of all the block types which are
-    // present in both of the identities
-    QList<int> blockTypesOfId1 = m_Ids[0]->getAvailableBlockTypes();
-    QList<int> blockTypesOfId2 = m_Ids[1]->getAvailableBlockTypes();
-    QList<int> allBlockTypes = blockTypesOfId1.toSet().unite(blockTypesOfId2.toSet()).toList();
-    std::sort(allBlockTypes.begin(), allBlockTypes.end());
+    m_Id1 = id1;
+    m_Id2 = id2;
 
-    QTextCursor cursor = ui->txt_Diff->textCursor();
+    // Decrypt keys if requested
+    if (!decryptKeys()) return;
 
-    writeSummary(cursor);
-    writeDiffTable(cursor, allBlockTypes);
-    
-    // Maximize diff window if "shorten keys" is disabled
-    if (!ui->chk_ShortenKeys->isChecked())
-        this->setWindowState(Qt::WindowMaximized);
+    m_Result = IdentityDiff::compare(m_Id1, m_Id2, &m_KeysId1, &m_KeysId2);
+
+    QVector<DiffItemModel::Row> rows;
+    for (int i=0; i<m_Result.blocks.size(); i++)
+        rows += buildRows(i);
+
+    m_pDiffModel->setRows(rows);
+    updateSpans();
+    updateColumnWidths();
+    writeSummary();
+
+    int differenceCount = m_pDiffModel->getDifferenceCount();
+    ui->lbl_DifferenceCount->setText(tr("%1 difference(s)").arg(differenceCount));
+    ui->btn_NextDifference->setEnabled(differenceCount > 0);
+    ui->btn_PreviousDifference->setEnabled(differenceCount > 0);
+}
+
+void DiffDialog::onShortenKeysToggled(bool checked)
+{
+    m_pDiffModel->setShortenValues(checked);
+    updateColumnWidths();
+}
+
+void DiffDialog::onNextDifference()
+{
+    showDifference(true);
+}
+
+void DiffDialog::onPreviousDifference()
+{
+    showDifference(false);
 }
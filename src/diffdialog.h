@@ -2,9 +2,9 @@
 #define DIFFDIALOG_H
 
 #include "common.h"
-
-// Forward declarations
-class IdentityModel;
+#include "identitydiff.h"
+#include "diffitemmodel.h"
+#include <QTableView>
 
 namespace Ui {
 class DiffDialog;
@@ -20,34 +20,28 @@ public:
     
 private:
     Ui::DiffDialog *ui;
-    QList<IdentityModel*> m_Ids;
-    QByteArray m_ImkId1;
-    QByteArray m_IlkId1;
-    QByteArray m_ImkId2;
-    QByteArray m_IlkId2;
-    QByteArray m_IukId1;
-    QByteArray m_IukId2;
-    QList<QByteArray> m_prevImksId1;
-    QList<QByteArray> m_prevImksId2;
+    DiffItemModel* m_pDiffModel = nullptr;
+    IdentityModel m_Id1;
+    IdentityModel m_Id2;
+    IdentityDiff::KeyInfo m_KeysId1;
+    IdentityDiff::KeyInfo m_KeysId2;
+    IdentityDiff::Result m_Result;
 
 private:
-    QList<int> calculateColumnWidths(QList<IdentityModel*> ids);
-    QTextCharFormat getItemFormat(int diffType=0);
-    QTextCharFormat getBlockHeaderFormat();
-    QTextCharFormat getSummaryTextFormat();
-    QTextCharFormat getSummarySuccessTextFormat();
-    QTextCharFormat getSummaryNeutralTextFormat();
-    QTextCharFormat getSummaryFailureTextFormat();
-    QTextFrameFormat getBlockFrameFormat();
-    QTextTableFormat getTableFormat();
-    QString shortenValue(QString value);
-    bool DecryptBlocks(QList<IdentityModel*>& ids);
-    void writeSummary(QTextCursor& cursor);
-    void writeDiffTable(QTextCursor& cursor, QList<int>& allBlockTypes);
+    void setupDiffView(QTableView* view, int hiddenColumn);
+    void updateColumnWidths();
+    void updateSpans();
+    void showDifference(bool forward);
+    bool decryptKeys();
+    QVector<DiffItemModel::Row> buildRows(int blockIndex);
+    void writeSummary();
     
 private slots:
     void onChooseIdentityFile();
     void onStartDiff();
+    void onShortenKeysToggled(bool checked);
+    void onNextDifference();
+    void onPreviousDifference();
 };
 
 #endif // DIFFDIALOG_H
@@ -0,0 +1,263 @@
+/*
+ * This file is part of the "IdTool" utility app.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Alexander Hauser
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "diffitemmodel.h"
+
+/*!
+ *
+ * \class DiffItemModel
+ * \brief A table model presenting the result of an \c IdentityDiff
+ * to Qt's item views.
+ *
+ * Every row holds the name of a block item along with its values
+ * within both compared identities. Each block is introduced by a
+ * block header row. Rows only hold the raw values, all formatting
+ * (shortening long values, fonts and background colors) is done
+ * on demand within \c data(), so only rows which are actually
+ * visible are ever being formatted.
+ *
+ * \sa IdentityDiff, DiffDialog
+ *
+*/
+
+/*!
+ * Creates a new, empty \c DiffItemModel using \a parent as
+ * the parent object.
+ */
+
+DiffItemModel::DiffItemModel(QObject* parent) :
+    QAbstractTableModel(parent)
+{
+}
+
+/*!
+ * Replaces the contents of the model with \a rows.
+ */
+
+void DiffItemModel::setRows(QVector<Row> rows)
+{
+    beginResetModel();
+    m_Rows = rows;
+    endResetModel();
+}
+
+/*!
+ * Returns the row at index \a row, which must be valid.
+ */
+
+const DiffItemModel::Row& DiffItemModel::getRow(int row) const
+{
+    return m_Rows.at(row);
+}
+
+/*!
+ * Sets whether long values should be shortened for display. If
+ * \a shorten is \c true, values are being shortened. The full
+ * value is always available as a tooltip.
+ */
+
+void DiffItemModel::setShortenValues(bool shorten)
+{
+    if (m_bShortenValues == shorten) return;
+    m_bShortenValues = shorten;
+
+    if (m_Rows.isEmpty()) return;
+    emit dataChanged(index(0, VALUE1_COLUMN), index(m_Rows.size() - 1, VALUE2_COLUMN),
+                     QVector<int>() << Qt::DisplayRole);
+}
+
+/*!
+ * Returns \c true if long values are being shortened for display,
+ * or \c false otherwise.
+ */
+
+bool DiffItemModel::getShortenValues() const
+{
+    return m_bShortenValues;
+}
+
+/*!
+ * Searches for the next row holding a difference, starting after
+ * \a startRow if \a forward is \c true, or before \a startRow otherwise.
+ * The search wraps around at the end (or start) of the model. If
+ * \a startRow is not a valid row, the search starts at the first
+ * (or last) row.
+ *
+ * Returns the index of the row found, or -1 if there are no
+ * differences at all.
+ */
+
+int DiffItemModel::findDifference(int startRow, bool forward) const
+{
+    int rowCount = m_Rows.size();
+    int step = forward ? 1 : -1;
+    if (startRow < 0 || startRow >= rowCount) startRow = forward ? -1 : rowCount;
+
+    for (int i=1; i<=rowCount; i++)
+    {
+        int row = ((startRow + i * step) % rowCount + rowCount) % rowCount;
+        const Row& current = m_Rows.at(row);
+        if (!current.isBlockHeader && current.diffType != IdentityDiff::EQUAL) return row;
+    }
+
+    return -1;
+}
+
+/*!
+ * Returns the number of rows holding a difference.
+ */
+
+int DiffItemModel::getDifferenceCount() const
+{
+    int result = 0;
+
+    for (const Row& row : m_Rows)
+        if (!row.isBlockHeader && row.diffType != IdentityDiff::EQUAL) result++;
+
+    return result;
+}
+
+/*!
+ * Returns the length of the longest text being displayed within
+ * \a column, which views can use to size their columns without
+ * having to lay out every cell.
+ */
+
+int DiffItemModel::getMaxTextLength(int column) const
+{
+    int result = 0;
+
+    for (const Row& row : m_Rows)
+    {
+        if (row.isBlockHeader) continue;
+        int length = column == NAME_COLUMN || !m_bShortenValues ?
+                    getText(row, column).length() :
+                    std::min(getText(row, column).length(), 23);
+        if (length > result) result = length;
+    }
+
+    return result;
+}
+
+/*!
+ * Shortens \a value to at most 23 characters by replacing its
+ * middle part with an ellipsis.
+ */
+
+QString DiffItemModel::shortenValue(QString value)
+{
+    if (value.length() <= 23) return value;
+
+    value = value.remove(10, value.length() - 20);
+    value = value.insert(10, QString("..."));
+    return value;
+}
+
+int DiffItemModel::rowCount(const QModelIndex& parent) const
+{
+    if (parent.isValid()) return 0;
+    return m_Rows.size();
+}
+
+int DiffItemModel::columnCount(const QModelIndex& parent) const
+{
+    if (parent.isValid()) return 0;
+    return COLUMN_COUNT;
+}
+
+QVariant DiffItemModel::data(const QModelIndex& index, int role) const
+{
+    if (!index.isValid() || index.row() >= m_Rows.size()) return QVariant();
+
+    const Row& row = m_Rows.at(index.row());
+    int column = index.column();
+
+    switch (role)
+    {
+    case Qt::DisplayRole:
+    {
+        QString text = getText(row, column);
+        if (m_bShortenValues && column != NAME_COLUMN) text = shortenValue(text);
+        return text;
+    }
+
+    case Qt::ToolTipRole:
+        if (row.isBlockHeader || column == NAME_COLUMN) return QVariant();
+        return getText(row, column);
+
+    case Qt::FontRole:
+        if (row.isBlockHeader) return QFont("Courier", 12, QFont::Bold);
+        return QFont("Courier", 9);
+
+    case Qt::BackgroundRole:
+        if (row.isBlockHeader || column == NAME_COLUMN) return QVariant();
+        if (row.diffType == IdentityDiff::EQUAL) return QBrush(QColor::fromRgb(156,219,156,255));
+        return QBrush(QColor::fromRgb(255,135,135,255));
+
+    case Qt::TextAlignmentRole:
+        if (column == VALUE1_COLUMN && !row.isBlockHeader)
+            return int(Qt::AlignRight | Qt::AlignVCenter);
+        return int(Qt::AlignLeft | Qt::AlignVCenter);
+
+    case DIFF_TYPE_ROLE:
+        return row.diffType;
+
+    case BLOCK_HEADER_ROLE:
+        return row.isBlockHeader;
+    }
+
+    return QVariant();
+}
+
+QVariant DiffItemModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (orientation != Qt::Horizontal || role != Qt::DisplayRole) return QVariant();
+
+    switch (section)
+    {
+    case NAME_COLUMN: return tr("Item");
+    case VALUE1_COLUMN: return tr("Identity 1");
+    case VALUE2_COLUMN: return tr("Identity 2");
+    }
+
+    return QVariant();
+}
+
+/*!
+ * Returns the unformatted text of \a row for \a column.
+ */
+
+QString DiffItemModel::getText(const Row& row, int column) const
+{
+    switch (column)
+    {
+    case NAME_COLUMN: return row.name;
+    case VALUE1_COLUMN: return row.value1;
+    case VALUE2_COLUMN: return row.value2;
+    }
+
+    return QString();
+}
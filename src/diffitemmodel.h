@@ -0,0 +1,90 @@
+/*
+ * This file is part of the "IdTool" utility app.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Alexander Hauser
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef DIFFITEMMODEL_H
+#define DIFFITEMMODEL_H
+
+#include "common.h"
+#include "identitydiff.h"
+
+/**********************************************
+ *    class DiffItemModel                     *
+ *********************************************/
+
+class DiffItemModel : public QAbstractTableModel
+{
+    Q_OBJECT
+
+public:
+    enum Column
+    {
+        NAME_COLUMN,
+        VALUE1_COLUMN,
+        VALUE2_COLUMN,
+        COLUMN_COUNT
+    };
+
+    enum Role
+    {
+        DIFF_TYPE_ROLE = Qt::UserRole + 1,
+        BLOCK_HEADER_ROLE
+    };
+
+    struct Row
+    {
+        QString name;
+        QString value1;
+        QString value2;
+        IdentityDiff::DiffType diffType;
+        bool isBlockHeader;
+    };
+
+private:
+    QVector<Row> m_Rows;
+    bool m_bShortenValues = true;
+
+public:
+    explicit DiffItemModel(QObject* parent = nullptr);
+    void setRows(QVector<Row> rows);
+    const Row& getRow(int row) const;
+    void setShortenValues(bool shorten);
+    bool getShortenValues() const;
+    int findDifference(int startRow, bool forward) const;
+    int getDifferenceCount() const;
+    int getMaxTextLength(int column) const;
+    static QString shortenValue(QString value);
+
+    // QAbstractItemModel
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex& parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+
+private:
+    QString getText(const Row& row, int column) const;
+};
+
+#endif // DIFFITEMMODEL_H
@@ -0,0 +1,516 @@
+/*
+ * This file is part of the "IdTool" utility app.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Alexander Hauser
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "enscryptcalibration.h"
+#include "cryptutil.h"
+#include <QStandardPaths>
+#include <QSysInfo>
+#include <cmath>
+
+/*!
+ *
+ * \class EnScryptCalibration
+ * \brief Measures and caches the EnScrypt throughput of the current machine.
+ *
+ * EnScrypt (iterated scrypt with r=256 and p=1) is the PBKDF protecting
+ * SQRL identities. Its cost per iteration depends on the log-n-factor
+ * and, of course, on the speed of the CPU and memory subsystem.
+ *
+ * \c EnScryptCalibration measures the number of iterations per second
+ * that can be run on the current machine for a given log-n-factor and
+ * caches the results, both in memory and on disk. The cached values are
+ * being used to estimate the remaining time of running EnScrypt operations,
+ * and to recommend EnScrypt parameters which will hit a given target
+ * unlock time.
+ *
+ * The cache is continuously refined using the timings of "real" EnScrypt
+ * runs, which are being reported via \c addMeasurement(). Only interactive
+ * runs which had the \c KdfExecutor to themselves are reported, since
+ * batch jobs running in parallel compete for cores and memory bandwidth
+ * and would drag the cached throughput down.
+ *
+ * \sa CryptUtil
+ *
+*/
+
+const int EnScryptCalibration::MIN_LOGN_FACTOR = 1;
+const int EnScryptCalibration::MAX_LOGN_FACTOR = 16;
+const int EnScryptCalibration::MIN_RECOMMENDED_ITERATIONS = 10;
+const int EnScryptCalibration::DEFAULT_MEASURE_MILLISECONDS = 500;
+
+QMutex EnScryptCalibration::m_Mutex;
+QMap<int, double> EnScryptCalibration::m_IterationsPerSecond;
+bool EnScryptCalibration::m_bCacheLoaded = false;
+
+/*!
+ * Runs EnScrypt iterations using \a logNFactor for at least \a minMilliseconds
+ * milliseconds (but at least for one iteration) and returns the measured
+ * number of iterations per second.
+ *
+ * The result is not being stored in the cache. Use \c calibrate() for
+ * measuring and caching throughput values.
+ *
+ * Returns \c 0 if \a logNFactor is out of range or if the measurement failed.
+ */
+
+double EnScryptCalibration::measureIterationsPerSecond(int logNFactor, int minMilliseconds)
+{
+    if (logNFactor < MIN_LOGN_FACTOR || logNFactor > MAX_LOGN_FACTOR)
+        return 0.0;
+
+    QByteArray randomSalt(16, 0);
+    if (!CryptUtil::getRandomBytes(randomSalt)) return 0.0;
+
+    // Run a single iteration first, so that the scrypt scratch
+    // memory is already paged in once we start measuring
+    if (!runIteration(randomSalt, logNFactor)) return 0.0;
+
+    QElapsedTimer timer;
+    int iterationCount = 0;
+    timer.start();
+
+    do
+    {
+        if (!runIteration(randomSalt, logNFactor)) return 0.0;
+        iterationCount++;
+    }
+    while (timer.elapsed() < minMilliseconds);
+
+    qint64 elapsedNanoseconds = timer.nsecsElapsed();
+    if (elapsedNanoseconds <= 0) return 0.0;
+
+    return iterationCount * 1000000000.0 / elapsedNanoseconds;
+}
+
+/*!
+ * Returns the cached number of EnScrypt iterations per second for
+ * \a logNFactor.
+ *
+ * If no value is cached for \a logNFactor and \a measureIfUnknown is
+ * \c true, the throughput is being measured and cached. If \a measureIfUnknown
+ * is \c false, the value is extrapolated from the nearest cached log-n-factor
+ * instead (the cost of scrypt doubles with every increment of the
+ * log-n-factor).
+ *
+ * Returns \c 0 if no value is known or could be measured.
+ */
+
+double EnScryptCalibration::getIterationsPerSecond(int logNFactor, bool measureIfUnknown)
+{
+    double iterationsPerSecond = 0.0;
+
+    if (!isCacheLoaded()) loadCache();
+
+    m_Mutex.lock();
+    if (m_IterationsPerSecond.contains(logNFactor))
+        iterationsPerSecond = m_IterationsPerSecond.value(logNFactor);
+    m_Mutex.unlock();
+
+    if (iterationsPerSecond > 0) return iterationsPerSecond;
+
+    if (measureIfUnknown)
+    {
+        calibrate(QList<int>({ logNFactor }));
+
+        m_Mutex.lock();
+        iterationsPerSecond = m_IterationsPerSecond.value(logNFactor, 0.0);
+        m_Mutex.unlock();
+
+        return iterationsPerSecond;
+    }
+
+    return lookupIterationsPerSecond(logNFactor);
+}
+
+/*!
+ * Measures the EnScrypt throughput for every log-n-factor in \a logNFactors,
+ * running each measurement for at least \a minMilliseconds, and stores the
+ * results in the cache.
+ */
+
+void EnScryptCalibration::calibrate(QList<int> logNFactors, int minMilliseconds)
+{
+    if (!isCacheLoaded()) loadCache();
+
+    for (int logNFactor : logNFactors)
+    {
+        double iterationsPerSecond = measureIterationsPerSecond(logNFactor, minMilliseconds);
+        if (iterationsPerSecond <= 0) continue;
+
+        m_Mutex.lock();
+        m_IterationsPerSecond[logNFactor] = iterationsPerSecond;
+        m_Mutex.unlock();
+    }
+
+    saveCache();
+}
+
+/*!
+ * Refines the cached throughput for \a logNFactor using the timing of
+ * a "real" EnScrypt run, which performed \a iterationCount iterations
+ * in \a elapsedMilliseconds milliseconds.
+ *
+ * Runs shorter than 100 ms are being ignored since their timing is too
+ * imprecise to be useful. Callers must only report runs which were not
+ * competing with other KDF jobs for the CPU, otherwise the cache ends up
+ * underestimating the throughput of interactive runs.
+ */
+
+void EnScryptCalibration::addMeasurement(int logNFactor, int iterationCount, qint64 elapsedMilliseconds)
+{
+    if (iterationCount < 1 || elapsedMilliseconds < 100) return;
+    if (logNFactor < MIN_LOGN_FACTOR || logNFactor > MAX_LOGN_FACTOR) return;
+
+    double iterationsPerSecond = iterationCount * 1000.0 / elapsedMilliseconds;
+
+    m_Mutex.lock();
+    double cached = m_IterationsPerSecond.value(logNFactor, 0.0);
+
+    // Smooth out outliers by using a moving average
+    if (cached > 0) iterationsPerSecond = (cached + iterationsPerSecond) / 2;
+    m_IterationsPerSecond[logNFactor] = iterationsPerSecond;
+    m_Mutex.unlock();
+}
+
+/*!
+ * Returns the estimated number of milliseconds needed for running
+ * \a iterationCount EnScrypt iterations using \a logNFactor, or \c -1
+ * if no estimate is available.
+ *
+ * \sa getIterationsPerSecond()
+ */
+
+qint64 EnScryptCalibration::estimateMilliseconds(int logNFactor, int iterationCount, bool measureIfUnknown)
+{
+    double iterationsPerSecond = getIterationsPerSecond(logNFactor, measureIfUnknown);
+    if (iterationsPerSecond <= 0) return -1;
+
+    return qRound64(iterationCount * 1000.0 / iterationsPerSecond);
+}
+
+/*!
+ * Returns the number of EnScrypt iterations using \a logNFactor which
+ * will take approximately \a targetSeconds seconds on the current machine,
+ * or \c 0 if the throughput could not be determined.
+ */
+
+int EnScryptCalibration::recommendIterationCount(int logNFactor, int targetSeconds)
+{
+    double iterationsPerSecond = getIterationsPerSecond(logNFactor);
+    if (iterationsPerSecond <= 0) return 0;
+
+    return std::max(1, static_cast<int>(qRound64(iterationsPerSecond * targetSeconds)));
+}
+
+/*!
+ * Recommends EnScrypt parameters which will take approximately
+ * \a targetSeconds seconds to run on the current machine.
+ *
+ * The highest (most memory-hard) log-n-factor between \a minLogNFactor
+ * and \a maxLogNFactor which still allows for at least
+ * \c MIN_RECOMMENDED_ITERATIONS iterations is chosen. If no log-n-factor
+ * satisfies this condition, \a minLogNFactor is used.
+ *
+ * Upon success, the parameters are placed in \a logNFactor and
+ * \a iterationCount.
+ *
+ * \return Returns \c true on success, or \c false if the throughput could
+ * not be determined.
+ */
+
+bool EnScryptCalibration::recommendParameters(int& logNFactor, int& iterationCount, int targetSeconds,
+                                              int minLogNFactor, int maxLogNFactor)
+{
+    minLogNFactor = std::max(minLogNFactor, MIN_LOGN_FACTOR);
+    maxLogNFactor = std::min(maxLogNFactor, MAX_LOGN_FACTOR);
+    if (minLogNFactor > maxLogNFactor || targetSeconds < 1) return false;
+
+    for (int i=maxLogNFactor; i>=minLogNFactor; i--)
+    {
+        int iterations = recommendIterationCount(i, targetSeconds);
+
+        if (iterations >= MIN_RECOMMENDED_ITERATIONS || i == minLogNFactor)
+        {
+            if (iterations < 1) return false;
+
+            logNFactor = i;
+            iterationCount = iterations;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*!
+ * Returns a human-readable representation of the duration
+ * \a milliseconds, e.g. "1 min 12 s".
+ */
+
+QString EnScryptCalibration::formatDuration(qint64 milliseconds)
+{
+    qint64 seconds = (milliseconds + 500) / 1000;
+
+    if (seconds < 1) return QObject::tr("< 1 s");
+    if (seconds < 60) return QObject::tr("%1 s").arg(seconds);
+    if (seconds < 3600) return QObject::tr("%1 min %2 s").arg(seconds / 60).arg(seconds % 60);
+
+    return QObject::tr("%1 h %2 min").arg(seconds / 3600).arg((seconds % 3600) / 60);
+}
+
+/*!
+ * Returns a text table listing the EnScrypt throughput for each of
+ * the given \a logNFactors, along with the number of iterations needed
+ * for hitting each of the unlock times given in \a targetSeconds.
+ *
+ * Throughput values that are not cached yet are being measured.
+ */
+
+QString EnScryptCalibration::createThroughputTable(QList<int> logNFactors, QList<int> targetSeconds)
+{
+    QString result;
+
+    result += QString("%1 %2 %3 %4")
+            .arg("logN", 4)
+            .arg("Memory", 10)
+            .arg("Iter/s", 10)
+            .arg("ms/Iter", 10);
+
+    for (int seconds : targetSeconds)
+        result += QString(" %1").arg(QString("@%1s").arg(seconds), 8);
+
+    result += "\n";
+
+    for (int logNFactor : logNFactors)
+    {
+        double iterationsPerSecond = getIterationsPerSecond(logNFactor);
+
+        // scrypt needs 128 * r * N bytes of scratch memory
+        qint64 memoryKiB = (128LL * 256 * (1LL << logNFactor)) / 1024;
+        QString memory = memoryKiB >= 1024 ?
+                    QString("%1 MiB").arg(memoryKiB / 1024) :
+                    QString("%1 KiB").arg(memoryKiB);
+
+        result += QString("%1 %2 %3 %4")
+                .arg(logNFactor, 4)
+                .arg(memory, 10)
+                .arg(iterationsPerSecond, 10, 'f', 2)
+                .arg(iterationsPerSecond > 0 ? 1000.0 / iterationsPerSecond : 0.0, 10, 'f', 2);
+
+        for (int seconds : targetSeconds)
+            result += QString(" %1").arg(qRound64(iterationsPerSecond * seconds), 8);
+
+        result += "\n";
+    }
+
+    return result;
+}
+
+/*!
+ * Returns the full path of the on-disk calibration cache, or an empty
+ * string if no writable cache location is available.
+ */
+
+QString EnScryptCalibration::getCacheFileName()
+{
+    QString cacheDir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+    if (cacheDir.isEmpty()) return "";
+
+    return QDir(cacheDir).filePath("enscrypt-calibration.json");
+}
+
+/*!
+ * Loads cached throughput values from disk into memory. Values which were
+ * measured on a different machine are being ignored.
+ *
+ * Returns \c true if the cache file was found and successfully loaded.
+ */
+
+bool EnScryptCalibration::loadCache()
+{
+    QMap<int, double> values;
+    bool ok = readCacheFile(values);
+
+    // Only flag the cache as loaded once its values are in place,
+    // so that concurrent callers never see a partially loaded cache
+    m_Mutex.lock();
+    for (int logNFactor : values.keys())
+    {
+        if (!m_IterationsPerSecond.contains(logNFactor))
+            m_IterationsPerSecond[logNFactor] = values.value(logNFactor);
+    }
+    m_bCacheLoaded = true;
+    m_Mutex.unlock();
+
+    return ok;
+}
+
+/*!
+ * Writes the in-memory throughput cache to disk.
+ *
+ * Returns \c true on success, and \c false otherwise.
+ */
+
+bool EnScryptCalibration::saveCache()
+{
+    QString fileName = getCacheFileName();
+    if (fileName.isEmpty()) return false;
+
+    QJsonObject values;
+
+    m_Mutex.lock();
+    for (int logNFactor : m_IterationsPerSecond.keys())
+        values[QString::number(logNFactor)] = m_IterationsPerSecond.value(logNFactor);
+    m_Mutex.unlock();
+
+    QJsonObject json;
+    json["host"] = QSysInfo::machineHostName();
+    json["cpu"] = QSysInfo::currentCpuArchitecture();
+    json["iterations_per_second"] = values;
+
+    QDir().mkpath(QFileInfo(fileName).absolutePath());
+
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly)) return false;
+    file.write(QJsonDocument(json).toJson());
+    return file.commit();
+}
+
+/*!
+ * Clears the in-memory throughput cache.
+ */
+
+void EnScryptCalibration::clearCache()
+{
+    m_Mutex.lock();
+    m_IterationsPerSecond.clear();
+    m_Mutex.unlock();
+}
+
+/*!
+ * Returns \c true if the cache was already loaded from disk.
+ */
+
+bool EnScryptCalibration::isCacheLoaded()
+{
+    m_Mutex.lock();
+    bool cacheLoaded = m_bCacheLoaded;
+    m_Mutex.unlock();
+
+    return cacheLoaded;
+}
+
+/*!
+ * Reads the throughput values measured on the current machine from the
+ * cache file into \a values.
+ *
+ * Returns \c true if the cache file was found and successfully read.
+ */
+
+bool EnScryptCalibration::readCacheFile(QMap<int, double>& values)
+{
+    QString fileName = getCacheFileName();
+    if (fileName.isEmpty()) return false;
+
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) return false;
+    QByteArray data = file.readAll();
+    file.close();
+
+    QJsonParseError error;
+    QJsonDocument doc = QJsonDocument::fromJson(data, &error);
+    if (error.error != QJsonParseError::NoError) return false;
+
+    QJsonObject json = doc.object();
+    if (json["host"].toString() != QSysInfo::machineHostName() ||
+            json["cpu"].toString() != QSysInfo::currentCpuArchitecture())
+    {
+        return false;
+    }
+
+    QJsonObject jsonValues = json["iterations_per_second"].toObject();
+
+    for (QString key : jsonValues.keys())
+    {
+        bool ok = false;
+        int logNFactor = key.toInt(&ok);
+        double iterationsPerSecond = jsonValues[key].toDouble(0.0);
+
+        if (ok && iterationsPerSecond > 0) values[logNFactor] = iterationsPerSecond;
+    }
+
+    return true;
+}
+
+/*!
+ * Runs a single EnScrypt iteration (a single scrypt operation) on an empty
+ * password, using \a randomSalt and \a logNFactor, without reporting it
+ * to the cache via \c addMeasurement().
+ *
+ * Returns \c true on success, \c false otherwise.
+ */
+
+bool EnScryptCalibration::runIteration(QByteArray randomSalt, int logNFactor)
+{
+    const unsigned char password = 0;
+    unsigned char key[32];
+
+    return crypto_pwhash_scryptsalsa208sha256_ll(
+                &password,
+                0,
+                reinterpret_cast<const unsigned char*>(randomSalt.constData()),
+                static_cast<size_t>(randomSalt.length()),
+                1ULL << logNFactor,
+                256,
+                1,
+                key,
+                sizeof(key)) == 0;
+}
+
+/*!
+ * Returns the throughput for \a logNFactor, extrapolated from the
+ * nearest cached log-n-factor, or \c 0 if the cache is empty.
+ */
+
+double EnScryptCalibration::lookupIterationsPerSecond(int logNFactor)
+{
+    double result = 0.0;
+    int nearestDistance = -1;
+
+    m_Mutex.lock();
+    for (int cachedLogNFactor : m_IterationsPerSecond.keys())
+    {
+        int distance = std::abs(cachedLogNFactor - logNFactor);
+        if (nearestDistance != -1 && distance >= nearestDistance) continue;
+
+        nearestDistance = distance;
+        result = m_IterationsPerSecond.value(cachedLogNFactor) *
+                std::pow(2.0, cachedLogNFactor - logNFactor);
+    }
+    m_Mutex.unlock();
+
+    return result;
+}
@@ -0,0 +1,73 @@
+/*
+ * This file is part of the "IdTool" utility app.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Alexander Hauser
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef ENSCRYPTCALIBRATION_H
+#define ENSCRYPTCALIBRATION_H
+
+#include "corecommon.h"
+#include <QMutex>
+
+/**********************************************
+ *    class EnScryptCalibration               *
+ *********************************************/
+
+class EnScryptCalibration
+{
+public:
+    static const int MIN_LOGN_FACTOR;
+    static const int MAX_LOGN_FACTOR;
+    static const int MIN_RECOMMENDED_ITERATIONS;
+    static const int DEFAULT_MEASURE_MILLISECONDS;
+
+private:
+    static QMutex m_Mutex;
+    static QMap<int, double> m_IterationsPerSecond;
+    static bool m_bCacheLoaded;
+
+public:
+    static double measureIterationsPerSecond(int logNFactor, int minMilliseconds = DEFAULT_MEASURE_MILLISECONDS);
+    static double getIterationsPerSecond(int logNFactor, bool measureIfUnknown = true);
+    static void calibrate(QList<int> logNFactors, int minMilliseconds = DEFAULT_MEASURE_MILLISECONDS);
+    static void addMeasurement(int logNFactor, int iterationCount, qint64 elapsedMilliseconds);
+    static qint64 estimateMilliseconds(int logNFactor, int iterationCount, bool measureIfUnknown = true);
+    static int recommendIterationCount(int logNFactor, int targetSeconds);
+    static bool recommendParameters(int& logNFactor, int& iterationCount, int targetSeconds,
+                                    int minLogNFactor = 9, int maxLogNFactor = 9);
+    static QString formatDuration(qint64 milliseconds);
+    static QString createThroughputTable(QList<int> logNFactors, QList<int> targetSeconds = QList<int>({1, 5, 10}));
+    static QString getCacheFileName();
+    static bool loadCache();
+    static bool saveCache();
+    static void clearCache();
+
+private:
+    static bool isCacheLoaded();
+    static bool readCacheFile(QMap<int, double>& values);
+    static bool runIteration(QByteArray randomSalt, int logNFactor);
+    static double lookupIterationsPerSecond(int logNFactor);
+};
+
+#endif // ENSCRYPTCALIBRATION_H
@@ -71,6 +71,10 @@ IdentityClipboard* IdentityClipboard::getInstance()
 void IdentityClipboard::setBlock(IdentityBlock block)
 {
     m_block = block;
+    // Take a deep copy so the model's item list is not left shared,
+    // which would make it detach (and invalidate item pointers held
+    // by the UI) on its next modification.
+    m_block.items.detach();
     m_bHasBlock = true;
 }
 
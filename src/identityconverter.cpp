@@ -0,0 +1,443 @@
+/*
+ * This file is part of the "IdTool" utility app.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Alexander Hauser
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "identityconverter.h"
+#include "identityparser.h"
+#include "cryptutil.h"
+
+/*!
+ *
+ * \class IdentityConverter
+ * \brief Converts batches of identities between the binary, base64 and
+ * textual formats on a pool of worker threads.
+ *
+ * Identities can be stored in three formats: the binary S4 format
+ * (starting with "sqrldata"), its base64url-encoded form (starting with
+ * "SQRLDATA") and the textual base56 form, which only contains the
+ * blocks of type 2 and 3. \c detectFormat() determines the format of
+ * an identity, \c decode() turns it into its raw binary form and
+ * \c encode() produces any of the formats from the raw binary form.
+ *
+ * Conversions work directly on the binary block structure and don't
+ * require block definitions, since neither the base64 nor the textual
+ * encoding depends on the contents of the blocks.
+ *
+ * \c convert() processes a batch of jobs concurrently, but keeps the
+ * results in the order of the jobs. Each job either carries its input
+ * data or the name of the file to read it from. The time spent within
+ * the read, decode and encode stages is accumulated over all worker
+ * threads, and callers can add the time spent for writing the results
+ * using \c recordStage(), so that \c getStatsJson() can report the
+ * throughput of each stage.
+ *
+ * \sa IdentityConvertTask, IdentityParser
+ *
+*/
+
+/*!
+ * Creates a new \c IdentityConverter object producing \a outputFormat,
+ * running one worker thread per CPU core by default.
+ */
+
+IdentityConverter::IdentityConverter(Format outputFormat) :
+    m_OutputFormat(outputFormat)
+{
+    m_ThreadPool.setMaxThreadCount(QThread::idealThreadCount());
+}
+
+/*!
+ * Sets the maximum number of worker threads to \a threadCount. If
+ * \a threadCount is smaller than 1, one thread per CPU core is used.
+ */
+
+void IdentityConverter::setMaxThreadCount(int threadCount)
+{
+    if (threadCount < 1) threadCount = QThread::idealThreadCount();
+    m_ThreadPool.setMaxThreadCount(threadCount);
+}
+
+/*!
+ * Returns the maximum number of worker threads.
+ */
+
+int IdentityConverter::getMaxThreadCount()
+{
+    return m_ThreadPool.maxThreadCount();
+}
+
+/*!
+ * Converts all \a jobs concurrently and returns once all of them are
+ * done. For each job, the input is read from its file (if a file name
+ * is set), its format is detected and the converted identity is stored
+ * within the job's \c output. Failed jobs have their \c errorMessage
+ * set and an empty \c output. The inputs are released after conversion.
+ *
+ * Jobs are split into contiguous chunks, so that small identities don't
+ * cause one task per identity.
+ */
+
+void IdentityConverter::convert(QVector<Job>& jobs)
+{
+    if (jobs.isEmpty()) return;
+
+    // Detach in this thread, workers only access their own chunk
+    Job* pJobs = jobs.data();
+    int chunkSize = qMax(1, jobs.size() / (m_ThreadPool.maxThreadCount() * 4));
+
+    for (int i=0; i<jobs.size(); i+=chunkSize)
+    {
+        m_ThreadPool.start(new IdentityConvertTask(
+                               this, pJobs + i, qMin(chunkSize, jobs.size() - i)));
+    }
+
+    m_ThreadPool.waitForDone();
+}
+
+/*!
+ * Adds \a count identities with a total of \a bytes, which were
+ * processed within \a nsecs nanoseconds, to the statistics of \a stage.
+ */
+
+void IdentityConverter::recordStage(Stage stage, qint64 count, qint64 bytes, qint64 nsecs)
+{
+    QMutexLocker locker(&m_StatsMutex);
+
+    m_Stages[stage].count += count;
+    m_Stages[stage].bytes += bytes;
+    m_Stages[stage].nsecs += nsecs;
+}
+
+/*!
+ * Returns the accumulated statistics of \a stage.
+ */
+
+IdentityConverter::StageStats IdentityConverter::getStageStats(Stage stage)
+{
+    QMutexLocker locker(&m_StatsMutex);
+    return m_Stages[stage];
+}
+
+/*!
+ * Returns the statistics of all stages as JSON, with \a elapsedNsecs
+ * being the wall clock time of the whole conversion. The throughput of
+ * a stage is based on the time spent within it, summed up over all
+ * threads, and therefore describes the speed of a single thread.
+ */
+
+QJsonObject IdentityConverter::getStatsJson(qint64 elapsedNsecs)
+{
+    QJsonArray stages;
+    qint64 totalCount = 0;
+
+    for (int i=0; i<STAGE_COUNT; i++)
+    {
+        StageStats stats = getStageStats(static_cast<Stage>(i));
+        if (i == DECODE_STAGE) totalCount = stats.count;
+
+        double seconds = stats.nsecs / 1e9;
+        QJsonObject stage;
+        stage["stage"] = stageToString(static_cast<Stage>(i));
+        stage["count"] = stats.count;
+        stage["bytes"] = stats.bytes;
+        stage["busy_ms"] = stats.nsecs / 1e6;
+        stage["items_per_second"] = seconds > 0 ? stats.count / seconds : 0;
+        stage["mib_per_second"] = seconds > 0 ? stats.bytes / seconds / (1024 * 1024) : 0;
+        stages.append(stage);
+    }
+
+    double elapsedSeconds = elapsedNsecs / 1e9;
+    QJsonObject json;
+    json["threads"] = getMaxThreadCount();
+    json["elapsed_ms"] = elapsedNsecs / 1e6;
+    json["items_per_second"] = elapsedSeconds > 0 ? totalCount / elapsedSeconds : 0;
+    json["stages"] = stages;
+    return json;
+}
+
+/*!
+ * Returns the format of the identity \a data, or \c UNKNOWN_FORMAT if
+ * it is neither a binary nor a base64 identity and contains characters
+ * other than base56 characters and whitespace.
+ */
+
+IdentityConverter::Format IdentityConverter::detectFormat(const QByteArray& data)
+{
+    if (data.startsWith(IdentityParser::HEADER.toLatin1())) return BINARY;
+    if (data.startsWith(IdentityParser::HEADER_BASE64.toLatin1())) return BASE64;
+
+    bool hasBase56Chars = false;
+    for (char c : data)
+    {
+        if (c == ' ' || c == '\t' || c == '\r' || c == '\n') continue;
+        if (!CryptUtil::BASE56_ALPHABET.contains(c)) return UNKNOWN_FORMAT;
+        hasBase56Chars = true;
+    }
+
+    return hasBase56Chars ? TEXT : UNKNOWN_FORMAT;
+}
+
+/*!
+ * Decodes the identity \a data of the given \a format and returns the
+ * raw binary identity, including the "sqrldata" header. Identities in
+ * textual format only contain the blocks of type 2 and 3.
+ *
+ * \throws A \c std::runtime_error is raised if \a data is invalid.
+ */
+
+QByteArray IdentityConverter::decode(const QByteArray& data, Format format)
+{
+    QByteArray rawIdentity;
+
+    switch (format)
+    {
+    case BINARY:
+        rawIdentity = data;
+        break;
+    case BASE64:
+        rawIdentity = IdentityParser::base64DecodeIdentity(data.trimmed());
+        break;
+    case TEXT:
+        rawIdentity = CryptUtil::base56DecodeIdentity(QString::fromLatin1(data));
+        if (rawIdentity.isEmpty())
+        {
+            throw std::runtime_error(
+                        QObject::tr("Invalid textual identity!").toStdString());
+        }
+        rawIdentity.prepend(IdentityParser::HEADER.toLatin1());
+        break;
+    default:
+        throw std::runtime_error(
+                    QObject::tr("Unknown identity format!").toStdString());
+    }
+
+    if (rawIdentity.length() <= IdentityParser::HEADER.length())
+    {
+        throw std::runtime_error(
+                    QObject::tr("Identity contains no blocks!").toStdString());
+    }
+
+    return rawIdentity;
+}
+
+/*!
+ * Encodes the raw binary identity \a rawIdentity (including the
+ * "sqrldata" header) into \a format and returns the result, without
+ * a trailing newline.
+ *
+ * \throws A \c std::runtime_error is raised if the block structure of
+ * \a rawIdentity is invalid, or if \a format is \c TEXT and the
+ * identity contains no block of type 2.
+ */
+
+QByteArray IdentityConverter::encode(const QByteArray& rawIdentity, Format format)
+{
+    if (format == BINARY) return rawIdentity;
+
+    if (format == BASE64)
+    {
+        return IdentityParser::HEADER_BASE64.toLatin1() +
+                rawIdentity.mid(IdentityParser::HEADER.length()).toBase64(
+                    QByteArray::Base64UrlEncoding | QByteArray::OmitTrailingEquals);
+    }
+
+    if (format != TEXT)
+    {
+        throw std::runtime_error(
+                    QObject::tr("Unknown identity format!").toStdString());
+    }
+
+    // Like IdentityModel::getTextualVersion(), use the first blocks of
+    // type 2 and 3, but without parsing their contents
+    QByteArray block2, block3;
+    const uchar* data = reinterpret_cast<const uchar*>(rawIdentity.constData());
+    int offset = IdentityParser::HEADER.length();
+
+    while (offset + 4 <= rawIdentity.length())
+    {
+        int blockLength = data[offset] | (data[offset + 1] << 8);
+        int blockType = data[offset + 2] | (data[offset + 3] << 8);
+
+        if (blockLength < 4 || offset + blockLength > rawIdentity.length())
+        {
+            throw std::runtime_error(
+                        QObject::tr("Invalid block length at offset %1!")
+                        .arg(offset).toStdString());
+        }
+
+        if (blockType == 2 && block2.isEmpty()) block2 = rawIdentity.mid(offset, blockLength);
+        else if (blockType == 3 && block3.isEmpty()) block3 = rawIdentity.mid(offset, blockLength);
+
+        offset += blockLength;
+    }
+
+    if (block2.isEmpty())
+    {
+        throw std::runtime_error(
+                    QObject::tr("The identity does not contain a type 2 block!").toStdString());
+    }
+
+    return CryptUtil::base56EncodeIdentity(block2 + block3).toLatin1();
+}
+
+/*!
+ * Returns the name of \a format ("binary", "base64", "text" or "unknown").
+ */
+
+QString IdentityConverter::formatToString(Format format)
+{
+    switch (format)
+    {
+    case BINARY: return "binary";
+    case BASE64: return "base64";
+    case TEXT: return "text";
+    default: return "unknown";
+    }
+}
+
+/*!
+ * Returns the format named \a name, or \c UNKNOWN_FORMAT if there
+ * is no such format.
+ *
+ * \sa formatToString
+ */
+
+IdentityConverter::Format IdentityConverter::formatFromString(QString name)
+{
+    for (int i=0; i<UNKNOWN_FORMAT; i++)
+    {
+        if (formatToString(static_cast<Format>(i)) == name)
+            return static_cast<Format>(i);
+    }
+
+    return UNKNOWN_FORMAT;
+}
+
+/*!
+ * Returns the name of \a stage.
+ */
+
+QString IdentityConverter::stageToString(Stage stage)
+{
+    switch (stage)
+    {
+    case READ_STAGE: return "read";
+    case DECODE_STAGE: return "decode";
+    case ENCODE_STAGE: return "encode";
+    case WRITE_STAGE: return "write";
+    default: return "";
+    }
+}
+
+/*!
+ * Converts \a count jobs starting at \a jobs. Called on a worker thread.
+ */
+
+void IdentityConverter::convertJobs(Job* jobs, int count)
+{
+    StageStats stages[STAGE_COUNT];
+    QElapsedTimer timer;
+
+    for (int i=0; i<count; i++)
+    {
+        Job& job = jobs[i];
+
+        try
+        {
+            if (!job.fileName.isEmpty())
+            {
+                timer.start();
+                QFile file(job.fileName);
+                if (!file.open(QIODevice::ReadOnly))
+                {
+                    throw std::runtime_error(
+                                QObject::tr("Error opening file!").toStdString());
+                }
+                job.input = file.readAll();
+                stages[READ_STAGE].nsecs += timer.nsecsElapsed();
+                stages[READ_STAGE].bytes += job.input.size();
+                stages[READ_STAGE].count++;
+            }
+
+            timer.start();
+            job.inputFormat = detectFormat(job.input);
+            QByteArray rawIdentity = decode(job.input, job.inputFormat);
+            stages[DECODE_STAGE].nsecs += timer.nsecsElapsed();
+            stages[DECODE_STAGE].bytes += job.input.size();
+            stages[DECODE_STAGE].count++;
+
+            timer.start();
+            job.output = encode(rawIdentity, m_OutputFormat);
+            stages[ENCODE_STAGE].nsecs += timer.nsecsElapsed();
+            stages[ENCODE_STAGE].bytes += job.output.size();
+            stages[ENCODE_STAGE].count++;
+        }
+        catch (std::exception& e)
+        {
+            job.output.clear();
+            job.errorMessage = e.what();
+        }
+
+        job.input.clear();
+    }
+
+    for (int i=0; i<STAGE_COUNT; i++)
+    {
+        recordStage(static_cast<Stage>(i), stages[i].count, stages[i].bytes, stages[i].nsecs);
+    }
+}
+
+
+
+/*!
+ *
+ * \class IdentityConvertTask
+ * \brief A task converting a chunk of jobs for an \c IdentityConverter.
+ *
+ * \sa IdentityConverter
+ *
+*/
+
+/*!
+ * Creates a task converting \a count jobs starting at \a jobs
+ * for \a converter.
+ */
+
+IdentityConvertTask::IdentityConvertTask(IdentityConverter* converter,
+                                         IdentityConverter::Job* jobs, int count) :
+    m_pConverter(converter),
+    m_pJobs(jobs),
+    m_Count(count)
+{
+}
+
+/*!
+ * Runs the conversion.
+ */
+
+void IdentityConvertTask::run()
+{
+    m_pConverter->convertJobs(m_pJobs, m_Count);
+}
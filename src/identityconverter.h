@@ -0,0 +1,119 @@
+/*
+ * This file is part of the "IdTool" utility app.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Alexander Hauser
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef IDENTITYCONVERTER_H
+#define IDENTITYCONVERTER_H
+
+#include "corecommon.h"
+#include <QThreadPool>
+#include <QRunnable>
+#include <QMutex>
+
+/**********************************************
+ *    class IdentityConverter                 *
+ *********************************************/
+
+class IdentityConverter
+{
+public:
+    enum Format
+    {
+        BINARY,
+        BASE64,
+        TEXT,
+        UNKNOWN_FORMAT
+    };
+
+    enum Stage
+    {
+        READ_STAGE,
+        DECODE_STAGE,
+        ENCODE_STAGE,
+        WRITE_STAGE,
+        STAGE_COUNT
+    };
+
+    struct Job
+    {
+        QString name;
+        QString fileName;
+        QByteArray input;
+        QByteArray output;
+        Format inputFormat = UNKNOWN_FORMAT;
+        QString errorMessage;
+    };
+
+    struct StageStats
+    {
+        qint64 count = 0;
+        qint64 bytes = 0;
+        qint64 nsecs = 0;
+    };
+
+private:
+    Format m_OutputFormat;
+    QThreadPool m_ThreadPool;
+    QMutex m_StatsMutex;
+    StageStats m_Stages[STAGE_COUNT];
+
+public:
+    explicit IdentityConverter(Format outputFormat);
+    void setMaxThreadCount(int threadCount);
+    int getMaxThreadCount();
+    void convert(QVector<Job>& jobs);
+    void recordStage(Stage stage, qint64 count, qint64 bytes, qint64 nsecs);
+    StageStats getStageStats(Stage stage);
+    QJsonObject getStatsJson(qint64 elapsedNsecs);
+    static Format detectFormat(const QByteArray& data);
+    static QByteArray decode(const QByteArray& data, Format format);
+    static QByteArray encode(const QByteArray& rawIdentity, Format format);
+    static QString formatToString(Format format);
+    static Format formatFromString(QString name);
+    static QString stageToString(Stage stage);
+
+private:
+    void convertJobs(Job* jobs, int count);
+
+    friend class IdentityConvertTask;
+};
+
+/**********************************************
+ *    class IdentityConvertTask               *
+ *********************************************/
+
+class IdentityConvertTask : public QRunnable
+{
+private:
+    IdentityConverter* m_pConverter;
+    IdentityConverter::Job* m_pJobs;
+    int m_Count;
+
+public:
+    IdentityConvertTask(IdentityConverter* converter, IdentityConverter::Job* jobs, int count);
+    void run() override;
+};
+
+#endif // IDENTITYCONVERTER_H
@@ -0,0 +1,531 @@
+/*
+ * This file is part of the "IdTool" utility app.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Alexander Hauser
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "identitydiff.h"
+#include "cryptutil.h"
+#include "keycontext.h"
+#include <QThreadPool>
+
+/*!
+ *
+ * \class IdentityDiff
+ * \brief A headless engine for structurally comparing two identities.
+ *
+ * \c IdentityDiff compares two \c IdentityModel objects block by block
+ * and item by item. Blocks are matched by their block type, and items
+ * by their position within the block. Item values are compared on their
+ * raw binary representation, so that differences in formatting (e.g.
+ * the case of hex strings) are not reported as changes.
+ *
+ * The resulting \c IdentityDiff::Result is compact: it only holds block
+ * indexes and diff types, and item diff types only for changed blocks.
+ * Values are looked up in the compared identities when rendering or
+ * serializing the result (see \c toJson()).
+ *
+ * If the decrypted keys of both identities are given (see
+ * \c decryptKeys()), the keys are compared as well and the relationship
+ * of the identities (same identity, same lineage or unrelated) is
+ * derived from their current and previous IMKs.
+ *
+ * All methods are static and thread-safe, and \c compareAll() compares
+ * many pairs of identities in parallel.
+ *
+ * \sa DiffDialog, IdentityModel
+ *
+*/
+
+
+/*!
+ * Returns \c true if no differences were found, or \c false otherwise.
+ */
+
+bool IdentityDiff::Result::isEqual() const
+{
+    if (changedBlockCount > 0) return false;
+
+    for (const KeyDiff& keyDiff : keys)
+        if (keyDiff.diffType != EQUAL) return false;
+
+    return true;
+}
+
+/*!
+ * Returns the diff type of the item at \a itemIndex within the block
+ * diff at \a blockIndex.
+ */
+
+IdentityDiff::DiffType IdentityDiff::Result::itemDiffType(int blockIndex, int itemIndex) const
+{
+    const BlockDiff& blockDiff = blocks.at(blockIndex);
+    if (blockDiff.diffType != CHANGED) return blockDiff.diffType;
+
+    return blockDiff.itemDiffTypes.value(itemIndex, EQUAL);
+}
+
+/*!
+ * Compares the identities \a id1 and \a id2 and returns the result.
+ *
+ * If both \a keys1 and \a keys2 are given, the decrypted keys of the
+ * identities are compared as well, and their relationship is derived.
+ */
+
+IdentityDiff::Result IdentityDiff::compare(const IdentityModel& id1, const IdentityModel& id2,
+                                           const KeyInfo* keys1, const KeyInfo* keys2)
+{
+    Result result;
+
+    // Get a sorted list of all the block types which are
+    // present in either of the identities
+    QList<int> blockTypes;
+    for (const IdentityBlock& block : id1.blocks)
+        if (!blockTypes.contains(block.blockType)) blockTypes.append(block.blockType);
+    for (const IdentityBlock& block : id2.blocks)
+        if (!blockTypes.contains(block.blockType)) blockTypes.append(block.blockType);
+    std::sort(blockTypes.begin(), blockTypes.end());
+
+    for (int blockType : blockTypes)
+    {
+        BlockDiff blockDiff;
+        blockDiff.blockType = blockType;
+        blockDiff.blockIndex1 = indexOfBlockType(id1, blockType);
+        blockDiff.blockIndex2 = indexOfBlockType(id2, blockType);
+
+        if (blockDiff.blockIndex1 < 0)
+        {
+            blockDiff.diffType = ONLY_IN_SECOND;
+            result.changedItemCount += id2.blocks.at(blockDiff.blockIndex2).items.size();
+        }
+        else if (blockDiff.blockIndex2 < 0)
+        {
+            blockDiff.diffType = ONLY_IN_FIRST;
+            result.changedItemCount += id1.blocks.at(blockDiff.blockIndex1).items.size();
+        }
+        else
+        {
+            const QList<IdentityBlockItem>& items1 = id1.blocks.at(blockDiff.blockIndex1).items;
+            const QList<IdentityBlockItem>& items2 = id2.blocks.at(blockDiff.blockIndex2).items;
+            int itemCount = std::max(items1.size(), items2.size());
+            int changedItems = 0;
+            QVector<DiffType> itemDiffTypes(itemCount, EQUAL);
+
+            for (int i=0; i<itemCount; i++)
+            {
+                if (i >= items1.size()) itemDiffTypes[i] = ONLY_IN_SECOND;
+                else if (i >= items2.size()) itemDiffTypes[i] = ONLY_IN_FIRST;
+                else itemDiffTypes[i] = compareItems(items1.at(i), items2.at(i));
+
+                if (itemDiffTypes[i] != EQUAL) changedItems++;
+            }
+
+            if (changedItems > 0)
+            {
+                blockDiff.diffType = CHANGED;
+                blockDiff.itemDiffTypes = itemDiffTypes;
+                result.changedItemCount += changedItems;
+            }
+        }
+
+        if (blockDiff.diffType != EQUAL) result.changedBlockCount++;
+        result.blocks.append(blockDiff);
+    }
+
+    if (keys1 && keys2) compareKeys(result, *keys1, *keys2);
+
+    return result;
+}
+
+/*!
+ * Compares all pairs of identities in \a pairs in parallel, using
+ * \a threadCount threads (or one thread per CPU core if \a threadCount
+ * is smaller than \c 1), and returns the results in the order of
+ * \a pairs. Keys are not compared.
+ */
+
+QList<IdentityDiff::Result> IdentityDiff::compareAll(const QList<ModelPair>& pairs, int threadCount)
+{
+    QVector<Result> results(pairs.size());
+    QAtomicInt nextIndex(0);
+
+    if (threadCount < 1) threadCount = QThread::idealThreadCount();
+    threadCount = std::max(1, std::min(threadCount, pairs.size()));
+
+    // Each task takes the next unprocessed pair until all pairs are done,
+    // which balances the load without creating a task per pair
+    QThreadPool threadPool;
+    threadPool.setMaxThreadCount(threadCount);
+    for (int i=0; i<threadCount; i++)
+        threadPool.start(new IdentityDiffTask(&pairs, &results, &nextIndex));
+    threadPool.waitForDone();
+
+    return results.toList();
+}
+
+/*!
+ * Compares \a item1 and \a item2 and returns \c EQUAL if both items
+ * have the same raw binary representation, or \c CHANGED otherwise.
+ */
+
+IdentityDiff::DiffType IdentityDiff::compareItems(const IdentityBlockItem& item1,
+                                                  const IdentityBlockItem& item2)
+{
+    if (item1.dataType != item2.dataType) return CHANGED;
+    if (item1.value == item2.value) return EQUAL;
+
+    // Values without a binary representation can only be
+    // compared as strings
+    QByteArray raw1 = item1.toByteArray();
+    QByteArray raw2 = item2.toByteArray();
+    if (raw1.isEmpty() && raw2.isEmpty()) return CHANGED;
+
+    return raw1 == raw2 ? EQUAL : CHANGED;
+}
+
+/*!
+ * Derives the relationship of two identities from their decrypted keys
+ * \a keys1 and \a keys2.
+ *
+ * Identities with the same IMK are the same identity. If the IMK of one
+ * identity is a previous IMK of the other, or both share a previous
+ * IMK, the identities belong to the same lineage (e.g. one was re-keyed
+ * from the other). If \a firstPrecedesSecond or \a secondPrecedesFirst
+ * are given, they receive whether the respective identity is an earlier
+ * edition of the other one.
+ *
+ * Returns \c UNKNOWN_RELATIONSHIP if the IMK of either identity is unknown.
+ */
+
+IdentityDiff::Relationship IdentityDiff::relate(const KeyInfo& keys1, const KeyInfo& keys2,
+                                                bool* firstPrecedesSecond,
+                                                bool* secondPrecedesFirst)
+{
+    bool first = !keys1.imk.isEmpty() && keys2.previousImks.contains(keys1.imk);
+    bool second = !keys2.imk.isEmpty() && keys1.previousImks.contains(keys2.imk);
+    if (firstPrecedesSecond) *firstPrecedesSecond = first;
+    if (secondPrecedesFirst) *secondPrecedesFirst = second;
+
+    if (keys1.imk.isEmpty() || keys2.imk.isEmpty()) return UNKNOWN_RELATIONSHIP;
+    if (keys1.imk == keys2.imk) return SAME_IDENTITY;
+    if (first || second) return SAME_LINEAGE;
+
+    for (const QByteArray& previousImk : keys1.previousImks)
+        if (keys2.previousImks.contains(previousImk)) return SAME_LINEAGE;
+
+    return UNRELATED;
+}
+
+/*!
+ * Decrypts the keys of \a identity and places them into \a keys.
+ *
+ * If \a password is not empty, block 1 is decrypted to obtain the IMK
+ * and ILK, and the previous IUKs are decrypted from block 3 (if present).
+ * If \a rescueCode is not empty, block 2 is decrypted to obtain the IUK.
+ * If a valid \a progressSink pointer is given, it is used to publish
+ * the progress of the key derivation.
+ *
+ * Returns \c true on success. Otherwise, \c false is returned and a
+ * description of the error is placed into \a errorMessage, if given.
+ */
+
+bool IdentityDiff::decryptKeys(KeyInfo& keys, IdentityModel& identity, QString password,
+                               QString rescueCode, ProgressSink* progressSink,
+                               QString* errorMessage)
+{
+    keys = KeyInfo();
+    QString error;
+
+    if (!password.isEmpty())
+    {
+        IdentityBlock* pBlock1 = identity.getBlock(1);
+        IdentityBlock* pBlock3 = identity.getBlock(3);
+        QByteArray key(32, 0);
+        keys.imk = QByteArray(32, 0);
+        keys.ilk = QByteArray(32, 0);
+
+        if (!pBlock1)
+            error = QObject::tr("The identity has no block 1!");
+        else if (!CryptUtil::createKeyFromPassword(key, *pBlock1, password, progressSink))
+            error = QObject::tr("Deriving the key from the password failed or was aborted!");
+        else if (!CryptUtil::decryptBlock1(keys.imk, keys.ilk, pBlock1, key))
+            error = QObject::tr("Decryption of block 1 failed!");
+
+        if (error.isEmpty() && pBlock3)
+        {
+            KeyContext imkContext(keys.imk);
+            if (!CryptUtil::decryptBlock3(keys.previousIuks, pBlock3, imkContext))
+                error = QObject::tr("Decryption of block 3 failed!");
+
+            for (const QByteArray& previousIuk : keys.previousIuks)
+                keys.previousImks.append(CryptUtil::createImkFromIuk(previousIuk));
+        }
+    }
+
+    if (error.isEmpty() && !rescueCode.isEmpty())
+    {
+        IdentityBlock* pBlock2 = identity.getBlock(2);
+        keys.iuk = QByteArray(32, 0);
+
+        if (!pBlock2)
+            error = QObject::tr("The identity has no block 2!");
+        else if (!CryptUtil::decryptBlock2(keys.iuk, pBlock2, rescueCode, progressSink))
+            error = QObject::tr("Decryption of block 2 failed!");
+    }
+
+    if (error.isEmpty()) return true;
+
+    keys = KeyInfo();
+    if (errorMessage) *errorMessage = error;
+    return false;
+}
+
+/*!
+ * Returns the key of type \a keyType from \a keys. For previous IUKs,
+ * \a keyIndex selects the key. If the key is not present, an empty
+ * byte array is returned.
+ */
+
+QByteArray IdentityDiff::getKey(const KeyInfo& keys, KeyType keyType, int keyIndex)
+{
+    switch (keyType)
+    {
+    case IMK: return keys.imk;
+    case ILK: return keys.ilk;
+    case IUK: return keys.iuk;
+    case PREVIOUS_IUK: return keys.previousIuks.value(keyIndex);
+    }
+
+    return QByteArray();
+}
+
+/*!
+ * Returns a string representation of \a diffType, as being used
+ * by \c toJson().
+ */
+
+QString IdentityDiff::diffTypeToString(DiffType diffType)
+{
+    switch (diffType)
+    {
+    case EQUAL: return "equal";
+    case CHANGED: return "changed";
+    case ONLY_IN_FIRST: return "only_in_first";
+    case ONLY_IN_SECOND: return "only_in_second";
+    }
+
+    return QString();
+}
+
+/*!
+ * Returns a string representation of \a relationship, as being used
+ * by \c toJson().
+ */
+
+QString IdentityDiff::relationshipToString(Relationship relationship)
+{
+    switch (relationship)
+    {
+    case UNKNOWN_RELATIONSHIP: return "unknown";
+    case SAME_IDENTITY: return "same_identity";
+    case SAME_LINEAGE: return "same_lineage";
+    case UNRELATED: return "unrelated";
+    }
+
+    return QString();
+}
+
+/*!
+ * Serializes \a result, which was created by comparing \a id1 and \a id2,
+ * into a JSON object. Only differing blocks and items are included,
+ * unless \a includeEqual is \c true.
+ *
+ * Decrypted keys are never included, only whether they differ.
+ */
+
+QJsonObject IdentityDiff::toJson(const Result& result, const IdentityModel& id1,
+                                 const IdentityModel& id2, bool includeEqual)
+{
+    QJsonArray blocks;
+
+    for (int i=0; i<result.blocks.size(); i++)
+    {
+        const BlockDiff& blockDiff = result.blocks.at(i);
+        if (blockDiff.diffType == EQUAL && !includeEqual) continue;
+
+        const QList<IdentityBlockItem> noItems;
+        const QList<IdentityBlockItem>& items1 = blockDiff.blockIndex1 < 0 ? noItems :
+                id1.blocks.at(blockDiff.blockIndex1).items;
+        const QList<IdentityBlockItem>& items2 = blockDiff.blockIndex2 < 0 ? noItems :
+                id2.blocks.at(blockDiff.blockIndex2).items;
+
+        QJsonArray items;
+        int itemCount = std::max(items1.size(), items2.size());
+        for (int j=0; j<itemCount; j++)
+        {
+            DiffType diffType = result.itemDiffType(i, j);
+            if (diffType == EQUAL && !includeEqual) continue;
+
+            const IdentityBlockItem& item = j < items1.size() ? items1.at(j) : items2.at(j);
+            QJsonObject itemObject;
+            itemObject["index"] = j;
+            itemObject["name"] = item.name;
+            itemObject["diff"] = diffTypeToString(diffType);
+            if (j < items1.size()) itemObject["value1"] = items1.at(j).value;
+            if (j < items2.size()) itemObject["value2"] = items2.at(j).value;
+            items.append(itemObject);
+        }
+
+        QJsonObject blockObject;
+        blockObject["block_type"] = blockDiff.blockType;
+        blockObject["diff"] = diffTypeToString(blockDiff.diffType);
+        blockObject["items"] = items;
+        blocks.append(blockObject);
+    }
+
+    QJsonArray keys;
+    for (const KeyDiff& keyDiff : result.keys)
+    {
+        if (keyDiff.diffType == EQUAL && !includeEqual) continue;
+
+        static const char* keyNames[] = { "imk", "ilk", "iuk", "previous_iuk" };
+        QJsonObject keyObject;
+        keyObject["key"] = keyNames[keyDiff.keyType];
+        keyObject["index"] = keyDiff.keyIndex;
+        keyObject["diff"] = diffTypeToString(keyDiff.diffType);
+        keys.append(keyObject);
+    }
+
+    QJsonObject json;
+    json["equal"] = result.isEqual();
+    json["changed_blocks"] = result.changedBlockCount;
+    json["changed_items"] = result.changedItemCount;
+    json["relationship"] = relationshipToString(result.relationship);
+    if (result.firstPrecedesSecond) json["first_precedes_second"] = true;
+    if (result.secondPrecedesFirst) json["second_precedes_first"] = true;
+    json["blocks"] = blocks;
+    json["keys"] = keys;
+
+    return json;
+}
+
+/*!
+ * Returns the index of the first block of type \a blockType within
+ * \a identity, or \c -1 if the identity has no such block.
+ */
+
+int IdentityDiff::indexOfBlockType(const IdentityModel& identity, int blockType)
+{
+    for (int i=0; i<identity.blocks.size(); i++)
+        if (identity.blocks.at(i).blockType == blockType) return i;
+
+    return -1;
+}
+
+/*!
+ * Compares the decrypted keys \a keys1 and \a keys2, adds the key diffs
+ * to \a result and derives the identities' relationship.
+ *
+ * Each key diff is anchored to the item within its block after which the
+ * decrypted key is to be displayed: the IMK and ILK after their encrypted
+ * counterparts in block 1, the IUK after the encrypted IUK in block 2 and
+ * every previous IUK after its encrypted counterpart in block 3.
+ */
+
+void IdentityDiff::compareKeys(Result& result, const KeyInfo& keys1, const KeyInfo& keys2)
+{
+    if (!keys1.imk.isEmpty() || !keys2.imk.isEmpty())
+    {
+        result.keys.append({ 1, 11, IMK, 0, compareValues(keys1.imk, keys2.imk) });
+        result.keys.append({ 1, 12, ILK, 0, compareValues(keys1.ilk, keys2.ilk) });
+
+        int previousIukCount = std::max(keys1.previousIuks.size(), keys2.previousIuks.size());
+        for (int i=0; i<previousIukCount; i++)
+        {
+            result.keys.append({ 3, 3 + i, PREVIOUS_IUK, i,
+                                 compareValues(keys1.previousIuks.value(i),
+                                               keys2.previousIuks.value(i)) });
+        }
+    }
+
+    if (!keys1.iuk.isEmpty() || !keys2.iuk.isEmpty())
+        result.keys.append({ 2, 5, IUK, 0, compareValues(keys1.iuk, keys2.iuk) });
+
+    result.relationship = relate(keys1, keys2, &result.firstPrecedesSecond,
+                                 &result.secondPrecedesFirst);
+}
+
+/*!
+ * Compares two decrypted key values, treating empty values as missing.
+ */
+
+IdentityDiff::DiffType IdentityDiff::compareValues(const QByteArray& value1, const QByteArray& value2)
+{
+    if (value1.isEmpty() && !value2.isEmpty()) return ONLY_IN_SECOND;
+    if (!value1.isEmpty() && value2.isEmpty()) return ONLY_IN_FIRST;
+
+    return value1 == value2 ? EQUAL : CHANGED;
+}
+
+
+
+/*!
+ *
+ * \class IdentityDiffTask
+ * \brief A \c QRunnable comparing pairs of identities for
+ * \c IdentityDiff::compareAll().
+ *
+ * \sa IdentityDiff
+ *
+*/
+
+
+/*!
+ * Creates a new task which compares the pairs of identities within
+ * \a pairs, storing the results at the same index within \a results.
+ * \a nextIndex is shared by all tasks and holds the index of the next
+ * unprocessed pair.
+ */
+
+IdentityDiffTask::IdentityDiffTask(const QList<IdentityDiff::ModelPair>* pairs,
+                                   QVector<IdentityDiff::Result>* results,
+                                   QAtomicInt* nextIndex)
+{
+    m_pPairs = pairs;
+    m_pResults = results;
+    m_pNextIndex = nextIndex;
+}
+
+/*!
+ * Compares pairs until all pairs have been taken.
+ */
+
+void IdentityDiffTask::run()
+{
+    for (int i = m_pNextIndex->fetchAndAddRelaxed(1); i < m_pPairs->size();
+         i = m_pNextIndex->fetchAndAddRelaxed(1))
+    {
+        const IdentityDiff::ModelPair& pair = m_pPairs->at(i);
+        (*m_pResults)[i] = IdentityDiff::compare(*pair.first, *pair.second);
+    }
+}
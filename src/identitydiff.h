@@ -0,0 +1,149 @@
+/*
+ * This file is part of the "IdTool" utility app.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Alexander Hauser
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef IDENTITYDIFF_H
+#define IDENTITYDIFF_H
+
+#include "corecommon.h"
+#include "identitymodel.h"
+#include "progresssink.h"
+#include <QRunnable>
+
+/**********************************************
+ *    class IdentityDiff                      *
+ *********************************************/
+
+class IdentityDiff
+{
+public:
+    enum DiffType
+    {
+        EQUAL,
+        CHANGED,
+        ONLY_IN_FIRST,
+        ONLY_IN_SECOND
+    };
+
+    enum Relationship
+    {
+        UNKNOWN_RELATIONSHIP,
+        SAME_IDENTITY,
+        SAME_LINEAGE,
+        UNRELATED
+    };
+
+    enum KeyType
+    {
+        IMK,
+        ILK,
+        IUK,
+        PREVIOUS_IUK
+    };
+
+    struct KeyInfo
+    {
+        QByteArray imk;
+        QByteArray ilk;
+        QByteArray iuk;
+        QList<QByteArray> previousIuks;
+        QList<QByteArray> previousImks;
+    };
+
+    struct BlockDiff
+    {
+        int blockType = -1;
+        int blockIndex1 = -1;
+        int blockIndex2 = -1;
+        DiffType diffType = EQUAL;
+        QVector<DiffType> itemDiffTypes;
+    };
+
+    struct KeyDiff
+    {
+        int blockType;
+        int afterItemIndex;
+        KeyType keyType;
+        int keyIndex;
+        DiffType diffType;
+    };
+
+    struct Result
+    {
+        QList<BlockDiff> blocks;
+        QList<KeyDiff> keys;
+        Relationship relationship = UNKNOWN_RELATIONSHIP;
+        bool firstPrecedesSecond = false;
+        bool secondPrecedesFirst = false;
+        int changedBlockCount = 0;
+        int changedItemCount = 0;
+
+        bool isEqual() const;
+        DiffType itemDiffType(int blockIndex, int itemIndex) const;
+    };
+
+    typedef QPair<const IdentityModel*, const IdentityModel*> ModelPair;
+
+public:
+    static Result compare(const IdentityModel& id1, const IdentityModel& id2,
+                          const KeyInfo* keys1 = nullptr, const KeyInfo* keys2 = nullptr);
+    static QList<Result> compareAll(const QList<ModelPair>& pairs, int threadCount = 0);
+    static DiffType compareItems(const IdentityBlockItem& item1, const IdentityBlockItem& item2);
+    static Relationship relate(const KeyInfo& keys1, const KeyInfo& keys2,
+                               bool* firstPrecedesSecond = nullptr,
+                               bool* secondPrecedesFirst = nullptr);
+    static bool decryptKeys(KeyInfo& keys, IdentityModel& identity, QString password,
+                            QString rescueCode, ProgressSink* progressSink = nullptr,
+                            QString* errorMessage = nullptr);
+    static QByteArray getKey(const KeyInfo& keys, KeyType keyType, int keyIndex = 0);
+    static QString diffTypeToString(DiffType diffType);
+    static QString relationshipToString(Relationship relationship);
+    static QJsonObject toJson(const Result& result, const IdentityModel& id1,
+                              const IdentityModel& id2, bool includeEqual = false);
+
+private:
+    static int indexOfBlockType(const IdentityModel& identity, int blockType);
+    static void compareKeys(Result& result, const KeyInfo& keys1, const KeyInfo& keys2);
+    static DiffType compareValues(const QByteArray& value1, const QByteArray& value2);
+};
+
+/**********************************************
+ *    class IdentityDiffTask                  *
+ *********************************************/
+
+class IdentityDiffTask : public QRunnable
+{
+private:
+    const QList<IdentityDiff::ModelPair>* m_pPairs;
+    QVector<IdentityDiff::Result>* m_pResults;
+    QAtomicInt* m_pNextIndex;
+
+public:
+    IdentityDiffTask(const QList<IdentityDiff::ModelPair>* pairs,
+                     QVector<IdentityDiff::Result>* results, QAtomicInt* nextIndex);
+    void run() override;
+};
+
+#endif // IDENTITYDIFF_H
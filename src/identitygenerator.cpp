@@ -0,0 +1,491 @@
+/*
+ * This file is part of the "IdTool" utility app.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Alexander Hauser
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "identitygenerator.h"
+#include "cryptutil.h"
+#include "scryptkernel.h"
+#include <QtEndian>
+
+const int DeterministicRandom::SEED_LENGTH = randombytes_SEEDBYTES;
+const int DeterministicRandom::BUFFER_SIZE = 256;
+
+/*!
+ *
+ * \class DeterministicRandom
+ * \brief A reproducible stream of random bytes.
+ *
+ * The stream is produced by libsodium's \c randombytes_buf_deterministic()
+ * in blocks of 256 bytes, each one seeded with a keyed hash of the
+ * \c seed, the stream id and the block number. Different stream ids
+ * therefore yield independent streams from the same seed, which allows
+ * generating items in parallel and in any order while still getting the
+ * same results.
+ *
+ * \warning The output is only as secret as the seed. Never use it for
+ * real identities.
+ *
+*/
+
+/*!
+ * Creates a new random stream for \a seed and \a streamId. Seeds that
+ * are not \c SEED_LENGTH bytes long are hashed using \c createSeed().
+ */
+
+DeterministicRandom::DeterministicRandom(QByteArray seed, quint64 streamId) :
+    m_Seed(seed.size() == SEED_LENGTH ? seed : createSeed(seed)),
+    m_StreamId(streamId)
+{
+}
+
+/*!
+ * Returns the next \a count bytes of the stream.
+ */
+
+QByteArray DeterministicRandom::getBytes(int count)
+{
+    QByteArray result;
+    result.reserve(count);
+
+    while (result.size() < count)
+    {
+        if (m_Position >= m_Buffer.size()) refill();
+
+        int chunk = qMin(count - result.size(), m_Buffer.size() - m_Position);
+        result.append(m_Buffer.constData() + m_Position, chunk);
+        m_Position += chunk;
+    }
+
+    return result;
+}
+
+/*!
+ * Returns the next byte of the stream.
+ */
+
+unsigned char DeterministicRandom::getByte()
+{
+    if (m_Position >= m_Buffer.size()) refill();
+    return static_cast<unsigned char>(m_Buffer.at(m_Position++));
+}
+
+/*!
+ * Returns a uniformly distributed number between 0 and \a upperBound - 1,
+ * where \a upperBound must be between 1 and 256. Bytes which would bias
+ * the result are skipped.
+ */
+
+int DeterministicRandom::getUniform(int upperBound)
+{
+    int limit = 256 - 256 % upperBound;
+    int value;
+
+    do
+    {
+        value = getByte();
+    } while (value >= limit);
+
+    return value % upperBound;
+}
+
+/*!
+ * Returns a seed of \c SEED_LENGTH bytes derived from arbitrary \a data,
+ * such as a seed phrase given on the command line.
+ */
+
+QByteArray DeterministicRandom::createSeed(QByteArray data)
+{
+    QByteArray seed(SEED_LENGTH, 0);
+    crypto_generichash(reinterpret_cast<unsigned char*>(seed.data()), static_cast<size_t>(seed.size()),
+                       reinterpret_cast<const unsigned char*>(data.constData()),
+                       static_cast<unsigned long long>(data.size()), nullptr, 0);
+    return seed;
+}
+
+/*!
+ * Fills the buffer with the next block of the stream.
+ */
+
+void DeterministicRandom::refill()
+{
+    QByteArray message(16, 0);
+    qToLittleEndian<quint64>(m_StreamId, message.data());
+    qToLittleEndian<quint64>(m_BlockCounter++, message.data() + 8);
+
+    unsigned char blockSeed[randombytes_SEEDBYTES];
+    crypto_generichash(blockSeed, sizeof(blockSeed),
+                       reinterpret_cast<const unsigned char*>(message.constData()),
+                       static_cast<unsigned long long>(message.size()),
+                       reinterpret_cast<const unsigned char*>(m_Seed.constData()),
+                       static_cast<size_t>(m_Seed.size()));
+
+    m_Buffer.resize(BUFFER_SIZE);
+    randombytes_buf_deterministic(m_Buffer.data(), static_cast<size_t>(m_Buffer.size()), blockSeed);
+    m_Position = 0;
+}
+
+
+
+const int IdentityGenerator::PASSWORD_LENGTH = 16;
+const int IdentityGenerator::MAX_PREVIOUS_IUKS = 4;
+
+/*!
+ *
+ * \class IdentityGenerator
+ * \brief Generates reproducible identities in bulk, e.g. for test corpora.
+ *
+ * In contrast to \c CryptUtil::createIdentity(), which runs EnScrypt for
+ * five seconds per block and uses the system's random number generator,
+ * the generator runs a fixed number of EnScrypt iterations with a fixed
+ * log-n-factor, and draws all random values (IUK, rescue code, password,
+ * initialization vector, salts and previous IUKs) from a
+ * \c DeterministicRandom stream. The stream of each identity is selected
+ * by its index, so identity \c n is always the same for a given seed and
+ * parameters, no matter how many identities are generated at once or on
+ * how many threads.
+ *
+ * Every identity contains blocks 1 and 2, and a block 3 with up to four
+ * previous IUKs if \c setPreviousIukCount() is used.
+ *
+ * The identities are generated in chunks on a thread pool. The EnScrypt
+ * keys of a whole chunk are derived at once using
+ * \c CryptUtil::enScryptIterationsBatch(), which fills the lanes of the
+ * SIMD scrypt kernel and runs on the shared \c KdfExecutor, so that the
+ * scrypt scratch memory stays within the executor's memory budget no
+ * matter how many worker threads are used.
+ *
+ * \warning Generated identities are only as secret as the seed and must
+ * never be used as real identities.
+ *
+ * \sa IdentityGenerateTask, DeterministicRandom
+ *
+*/
+
+/*!
+ * Creates a new \c IdentityGenerator drawing its random values from
+ * \a seed and running \a iterationCount EnScrypt iterations with
+ * \a logNFactor per block. One worker thread per CPU core is used by
+ * default.
+ */
+
+IdentityGenerator::IdentityGenerator(QByteArray seed, int logNFactor, int iterationCount) :
+    m_Seed(seed),
+    m_LogNFactor(logNFactor),
+    m_IterationCount(iterationCount)
+{
+    m_ThreadPool.setMaxThreadCount(QThread::idealThreadCount());
+}
+
+/*!
+ * Encrypts all identities under \a password instead of a random
+ * password. The random password is still drawn from the stream, so
+ * the keys of the identities don't depend on this setting.
+ */
+
+void IdentityGenerator::setPassword(QString password)
+{
+    m_Password = password;
+}
+
+/*!
+ * Adds a block 3 with \a count previous IUKs to each identity. A
+ * \a count of \c 0 omits block 3. The count is limited to
+ * \c MAX_PREVIOUS_IUKS.
+ */
+
+void IdentityGenerator::setPreviousIukCount(int count)
+{
+    m_PreviousIukCount = qBound(0, count, MAX_PREVIOUS_IUKS);
+}
+
+/*!
+ * Sets the maximum number of worker threads to \a threadCount. If
+ * \a threadCount is smaller than 1, one thread per CPU core is used.
+ */
+
+void IdentityGenerator::setMaxThreadCount(int threadCount)
+{
+    if (threadCount < 1) threadCount = QThread::idealThreadCount();
+    m_ThreadPool.setMaxThreadCount(threadCount);
+}
+
+/*!
+ * Returns the maximum number of worker threads.
+ */
+
+int IdentityGenerator::getMaxThreadCount()
+{
+    return m_ThreadPool.maxThreadCount();
+}
+
+/*!
+ * Generates \a count identities, starting at index \a firstIndex,
+ * concurrently and returns them in the order of their index. Failed
+ * identities have their \c errorMessage set and no \c rawIdentity.
+ *
+ * If a valid \a progressSink pointer is given, the number of generated
+ * identities is published to it. The sink is only ever accessed from the
+ * calling thread, which polls the workers' progress, so any sink can be
+ * used. If the sink is or gets canceled, the identities that were not
+ * started yet are skipped and marked as failed.
+ */
+
+QVector<IdentityGenerator::Identity> IdentityGenerator::generate(int firstIndex, int count,
+                                                                 ProgressSink* progressSink)
+{
+    QVector<Identity> identities(qMax(0, count));
+    if (identities.isEmpty()) return identities;
+
+    // Detach in this thread, workers only access their own chunk
+    Identity* pIdentities = identities.data();
+    for (int i=0; i<identities.size(); i++) pIdentities[i].index = firstIndex + i;
+
+    // Every identity runs two EnScrypt chains, and a chunk should at
+    // least fill all lanes of the scrypt kernel
+    int laneCount = ScryptKernel::getLaneCount(ScryptKernel::detectImplementation());
+    int chunkSize = qMax(qMax(1, laneCount / 2),
+                         identities.size() / (m_ThreadPool.maxThreadCount() * 4));
+    m_CompletedCount.storeRelease(0);
+    m_Canceled.storeRelease(0);
+
+    if (progressSink != nullptr)
+    {
+        progressSink->setProgressMaximum(identities.size());
+        if (progressSink->isCanceled()) m_Canceled.storeRelease(1);
+    }
+
+    for (int i=0; i<identities.size(); i+=chunkSize)
+    {
+        m_ThreadPool.start(new IdentityGenerateTask(
+                               this, pIdentities + i, qMin(chunkSize, identities.size() - i)));
+    }
+
+    if (progressSink == nullptr)
+    {
+        m_ThreadPool.waitForDone();
+        return identities;
+    }
+
+    while (!m_ThreadPool.waitForDone(ThrottledProgressSink::DEFAULT_INTERVAL_MS))
+    {
+        progressSink->setProgressValue(m_CompletedCount.loadAcquire());
+        if (progressSink->isCanceled()) m_Canceled.storeRelease(1);
+    }
+
+    progressSink->setProgressValue(m_CompletedCount.loadAcquire());
+    return identities;
+}
+
+/*!
+ * Generates the identity with \a index.
+ */
+
+IdentityGenerator::Identity IdentityGenerator::generateIdentity(int index)
+{
+    Identity result;
+    result.index = index;
+
+    deriveIdentities(&result, 1);
+    return result;
+}
+
+/*!
+ * Generates \a count identities starting at \a identities, using the
+ * index already set in each of them. Called on a worker thread.
+ */
+
+void IdentityGenerator::generateIdentities(Identity* identities, int count)
+{
+    if (m_Canceled.loadAcquire() != 0)
+    {
+        for (int i=0; i<count; i++) identities[i].errorMessage = QObject::tr("Canceled!");
+        return;
+    }
+
+    deriveIdentities(identities, count);
+    m_CompletedCount.fetchAndAddRelease(count);
+}
+
+/*!
+ * Generates \a count identities starting at \a identities, deriving the
+ * EnScrypt keys of all of them in a single batch.
+ */
+
+void IdentityGenerator::deriveIdentities(Identity* identities, int count)
+{
+    if (sodium_init() < 0)
+    {
+        for (int i=0; i<count; i++)
+            identities[i].errorMessage = QObject::tr("Error initializing the crypto library!");
+        return;
+    }
+
+    QVector<KeyMaterial> materials(count);
+    QStringList passwords;
+    QList<QByteArray> salts;
+    QList<int> iterationCounts;
+
+    for (int i=0; i<count; i++)
+    {
+        materials[i] = drawKeyMaterial(identities[i]);
+        passwords << identities[i].password << identities[i].rescueCode;
+        salts << materials[i].block1Salt << materials[i].block2Salt;
+        iterationCounts << m_IterationCount << m_IterationCount;
+    }
+
+    QList<QByteArray> keys;
+    if (!CryptUtil::enScryptIterationsBatch(keys, passwords, salts, m_LogNFactor, iterationCounts))
+    {
+        for (int i=0; i<count; i++)
+            identities[i].errorMessage = QObject::tr("Error running EnScrypt!");
+        return;
+    }
+
+    for (int i=0; i<count; i++)
+        createBlocks(identities[i], materials[i], keys[2*i], keys[2*i+1]);
+}
+
+/*!
+ * Draws the random values of \a identity from its stream, placing the
+ * rescue code and password into \a identity and returning all keys,
+ * salts and the initialization vector.
+ */
+
+IdentityGenerator::KeyMaterial IdentityGenerator::drawKeyMaterial(Identity& identity)
+{
+    // The order in which the values are drawn defines the identities
+    // of a seed, so it must never change
+    DeterministicRandom random(m_Seed, static_cast<quint64>(identity.index));
+    KeyMaterial material;
+    material.iuk = random.getBytes(32);
+    identity.rescueCode = createRescueCode(random);
+    identity.password = createPassword(random);
+    material.initVec = random.getBytes(12);
+    material.block1Salt = random.getBytes(16);
+    material.block2Salt = random.getBytes(16);
+    for (int i=0; i<m_PreviousIukCount; i++) material.previousIuks.append(random.getBytes(32));
+
+    if (!m_Password.isEmpty()) identity.password = m_Password;
+    return material;
+}
+
+/*!
+ * Creates the blocks of \a identity from \a material, encrypting block 1
+ * under \a block1Key and block 2 under \a block2Key, and places the
+ * raw identity into \a identity.
+ */
+
+void IdentityGenerator::createBlocks(Identity& identity, const KeyMaterial& material,
+                                     QByteArray block1Key, QByteArray block2Key)
+{
+    IdentityModel model;
+    model.blocks.append(CryptUtil::encryptBlock1(material.iuk, block1Key, material.initVec,
+                                                 material.block1Salt, m_LogNFactor, m_IterationCount));
+    model.blocks.append(CryptUtil::encryptBlock2(material.iuk, block2Key, material.block2Salt,
+                                                 m_LogNFactor, m_IterationCount));
+    if (!material.previousIuks.isEmpty())
+    {
+        model.blocks.append(CryptUtil::createBlock3(material.previousIuks,
+                                                    CryptUtil::createImkFromIuk(material.iuk)));
+    }
+
+    for (const IdentityBlock& block : model.blocks)
+    {
+        if (block.items.isEmpty())
+        {
+            identity.errorMessage = QObject::tr("Error creating the identity blocks!");
+            return;
+        }
+    }
+
+    identity.rawIdentity = model.getRawBytes();
+}
+
+/*!
+ * Draws a 24 digit rescue code from \a random, following the same
+ * scheme as \c CryptUtil::createNewRescueCode().
+ */
+
+QString IdentityGenerator::createRescueCode(DeterministicRandom& random)
+{
+    QString rescueCode;
+
+    for (int i=0; i<12; i++)
+    {
+        rescueCode.append(QString("%1").arg(random.getUniform(100), 2, 10, QChar('0')));
+    }
+
+    return rescueCode;
+}
+
+/*!
+ * Draws a password of \c PASSWORD_LENGTH base56 characters from \a random.
+ */
+
+QString IdentityGenerator::createPassword(DeterministicRandom& random)
+{
+    QString password;
+
+    for (int i=0; i<PASSWORD_LENGTH; i++)
+    {
+        password.append(QLatin1Char(CryptUtil::BASE56_ALPHABET.at(
+                                        random.getUniform(CryptUtil::BASE56_BASE_NUM))));
+    }
+
+    return password;
+}
+
+
+
+/*!
+ *
+ * \class IdentityGenerateTask
+ * \brief A task generating a chunk of identities for an \c IdentityGenerator.
+ *
+ * \sa IdentityGenerator
+ *
+*/
+
+/*!
+ * Creates a task generating \a count identities starting at
+ * \a identities for \a generator.
+ */
+
+IdentityGenerateTask::IdentityGenerateTask(IdentityGenerator* generator,
+                                           IdentityGenerator::Identity* identities, int count) :
+    m_pGenerator(generator),
+    m_pIdentities(identities),
+    m_Count(count)
+{
+}
+
+/*!
+ * Runs the generation.
+ */
+
+void IdentityGenerateTask::run()
+{
+    m_pGenerator->generateIdentities(m_pIdentities, m_Count);
+}
@@ -0,0 +1,137 @@
+/*
+ * This file is part of the "IdTool" utility app.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Alexander Hauser
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef IDENTITYGENERATOR_H
+#define IDENTITYGENERATOR_H
+
+#include "corecommon.h"
+#include "progresssink.h"
+#include <QThreadPool>
+#include <QRunnable>
+
+/**********************************************
+ *    class DeterministicRandom               *
+ *********************************************/
+
+class DeterministicRandom
+{
+public:
+    static const int SEED_LENGTH;
+
+private:
+    static const int BUFFER_SIZE;
+    QByteArray m_Seed;
+    quint64 m_StreamId;
+    quint64 m_BlockCounter = 0;
+    QByteArray m_Buffer;
+    int m_Position = 0;
+
+public:
+    DeterministicRandom(QByteArray seed, quint64 streamId = 0);
+    QByteArray getBytes(int count);
+    unsigned char getByte();
+    int getUniform(int upperBound);
+    static QByteArray createSeed(QByteArray data);
+
+private:
+    void refill();
+};
+
+/**********************************************
+ *    class IdentityGenerator                 *
+ *********************************************/
+
+class IdentityGenerator
+{
+public:
+    static const int PASSWORD_LENGTH;
+    static const int MAX_PREVIOUS_IUKS;
+
+    struct Identity
+    {
+        int index = 0;
+        QByteArray rawIdentity;
+        QString password;
+        QString rescueCode;
+        QString errorMessage;
+    };
+
+private:
+    struct KeyMaterial
+    {
+        QByteArray iuk;
+        QByteArray initVec;
+        QByteArray block1Salt;
+        QByteArray block2Salt;
+        QList<QByteArray> previousIuks;
+    };
+
+    QByteArray m_Seed;
+    int m_LogNFactor;
+    int m_IterationCount;
+    int m_PreviousIukCount = 0;
+    QString m_Password;
+    QThreadPool m_ThreadPool;
+    QAtomicInt m_CompletedCount;
+    QAtomicInt m_Canceled;
+
+public:
+    IdentityGenerator(QByteArray seed, int logNFactor, int iterationCount);
+    void setPassword(QString password);
+    void setPreviousIukCount(int count);
+    void setMaxThreadCount(int threadCount);
+    int getMaxThreadCount();
+    QVector<Identity> generate(int firstIndex, int count, ProgressSink* progressSink = nullptr);
+    Identity generateIdentity(int index);
+
+private:
+    void generateIdentities(Identity* identities, int count);
+    void deriveIdentities(Identity* identities, int count);
+    KeyMaterial drawKeyMaterial(Identity& identity);
+    void createBlocks(Identity& identity, const KeyMaterial& material, QByteArray block1Key, QByteArray block2Key);
+    static QString createRescueCode(DeterministicRandom& random);
+    static QString createPassword(DeterministicRandom& random);
+
+    friend class IdentityGenerateTask;
+};
+
+/**********************************************
+ *    class IdentityGenerateTask              *
+ *********************************************/
+
+class IdentityGenerateTask : public QRunnable
+{
+private:
+    IdentityGenerator* m_pGenerator;
+    IdentityGenerator::Identity* m_pIdentities;
+    int m_Count;
+
+public:
+    IdentityGenerateTask(IdentityGenerator* generator, IdentityGenerator::Identity* identities, int count);
+    void run() override;
+};
+
+#endif // IDENTITYGENERATOR_H
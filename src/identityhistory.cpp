@@ -0,0 +1,383 @@
+/*
+ * This file is part of the "IdTool" utility app.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Alexander Hauser
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "identityhistory.h"
+
+/*!
+ *
+ * \class IdentityHistory
+ * \brief Keeps an undo/redo history of an \c IdentityModel.
+ *
+ * Every recorded state is a snapshot holding one shared, immutable
+ * copy per identity block. \c IdentityHistory observes the model and
+ * tracks which blocks were changed since the last recorded state, so
+ * that a new snapshot only copies those blocks and shares all other
+ * blocks with the previous state. Recording a change therefore costs
+ * a copy of the touched blocks instead of a copy of the whole identity.
+ *
+ * Snapshots are restored into the existing model, using
+ * \c IdentityModel::updateBlock() for changed blocks if the block count
+ * did not change, so that views only need to update the affected blocks.
+ *
+ * \sa IdentityModel, IdentityModelObserver
+ *
+*/
+
+
+/*!
+ * Creates a new \c IdentityHistory for \a identityModel, keeping at
+ * most \a maxSteps undo steps. The current state of the model is
+ * recorded as the initial state.
+ */
+
+IdentityHistory::IdentityHistory(IdentityModel* identityModel, int maxSteps)
+{
+    m_pModel = identityModel;
+    m_MaxSteps = maxSteps;
+
+    if (m_pModel) m_pModel->addObserver(this);
+    clear();
+}
+
+/*!
+ * Destroys the \c IdentityHistory and unregisters it from the model.
+ */
+
+IdentityHistory::~IdentityHistory()
+{
+    if (m_pModel) m_pModel->removeObserver(this);
+}
+
+/*!
+ * Records the current state of the model as a new undo step, discarding
+ * all redo steps. Does nothing if the model was not changed since the
+ * last recorded state.
+ *
+ * Returns \c true if a new step was recorded, or \c false otherwise.
+ */
+
+bool IdentityHistory::record()
+{
+    if (!m_pModel || !m_bChanged) return false;
+
+    Snapshot snapshot = takeSnapshot();
+
+    while (m_Snapshots.size() > m_Index + 1)
+        m_Snapshots.removeLast();
+
+    m_Snapshots.append(snapshot);
+    m_Index = m_Snapshots.size() - 1;
+
+    while (m_Snapshots.size() > m_MaxSteps + 1)
+    {
+        m_Snapshots.removeFirst();
+        m_Index--;
+    }
+
+    return true;
+}
+
+/*!
+ * Restores the previously recorded state. Changes that were not yet
+ * recorded are recorded first, so that they can be redone.
+ *
+ * Returns \c true if a state was restored, or \c false otherwise.
+ */
+
+bool IdentityHistory::undo()
+{
+    record();
+    if (!canUndo()) return false;
+
+    m_Index--;
+    restore(m_Snapshots[m_Index]);
+    return true;
+}
+
+/*!
+ * Restores the state that was undone last.
+ *
+ * Returns \c true if a state was restored, or \c false otherwise.
+ */
+
+bool IdentityHistory::redo()
+{
+    if (!canRedo()) return false;
+
+    m_Index++;
+    restore(m_Snapshots[m_Index]);
+    return true;
+}
+
+/*!
+ * Returns \c true if there is a state that \c undo() can restore,
+ * or \c false otherwise.
+ */
+
+bool IdentityHistory::canUndo()
+{
+    return m_Index > 0 || m_bChanged;
+}
+
+/*!
+ * Returns \c true if there is a state that \c redo() can restore,
+ * or \c false otherwise.
+ */
+
+bool IdentityHistory::canRedo()
+{
+    return !m_bChanged && m_Index < m_Snapshots.size() - 1;
+}
+
+/*!
+ * Discards all undo and redo steps and records the current state of
+ * the model as the initial state.
+ */
+
+void IdentityHistory::clear()
+{
+    m_Snapshots.clear();
+    m_Current.clear();
+
+    if (m_pModel)
+    {
+        for (int i=0; i<m_pModel->blocks.size(); i++)
+            m_Current.append(SharedBlock());
+    }
+
+    m_bChanged = true;
+    m_Snapshots.append(takeSnapshot());
+    m_Index = 0;
+}
+
+/*!
+ * Returns the number of recorded states, including the initial state.
+ */
+
+int IdentityHistory::getStepCount()
+{
+    return m_Snapshots.size();
+}
+
+/*!
+ * Returns the index of the recorded state the model currently
+ * corresponds to.
+ */
+
+int IdentityHistory::getCurrentStep()
+{
+    return m_Index;
+}
+
+/*!
+ * Returns the snapshot of the recorded state at index \a step.
+ */
+
+const IdentityHistory::Snapshot& IdentityHistory::getSnapshot(int step)
+{
+    return m_Snapshots.at(step);
+}
+
+/*!
+ * Creates a snapshot of the model's current state, copying all blocks
+ * that were changed since the last snapshot and sharing the others.
+ */
+
+IdentityHistory::Snapshot IdentityHistory::takeSnapshot()
+{
+    if (!m_pModel) return Snapshot();
+
+    for (int i=0; i<m_Current.size(); i++)
+    {
+        if (!m_Current[i].isNull()) continue;
+
+        IdentityBlock* pCopy = new IdentityBlock(m_pModel->blocks.at(i));
+
+        // Detach the copy, so that the live item list stays unshared
+        // and pointers into it remain valid
+        pCopy->items.detach();
+        m_Current[i] = SharedBlock(pCopy);
+    }
+
+    m_bChanged = false;
+    return m_Current;
+}
+
+/*!
+ * Restores the model's state from \a snapshot and notifies all other
+ * observers about the changes.
+ */
+
+void IdentityHistory::restore(const Snapshot& snapshot)
+{
+    m_bRestoring = true;
+
+    if (snapshot.size() == m_pModel->blocks.size())
+    {
+        for (int i=0; i<snapshot.size(); i++)
+        {
+            if (snapshot[i] == m_Current[i]) continue;
+            m_pModel->updateBlock(&m_pModel->blocks[i], *snapshot[i]);
+        }
+    }
+    else
+    {
+        QList<IdentityBlock> blocks;
+        for (const SharedBlock& block : snapshot)
+        {
+            blocks.append(*block);
+            blocks.last().items.detach();
+        }
+
+        m_pModel->blocks = blocks;
+        m_pModel->blocks.detach();
+        m_pModel->notifyModelReset();
+    }
+
+    m_Current = snapshot;
+    m_bChanged = false;
+    m_bRestoring = false;
+}
+
+/*!
+ * Marks the block at \a blockIndex as changed since the last snapshot.
+ */
+
+void IdentityHistory::markChanged(int blockIndex)
+{
+    if (blockIndex < 0 || blockIndex >= m_Current.size()) return;
+
+    m_Current[blockIndex].clear();
+    m_bChanged = true;
+}
+
+/*!
+ * Tracks the insertion of a new block at \a blockIndex.
+ */
+
+void IdentityHistory::blockInserted(int blockIndex)
+{
+    if (m_bRestoring) return;
+
+    m_Current.insert(blockIndex, SharedBlock());
+    m_bChanged = true;
+}
+
+/*!
+ * Tracks the removal of the block at \a blockIndex.
+ */
+
+void IdentityHistory::blockRemoved(int blockIndex)
+{
+    if (m_bRestoring) return;
+
+    m_Current.removeAt(blockIndex);
+    m_bChanged = true;
+}
+
+/*!
+ * Tracks the move of a block from \a fromIndex to \a toIndex.
+ * The moved block itself stays unchanged and remains shared.
+ */
+
+void IdentityHistory::blockMoved(int fromIndex, int toIndex)
+{
+    if (m_bRestoring) return;
+
+    m_Current.move(fromIndex, toIndex);
+    m_bChanged = true;
+}
+
+/*!
+ * Tracks a change to the block at \a blockIndex.
+ */
+
+void IdentityHistory::blockChanged(int blockIndex)
+{
+    if (m_bRestoring) return;
+    markChanged(blockIndex);
+}
+
+/*!
+ * Tracks the insertion of an item into the block at \a blockIndex.
+ */
+
+void IdentityHistory::itemInserted(int blockIndex, int itemIndex)
+{
+    Q_UNUSED(itemIndex);
+    if (m_bRestoring) return;
+    markChanged(blockIndex);
+}
+
+/*!
+ * Tracks the removal of an item from the block at \a blockIndex.
+ */
+
+void IdentityHistory::itemRemoved(int blockIndex, int itemIndex)
+{
+    Q_UNUSED(itemIndex);
+    if (m_bRestoring) return;
+    markChanged(blockIndex);
+}
+
+/*!
+ * Tracks the move of an item within the block at \a blockIndex.
+ */
+
+void IdentityHistory::itemMoved(int blockIndex, int fromIndex, int toIndex)
+{
+    Q_UNUSED(fromIndex);
+    Q_UNUSED(toIndex);
+    if (m_bRestoring) return;
+    markChanged(blockIndex);
+}
+
+/*!
+ * Tracks a changed item value within the block at \a blockIndex.
+ */
+
+void IdentityHistory::itemChanged(int blockIndex, int itemIndex)
+{
+    Q_UNUSED(itemIndex);
+    if (m_bRestoring) return;
+    markChanged(blockIndex);
+}
+
+/*!
+ * Marks all blocks as changed after the model was reset or changed
+ * in an unknown way.
+ */
+
+void IdentityHistory::modelReset()
+{
+    if (m_bRestoring || !m_pModel) return;
+
+    m_Current.clear();
+    for (int i=0; i<m_pModel->blocks.size(); i++)
+        m_Current.append(SharedBlock());
+
+    m_bChanged = true;
+}
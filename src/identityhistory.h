@@ -0,0 +1,84 @@
+/*
+ * This file is part of the "IdTool" utility app.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Alexander Hauser
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef IDENTITYHISTORY_H
+#define IDENTITYHISTORY_H
+
+#include "corecommon.h"
+#include "identitymodel.h"
+
+/**********************************************
+ *    class IdentityHistory                   *
+ *********************************************/
+
+class IdentityHistory : public IdentityModelObserver
+{
+public:
+    static const int DEFAULT_MAX_STEPS = 100;
+
+    typedef QSharedPointer<const IdentityBlock> SharedBlock;
+    typedef QList<SharedBlock> Snapshot;
+
+private:
+    IdentityModel* m_pModel = nullptr;
+    QList<Snapshot> m_Snapshots;
+    Snapshot m_Current;
+    int m_Index = 0;
+    int m_MaxSteps = DEFAULT_MAX_STEPS;
+    bool m_bChanged = false;
+    bool m_bRestoring = false;
+
+public:
+    explicit IdentityHistory(IdentityModel* identityModel, int maxSteps = DEFAULT_MAX_STEPS);
+    ~IdentityHistory() override;
+    bool record();
+    bool undo();
+    bool redo();
+    bool canUndo();
+    bool canRedo();
+    void clear();
+    int getStepCount();
+    int getCurrentStep();
+    const Snapshot& getSnapshot(int step);
+
+    // IdentityModelObserver
+    void blockInserted(int blockIndex) override;
+    void blockRemoved(int blockIndex) override;
+    void blockMoved(int fromIndex, int toIndex) override;
+    void blockChanged(int blockIndex) override;
+    void itemInserted(int blockIndex, int itemIndex) override;
+    void itemRemoved(int blockIndex, int itemIndex) override;
+    void itemMoved(int blockIndex, int fromIndex, int toIndex) override;
+    void itemChanged(int blockIndex, int itemIndex) override;
+    void modelReset() override;
+
+private:
+    Snapshot takeSnapshot();
+    void restore(const Snapshot& snapshot);
+    void markChanged(int blockIndex);
+};
+
+#endif // IDENTITYHISTORY_H
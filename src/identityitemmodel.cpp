@@ -0,0 +1,406 @@
+/*
+ * This file is part of the "IdTool" utility app.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Alexander Hauser
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "identityitemmodel.h"
+
+/*!
+ *
+ * \class IdentityItemModel
+ * \brief A \c QAbstractItemModel adapter exposing an \c IdentityModel
+ * to Qt's item views.
+ *
+ * Blocks are represented as top-level rows and their items as child
+ * rows. The adapter does not copy any identity data. It observes the
+ * underlying \c IdentityModel and translates its change notifications
+ * into the respective row insertions, removals, moves and data changes,
+ * so that views only need to repaint the affected (and visible) rows.
+ *
+ * Child indexes carry a pointer to their parent \c IdentityBlock, which
+ * stays valid while blocks are inserted, removed or moved around it.
+ *
+ * \sa IdentityModel, IdentityTreeView
+ *
+*/
+
+/*!
+ * Creates a new \c IdentityItemModel for \a identityModel, using
+ * \a parent as the parent object, and registers it as an observer
+ * of \a identityModel.
+ */
+
+IdentityItemModel::IdentityItemModel(IdentityModel* identityModel, QObject* parent) :
+    QAbstractItemModel(parent)
+{
+    m_pModel = identityModel;
+    if (m_pModel) m_pModel->addObserver(this);
+}
+
+/*!
+ * Unregisters the adapter from the underlying identity model.
+ */
+
+IdentityItemModel::~IdentityItemModel()
+{
+    if (m_pModel) m_pModel->removeObserver(this);
+}
+
+/*!
+ * Returns the underlying \c IdentityModel.
+ */
+
+IdentityModel* IdentityItemModel::getModel()
+{
+    return m_pModel;
+}
+
+/*!
+ * Sets whether actions for unauthenticated changes (editing values and
+ * the block and item options menus) should be offered to views.
+ * If \a enable is \c true, they are being offered.
+ */
+
+void IdentityItemModel::setEnableUnauthenticatedChanges(bool enable)
+{
+    if (m_bEnableUnauthenticatedChanges == enable) return;
+    m_bEnableUnauthenticatedChanges = enable;
+
+    // Only the available actions change, so no reset is required
+    for (int i=0; i<rowCount(); i++)
+    {
+        QModelIndex blockIndex = index(i, NAME_COLUMN);
+        emit dataChanged(blockIndex, blockIndex, QVector<int>() << ACTIONS_ROLE);
+
+        int itemCount = rowCount(blockIndex);
+        if (itemCount == 0) continue;
+
+        emit dataChanged(index(0, ACTIONS_COLUMN, blockIndex),
+                         index(itemCount - 1, ACTIONS_COLUMN, blockIndex),
+                         QVector<int>() << ACTIONS_ROLE);
+    }
+}
+
+/*!
+ * Returns \c true if \a index represents an identity block, or \c false
+ * if it represents a block item or is invalid.
+ */
+
+bool IdentityItemModel::isBlockIndex(const QModelIndex& index) const
+{
+    return index.isValid() && index.internalPointer() == nullptr;
+}
+
+/*!
+ * Returns the \c IdentityBlock represented by \a index, or the parent
+ * block if \a index represents an item. Returns \c nullptr if \a index
+ * is invalid.
+ */
+
+IdentityBlock* IdentityItemModel::getBlock(const QModelIndex& index) const
+{
+    if (!index.isValid() || !m_pModel) return nullptr;
+
+    if (isBlockIndex(index))
+    {
+        if (index.row() >= m_pModel->blocks.size()) return nullptr;
+        return &m_pModel->blocks[index.row()];
+    }
+
+    return static_cast<IdentityBlock*>(index.internalPointer());
+}
+
+/*!
+ * Returns the \c IdentityBlockItem represented by \a index, or
+ * \c nullptr if \a index does not represent a block item.
+ */
+
+IdentityBlockItem* IdentityItemModel::getItem(const QModelIndex& index) const
+{
+    if (!index.isValid() || isBlockIndex(index)) return nullptr;
+
+    IdentityBlock* pBlock = static_cast<IdentityBlock*>(index.internalPointer());
+    if (index.row() >= pBlock->items.size()) return nullptr;
+
+    return &pBlock->items[index.row()];
+}
+
+/*!
+ * Converts the CSS color specification \a color used within block
+ * definitions (e.g. "rgb(214, 201, 163)" or "#d6c9a3") into a \c QColor.
+ * Returns an invalid \c QColor if \a color cannot be parsed.
+ */
+
+QColor IdentityItemModel::parseColor(QString color)
+{
+    static QHash<QString, QColor> cache;
+
+    auto iter = cache.constFind(color);
+    if (iter != cache.constEnd()) return iter.value();
+
+    QColor result;
+    QRegularExpression rgbRegex(
+                "^\\s*rgba?\\(\\s*(\\d+)\\s*,\\s*(\\d+)\\s*,\\s*(\\d+)\\s*(?:,\\s*([\\d.]+)\\s*)?\\)\\s*$");
+    QRegularExpressionMatch match = rgbRegex.match(color);
+
+    if (match.hasMatch())
+    {
+        result = QColor(match.captured(1).toInt(),
+                        match.captured(2).toInt(),
+                        match.captured(3).toInt());
+
+        if (!match.captured(4).isEmpty())
+            result.setAlphaF(match.captured(4).toDouble());
+    }
+    else
+    {
+        result = QColor(color.trimmed());
+    }
+
+    cache.insert(color, result);
+    return result;
+}
+
+QModelIndex IdentityItemModel::index(int row, int column, const QModelIndex& parent) const
+{
+    if (!m_pModel || row < 0 || column < 0 || column >= COLUMN_COUNT)
+        return QModelIndex();
+
+    if (!parent.isValid())
+    {
+        if (row >= m_pModel->blocks.size()) return QModelIndex();
+        return createIndex(row, column, nullptr);
+    }
+
+    if (!isBlockIndex(parent) || parent.row() >= m_pModel->blocks.size())
+        return QModelIndex();
+
+    IdentityBlock* pBlock = &m_pModel->blocks[parent.row()];
+    if (row >= pBlock->items.size()) return QModelIndex();
+
+    return createIndex(row, column, pBlock);
+}
+
+QModelIndex IdentityItemModel::parent(const QModelIndex& index) const
+{
+    if (!index.isValid() || isBlockIndex(index) || !m_pModel)
+        return QModelIndex();
+
+    int blockIndex = m_pModel->indexOfBlock(
+                static_cast<IdentityBlock*>(index.internalPointer()));
+    if (blockIndex < 0) return QModelIndex();
+
+    return createIndex(blockIndex, NAME_COLUMN, nullptr);
+}
+
+int IdentityItemModel::rowCount(const QModelIndex& parent) const
+{
+    if (!m_pModel) return 0;
+    if (!parent.isValid()) return m_pModel->blocks.size();
+    if (!isBlockIndex(parent) || parent.column() != NAME_COLUMN) return 0;
+    if (parent.row() >= m_pModel->blocks.size()) return 0;
+
+    return m_pModel->blocks[parent.row()].items.size();
+}
+
+int IdentityItemModel::columnCount(const QModelIndex& parent) const
+{
+    Q_UNUSED(parent)
+    return COLUMN_COUNT;
+}
+
+QVariant IdentityItemModel::data(const QModelIndex& index, int role) const
+{
+    if (isBlockIndex(index))
+    {
+        IdentityBlock* pBlock = getBlock(index);
+        if (!pBlock || index.column() != NAME_COLUMN) return QVariant();
+
+        switch (role)
+        {
+        case Qt::DisplayRole:
+            return pBlock->description;
+        case Qt::ToolTipRole:
+            return tr("Block type %1").arg(pBlock->blockType);
+        case BLOCK_COLOR_ROLE:
+            return parseColor(pBlock->color);
+        case ACTIONS_ROLE:
+            return m_bEnableUnauthenticatedChanges ? OPTIONS_ACTION : NO_ACTION;
+        default:
+            return QVariant();
+        }
+    }
+
+    IdentityBlockItem* pItem = getItem(index);
+    if (!pItem) return QVariant();
+
+    switch (index.column())
+    {
+    case NAME_COLUMN:
+        if (role == Qt::DisplayRole) return pItem->name;
+        if (role == Qt::ToolTipRole) return pItem->description;
+        if (role == Qt::DecorationRole)
+        {
+            static const QIcon infoIcon(":/res/img/InfoRule_16x.png");
+            return infoIcon;
+        }
+        break;
+
+    case VALUE_COLUMN:
+        if (role == Qt::DisplayRole)
+        {
+            if (pItem->value.length() > 50)
+                return pItem->value.left(18) + "..." + pItem->value.right(18);
+            return pItem->value;
+        }
+        if (role == Qt::ToolTipRole) return pItem->value;
+        break;
+
+    case ACTIONS_COLUMN:
+        if (role == ACTIONS_ROLE)
+        {
+            int actions = COPY_ACTION;
+            if (m_bEnableUnauthenticatedChanges) actions |= EDIT_ACTION | OPTIONS_ACTION;
+            return actions;
+        }
+        break;
+    }
+
+    return QVariant();
+}
+
+Qt::ItemFlags IdentityItemModel::flags(const QModelIndex& index) const
+{
+    if (!index.isValid()) return Qt::NoItemFlags;
+    return Qt::ItemIsEnabled | Qt::ItemIsSelectable;
+}
+
+void IdentityItemModel::blockAboutToBeInserted(int blockIndex)
+{
+    beginInsertRows(QModelIndex(), blockIndex, blockIndex);
+}
+
+void IdentityItemModel::blockInserted(int blockIndex)
+{
+    Q_UNUSED(blockIndex)
+    endInsertRows();
+}
+
+void IdentityItemModel::blockAboutToBeRemoved(int blockIndex)
+{
+    beginRemoveRows(QModelIndex(), blockIndex, blockIndex);
+}
+
+void IdentityItemModel::blockRemoved(int blockIndex)
+{
+    Q_UNUSED(blockIndex)
+    endRemoveRows();
+}
+
+void IdentityItemModel::blockAboutToBeMoved(int fromIndex, int toIndex)
+{
+    // Qt expects the destination row in terms of the state before the move
+    int destination = toIndex > fromIndex ? toIndex + 1 : toIndex;
+
+    m_bMovingRows = beginMoveRows(QModelIndex(), fromIndex, fromIndex,
+                                  QModelIndex(), destination);
+}
+
+void IdentityItemModel::blockMoved(int fromIndex, int toIndex)
+{
+    Q_UNUSED(fromIndex)
+    Q_UNUSED(toIndex)
+
+    if (m_bMovingRows) endMoveRows();
+    m_bMovingRows = false;
+}
+
+void IdentityItemModel::blockChanged(int blockIndex)
+{
+    // Item insertions and removals have already been announced
+    // separately, so only the data of the block and its items changed
+    QModelIndex parent = index(blockIndex, NAME_COLUMN);
+    emit dataChanged(parent, parent);
+
+    int itemCount = rowCount(parent);
+    if (itemCount == 0) return;
+
+    emit dataChanged(index(0, NAME_COLUMN, parent),
+                     index(itemCount - 1, COLUMN_COUNT - 1, parent));
+}
+
+void IdentityItemModel::itemAboutToBeInserted(int blockIndex, int itemIndex)
+{
+    beginInsertRows(index(blockIndex, NAME_COLUMN), itemIndex, itemIndex);
+}
+
+void IdentityItemModel::itemInserted(int blockIndex, int itemIndex)
+{
+    Q_UNUSED(blockIndex)
+    Q_UNUSED(itemIndex)
+    endInsertRows();
+}
+
+void IdentityItemModel::itemAboutToBeRemoved(int blockIndex, int itemIndex)
+{
+    beginRemoveRows(index(blockIndex, NAME_COLUMN), itemIndex, itemIndex);
+}
+
+void IdentityItemModel::itemRemoved(int blockIndex, int itemIndex)
+{
+    Q_UNUSED(blockIndex)
+    Q_UNUSED(itemIndex)
+    endRemoveRows();
+}
+
+void IdentityItemModel::itemAboutToBeMoved(int blockIndex, int fromIndex, int toIndex)
+{
+    QModelIndex parent = index(blockIndex, NAME_COLUMN);
+    int destination = toIndex > fromIndex ? toIndex + 1 : toIndex;
+
+    m_bMovingRows = beginMoveRows(parent, fromIndex, fromIndex, parent, destination);
+}
+
+void IdentityItemModel::itemMoved(int blockIndex, int fromIndex, int toIndex)
+{
+    Q_UNUSED(blockIndex)
+    Q_UNUSED(fromIndex)
+    Q_UNUSED(toIndex)
+
+    if (m_bMovingRows) endMoveRows();
+    m_bMovingRows = false;
+}
+
+void IdentityItemModel::itemChanged(int blockIndex, int itemIndex)
+{
+    QModelIndex parent = index(blockIndex, NAME_COLUMN);
+    emit dataChanged(index(itemIndex, NAME_COLUMN, parent),
+                     index(itemIndex, COLUMN_COUNT - 1, parent));
+}
+
+void IdentityItemModel::modelReset()
+{
+    beginResetModel();
+    endResetModel();
+}
@@ -0,0 +1,105 @@
+/*
+ * This file is part of the "IdTool" utility app.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Alexander Hauser
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef IDENTITYITEMMODEL_H
+#define IDENTITYITEMMODEL_H
+
+#include "common.h"
+#include "identitymodel.h"
+
+/**********************************************
+ *    class IdentityItemModel                 *
+ *********************************************/
+
+class IdentityItemModel : public QAbstractItemModel, public IdentityModelObserver
+{
+    Q_OBJECT
+
+public:
+    enum Column
+    {
+        NAME_COLUMN,
+        VALUE_COLUMN,
+        ACTIONS_COLUMN,
+        COLUMN_COUNT
+    };
+
+    enum Role
+    {
+        BLOCK_COLOR_ROLE = Qt::UserRole + 1,
+        ACTIONS_ROLE
+    };
+
+    enum Action
+    {
+        NO_ACTION = 0x0,
+        COPY_ACTION = 0x1,
+        EDIT_ACTION = 0x2,
+        OPTIONS_ACTION = 0x4
+    };
+
+private:
+    IdentityModel* m_pModel = nullptr;
+    bool m_bEnableUnauthenticatedChanges = false;
+    bool m_bMovingRows = false;
+
+public:
+    explicit IdentityItemModel(IdentityModel* identityModel, QObject* parent = nullptr);
+    ~IdentityItemModel() override;
+    IdentityModel* getModel();
+    void setEnableUnauthenticatedChanges(bool enable);
+    bool isBlockIndex(const QModelIndex& index) const;
+    IdentityBlock* getBlock(const QModelIndex& index) const;
+    IdentityBlockItem* getItem(const QModelIndex& index) const;
+    static QColor parseColor(QString color);
+
+    // QAbstractItemModel
+    QModelIndex index(int row, int column, const QModelIndex& parent = QModelIndex()) const override;
+    QModelIndex parent(const QModelIndex& index) const override;
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex& parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+    Qt::ItemFlags flags(const QModelIndex& index) const override;
+
+    // IdentityModelObserver
+    void blockAboutToBeInserted(int blockIndex) override;
+    void blockInserted(int blockIndex) override;
+    void blockAboutToBeRemoved(int blockIndex) override;
+    void blockRemoved(int blockIndex) override;
+    void blockAboutToBeMoved(int fromIndex, int toIndex) override;
+    void blockMoved(int fromIndex, int toIndex) override;
+    void blockChanged(int blockIndex) override;
+    void itemAboutToBeInserted(int blockIndex, int itemIndex) override;
+    void itemInserted(int blockIndex, int itemIndex) override;
+    void itemAboutToBeRemoved(int blockIndex, int itemIndex) override;
+    void itemRemoved(int blockIndex, int itemIndex) override;
+    void itemAboutToBeMoved(int blockIndex, int fromIndex, int toIndex) override;
+    void itemMoved(int blockIndex, int fromIndex, int toIndex) override;
+    void itemChanged(int blockIndex, int itemIndex) override;
+    void modelReset() override;
+};
+
+#endif // IDENTITYITEMMODEL_H
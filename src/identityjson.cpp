@@ -0,0 +1,386 @@
+/*
+ * This file is part of the "IdTool" utility app.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Alexander Hauser
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "identityjson.h"
+#include <cmath>
+
+/*!
+ *
+ * \class IdentityJson
+ * \brief Converts identities to and from a canonical JSON representation.
+ *
+ * The canonical representation of an \c IdentityModel is a JSON object
+ * holding a \c format_version, an optional \c source (e.g. the file name
+ * the identity was read from) and the list of \c blocks. Each block
+ * carries its type, the metadata from its block definition template
+ * (description and color) and its items. Each item carries its name,
+ * description, data type, size, repeat information and its value.
+ *
+ * Item values are typed: \c UINT_8, \c UINT_16 and \c UINT_32 values are
+ * written as JSON numbers, byte arrays as hex strings and strings as-is.
+ * Values which cannot be represented exactly as a number (e.g. invalid
+ * values entered in "unauthenticated" edit mode) are kept as strings, so
+ * that \c fromJson() reproduces an identical model and \c getRawBytes()
+ * yields byte-exactly the same S4 data as before the export.
+ *
+ * Since \c QJsonObject keeps its keys sorted, the output is deterministic
+ * for equal identities.
+ *
+ * \sa IdentityJsonWriter, IdentityJsonReader
+ *
+*/
+
+const int IdentityJson::FORMAT_VERSION = 1;
+
+/*!
+ * Returns the canonical JSON representation of \a identity. If \a source
+ * is not empty, it is being stored within the \c source key.
+ */
+
+QJsonObject IdentityJson::toJson(const IdentityModel& identity, QString source)
+{
+    QJsonArray blocks;
+
+    for (const IdentityBlock& block : identity.blocks)
+    {
+        QJsonArray items;
+        for (const IdentityBlockItem& item : block.items)
+        {
+            QJsonObject itemObject;
+            itemObject["name"] = item.name;
+            itemObject["description"] = item.description;
+            itemObject["type"] = IdentityBlockItem::DataTypeMap.value(item.dataType).name;
+            itemObject["bytes"] = item.nrOfBytes;
+            itemObject["value"] = itemValueToJson(item);
+            itemObject["repeat_index"] = item.repeatIndex;
+            itemObject["repeat_count"] = item.repeatCount;
+            items.append(itemObject);
+        }
+
+        QJsonObject blockObject;
+        blockObject["type"] = block.blockType;
+        blockObject["description"] = block.description;
+        blockObject["color"] = block.color;
+        blockObject["items"] = items;
+        blocks.append(blockObject);
+    }
+
+    QJsonObject json;
+    json["format_version"] = FORMAT_VERSION;
+    if (!source.isEmpty()) json["source"] = source;
+    json["blocks"] = blocks;
+    return json;
+}
+
+/*!
+ * Creates an identity from its canonical JSON representation \a json.
+ * If \a source is not \c nullptr, it receives the value of the \c source
+ * key (or an empty string if there is none).
+ *
+ * \throws A \c std::runtime_error is raised if \a json is not a valid
+ * canonical identity representation.
+ */
+
+IdentityModel IdentityJson::fromJson(const QJsonObject& json, QString* source)
+{
+    int formatVersion = json["format_version"].toInt(-1);
+    if (formatVersion < 1 || formatVersion > FORMAT_VERSION)
+    {
+        throw std::runtime_error(
+                    QObject::tr("Missing or unsupported format version!").toStdString());
+    }
+
+    if (!json["blocks"].isArray())
+    {
+        throw std::runtime_error(
+                    QObject::tr("Missing block list!").toStdString());
+    }
+
+    IdentityModel identity;
+    const QJsonArray blocks = json["blocks"].toArray();
+
+    for (const QJsonValue& blockValue : blocks)
+    {
+        QJsonObject blockObject = blockValue.toObject();
+        if (!blockObject["type"].isDouble() || !blockObject["items"].isArray())
+        {
+            throw std::runtime_error(
+                        QObject::tr("Invalid block at index %1!")
+                        .arg(identity.blocks.size()).toStdString());
+        }
+
+        IdentityBlock block;
+        block.blockType = blockObject["type"].toInt();
+        block.description = blockObject["description"].toString();
+        block.color = blockObject["color"].toString(block.color);
+
+        const QJsonArray items = blockObject["items"].toArray();
+        for (const QJsonValue& itemValue : items)
+        {
+            QJsonObject itemObject = itemValue.toObject();
+            QString dataTypeName = itemObject["type"].toString();
+            ItemDataType dataType = IdentityBlockItem::findDataType(dataTypeName);
+
+            if (dataType == ItemDataType::UNDEFINED &&
+                    dataTypeName != IdentityBlockItem::DataTypeMap.value(ItemDataType::UNDEFINED).name)
+            {
+                throw std::runtime_error(
+                            QObject::tr("Invalid data type \"%1\" in block %2!")
+                            .arg(dataTypeName).arg(block.blockType).toStdString());
+            }
+
+            IdentityBlockItem item;
+            item.name = itemObject["name"].toString();
+            item.description = itemObject["description"].toString();
+            item.dataType = dataType;
+            item.nrOfBytes = itemObject["bytes"].toInt();
+            item.value = itemValueFromJson(itemObject["value"], dataType);
+            item.repeatIndex = itemObject["repeat_index"].toInt(-1);
+            item.repeatCount = itemObject["repeat_count"].toInt(1);
+            block.items.append(item);
+        }
+
+        identity.blocks.append(block);
+    }
+
+    if (source != nullptr) *source = json["source"].toString();
+    return identity;
+}
+
+/*!
+ * Returns the canonical JSON representation of \a identity as a single,
+ * compact line of UTF-8 encoded JSON, terminated by a newline character.
+ *
+ * \sa toJson
+ */
+
+QByteArray IdentityJson::toJsonLine(const IdentityModel& identity, QString source)
+{
+    return QJsonDocument(toJson(identity, source)).toJson(QJsonDocument::Compact) + '\n';
+}
+
+/*!
+ * Returns the typed JSON value of \a item.
+ */
+
+QJsonValue IdentityJson::itemValueToJson(const IdentityBlockItem& item)
+{
+    if (item.dataType == UINT_8 || item.dataType == UINT_16 || item.dataType == UINT_32)
+    {
+        // Only use a number if converting it back yields the same string
+        bool ok = false;
+        qint64 number = item.value.toLongLong(&ok);
+        if (ok && QString::number(number) == item.value && qAbs(number) <= (Q_INT64_C(1) << 53))
+            return QJsonValue(static_cast<double>(number));
+    }
+
+    return QJsonValue(item.value);
+}
+
+/*!
+ * Returns the model representation of the JSON item value \a value of
+ * an item of type \a dataType.
+ *
+ * \throws A \c std::runtime_error is raised if \a value neither is
+ * a string nor an integral number, or if the number is out of the range
+ * of \a dataType.
+ */
+
+QString IdentityJson::itemValueFromJson(const QJsonValue& value, ItemDataType dataType)
+{
+    if (value.isString()) return value.toString();
+
+    if (value.isDouble())
+    {
+        // Numbers are only written for exactly representable integers,
+        // so anything else (including infinity and NaN) is rejected
+        double minimum = -9007199254740992.0;
+        double maximum = 9007199254740992.0;
+
+        if (dataType == UINT_8) { minimum = 0; maximum = 255; }
+        else if (dataType == UINT_16) { minimum = 0; maximum = 65535; }
+        else if (dataType == UINT_32) { minimum = 0; maximum = 4294967295.0; }
+
+        double number = value.toDouble();
+        if (number >= minimum && number <= maximum && std::floor(number) == number)
+            return QString::number(static_cast<qint64>(number));
+    }
+
+    throw std::runtime_error(
+                QObject::tr("Invalid item value!").toStdString());
+}
+
+/**************************************************************
+ *************************************************************/
+
+/*!
+ *
+ * \class IdentityJsonWriter
+ * \brief Streams identities to a device as JSON Lines.
+ *
+ * Every call to \c write() appends the canonical JSON representation of
+ * one identity as a single line to the device. Nothing but the current
+ * identity is being held in memory, so arbitrarily large corpora can be
+ * exported in constant memory.
+ *
+ * \sa IdentityJson, IdentityJsonReader
+ *
+*/
+
+/*!
+ * Creates a writer which writes to the opened \a device. The writer
+ * does not take ownership of \a device.
+ */
+
+IdentityJsonWriter::IdentityJsonWriter(QIODevice* device) :
+    m_pDevice(device)
+{
+}
+
+/*!
+ * Writes \a identity and the optional \a source as one line to the
+ * device. Returns \c true on success, or \c false otherwise.
+ */
+
+bool IdentityJsonWriter::write(const IdentityModel& identity, QString source)
+{
+    QByteArray line = IdentityJson::toJsonLine(identity, source);
+    if (m_pDevice->write(line) != line.size()) return false;
+
+    m_Count++;
+    return true;
+}
+
+/*!
+ * Returns the number of identities written so far.
+ */
+
+qint64 IdentityJsonWriter::getCount() const
+{
+    return m_Count;
+}
+
+/**************************************************************
+ *************************************************************/
+
+/*!
+ *
+ * \class IdentityJsonReader
+ * \brief Streams identities from a device containing JSON Lines.
+ *
+ * Each call to \c readNext() reads the next non-empty line from the
+ * device and converts it into an identity, so arbitrarily large corpora
+ * can be imported in constant memory. Sequential devices such as pipes
+ * or stdin are supported.
+ *
+ * \sa IdentityJson, IdentityJsonWriter
+ *
+*/
+
+/*!
+ * Creates a reader which reads from the opened \a device. The reader
+ * does not take ownership of \a device.
+ */
+
+IdentityJsonReader::IdentityJsonReader(QIODevice* device) :
+    m_pDevice(device)
+{
+}
+
+/*!
+ * Reads the next identity from the device into \a identity. Returns
+ * \c true if an identity was read, or \c false at the end of the data.
+ *
+ * \throws A \c std::runtime_error is raised if the line being read is
+ * not a valid canonical identity representation. The error message
+ * contains the line number, and reading may continue with the next line.
+ */
+
+bool IdentityJsonReader::readNext(IdentityModel& identity)
+{
+    for (;;)
+    {
+        // readLine() only returns an empty array at the end of the data,
+        // which (unlike atEnd()) also works for pipes
+        QByteArray line = m_pDevice->readLine();
+        if (line.isEmpty()) return false;
+
+        m_LineNumber++;
+        line = line.trimmed();
+        if (line.isEmpty()) continue;
+
+        QJsonParseError parseError;
+        QJsonDocument doc = QJsonDocument::fromJson(line, &parseError);
+        if (parseError.error != QJsonParseError::NoError || !doc.isObject())
+        {
+            throw std::runtime_error(
+                        QObject::tr("Line %1: Invalid JSON object!")
+                        .arg(m_LineNumber).toStdString());
+        }
+
+        try
+        {
+            identity = IdentityJson::fromJson(doc.object(), &m_Source);
+        }
+        catch (std::exception& e)
+        {
+            throw std::runtime_error(
+                        QObject::tr("Line %1: %2")
+                        .arg(m_LineNumber).arg(e.what()).toStdString());
+        }
+
+        m_Count++;
+        return true;
+    }
+}
+
+/*!
+ * Returns the source of the identity read last, or an empty string
+ * if it has none.
+ */
+
+QString IdentityJsonReader::getSource() const
+{
+    return m_Source;
+}
+
+/*!
+ * Returns the number of the line read last (starting at 1).
+ */
+
+qint64 IdentityJsonReader::getLineNumber() const
+{
+    return m_LineNumber;
+}
+
+/*!
+ * Returns the number of identities read so far.
+ */
+
+qint64 IdentityJsonReader::getCount() const
+{
+    return m_Count;
+}
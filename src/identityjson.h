@@ -0,0 +1,88 @@
+/*
+ * This file is part of the "IdTool" utility app.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Alexander Hauser
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef IDENTITYJSON_H
+#define IDENTITYJSON_H
+
+#include "corecommon.h"
+#include "identitymodel.h"
+
+/**********************************************
+ *    class IdentityJson                      *
+ *********************************************/
+
+class IdentityJson
+{
+public:
+    static const int FORMAT_VERSION;
+
+public:
+    static QJsonObject toJson(const IdentityModel& identity, QString source = QString());
+    static IdentityModel fromJson(const QJsonObject& json, QString* source = nullptr);
+    static QByteArray toJsonLine(const IdentityModel& identity, QString source = QString());
+
+private:
+    static QJsonValue itemValueToJson(const IdentityBlockItem& item);
+    static QString itemValueFromJson(const QJsonValue& value, ItemDataType dataType);
+};
+
+/**********************************************
+ *    class IdentityJsonWriter                *
+ *********************************************/
+
+class IdentityJsonWriter
+{
+private:
+    QIODevice* m_pDevice = nullptr;
+    qint64 m_Count = 0;
+
+public:
+    IdentityJsonWriter(QIODevice* device);
+    bool write(const IdentityModel& identity, QString source = QString());
+    qint64 getCount() const;
+};
+
+/**********************************************
+ *    class IdentityJsonReader                *
+ *********************************************/
+
+class IdentityJsonReader
+{
+private:
+    QIODevice* m_pDevice = nullptr;
+    qint64 m_LineNumber = 0;
+    qint64 m_Count = 0;
+    QString m_Source;
+
+public:
+    IdentityJsonReader(QIODevice* device);
+    bool readNext(IdentityModel& identity);
+    QString getSource() const;
+    qint64 getLineNumber() const;
+    qint64 getCount() const;
+};
+
+#endif // IDENTITYJSON_H
@@ -0,0 +1,405 @@
+/*
+ * This file is part of the "IdTool" utility app.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Alexander Hauser
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "identitylineage.h"
+#include "cryptutil.h"
+#include "keycontext.h"
+
+/*!
+ *
+ * \class IdentityLineage
+ * \brief Groups a corpus of identities into lineages.
+ *
+ * Identities which were re-keyed, had their password changed or were
+ * re-exported are related through their identity master keys (IMKs):
+ * copies of the same identity share the same IMK, and a re-keyed
+ * identity keeps the IMKs of its predecessors as previous IMKs (derived
+ * from the previous IUKs in block 3).
+ *
+ * Instead of comparing all pairs of identities, \c cluster() builds hash
+ * indexes of all current and previous IMKs and joins related identities
+ * using a union-find structure, which runs in near-linear time. The
+ * result is a list of clusters (lineages) and the edges of the lineage
+ * graph connecting their members.
+ *
+ * \c decryptIdentities() decrypts the required keys for a whole corpus,
+ * running the password based key derivations as batch jobs of the shared
+ * \c KdfExecutor, within its memory budget.
+ *
+ * \sa IdentityDiff, KdfExecutor
+ *
+*/
+
+
+/*!
+ * Adds an identity named \a name with the decrypted \a imk and the IMKs
+ * derived from its previous IUKs, \a previousImks, and returns its index.
+ */
+
+int IdentityLineage::addIdentity(QString name, QByteArray imk, QList<QByteArray> previousImks)
+{
+    Member member;
+    member.name = name;
+    member.imk = imk;
+    member.previousImks = previousImks;
+    m_Members.append(member);
+
+    return m_Members.size() - 1;
+}
+
+/*!
+ * Adds an identity named \a name which could not be decrypted because
+ * of \a error, and returns its index. Failed identities are not part of
+ * any cluster.
+ */
+
+int IdentityLineage::addFailedIdentity(QString name, QString error)
+{
+    Member member;
+    member.name = name;
+    member.error = error;
+    m_Members.append(member);
+
+    return m_Members.size() - 1;
+}
+
+/*!
+ * Clusters all added identities into lineages and creates the edges of
+ * the lineage graph.
+ *
+ * Identities sharing an IMK are connected by a \c SAME_IDENTITY edge to
+ * the first identity with that IMK. An identity having the IMK of another
+ * identity as previous IMK is connected by a \c PRECEDES edge from the
+ * older identity. If the identity holding a previous IMK is not part of
+ * the corpus, all identities sharing that previous IMK are connected by
+ * \c SHARES_PREVIOUS edges instead.
+ */
+
+void IdentityLineage::cluster()
+{
+    m_Edges.clear();
+    m_Clusters.clear();
+    m_Parents.resize(m_Members.size());
+    for (int i=0; i<m_Parents.size(); i++) m_Parents[i] = i;
+
+    QHash<QByteArray, int> membersByImk;
+    QHash<QByteArray, int> membersByPreviousImk;
+
+    for (int i=0; i<m_Members.size(); i++)
+    {
+        const Member& member = m_Members.at(i);
+        if (!member.error.isEmpty()) continue;
+
+        auto it = membersByImk.constFind(member.imk);
+        if (it == membersByImk.constEnd())
+        {
+            membersByImk.insert(member.imk, i);
+            continue;
+        }
+
+        unite(it.value(), i);
+        m_Edges.append({ it.value(), i, SAME_IDENTITY });
+    }
+
+    for (int i=0; i<m_Members.size(); i++)
+    {
+        const Member& member = m_Members.at(i);
+        if (!member.error.isEmpty()) continue;
+
+        for (const QByteArray& previousImk : member.previousImks)
+        {
+            auto it = membersByImk.constFind(previousImk);
+            if (it != membersByImk.constEnd())
+            {
+                unite(it.value(), i);
+                m_Edges.append({ it.value(), i, PRECEDES });
+                continue;
+            }
+
+            it = membersByPreviousImk.constFind(previousImk);
+            if (it == membersByPreviousImk.constEnd())
+            {
+                membersByPreviousImk.insert(previousImk, i);
+                continue;
+            }
+
+            if (findRoot(it.value()) == findRoot(i)) continue;
+
+            unite(it.value(), i);
+            m_Edges.append({ it.value(), i, SHARES_PREVIOUS });
+        }
+    }
+
+    // Number the clusters in the order of their first member
+    QHash<int, int> clustersByRoot;
+    for (int i=0; i<m_Members.size(); i++)
+    {
+        Member& member = m_Members[i];
+        if (!member.error.isEmpty())
+        {
+            member.cluster = -1;
+            continue;
+        }
+
+        int root = findRoot(i);
+        auto it = clustersByRoot.constFind(root);
+        if (it == clustersByRoot.constEnd())
+        {
+            it = clustersByRoot.insert(root, m_Clusters.size());
+            m_Clusters.append(QList<int>());
+        }
+
+        member.cluster = it.value();
+        m_Clusters[member.cluster].append(i);
+    }
+}
+
+/*!
+ * Returns all added identities. Their cluster index is only valid
+ * after calling \c cluster().
+ */
+
+const QList<IdentityLineage::Member>& IdentityLineage::getMembers()
+{
+    return m_Members;
+}
+
+/*!
+ * Returns the edges of the lineage graph, as created by \c cluster().
+ */
+
+const QList<IdentityLineage::Edge>& IdentityLineage::getEdges()
+{
+    return m_Edges;
+}
+
+/*!
+ * Returns the clusters created by \c cluster(), each holding the
+ * indexes of its members.
+ */
+
+const QList<QList<int>>& IdentityLineage::getClusters()
+{
+    return m_Clusters;
+}
+
+/*!
+ * Serializes the identities, clusters and edges of the lineage graph
+ * into a JSON object. Keys are never included.
+ */
+
+QJsonObject IdentityLineage::toJson()
+{
+    QJsonArray identities;
+    for (const Member& member : m_Members)
+    {
+        QJsonObject identity;
+        identity["name"] = member.name;
+        if (member.error.isEmpty()) identity["cluster"] = member.cluster;
+        else identity["error"] = member.error;
+        identities.append(identity);
+    }
+
+    QJsonArray clusters;
+    for (const QList<int>& cluster : m_Clusters)
+    {
+        QJsonArray members;
+        for (int member : cluster) members.append(member);
+        clusters.append(members);
+    }
+
+    QJsonArray edges;
+    for (const Edge& edge : m_Edges)
+    {
+        QJsonObject edgeObject;
+        edgeObject["from"] = edge.from;
+        edgeObject["to"] = edge.to;
+        edgeObject["relation"] = relationToString(edge.relation);
+        edges.append(edgeObject);
+    }
+
+    QJsonObject json;
+    json["identities"] = identities;
+    json["clusters"] = clusters;
+    json["edges"] = edges;
+    return json;
+}
+
+/*!
+ * Returns a string representation of \a relation, as being used
+ * by \c toJson().
+ */
+
+QString IdentityLineage::relationToString(Relation relation)
+{
+    switch (relation)
+    {
+    case SAME_IDENTITY: return "same_identity";
+    case PRECEDES: return "precedes";
+    case SHARES_PREVIOUS: return "shares_previous";
+    }
+
+    return QString();
+}
+
+/*!
+ * Decrypts the IMK and the previous IMKs of all \a identities, using the
+ * password at the same index within \a passwords.
+ *
+ * The password based key derivations of all identities are run as
+ * batches of the shared \c KdfExecutor (see
+ * \c CryptUtil::enScryptIterationsBatch()), grouped by their scrypt
+ * log-n-factor, so that the number of concurrent derivations is bounded
+ * by the executor's memory budget.
+ *
+ * The results are placed into \a imks and \a previousImks, and for
+ * identities which could not be decrypted, a description of the error
+ * is placed into \a errors (which is empty for successfully decrypted
+ * identities). Returns the number of successfully decrypted identities.
+ */
+
+int IdentityLineage::decryptIdentities(QList<IdentityModel>& identities, const QStringList& passwords,
+                                       QList<QByteArray>& imks, QList<QList<QByteArray>>& previousImks,
+                                       QStringList& errors)
+{
+    imks.clear();
+    previousImks.clear();
+    errors.clear();
+
+    QMap<int, QList<int>> indexesByLogNFactor;
+
+    for (int i=0; i<identities.size(); i++)
+    {
+        imks.append(QByteArray());
+        previousImks.append(QList<QByteArray>());
+        errors.append(QString());
+
+        IdentityBlock* pBlock1 = identities[i].getBlock(1);
+
+        if (passwords.value(i).isEmpty())
+            errors[i] = QObject::tr("No password given!");
+        else if (pBlock1 == nullptr || pBlock1->items.size() < 14)
+            errors[i] = QObject::tr("The identity has no valid block 1!");
+        else
+            indexesByLogNFactor[pBlock1->items[5].value.toInt()].append(i);
+    }
+
+    int decryptedCount = 0;
+
+    for (auto it = indexesByLogNFactor.constBegin(); it != indexesByLogNFactor.constEnd(); ++it)
+    {
+        const QList<int>& indexes = it.value();
+        QStringList groupPasswords;
+        QList<QByteArray> salts;
+        QList<int> iterationCounts;
+
+        for (int i : indexes)
+        {
+            const IdentityBlock* pBlock1 = identities[i].getBlock(1);
+            groupPasswords.append(passwords.at(i));
+            salts.append(QByteArray::fromHex(pBlock1->items[4].value.toLocal8Bit()));
+            iterationCounts.append(pBlock1->items[6].value.toInt());
+        }
+
+        QList<QByteArray> keys;
+        if (!CryptUtil::enScryptIterationsBatch(keys, groupPasswords, salts, it.key(), iterationCounts))
+        {
+            for (int i : indexes)
+                errors[i] = QObject::tr("Deriving the key from the password failed!");
+            continue;
+        }
+
+        for (int j=0; j<indexes.size(); j++)
+        {
+            int i = indexes.at(j);
+            IdentityBlock* pBlock1 = identities[i].getBlock(1);
+            IdentityBlock* pBlock3 = identities[i].getBlock(3);
+            QByteArray imk(32, 0);
+            QByteArray ilk(32, 0);
+
+            if (!CryptUtil::decryptBlock1(imk, ilk, pBlock1, keys.at(j)))
+            {
+                errors[i] = QObject::tr("Decryption of block 1 failed!");
+                continue;
+            }
+
+            if (pBlock3 != nullptr)
+            {
+                QList<QByteArray> previousIuks;
+                KeyContext imkContext(imk);
+
+                if (!CryptUtil::decryptBlock3(previousIuks, pBlock3, imkContext))
+                {
+                    errors[i] = QObject::tr("Decryption of block 3 failed!");
+                    continue;
+                }
+
+                for (const QByteArray& previousIuk : previousIuks)
+                    previousImks[i].append(CryptUtil::createImkFromIuk(previousIuk));
+            }
+
+            imks[i] = imk;
+            decryptedCount++;
+        }
+    }
+
+    return decryptedCount;
+}
+
+/*!
+ * Returns the root of the cluster \a member belongs to, compressing
+ * the path on the way.
+ */
+
+int IdentityLineage::findRoot(int member)
+{
+    int root = member;
+    while (m_Parents[root] != root) root = m_Parents[root];
+
+    while (m_Parents[member] != root)
+    {
+        int parent = m_Parents[member];
+        m_Parents[member] = root;
+        member = parent;
+    }
+
+    return root;
+}
+
+/*!
+ * Joins the clusters of \a member1 and \a member2. The root with the
+ * lower index becomes the root of the joined cluster.
+ */
+
+void IdentityLineage::unite(int member1, int member2)
+{
+    int root1 = findRoot(member1);
+    int root2 = findRoot(member2);
+    if (root1 == root2) return;
+
+    if (root1 < root2) m_Parents[root2] = root1;
+    else m_Parents[root1] = root2;
+}
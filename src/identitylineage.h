@@ -0,0 +1,87 @@
+/*
+ * This file is part of the "IdTool" utility app.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Alexander Hauser
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef IDENTITYLINEAGE_H
+#define IDENTITYLINEAGE_H
+
+#include "corecommon.h"
+#include "identitymodel.h"
+
+/**********************************************
+ *    class IdentityLineage                   *
+ *********************************************/
+
+class IdentityLineage
+{
+public:
+    enum Relation
+    {
+        SAME_IDENTITY,
+        PRECEDES,
+        SHARES_PREVIOUS
+    };
+
+    struct Member
+    {
+        QString name;
+        QByteArray imk;
+        QList<QByteArray> previousImks;
+        QString error;
+        int cluster = -1;
+    };
+
+    struct Edge
+    {
+        int from;
+        int to;
+        Relation relation;
+    };
+
+private:
+    QList<Member> m_Members;
+    QList<Edge> m_Edges;
+    QList<QList<int>> m_Clusters;
+    QVector<int> m_Parents;
+
+public:
+    int addIdentity(QString name, QByteArray imk, QList<QByteArray> previousImks);
+    int addFailedIdentity(QString name, QString error);
+    void cluster();
+    const QList<Member>& getMembers();
+    const QList<Edge>& getEdges();
+    const QList<QList<int>>& getClusters();
+    QJsonObject toJson();
+    static QString relationToString(Relation relation);
+    static int decryptIdentities(QList<IdentityModel>& identities, const QStringList& passwords,
+                                 QList<QByteArray>& imks, QList<QList<QByteArray>>& previousImks,
+                                 QStringList& errors);
+
+private:
+    int findRoot(int member);
+    void unite(int member1, int member2);
+};
+
+#endif // IDENTITYLINEAGE_H
@@ -0,0 +1,282 @@
+/*
+ * This file is part of the "IdTool" utility app.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Alexander Hauser
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "identityloader.h"
+#include "identityparser.h"
+#include <QDirIterator>
+
+/*!
+ *
+ * \class IdentityLoader
+ * \brief Reads and parses identity files on a pool of worker threads.
+ *
+ * \c IdentityLoader takes a list of identity files, reads and parses
+ * them concurrently and emits \c identityLoaded() on the thread the
+ * loader lives in as soon as each file has been parsed. Results are
+ * therefore reported in the order of completion, not in the order the
+ * files were passed in.
+ *
+ * Files which cannot be opened or parsed do not interrupt the remaining
+ * loads. Their errors are collected and can be retrieved using
+ * \c getErrors() once \c finished() was emitted, so that they can be
+ * presented in a single summary.
+ *
+ * \sa IdentityParser, IdentityLoadTask
+ *
+*/
+
+const QStringList IdentityLoader::FILE_NAME_FILTERS = { "*.sqrl", "*.sqrc" };
+
+/*!
+ * Creates a new \c IdentityLoader object, running one worker thread
+ * per CPU core by default.
+ */
+
+IdentityLoader::IdentityLoader(QObject* parent)
+    : QObject(parent)
+{
+    qRegisterMetaType<IdentityModel*>("IdentityModel*");
+    m_ThreadPool.setMaxThreadCount(QThread::idealThreadCount());
+}
+
+/*!
+ * Waits for all running loads to finish and frees all identities that
+ * were parsed but not yet handed out.
+ */
+
+IdentityLoader::~IdentityLoader()
+{
+    m_ThreadPool.clear();
+    m_ThreadPool.waitForDone();
+
+    for (const Result& result : m_Results)
+        delete result.pModel;
+}
+
+/*!
+ * Expands \a paths into a sorted list of identity files. Directories are
+ * searched for files matching \c FILE_NAME_FILTERS, including their
+ * subdirectories if \a recursive is \c true. All other paths are
+ * included as they are, so that missing or unreadable files are
+ * reported by \c load(). Duplicates are removed.
+ */
+
+QStringList IdentityLoader::collectIdentityFiles(const QStringList& paths, bool recursive)
+{
+    QStringList result;
+
+    for (const QString& path : paths)
+    {
+        QFileInfo fileInfo(path);
+
+        if (!fileInfo.isDir())
+        {
+            result.append(fileInfo.absoluteFilePath());
+            continue;
+        }
+
+        QDirIterator it(fileInfo.absoluteFilePath(), FILE_NAME_FILTERS, QDir::Files,
+                        recursive ? QDirIterator::Subdirectories :
+                                    QDirIterator::NoIteratorFlags);
+        QStringList dirFiles;
+        while (it.hasNext()) dirFiles.append(it.next());
+
+        dirFiles.sort();
+        result.append(dirFiles);
+    }
+
+    result.removeDuplicates();
+    return result;
+}
+
+/*!
+ * Queues all files in \a fileNames for being loaded and returns the
+ * number of queued files.
+ *
+ * \c identityLoaded() is emitted for every successfully parsed file,
+ * and \c finished() once all queued files (including those of previous
+ * calls that are still pending) have been processed.
+ */
+
+int IdentityLoader::load(const QStringList& fileNames)
+{
+    for (const QString& fileName : fileNames)
+    {
+        m_PendingCount++;
+        m_ThreadPool.start(new IdentityLoadTask(this, fileName));
+    }
+
+    return fileNames.size();
+}
+
+/*!
+ * Returns \c true if any queued files are still being loaded,
+ * or \c false otherwise.
+ */
+
+bool IdentityLoader::isLoading()
+{
+    return m_PendingCount > 0;
+}
+
+/*!
+ * Returns the number of queued files that have not yet been reported.
+ */
+
+int IdentityLoader::getPendingCount()
+{
+    return m_PendingCount;
+}
+
+/*!
+ * Returns the errors collected since the last call to \c clearErrors().
+ */
+
+QList<IdentityLoader::Error> IdentityLoader::getErrors()
+{
+    return m_Errors;
+}
+
+/*!
+ * Discards all collected errors.
+ */
+
+void IdentityLoader::clearErrors()
+{
+    m_Errors.clear();
+}
+
+/*!
+ * Sets the maximum number of worker threads to \a threadCount. If
+ * \a threadCount is smaller than \c 1, one thread per CPU core is used.
+ */
+
+void IdentityLoader::setMaxThreadCount(int threadCount)
+{
+    if (threadCount < 1) threadCount = QThread::idealThreadCount();
+    m_ThreadPool.setMaxThreadCount(threadCount);
+}
+
+/*!
+ * Returns the maximum number of worker threads.
+ */
+
+int IdentityLoader::getMaxThreadCount()
+{
+    return m_ThreadPool.maxThreadCount();
+}
+
+/*!
+ * Stores \a result, which was produced by a worker thread, and schedules
+ * it for being processed on the loader's thread.
+ */
+
+void IdentityLoader::addResult(const Result& result)
+{
+    QMutexLocker locker(&m_ResultMutex);
+    m_Results.append(result);
+
+    if (m_bProcessingScheduled) return;
+
+    // Batch all results arriving until the event loop gets to process them
+    m_bProcessingScheduled = true;
+    QMetaObject::invokeMethod(this, "onProcessResults", Qt::QueuedConnection);
+}
+
+/*!
+ * Hands out all results collected so far. Errors are stored for the
+ * summary, and \c finished() is emitted once no more loads are pending.
+ */
+
+void IdentityLoader::onProcessResults()
+{
+    QList<Result> results;
+    {
+        QMutexLocker locker(&m_ResultMutex);
+        results.swap(m_Results);
+        m_bProcessingScheduled = false;
+    }
+
+    for (const Result& result : results)
+    {
+        m_PendingCount--;
+
+        if (result.pModel) emit identityLoaded(result.pModel, result.fileName);
+        else m_Errors.append({ result.fileName, result.errorMessage });
+    }
+
+    if (!results.isEmpty() && m_PendingCount == 0) emit finished();
+}
+
+
+
+/*!
+ *
+ * \class IdentityLoadTask
+ * \brief A \c QRunnable reading and parsing a single identity file
+ * for an \c IdentityLoader.
+ *
+ * \sa IdentityLoader
+ *
+*/
+
+
+/*!
+ * Creates a new task for loading the identity file \a fileName and
+ * reporting the result to \a loader.
+ */
+
+IdentityLoadTask::IdentityLoadTask(IdentityLoader* loader, QString fileName)
+{
+    m_pLoader = loader;
+    m_FileName = fileName;
+}
+
+/*!
+ * Reads and parses the identity file and reports the resulting
+ * identity or error to the loader.
+ */
+
+void IdentityLoadTask::run()
+{
+    IdentityLoader::Result result;
+    result.fileName = m_FileName;
+    result.pModel = new IdentityModel();
+
+    try
+    {
+        IdentityParser parser;
+        parser.parseFile(m_FileName, result.pModel);
+    }
+    catch (std::exception& e)
+    {
+        delete result.pModel;
+        result.pModel = nullptr;
+        result.errorMessage = e.what();
+    }
+
+    m_pLoader->addResult(result);
+}
@@ -0,0 +1,110 @@
+/*
+ * This file is part of the "IdTool" utility app.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Alexander Hauser
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef IDENTITYLOADER_H
+#define IDENTITYLOADER_H
+
+#include "corecommon.h"
+#include "identitymodel.h"
+#include <QThreadPool>
+#include <QRunnable>
+#include <QMutex>
+
+/**********************************************
+ *    class IdentityLoader                    *
+ *********************************************/
+
+class IdentityLoader : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Result
+    {
+        QString fileName;
+        IdentityModel* pModel = nullptr;
+        QString errorMessage;
+    };
+
+    struct Error
+    {
+        QString fileName;
+        QString message;
+    };
+
+    static const QStringList FILE_NAME_FILTERS;
+
+private:
+    QMutex m_ResultMutex;
+    QList<Result> m_Results;
+    QList<Error> m_Errors;
+    int m_PendingCount = 0;
+    bool m_bProcessingScheduled = false;
+    QThreadPool m_ThreadPool;
+
+public:
+    explicit IdentityLoader(QObject* parent = nullptr);
+    ~IdentityLoader() override;
+    static QStringList collectIdentityFiles(const QStringList& paths, bool recursive = true);
+    int load(const QStringList& fileNames);
+    bool isLoading();
+    int getPendingCount();
+    QList<Error> getErrors();
+    void clearErrors();
+    void setMaxThreadCount(int threadCount);
+    int getMaxThreadCount();
+
+private:
+    void addResult(const Result& result);
+
+    friend class IdentityLoadTask;
+
+signals:
+    void identityLoaded(IdentityModel* model, QString fileName);
+    void finished();
+
+private slots:
+    void onProcessResults();
+};
+
+/**********************************************
+ *    class IdentityLoadTask                  *
+ *********************************************/
+
+class IdentityLoadTask : public QRunnable
+{
+private:
+    IdentityLoader* m_pLoader;
+    QString m_FileName;
+
+public:
+    IdentityLoadTask(IdentityLoader* loader, QString fileName);
+    void run() override;
+};
+
+Q_DECLARE_METATYPE(IdentityModel*)
+
+#endif // IDENTITYLOADER_H
@@ -25,6 +25,7 @@
  */
 
 #include "identitymodel.h"
+#include "allocationtracker.h"
 #include "identityparser.h"
 #include "cryptutil.h"
 
@@ -42,10 +43,54 @@
  * More information SQRL's storage format can be found at
  * https://www.grc.com/sqrl/SQRL_Cryptography.pdf
  *
- * \sa IdentityBlock, IdentityBlockItem
+ * Changes made through the model's mutation methods (such as
+ * \c insertBlock() or \c setItemValue()) are reported to all registered
+ * \c IdentityModelObserver instances, allowing views to patch only the
+ * affected parts of their representation. Code that modifies \c blocks
+ * directly must call \c notifyBlockChanged() or \c notifyModelReset()
+ * afterwards.
+ *
+ * \sa IdentityBlock, IdentityBlockItem, IdentityModelObserver
  *
 */
 
+/*!
+ * Creates a new, empty \c IdentityModel.
+ */
+
+IdentityModel::IdentityModel()
+{
+}
+
+/*!
+ * Creates a copy of the identity model \a other.
+ *
+ * \note Registered observers are not copied.
+ */
+
+IdentityModel::IdentityModel(const IdentityModel& other) :
+    blocks(other.blocks)
+{
+}
+
+/*!
+ * Replaces the blocks of this identity model with the blocks of \a other
+ * and notifies all registered observers about the reset.
+ *
+ * \note Registered observers are neither copied nor replaced.
+ */
+
+IdentityModel& IdentityModel::operator=(const IdentityModel& other)
+{
+    if (this != &other)
+    {
+        blocks = other.blocks;
+        notifyModelReset();
+    }
+
+    return *this;
+}
+
 /*!
  * Retrieves the raw binary representation of the identity model
  * and writes it to a file specified by \a fileName.
@@ -91,6 +136,21 @@ IdentityBlock *IdentityModel::getBlock(int blockType)
     return nullptr;
 }
 
+/*!
+ * Returns the index of \a block within the identity's list of blocks,
+ * or \c -1 if \a block is not part of this identity model.
+ */
+
+int IdentityModel::indexOfBlock(const IdentityBlock* block)
+{
+    for (int i=0; i<blocks.size(); i++)
+    {
+        if (&blocks[i] == block) return i;
+    }
+
+    return -1;
+}
+
 /*!
  * \brief Returns a list of block types which are available
  * in the current \c IdentityModel.
@@ -100,7 +160,7 @@ QList<int> IdentityModel::getAvailableBlockTypes()
 {
     QList<int> result;
 
-    for (IdentityBlock block : blocks)
+    for (const IdentityBlock& block : qAsConst(blocks))
     {
         if (!result.contains(block.blockType))
         {
@@ -115,13 +175,13 @@ QList<int> IdentityModel::getAvailableBlockTypes()
  * Returns the raw binary representation of the identity block.
  */
 
-QByteArray IdentityBlock::toByteArray()
+QByteArray IdentityBlock::toByteArray() const
 {
     QByteArray ba;
 
     for (int i=0; i<items.size(); i++)
     {
-        ba.append(items[i].toByteArray());
+        ba.append(items.at(i).toByteArray());
     }
 
     return ba;
@@ -139,16 +199,18 @@ QByteArray IdentityBlock::toByteArray()
 
 bool IdentityModel::deleteBlock(IdentityBlock* block)
 {
-    for (int i=0; i<blocks.size(); i++)
-    {
-        if (&blocks[i] == block)
-        {
-            blocks.erase(blocks.begin()+ static_cast<long long>(i));
-            return true;
-        }
-    }
+    int index = indexOfBlock(block);
+    if (index < 0) return false;
 
-    return false;
+    for (IdentityModelObserver* pObserver : m_Observers)
+        pObserver->blockAboutToBeRemoved(index);
+
+    blocks.removeAt(index);
+
+    for (IdentityModelObserver* pObserver : m_Observers)
+        pObserver->blockRemoved(index);
+
+    return true;
 }
 
 /*!
@@ -158,36 +220,30 @@ bool IdentityModel::deleteBlock(IdentityBlock* block)
  *
  * If \a up is \c true, \a block will be moved upwards (index -= 1),
  * or downwards (index += 1) otherwise.
+ *
+ * \note Pointers to the moved block stay valid and keep pointing to
+ * the same block after the move.
  */
 
 bool IdentityModel::moveBlock(IdentityBlock* block, bool up)
 {
     if (blocks.size() < 2) return false;
 
-    for (int i=0; i<blocks.size(); i++)
-    {
-        if (&blocks[i] == block)
-        {
-            if (up)
-            {
-                if (i == 0) return false;
-                IdentityBlock tempBlock = blocks[i];
-                blocks[i] = blocks[i-1];
-                blocks[i-1] = tempBlock;
-            }
-            else
-            {
-                if (i == (blocks.size() - 1)) return false;
-                IdentityBlock tempBlock = blocks[i];
-                blocks[i] = blocks[i+1];
-                blocks[i+1] = tempBlock;
-            }
+    int from = indexOfBlock(block);
+    if (from < 0) return false;
 
-            return true;
-        }
-    }
+    int to = up ? from - 1 : from + 1;
+    if (to < 0 || to >= blocks.size()) return false;
 
-    return false;
+    for (IdentityModelObserver* pObserver : m_Observers)
+        pObserver->blockAboutToBeMoved(from, to);
+
+    blocks.move(from, to);
+
+    for (IdentityModelObserver* pObserver : m_Observers)
+        pObserver->blockMoved(from, to);
+
+    return true;
 }
 
 /*!
@@ -203,16 +259,230 @@ bool IdentityModel::moveBlock(IdentityBlock* block, bool up)
 
 bool IdentityModel::insertBlock(IdentityBlock block, IdentityBlock* after)
 {
-    for (int i=0; i<blocks.size(); i++)
+    int index = indexOfBlock(after);
+    if (index < 0) return false;
+
+    for (IdentityModelObserver* pObserver : m_Observers)
+        pObserver->blockAboutToBeInserted(index + 1);
+
+    blocks.insert(index + 1, block);
+
+    for (IdentityModelObserver* pObserver : m_Observers)
+        pObserver->blockInserted(index + 1);
+
+    return true;
+}
+
+/*!
+ * Replaces the contents of \a block with \a newBlock and notifies
+ * all observers that the block has changed.
+ *
+ * If the number of items differs, surplus items are removed from (or
+ * missing items are appended to) the end of the block first, so that
+ * observers receive item removals or insertions for them and the final
+ * \c blockChanged() notification never changes the item count.
+ *
+ * Returns \c true if \a block was found and updated, and \c false
+ * if \a block is not part of this identity model.
+ */
+
+bool IdentityModel::updateBlock(IdentityBlock* block, IdentityBlock newBlock)
+{
+    int index = indexOfBlock(block);
+    if (index < 0) return false;
+
+    for (int i=block->items.size()-1; i>=newBlock.items.size(); i--)
     {
-        if (&blocks[i] == after)
-        {
-            blocks.insert(i+1, block);
-            return true;
-        }
+        for (IdentityModelObserver* pObserver : m_Observers)
+            pObserver->itemAboutToBeRemoved(index, i);
+
+        block->items.removeAt(i);
+
+        for (IdentityModelObserver* pObserver : m_Observers)
+            pObserver->itemRemoved(index, i);
     }
 
-    return false;
+    for (int i=block->items.size(); i<newBlock.items.size(); i++)
+    {
+        for (IdentityModelObserver* pObserver : m_Observers)
+            pObserver->itemAboutToBeInserted(index, i);
+
+        block->items.append(newBlock.items.at(i));
+
+        for (IdentityModelObserver* pObserver : m_Observers)
+            pObserver->itemInserted(index, i);
+    }
+
+    *block = newBlock;
+
+    // Make sure the block does not share its items with newBlock,
+    // so that pointers handed out to observers stay valid
+    block->items.detach();
+
+    for (IdentityModelObserver* pObserver : m_Observers)
+        pObserver->blockChanged(index);
+
+    return true;
+}
+
+/*!
+ * Deletes \a item from \a block and notifies all observers.
+ *
+ * Returns \c true if both \a block and \a item were found and
+ * the item was deleted, or \c false otherwise.
+ *
+ * \sa IdentityBlock::deleteItem
+ */
+
+bool IdentityModel::deleteItem(IdentityBlock* block, IdentityBlockItem* item)
+{
+    int blockIndex = indexOfBlock(block);
+    if (blockIndex < 0) return false;
+
+    int itemIndex = block->indexOfItem(item);
+    if (itemIndex < 0) return false;
+
+    for (IdentityModelObserver* pObserver : m_Observers)
+        pObserver->itemAboutToBeRemoved(blockIndex, itemIndex);
+
+    block->deleteItem(item);
+
+    for (IdentityModelObserver* pObserver : m_Observers)
+        pObserver->itemRemoved(blockIndex, itemIndex);
+
+    return true;
+}
+
+/*!
+ * Moves \a item within \a block one step upwards (if \a up is \c true)
+ * or downwards (if \a up is \c false) and notifies all observers.
+ *
+ * Returns \c true if the item was moved, or \c false otherwise.
+ *
+ * \sa IdentityBlock::moveItem
+ */
+
+bool IdentityModel::moveItem(IdentityBlock* block, IdentityBlockItem* item, bool up)
+{
+    int blockIndex = indexOfBlock(block);
+    if (blockIndex < 0) return false;
+
+    int from = block->indexOfItem(item);
+    if (from < 0) return false;
+
+    int to = up ? from - 1 : from + 1;
+    if (to < 0 || to >= block->items.size()) return false;
+
+    for (IdentityModelObserver* pObserver : m_Observers)
+        pObserver->itemAboutToBeMoved(blockIndex, from, to);
+
+    block->moveItem(item, up);
+
+    for (IdentityModelObserver* pObserver : m_Observers)
+        pObserver->itemMoved(blockIndex, from, to);
+
+    return true;
+}
+
+/*!
+ * Inserts \a item into \a block, placing it directly after the existing
+ * item pointed to by \a after, and notifies all observers.
+ *
+ * Returns \c true if the item was inserted, or \c false otherwise.
+ *
+ * \sa IdentityBlock::insertItem
+ */
+
+bool IdentityModel::insertItem(IdentityBlock* block, IdentityBlockItem item,
+                               IdentityBlockItem* after)
+{
+    int blockIndex = indexOfBlock(block);
+    if (blockIndex < 0) return false;
+
+    int itemIndex = block->indexOfItem(after);
+    if (itemIndex < 0) return false;
+
+    for (IdentityModelObserver* pObserver : m_Observers)
+        pObserver->itemAboutToBeInserted(blockIndex, itemIndex + 1);
+
+    block->insertItem(item, after);
+
+    for (IdentityModelObserver* pObserver : m_Observers)
+        pObserver->itemInserted(blockIndex, itemIndex + 1);
+
+    return true;
+}
+
+/*!
+ * Sets the value of \a item within \a block to \a value and notifies
+ * all observers that the item has changed.
+ *
+ * Returns \c true if the item was found and updated, or \c false otherwise.
+ */
+
+bool IdentityModel::setItemValue(IdentityBlock* block, IdentityBlockItem* item,
+                                 QString value)
+{
+    int blockIndex = indexOfBlock(block);
+    if (blockIndex < 0) return false;
+
+    int itemIndex = block->indexOfItem(item);
+    if (itemIndex < 0) return false;
+
+    item->value = value;
+
+    for (IdentityModelObserver* pObserver : m_Observers)
+        pObserver->itemChanged(blockIndex, itemIndex);
+
+    return true;
+}
+
+/*!
+ * Registers \a observer to be notified about changes to this identity
+ * model. The model does not take ownership of \a observer, which must
+ * be unregistered using \c removeObserver() before it is destroyed.
+ */
+
+void IdentityModel::addObserver(IdentityModelObserver* observer)
+{
+    if (observer && !m_Observers.contains(observer))
+        m_Observers.append(observer);
+}
+
+/*!
+ * Unregisters \a observer from this identity model.
+ */
+
+void IdentityModel::removeObserver(IdentityModelObserver* observer)
+{
+    m_Observers.removeAll(observer);
+}
+
+/*!
+ * Notifies all observers that the contents of \a block were changed
+ * by directly modifying it (for example by assigning a re-encrypted
+ * block to it). The modification must not have changed the number of
+ * items within \a block, use \c notifyModelReset() otherwise.
+ */
+
+void IdentityModel::notifyBlockChanged(IdentityBlock* block)
+{
+    int index = indexOfBlock(block);
+    if (index < 0) return;
+
+    for (IdentityModelObserver* pObserver : m_Observers)
+        pObserver->blockChanged(index);
+}
+
+/*!
+ * Notifies all observers that the identity model has been changed
+ * in a way that requires its representation to be rebuilt.
+ */
+
+void IdentityModel::notifyModelReset()
+{
+    for (IdentityModelObserver* pObserver : m_Observers)
+        pObserver->modelReset();
 }
 
 /*!
@@ -222,6 +492,7 @@ bool IdentityModel::insertBlock(IdentityBlock block, IdentityBlock* after)
 void IdentityModel::clear()
 {
     blocks.clear();
+    notifyModelReset();
 }
 
 /*!
@@ -230,8 +501,75 @@ void IdentityModel::clear()
 
 void IdentityModel::import(IdentityModel &model)
 {
-    clear();
     blocks = model.blocks;
+    notifyModelReset();
+}
+
+/*!
+ * Changes the identity to match the blocks of \a model, touching only
+ * the blocks that actually differ. Leading and trailing blocks which are
+ * equal in both identities are kept, differing blocks in between are
+ * updated pairwise, and the remaining surplus blocks are removed or the
+ * missing ones inserted. Observers are notified about every single
+ * change, so that views only need to update the affected blocks.
+ *
+ * Returns the number of blocks that were updated, removed or inserted.
+ */
+
+int IdentityModel::applyChanges(const IdentityModel& model)
+{
+    const QList<IdentityBlock>& newBlocks = model.blocks;
+    int oldCount = blocks.size();
+    int newCount = newBlocks.size();
+
+    int prefix = 0;
+    while (prefix < oldCount && prefix < newCount &&
+           blocks.at(prefix) == newBlocks.at(prefix))
+    {
+        prefix++;
+    }
+
+    int suffix = 0;
+    while (suffix < oldCount - prefix && suffix < newCount - prefix &&
+           blocks.at(oldCount - 1 - suffix) == newBlocks.at(newCount - 1 - suffix))
+    {
+        suffix++;
+    }
+
+    int oldEnd = oldCount - suffix;
+    int newEnd = newCount - suffix;
+    int changes = 0;
+    int i = prefix;
+
+    for (; i < oldEnd && i < newEnd; i++)
+    {
+        if (blocks.at(i) == newBlocks.at(i)) continue;
+
+        updateBlock(&blocks[i], newBlocks.at(i));
+        changes++;
+    }
+
+    for (; oldEnd > i; oldEnd--)
+    {
+        deleteBlock(&blocks[i]);
+        changes++;
+    }
+
+    for (; i < newEnd; i++)
+    {
+        for (IdentityModelObserver* pObserver : m_Observers)
+            pObserver->blockAboutToBeInserted(i);
+
+        blocks.insert(i, newBlocks.at(i));
+        blocks[i].items.detach();
+
+        for (IdentityModelObserver* pObserver : m_Observers)
+            pObserver->blockInserted(i);
+
+        changes++;
+    }
+
+    return changes;
 }
 
 /*!
@@ -240,11 +578,13 @@ void IdentityModel::import(IdentityModel &model)
 
 QByteArray IdentityModel::getRawBytes()
 {
+    ALLOC_SCOPE("IdentityModel::getRawBytes");
+
     QByteArray ba(IdentityParser::HEADER.toUtf8());
 
     for (int i=0; i<blocks.size(); i++)
     {
-        ba.append(blocks[i].toByteArray());
+        ba.append(blocks.at(i).toByteArray());
     }
 
     return ba;
@@ -361,6 +701,21 @@ IdentityBlockItem *IdentityBlock::getItem(QString name)
     return nullptr;
 }
 
+/*!
+ * Returns the index of \a item within the block's item list,
+ * or \c -1 if \a item is not part of this block.
+ */
+
+int IdentityBlock::indexOfItem(const IdentityBlockItem* item)
+{
+    for (int i=0; i<items.size(); i++)
+    {
+        if (&items[i] == item) return i;
+    }
+
+    return -1;
+}
+
 /*!
  * Duplicates \a item and inserts the exact copy into the block's
  * item list right behind \a item.
@@ -412,36 +767,23 @@ bool IdentityBlock::deleteItem(IdentityBlockItem* item)
  *
  * If \a up is \c true, \a item will be moved upwards (index -= 1),
  * or downwards (index += 1) otherwise.
+ *
+ * \note Pointers to the moved item stay valid and keep pointing to
+ * the same item after the move.
  */
 
 bool IdentityBlock::moveItem(IdentityBlockItem *item, bool up)
 {
     if (items.size() < 2) return false;
 
-    for (int i=0; i<items.size(); i++)
-    {
-        if (&items[i] == item)
-        {
-            if (up)
-            {
-                if (i == 0) return false;
-                IdentityBlockItem tempItem = items[i];
-                items[i] = items[i-1];
-                items[i-1] = tempItem;
-            }
-            else
-            {
-                if (i == (items.size() - 1)) return false;
-                IdentityBlockItem tempItem = items[i];
-                items[i] = items[i+1];
-                items[i+1] = tempItem;
-            }
+    int from = indexOfItem(item);
+    if (from < 0) return false;
 
-            return true;
-        }
-    }
+    int to = up ? from - 1 : from + 1;
+    if (to < 0 || to >= items.size()) return false;
 
-    return false;
+    items.move(from, to);
+    return true;
 }
 
 /*!
@@ -466,6 +808,212 @@ bool IdentityBlock::insertItem(IdentityBlockItem item, IdentityBlockItem *after)
     return false;
 }
 
+/*!
+ * Returns \c true if the block equals \a other in type, description,
+ * color and all of its items, or \c false otherwise.
+ */
+
+bool IdentityBlock::operator==(const IdentityBlock& other) const
+{
+    return blockType == other.blockType &&
+           description == other.description &&
+           color == other.color &&
+           items == other.items;
+}
+
+/*!
+ * Returns \c true if the block differs from \a other, or \c false
+ * otherwise.
+ */
+
+bool IdentityBlock::operator!=(const IdentityBlock& other) const
+{
+    return !(*this == other);
+}
+
+/**************************************************************
+ *************************************************************/
+
+/*!
+ *
+ * \class IdentityModelObserver
+ * \brief An interface for getting notified about changes to an
+ * \c IdentityModel.
+ *
+ * Observers are registered with \c IdentityModel::addObserver() and
+ * receive fine-grained notifications about inserted, removed, moved
+ * and changed blocks and items. Insertions, removals and moves are
+ * announced by an "about to be" notification right before the model
+ * is changed, whose indexes refer to the state before the change (except
+ * for the index to insert at or move to). All other notifications are
+ * sent after the change has been applied and refer to the resulting
+ * state. The default
+ * implementations do nothing, so subclasses only need to override
+ * the notifications they are interested in.
+ *
+ * \sa IdentityModel, UiBuilder
+ *
+*/
+
+IdentityModelObserver::~IdentityModelObserver()
+{
+}
+
+/*!
+ * Called right before a block is inserted at \a blockIndex.
+ */
+
+void IdentityModelObserver::blockAboutToBeInserted(int blockIndex)
+{
+    Q_UNUSED(blockIndex)
+}
+
+/*!
+ * Called after a block was inserted at \a blockIndex.
+ */
+
+void IdentityModelObserver::blockInserted(int blockIndex)
+{
+    Q_UNUSED(blockIndex)
+}
+
+/*!
+ * Called right before the block at \a blockIndex is removed.
+ */
+
+void IdentityModelObserver::blockAboutToBeRemoved(int blockIndex)
+{
+    Q_UNUSED(blockIndex)
+}
+
+/*!
+ * Called after the block formerly located at \a blockIndex was removed.
+ */
+
+void IdentityModelObserver::blockRemoved(int blockIndex)
+{
+    Q_UNUSED(blockIndex)
+}
+
+/*!
+ * Called right before the block at \a fromIndex is moved to \a toIndex.
+ */
+
+void IdentityModelObserver::blockAboutToBeMoved(int fromIndex, int toIndex)
+{
+    Q_UNUSED(fromIndex)
+    Q_UNUSED(toIndex)
+}
+
+/*!
+ * Called after a block was moved from \a fromIndex to \a toIndex.
+ */
+
+void IdentityModelObserver::blockMoved(int fromIndex, int toIndex)
+{
+    Q_UNUSED(fromIndex)
+    Q_UNUSED(toIndex)
+}
+
+/*!
+ * Called after the contents of the block at \a blockIndex were
+ * replaced or changed in an unspecified way. The number of items
+ * within the block is the same as before.
+ */
+
+void IdentityModelObserver::blockChanged(int blockIndex)
+{
+    Q_UNUSED(blockIndex)
+}
+
+/*!
+ * Called right before an item is inserted at \a itemIndex into the
+ * block at \a blockIndex.
+ */
+
+void IdentityModelObserver::itemAboutToBeInserted(int blockIndex, int itemIndex)
+{
+    Q_UNUSED(blockIndex)
+    Q_UNUSED(itemIndex)
+}
+
+/*!
+ * Called after an item was inserted at \a itemIndex into the block
+ * at \a blockIndex.
+ */
+
+void IdentityModelObserver::itemInserted(int blockIndex, int itemIndex)
+{
+    Q_UNUSED(blockIndex)
+    Q_UNUSED(itemIndex)
+}
+
+/*!
+ * Called right before the item at \a itemIndex is removed from the
+ * block at \a blockIndex.
+ */
+
+void IdentityModelObserver::itemAboutToBeRemoved(int blockIndex, int itemIndex)
+{
+    Q_UNUSED(blockIndex)
+    Q_UNUSED(itemIndex)
+}
+
+/*!
+ * Called after the item formerly located at \a itemIndex was removed
+ * from the block at \a blockIndex.
+ */
+
+void IdentityModelObserver::itemRemoved(int blockIndex, int itemIndex)
+{
+    Q_UNUSED(blockIndex)
+    Q_UNUSED(itemIndex)
+}
+
+/*!
+ * Called right before the item at \a fromIndex within the block at
+ * \a blockIndex is moved to \a toIndex.
+ */
+
+void IdentityModelObserver::itemAboutToBeMoved(int blockIndex, int fromIndex, int toIndex)
+{
+    Q_UNUSED(blockIndex)
+    Q_UNUSED(fromIndex)
+    Q_UNUSED(toIndex)
+}
+
+/*!
+ * Called after an item within the block at \a blockIndex was moved
+ * from \a fromIndex to \a toIndex.
+ */
+
+void IdentityModelObserver::itemMoved(int blockIndex, int fromIndex, int toIndex)
+{
+    Q_UNUSED(blockIndex)
+    Q_UNUSED(fromIndex)
+    Q_UNUSED(toIndex)
+}
+
+/*!
+ * Called after the value of the item at \a itemIndex within the block
+ * at \a blockIndex has changed.
+ */
+
+void IdentityModelObserver::itemChanged(int blockIndex, int itemIndex)
+{
+    Q_UNUSED(blockIndex)
+    Q_UNUSED(itemIndex)
+}
+
+/*!
+ * Called after the model has been changed in a way that requires
+ * observers to discard and rebuild their representation.
+ */
+
+void IdentityModelObserver::modelReset()
+{
+}
+
 /**************************************************************
  *************************************************************/
 
@@ -535,7 +1083,7 @@ QStringList IdentityBlockItem::getDataTypeList()
  * Returns the raw binary representation of the \c IdentityBlockItem.
  */
 
-QByteArray IdentityBlockItem::toByteArray()
+QByteArray IdentityBlockItem::toByteArray() const
 {
     QByteArray ba;
 
@@ -567,3 +1115,29 @@ QByteArray IdentityBlockItem::toByteArray()
 
     return ba;
 }
+
+/*!
+ * Returns \c true if all fields of the item equal those of \a other,
+ * or \c false otherwise.
+ */
+
+bool IdentityBlockItem::operator==(const IdentityBlockItem& other) const
+{
+    return name == other.name &&
+           description == other.description &&
+           dataType == other.dataType &&
+           nrOfBytes == other.nrOfBytes &&
+           value == other.value &&
+           repeatIndex == other.repeatIndex &&
+           repeatCount == other.repeatCount;
+}
+
+/*!
+ * Returns \c true if the item differs from \a other, or \c false
+ * otherwise.
+ */
+
+bool IdentityBlockItem::operator!=(const IdentityBlockItem& other) const
+{
+    return !(*this == other);
+}
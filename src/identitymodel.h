@@ -27,7 +27,7 @@
 #ifndef IDENTITYMODEL_H
 #define IDENTITYMODEL_H
 
-#include "common.h"
+#include "corecommon.h"
 
 struct ItemDataTypeInfo
 {
@@ -48,6 +48,7 @@ enum ItemDataType
 // Forward declarations
 class IdentityBlock;
 class IdentityBlockItem;
+class IdentityModelObserver;
 class CryptUtil;
 
 /**********************************************
@@ -59,15 +60,32 @@ class IdentityModel
 public:
     QList<IdentityBlock> blocks;
 
+private:
+    QList<IdentityModelObserver*> m_Observers;
+
 public:
+    IdentityModel();
+    IdentityModel(const IdentityModel& other);
+    IdentityModel& operator=(const IdentityModel& other);
     void writeToFile(QString fileName);
     IdentityBlock* getBlock(int blockType);
+    int indexOfBlock(const IdentityBlock* block);
     QList<int> getAvailableBlockTypes();
     bool deleteBlock(IdentityBlock* block);
     bool moveBlock(IdentityBlock* block, bool up);
     bool insertBlock(IdentityBlock block, IdentityBlock* after);
+    bool updateBlock(IdentityBlock* block, IdentityBlock newBlock);
+    bool deleteItem(IdentityBlock* block, IdentityBlockItem* item);
+    bool moveItem(IdentityBlock* block, IdentityBlockItem* item, bool up);
+    bool insertItem(IdentityBlock* block, IdentityBlockItem item, IdentityBlockItem* after);
+    bool setItemValue(IdentityBlock* block, IdentityBlockItem* item, QString value);
+    void addObserver(IdentityModelObserver* observer);
+    void removeObserver(IdentityModelObserver* observer);
+    void notifyBlockChanged(IdentityBlock* block);
+    void notifyModelReset();
     void clear();
     void import(IdentityModel& model);
+    int applyChanges(const IdentityModel& model);
     QByteArray getRawBytes();
     QString getTextualVersion();
     QString getTextualVersionFormatted();
@@ -75,6 +93,31 @@ public:
     bool hasBlockType(int blockType);
 };
 
+/**********************************************
+ *    class IdentityModelObserver             *
+ *********************************************/
+
+class IdentityModelObserver
+{
+public:
+    virtual ~IdentityModelObserver();
+    virtual void blockAboutToBeInserted(int blockIndex);
+    virtual void blockInserted(int blockIndex);
+    virtual void blockAboutToBeRemoved(int blockIndex);
+    virtual void blockRemoved(int blockIndex);
+    virtual void blockAboutToBeMoved(int fromIndex, int toIndex);
+    virtual void blockMoved(int fromIndex, int toIndex);
+    virtual void blockChanged(int blockIndex);
+    virtual void itemAboutToBeInserted(int blockIndex, int itemIndex);
+    virtual void itemInserted(int blockIndex, int itemIndex);
+    virtual void itemAboutToBeRemoved(int blockIndex, int itemIndex);
+    virtual void itemRemoved(int blockIndex, int itemIndex);
+    virtual void itemAboutToBeMoved(int blockIndex, int fromIndex, int toIndex);
+    virtual void itemMoved(int blockIndex, int fromIndex, int toIndex);
+    virtual void itemChanged(int blockIndex, int itemIndex);
+    virtual void modelReset();
+};
+
 /**********************************************
  *    class IdentityBlock                     *
  *********************************************/
@@ -89,11 +132,14 @@ public:
 
 public:
     IdentityBlockItem* getItem(QString name);
+    int indexOfItem(const IdentityBlockItem* item);
     bool duplicateItem(IdentityBlockItem* item);
     bool deleteItem(IdentityBlockItem* item);
     bool moveItem(IdentityBlockItem* item, bool up);
     bool insertItem(IdentityBlockItem item, IdentityBlockItem* after);
-    QByteArray toByteArray();
+    QByteArray toByteArray() const;
+    bool operator==(const IdentityBlock& other) const;
+    bool operator!=(const IdentityBlock& other) const;
 };
 
 /**********************************************
@@ -106,7 +152,9 @@ public:
     static QMap<ItemDataType, ItemDataTypeInfo> DataTypeMap;
     static ItemDataType findDataType(QString dataType);
     static QStringList getDataTypeList();
-    QByteArray toByteArray();
+    QByteArray toByteArray() const;
+    bool operator==(const IdentityBlockItem& other) const;
+    bool operator!=(const IdentityBlockItem& other) const;
 
 public:
     QString name = "";
@@ -25,6 +25,7 @@
  */
 
 #include "identityparser.h"
+#include "tracer.h"
 
 /*!
  *
@@ -44,6 +45,12 @@
  * with the app (within the blockdev/ subdirectory) to get a sense for how
  * data types, repitition and dynamic item lengths are handled.
  *
+ * Block definitions are read from disk for every parsed block by
+ * default, so that changes made using the block designer apply
+ * immediately. Long-running processes parsing lots of identities can
+ * keep the parsed definitions in memory by calling
+ * \c setBlockDefinitionCacheEnabled().
+ *
  * More information SQRL's storage format can be found here:
  * https://www.grc.com/sqrl/SQRL_Cryptography.pdf
  *
@@ -53,6 +60,10 @@
 
 const QString IdentityParser::HEADER = "sqrldata";
 const QString IdentityParser::HEADER_BASE64 = "SQRLDATA";
+QMutex IdentityParser::m_BlockDefinitionMutex;
+QHash<int, QJsonDocument> IdentityParser::m_BlockDefinitionCache;
+bool IdentityParser::m_bBlockDefinitionCacheEnabled = false;
+quint64 IdentityParser::m_BlockDefinitionCacheGeneration = 0;
 
 /*!
  * Parses the file specified by \a fileName, and places a pointer to
@@ -66,6 +77,8 @@ const QString IdentityParser::HEADER_BASE64 = "SQRLDATA";
 
 void IdentityParser::parseFile(QString fileName, IdentityModel* model)
 {
+    TRACE_SPAN("IdentityParser::parseFile", "parser");
+
     if (fileName.isEmpty() || !model)
     {
         throw std::invalid_argument(
@@ -138,6 +151,9 @@ bool IdentityParser::hasBlockDefinition(int blockType)
 
 void IdentityParser::parseIdentityData(QByteArray data, IdentityModel* model)
 {
+    TRACE_SPAN("IdentityParser::parseIdentityData", "parser");
+    ALLOC_SCOPE("IdentityParser::parseIdentityData");
+
     m_bIsBase64 = false;
 
     if (!checkHeader(data))
@@ -160,15 +176,8 @@ void IdentityParser::parseIdentityData(QByteArray data, IdentityModel* model)
         int blockLength = getBlockLength(data);
         int blockType = getBlockType(data);
 
-        QByteArray baBlockDef = getBlockDefinitionBytes(blockType);
-        if (baBlockDef.isNull() || baBlockDef.isEmpty())
-        {
-            baBlockDef = getUnknownBlockDefinition();
-        }
-
-
         QJsonDocument blockDef;
-        if(parseBlockDefinition(baBlockDef, &blockDef))
+        if (getBlockDefinition(blockType, &blockDef))
         {
             IdentityBlock block = parseBlock(data, &blockDef);
             model->blocks.push_back(block);
@@ -360,6 +369,8 @@ bool IdentityParser::checkHeader(QByteArray data)
 
 QByteArray IdentityParser::getBlockDefinitionBytes(int blockType)
 {
+    TRACE_SPAN("IdentityParser::getBlockDefinitionBytes", "parser");
+
     QDir path = QDir::currentPath();
     QDir fullPath = path.filePath(QString("blockdef/") + QString::number(blockType) + ".json");
     QString sFullPath = fullPath.absolutePath();
@@ -397,33 +408,117 @@ bool IdentityParser::parseBlockDefinition(QByteArray data, QJsonDocument* jsonDo
 }
 
 /*!
- * Converts \a item into a number of \c QStandardItem objects and returns
- * a list of pointers to those objects.
+ * Enables or disables keeping parsed block definitions in memory,
+ * depending on \a enabled. Changing the setting clears the cache.
  *
- * This is used to display block items in a UI view using the view/model paradigm.
+ * \sa preloadBlockDefinitions
  */
 
-QList<QStandardItem*> IdentityParser::toStandardItems(QJsonObject *item)
+void IdentityParser::setBlockDefinitionCacheEnabled(bool enabled)
 {
-    QList<QStandardItem*> result;
+    QMutexLocker locker(&m_BlockDefinitionMutex);
 
-    int nrOfBytes = (*item)["bytes"].toInt(0);
-    int repeatIndex = (*item)["repeat_index"].toInt(-1);
-    int repeatCount = (*item)["repeat_count"].toInt(1);
+    m_bBlockDefinitionCacheEnabled = enabled;
+    m_BlockDefinitionCache.clear();
+    m_BlockDefinitionCacheGeneration++;
+}
 
-    result.append(new QStandardItem((*item)["name"].toString("")));
-    result.append(new QStandardItem((*item)["description"].toString("")));
-    result.append(new QStandardItem((*item)["type"].toString("UNDEFINED")));
-    result.append(new QStandardItem(QString::number(nrOfBytes)));
-    result.append(new QStandardItem(QString::number(repeatIndex)));
-    result.append(new QStandardItem(QString::number(repeatCount)));
+/*!
+ * Parses all block definitions within the "blockdef/" subdirectory
+ * into the block definition cache and returns their number. Does
+ * nothing and returns 0 if the cache is disabled.
+ *
+ * \sa setBlockDefinitionCacheEnabled
+ */
 
-    return result;
+int IdentityParser::preloadBlockDefinitions()
+{
+    TRACE_SPAN("IdentityParser::preloadBlockDefinitions", "parser");
+
+    QDir blockDefDir(QDir::current().filePath("blockdef"));
+    const QStringList fileNames = blockDefDir.entryList(QStringList() << "*.json", QDir::Files);
+    int count = 0;
+
+    QMutexLocker locker(&m_BlockDefinitionMutex);
+    if (!m_bBlockDefinitionCacheEnabled) return 0;
+
+    for (const QString& fileName : fileNames)
+    {
+        bool ok = false;
+        int blockType = QFileInfo(fileName).completeBaseName().toInt(&ok);
+        if (!ok) continue;
+
+        QJsonDocument blockDef;
+        if (!parseBlockDefinition(getBlockDefinitionBytes(blockType), &blockDef)) continue;
+
+        m_BlockDefinitionCache.insert(blockType, blockDef);
+        count++;
+    }
+
+    return count;
+}
+
+/*!
+ * Places the parsed block definition for blocks of type \a blockType
+ * into \a blockDef, falling back to the "unknown block" definition if
+ * there is no specialized one. Returns \c true on success, or \c false
+ * if the block definition is invalid.
+ *
+ * If the block definition cache is enabled, definitions are only read
+ * and parsed once.
+ */
+
+bool IdentityParser::getBlockDefinition(int blockType, QJsonDocument* blockDef)
+{
+    QMutexLocker locker(&m_BlockDefinitionMutex);
+
+    if (m_bBlockDefinitionCacheEnabled && m_BlockDefinitionCache.contains(blockType))
+    {
+        *blockDef = m_BlockDefinitionCache.value(blockType);
+        return true;
+    }
+
+    bool cacheEnabled = m_bBlockDefinitionCacheEnabled;
+    quint64 cacheGeneration = m_BlockDefinitionCacheGeneration;
+    locker.unlock();
+
+    QByteArray baBlockDef = getBlockDefinitionBytes(blockType);
+    if (baBlockDef.isNull() || baBlockDef.isEmpty())
+    {
+        baBlockDef = getUnknownBlockDefinition();
+    }
+
+    if (!parseBlockDefinition(baBlockDef, blockDef)) return false;
+
+    if (cacheEnabled)
+    {
+        // The cache may have been disabled or cleared in the meantime,
+        // or another thread may have cached the definition already
+        locker.relock();
+        if (m_bBlockDefinitionCacheEnabled &&
+                m_BlockDefinitionCacheGeneration == cacheGeneration &&
+                !m_BlockDefinitionCache.contains(blockType))
+        {
+            m_BlockDefinitionCache.insert(blockType, *blockDef);
+        }
+    }
+
+    return true;
+}
+
+/*!
+ * Registers the resources of the idtoolcore library and returns \c true.
+ */
+
+static bool initCoreResources()
+{
+    Q_INIT_RESOURCE(idtoolcore);
+    return true;
 }
 
 /*!
  * Returns the raw, binary json block definition for an "unknown block".
- * This block definition is embedded into the application binary and is
+ * This block definition is embedded into the idtoolcore library and is
  * being used as a fallback if no "specialized" block definition can be
  * found within the "blockdef/" subdirectory for a specific block type.
  *
@@ -433,6 +528,11 @@ QList<QStandardItem*> IdentityParser::toStandardItems(QJsonObject *item)
 
 QByteArray IdentityParser::getUnknownBlockDefinition()
 {
+    // The resource is compiled into the (possibly static) idtoolcore
+    // library, which means it must be registered explicitly.
+    static const bool bResourceInitialized = initCoreResources();
+    Q_UNUSED(bResourceInitialized)
+
     QByteArray ba;
     QString resFile = ":/res/file/unknown_blockdef.json";
     QFile file(resFile);
@@ -458,6 +558,8 @@ QByteArray IdentityParser::getUnknownBlockDefinition()
 
 IdentityBlock IdentityParser::createEmptyBlock(int blockType)
 {
+    TRACE_SPAN("IdentityParser::createEmptyBlock", "parser");
+
     IdentityBlock result;
 
     QByteArray jsonData = getBlockDefinitionBytes(blockType);
@@ -27,8 +27,9 @@
 #ifndef S4PARSER_H
 #define S4PARSER_H
 
-#include "common.h"
+#include "corecommon.h"
 #include "identitymodel.h"
+#include <QMutex>
 
 /**********************************************
  *    class IdentityParser                    *
@@ -42,6 +43,10 @@ public:
 
 private:
     bool m_bIsBase64 = false;
+    static QMutex m_BlockDefinitionMutex;
+    static QHash<int, QJsonDocument> m_BlockDefinitionCache;
+    static bool m_bBlockDefinitionCacheEnabled;
+    static quint64 m_BlockDefinitionCacheGeneration;
 
 public:
     void parseFile(QString fileName, IdentityModel* model);
@@ -50,15 +55,17 @@ public:
     static bool hasBlockDefinition(int blockType);
     static QByteArray getBlockDefinitionBytes(int blockType);
     static bool parseBlockDefinition(QByteArray data, QJsonDocument* jsonDoc);
-    static QList<QStandardItem*> toStandardItems(QJsonObject* item);
     static IdentityBlock createEmptyBlock(int blockType);
     static IdentityBlockItem createEmptyItem(QString name, QString description, ItemDataType dataType, int nrOfBytes);
     static QByteArray base64DecodeIdentity(QByteArray data);
+    static void setBlockDefinitionCacheEnabled(bool enabled);
+    static int preloadBlockDefinitions();
 
 private:
     IdentityBlock parseBlock(QByteArray data, QJsonDocument* blockDef);
     bool checkHeader(QByteArray data);
     QByteArray getUnknownBlockDefinition();
+    bool getBlockDefinition(int blockType, QJsonDocument* blockDef);
     int getBlockLength(QByteArray data);
     int getBlockType(QByteArray data);
     QString parseUint8(QByteArray data, int offset);
@@ -0,0 +1,606 @@
+/*
+ * This file is part of the "IdTool" utility app.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Alexander Hauser
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "identityservice.h"
+#include "cryptutil.h"
+#include "enscryptcalibration.h"
+#include "identityconverter.h"
+#include "identityjson.h"
+#include "identityparser.h"
+#include <cmath>
+
+/*!
+ *
+ * \class IdentityService
+ * \brief Serves identity parsing and crypto requests for long-running
+ * processes such as the \c idtoold daemon.
+ *
+ * Requests and responses are JSON objects. Every request names its
+ * operation within the \c op key and may carry an \c id, which is
+ * copied into the response, so that clients can match out-of-order
+ * responses. Responses contain \c ok, and \c error if \c ok is false.
+ *
+ * Identities are passed as strings within the \c identity key, either
+ * in base64 ("SQRLDATA...") or textual format, or as their canonical
+ * JSON representation within the \c json key (see \c IdentityJson).
+ * Binary data (keys, raw identities) is hex- or base64-encoded.
+ *
+ * Supported operations:
+ *
+ * \list
+ *   \li \c ping - Does nothing.
+ *   \li \c parse - Returns the canonical JSON representation of the
+ *       \c identity.
+ *   \li \c validate - Checks whether the \c identity can be parsed (and
+ *       the check characters of textual identities), returning \c valid,
+ *       \c format, \c block_types and \c error.
+ *   \li \c serialize - Converts the identity to \c format (binary,
+ *       base64, text or json), returned within \c data (or \c identity
+ *       for json). Binary data is base64-encoded.
+ *   \li \c site-keys - Derives the site-specific key pair for \c domain
+ *       and \c alt_id, using \c password.
+ *   \li \c decrypt - Decrypts the identity keys using \c password
+ *       and/or \c rescue_code.
+ *   \li \c base56-encode, \c base56-decode - Converts between hex
+ *       \c data and base56 \c text.
+ *   \li \c stats - Returns the latency statistics of all operations.
+ * \endlist
+ *
+ * \c warmUp() keeps the block definitions in memory and loads the
+ * EnScrypt calibration data once. If enabled using
+ * \c setKeyCacheCapacity(), keys derived from passwords are cached in
+ * memory (indexed by a hash of the password and the scrypt parameters),
+ * so that repeated requests for the same identity skip the expensive
+ * key derivation.
+ *
+ * All public methods are thread-safe.
+ *
+ * \sa IdentityJson, IdentityConverter
+ *
+*/
+
+const QStringList IdentityService::OPERATIONS = {
+    "ping", "parse", "validate", "serialize", "site-keys",
+    "decrypt", "base56-encode", "base56-decode", "stats"
+};
+
+const int IdentityService::LATENCY_BUCKET_COUNT = 32;
+
+/*!
+ * Creates a new \c IdentityService object with the key cache disabled.
+ */
+
+IdentityService::IdentityService()
+{
+}
+
+/*!
+ * Prepares the service for serving requests: enables and fills the
+ * block definition cache, loads the EnScrypt calibration data and
+ * initializes libsodium.
+ */
+
+void IdentityService::warmUp()
+{
+    IdentityParser::setBlockDefinitionCacheEnabled(true);
+    int blockDefinitionCount = IdentityParser::preloadBlockDefinitions();
+    EnScryptCalibration::loadCache();
+
+    if (sodium_init() < 0)
+    {
+        throw std::runtime_error(
+                    QObject::tr("Initializing libsodium failed!").toStdString());
+    }
+
+    QMutexLocker locker(&m_Mutex);
+    m_BlockDefinitionCount = blockDefinitionCount;
+}
+
+/*!
+ * Sets the maximum number of cached password-derived keys to
+ * \a capacity. A capacity of 0 disables and clears the cache.
+ */
+
+void IdentityService::setKeyCacheCapacity(int capacity)
+{
+    QMutexLocker locker(&m_Mutex);
+
+    m_KeyCacheCapacity = qMax(0, capacity);
+    while (m_KeyCacheOrder.size() > m_KeyCacheCapacity)
+        m_KeyCache.remove(m_KeyCacheOrder.dequeue());
+}
+
+/*!
+ * Returns the maximum number of cached password-derived keys.
+ */
+
+int IdentityService::getKeyCacheCapacity()
+{
+    QMutexLocker locker(&m_Mutex);
+    return m_KeyCacheCapacity;
+}
+
+/*!
+ * Handles \a request and returns the response. Errors are reported
+ * within the response, this method does not throw.
+ *
+ * The latency recorded for the operation is the time spent handling
+ * the request plus \a queuedNsecs, the time the request has been
+ * waiting before (e.g. for a worker thread).
+ */
+
+QJsonObject IdentityService::handleRequest(const QJsonObject& request, qint64 queuedNsecs)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    QString operation = request["op"].toString();
+    QJsonObject response;
+    bool ok = true;
+
+    try
+    {
+        response = dispatch(operation, request);
+    }
+    catch (std::exception& e)
+    {
+        response = QJsonObject();
+        response["error"] = QString(e.what());
+        ok = false;
+    }
+
+    response["ok"] = ok;
+    if (request.contains("id")) response["id"] = request["id"];
+
+    recordLatency(OPERATIONS.contains(operation) ? operation : "invalid",
+                  queuedNsecs + timer.nsecsElapsed(), ok);
+    return response;
+}
+
+/*!
+ * Adds a request for \a operation, which took \a nsecs nanoseconds
+ * and succeeded if \a ok is \c true, to the latency statistics.
+ */
+
+void IdentityService::recordLatency(QString operation, qint64 nsecs, bool ok)
+{
+    // Bucket i holds latencies of [2^i, 2^(i+1)) microseconds
+    int bucket = 0;
+    for (qint64 usecs = nsecs / 1000; usecs > 1 && bucket < LATENCY_BUCKET_COUNT - 1; usecs >>= 1)
+        bucket++;
+
+    QMutexLocker locker(&m_Mutex);
+    LatencyStats& stats = m_Latencies[operation];
+
+    if (stats.buckets.isEmpty()) stats.buckets.fill(0, LATENCY_BUCKET_COUNT);
+    if (stats.count == 0 || nsecs < stats.minNsecs) stats.minNsecs = nsecs;
+    if (nsecs > stats.maxNsecs) stats.maxNsecs = nsecs;
+    stats.count++;
+    if (!ok) stats.errors++;
+    stats.totalNsecs += nsecs;
+    stats.buckets[bucket]++;
+}
+
+/*!
+ * Returns the latency statistics for \a operation.
+ */
+
+IdentityService::LatencyStats IdentityService::getLatencyStats(QString operation)
+{
+    QMutexLocker locker(&m_Mutex);
+    return m_Latencies.value(operation);
+}
+
+/*!
+ * Returns the latency statistics of all operations that have been
+ * requested so far (in microseconds, percentiles are upper bounds
+ * with a resolution of a power of two), along with the state of the
+ * key cache.
+ */
+
+QJsonObject IdentityService::getStatsJson()
+{
+    QMutexLocker locker(&m_Mutex);
+
+    QJsonObject operations;
+    for (auto it = m_Latencies.constBegin(); it != m_Latencies.constEnd(); ++it)
+    {
+        const LatencyStats& stats = it.value();
+        QJsonObject operation;
+        operation["count"] = stats.count;
+        operation["errors"] = stats.errors;
+        operation["mean_us"] = stats.count > 0 ? stats.totalNsecs / 1000.0 / stats.count : 0;
+        operation["min_us"] = stats.minNsecs / 1000.0;
+        operation["max_us"] = stats.maxNsecs / 1000.0;
+        operation["p50_us"] = getPercentile(stats, 0.5) / 1000.0;
+        operation["p90_us"] = getPercentile(stats, 0.9) / 1000.0;
+        operation["p99_us"] = getPercentile(stats, 0.99) / 1000.0;
+        operations[it.key()] = operation;
+    }
+
+    QJsonObject keyCache;
+    keyCache["capacity"] = m_KeyCacheCapacity;
+    keyCache["size"] = m_KeyCache.size();
+    keyCache["hits"] = m_KeyCacheHits;
+    keyCache["misses"] = m_KeyCacheMisses;
+
+    QJsonObject json;
+    json["operations"] = operations;
+    json["key_cache"] = keyCache;
+    json["block_definitions"] = m_BlockDefinitionCount;
+    return json;
+}
+
+/*!
+ * Runs \a operation for \a request and returns the operation's result.
+ *
+ * \throws A \c std::runtime_error is raised if the operation is unknown
+ * or fails.
+ */
+
+QJsonObject IdentityService::dispatch(QString operation, const QJsonObject& request)
+{
+    if (operation == "ping") return QJsonObject();
+    if (operation == "parse") return parse(request);
+    if (operation == "validate") return validate(request);
+    if (operation == "serialize") return serialize(request);
+    if (operation == "site-keys") return siteKeys(request);
+    if (operation == "decrypt") return decrypt(request);
+    if (operation == "base56-encode") return base56Encode(request);
+    if (operation == "base56-decode") return base56Decode(request);
+    if (operation == "stats") return getStatsJson();
+
+    throw std::runtime_error(
+                QObject::tr("Unknown operation \"%1\"!").arg(operation).toStdString());
+}
+
+/*!
+ * Handles the "parse" operation.
+ */
+
+QJsonObject IdentityService::parse(const QJsonObject& request)
+{
+    QJsonObject result;
+    result["identity"] = IdentityJson::toJson(readIdentity(request));
+    return result;
+}
+
+/*!
+ * Handles the "validate" operation. Invalid identities are not
+ * treated as an error of the request.
+ */
+
+QJsonObject IdentityService::validate(const QJsonObject& request)
+{
+    QJsonObject result;
+
+    if (!request["json"].isObject())
+    {
+        QString identityString = request["identity"].toString();
+        IdentityConverter::Format format = IdentityConverter::detectFormat(identityString.toLatin1());
+        result["format"] = IdentityConverter::formatToString(format);
+
+        if (format == IdentityConverter::TEXT && !CryptUtil::verifyTextualIdentity(identityString))
+        {
+            result["valid"] = false;
+            result["error"] = QObject::tr("Invalid check characters!");
+            return result;
+        }
+    }
+
+    try
+    {
+        IdentityModel identity = readIdentity(request);
+
+        QJsonArray blockTypes;
+        for (const IdentityBlock& block : qAsConst(identity.blocks))
+            blockTypes.append(block.blockType);
+
+        result["valid"] = true;
+        result["block_types"] = blockTypes;
+    }
+    catch (std::exception& e)
+    {
+        result["valid"] = false;
+        result["error"] = QString(e.what());
+    }
+
+    return result;
+}
+
+/*!
+ * Handles the "serialize" operation.
+ */
+
+QJsonObject IdentityService::serialize(const QJsonObject& request)
+{
+    IdentityModel identity = readIdentity(request);
+    QString formatName = request["format"].toString("base64");
+    QJsonObject result;
+
+    if (formatName == "json")
+    {
+        result["identity"] = IdentityJson::toJson(identity);
+        return result;
+    }
+
+    IdentityConverter::Format format = IdentityConverter::formatFromString(formatName);
+    if (format == IdentityConverter::UNKNOWN_FORMAT)
+    {
+        throw std::runtime_error(
+                    QObject::tr("Unknown format \"%1\"!").arg(formatName).toStdString());
+    }
+
+    QByteArray data = IdentityConverter::encode(identity.getRawBytes(), format);
+    result["data"] = format == IdentityConverter::BINARY ?
+                QString::fromLatin1(data.toBase64()) : QString::fromLatin1(data);
+    return result;
+}
+
+/*!
+ * Handles the "site-keys" operation.
+ */
+
+QJsonObject IdentityService::siteKeys(const QJsonObject& request)
+{
+    if (!request["password"].isString() || !request["domain"].isString())
+    {
+        throw std::runtime_error(
+                    QObject::tr("Both password and domain are required!").toStdString());
+    }
+
+    IdentityModel identity = readIdentity(request);
+    QByteArray imk = decryptImk(identity, request["password"].toString());
+
+    QByteArray publicKey(crypto_sign_PUBLICKEYBYTES, 0);
+    QByteArray privateKey(crypto_sign_SECRETKEYBYTES, 0);
+    if (!CryptUtil::createSiteKeys(publicKey, privateKey, request["domain"].toString(),
+                                   request["alt_id"].toString(), imk))
+    {
+        throw std::runtime_error(
+                    QObject::tr("Creation of site keys failed!").toStdString());
+    }
+
+    QJsonObject result;
+    result["public_key"] = QString(publicKey.toHex());
+    result["private_key"] = QString(privateKey.toHex());
+    return result;
+}
+
+/*!
+ * Handles the "decrypt" operation.
+ */
+
+QJsonObject IdentityService::decrypt(const QJsonObject& request)
+{
+    if (!request["password"].isString() && !request["rescue_code"].isString())
+    {
+        throw std::runtime_error(
+                    QObject::tr("Either password or rescue_code is required!").toStdString());
+    }
+
+    IdentityModel identity = readIdentity(request);
+    QJsonObject result;
+    QByteArray imk, ilk;
+
+    if (request["password"].isString())
+    {
+        imk = decryptImk(identity, request["password"].toString(), &ilk);
+        result["imk"] = QString(imk.toHex());
+        result["ilk"] = QString(ilk.toHex());
+    }
+
+    if (request["rescue_code"].isString())
+    {
+        IdentityBlock* pBlock2 = identity.getBlock(2);
+        QString rescueCode = CryptUtil::stripWhitespace(request["rescue_code"].toString()).remove('-');
+        QByteArray iuk(32, 0);
+
+        if (pBlock2 == nullptr || !CryptUtil::decryptBlock2(iuk, pBlock2, rescueCode))
+        {
+            throw std::runtime_error(
+                        QObject::tr("Decryption of block 2 failed!").toStdString());
+        }
+
+        result["iuk"] = QString(iuk.toHex());
+        if (imk.isEmpty()) imk = CryptUtil::createImkFromIuk(iuk);
+    }
+
+    IdentityBlock* pBlock3 = identity.getBlock(3);
+    if (pBlock3 != nullptr)
+    {
+        QList<QByteArray> previousIuks;
+        if (!CryptUtil::decryptBlock3(previousIuks, pBlock3, imk))
+        {
+            throw std::runtime_error(
+                        QObject::tr("Decryption of block 3 failed!").toStdString());
+        }
+
+        QJsonArray previousIukArray;
+        for (const QByteArray& previousIuk : previousIuks)
+            previousIukArray.append(QString(previousIuk.toHex()));
+        result["previous_iuks"] = previousIukArray;
+    }
+
+    return result;
+}
+
+/*!
+ * Handles the "base56-encode" operation.
+ */
+
+QJsonObject IdentityService::base56Encode(const QJsonObject& request)
+{
+    QJsonObject result;
+    result["text"] = CryptUtil::base56EncodeIdentity(
+                QByteArray::fromHex(request["data"].toString().toLatin1()));
+    return result;
+}
+
+/*!
+ * Handles the "base56-decode" operation.
+ */
+
+QJsonObject IdentityService::base56Decode(const QJsonObject& request)
+{
+    QByteArray data = CryptUtil::base56DecodeIdentity(request["text"].toString());
+    if (data.isEmpty())
+    {
+        throw std::runtime_error(
+                    QObject::tr("Invalid textual identity!").toStdString());
+    }
+
+    QJsonObject result;
+    result["data"] = QString(data.toHex());
+    return result;
+}
+
+/*!
+ * Returns the identity passed within \a request, either as its
+ * canonical JSON representation ("json") or as a base64 or textual
+ * identity string ("identity").
+ *
+ * \throws A \c std::runtime_error is raised if there is no identity
+ * or if it cannot be parsed.
+ */
+
+IdentityModel IdentityService::readIdentity(const QJsonObject& request)
+{
+    if (request["json"].isObject()) return IdentityJson::fromJson(request["json"].toObject());
+
+    QByteArray data = request["identity"].toString().toLatin1();
+    if (data.isEmpty())
+    {
+        throw std::runtime_error(
+                    QObject::tr("Missing identity!").toStdString());
+    }
+
+    IdentityModel identity;
+    IdentityParser parser;
+    parser.parseIdentityData(IdentityConverter::decode(
+                                 data, IdentityConverter::detectFormat(data)), &identity);
+    return identity;
+}
+
+/*!
+ * Decrypts block 1 of \a identity using \a password and returns the
+ * IMK. If \a ilk is not \c nullptr, it receives the ILK.
+ *
+ * \throws A \c std::runtime_error is raised if decryption fails.
+ */
+
+QByteArray IdentityService::decryptImk(IdentityModel& identity, QString password, QByteArray* ilk)
+{
+    IdentityBlock* pBlock1 = identity.getBlock(1);
+    QByteArray key;
+
+    if (pBlock1 == nullptr || pBlock1->items.size() < 14 || !deriveKey(key, *pBlock1, password))
+    {
+        throw std::runtime_error(
+                    QObject::tr("Decryption of block 1 failed!").toStdString());
+    }
+
+    QByteArray imk(32, 0);
+    QByteArray decryptedIlk(32, 0);
+    if (!CryptUtil::decryptBlock1(imk, decryptedIlk, pBlock1, key))
+    {
+        throw std::runtime_error(
+                    QObject::tr("Decryption of block 1 failed! Wrong password?").toStdString());
+    }
+
+    if (ilk != nullptr) *ilk = decryptedIlk;
+    return imk;
+}
+
+/*!
+ * Derives the key for decrypting \a block1 from \a password, using
+ * the key cache if it is enabled. Returns \c true on success, or
+ * \c false otherwise.
+ */
+
+bool IdentityService::deriveKey(QByteArray& key, IdentityBlock& block1, QString password)
+{
+    QMutexLocker locker(&m_Mutex);
+    bool cacheEnabled = m_KeyCacheCapacity > 0;
+    locker.unlock();
+
+    if (!cacheEnabled) return CryptUtil::createKeyFromPassword(key, block1, password);
+
+    // Index by a hash of the scrypt parameters and the password, so
+    // that the cache never holds any passwords
+    QByteArray input = block1.items[4].value.toLatin1() + '\0' +
+            block1.items[5].value.toLatin1() + '\0' +
+            block1.items[6].value.toLatin1() + '\0' +
+            password.toUtf8();
+    QByteArray cacheKey(crypto_generichash_BYTES, 0);
+    crypto_generichash(reinterpret_cast<unsigned char*>(cacheKey.data()), static_cast<size_t>(cacheKey.size()),
+                       reinterpret_cast<const unsigned char*>(input.constData()),
+                       static_cast<unsigned long long>(input.size()), nullptr, 0);
+    sodium_memzero(input.data(), static_cast<size_t>(input.size()));
+
+    locker.relock();
+    if (m_KeyCache.contains(cacheKey))
+    {
+        key = m_KeyCache.value(cacheKey);
+        m_KeyCacheHits++;
+        return true;
+    }
+    m_KeyCacheMisses++;
+    locker.unlock();
+
+    if (!CryptUtil::createKeyFromPassword(key, block1, password)) return false;
+
+    locker.relock();
+    if (m_KeyCacheCapacity > 0 && !m_KeyCache.contains(cacheKey))
+    {
+        m_KeyCache.insert(cacheKey, key);
+        m_KeyCacheOrder.enqueue(cacheKey);
+        while (m_KeyCacheOrder.size() > m_KeyCacheCapacity)
+            m_KeyCache.remove(m_KeyCacheOrder.dequeue());
+    }
+
+    return true;
+}
+
+/*!
+ * Returns the upper bound of the latency below which \a percentile
+ * (0..1) of all requests within \a stats completed, in nanoseconds.
+ */
+
+qint64 IdentityService::getPercentile(const LatencyStats& stats, double percentile)
+{
+    qint64 threshold = static_cast<qint64>(std::ceil(percentile * stats.count));
+    qint64 cumulated = 0;
+
+    for (int i=0; i<stats.buckets.size(); i++)
+    {
+        cumulated += stats.buckets.at(i);
+        if (cumulated >= threshold && cumulated > 0)
+            return qMin((Q_INT64_C(2) << i) * 1000, stats.maxNsecs);
+    }
+
+    return stats.maxNsecs;
+}
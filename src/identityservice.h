@@ -0,0 +1,90 @@
+/*
+ * This file is part of the "IdTool" utility app.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Alexander Hauser
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef IDENTITYSERVICE_H
+#define IDENTITYSERVICE_H
+
+#include "corecommon.h"
+#include "identitymodel.h"
+#include <QMutex>
+#include <QQueue>
+
+/**********************************************
+ *    class IdentityService                   *
+ *********************************************/
+
+class IdentityService
+{
+public:
+    struct LatencyStats
+    {
+        qint64 count = 0;
+        qint64 errors = 0;
+        qint64 totalNsecs = 0;
+        qint64 minNsecs = 0;
+        qint64 maxNsecs = 0;
+        QVector<qint64> buckets;
+    };
+
+    static const QStringList OPERATIONS;
+    static const int LATENCY_BUCKET_COUNT;
+
+private:
+    QMutex m_Mutex;
+    QHash<QString, LatencyStats> m_Latencies;
+    int m_KeyCacheCapacity = 0;
+    QHash<QByteArray, QByteArray> m_KeyCache;
+    QQueue<QByteArray> m_KeyCacheOrder;
+    qint64 m_KeyCacheHits = 0;
+    qint64 m_KeyCacheMisses = 0;
+    int m_BlockDefinitionCount = 0;
+
+public:
+    IdentityService();
+    void warmUp();
+    void setKeyCacheCapacity(int capacity);
+    int getKeyCacheCapacity();
+    QJsonObject handleRequest(const QJsonObject& request, qint64 queuedNsecs = 0);
+    void recordLatency(QString operation, qint64 nsecs, bool ok);
+    LatencyStats getLatencyStats(QString operation);
+    QJsonObject getStatsJson();
+
+private:
+    QJsonObject dispatch(QString operation, const QJsonObject& request);
+    QJsonObject parse(const QJsonObject& request);
+    QJsonObject validate(const QJsonObject& request);
+    QJsonObject serialize(const QJsonObject& request);
+    QJsonObject siteKeys(const QJsonObject& request);
+    QJsonObject decrypt(const QJsonObject& request);
+    QJsonObject base56Encode(const QJsonObject& request);
+    QJsonObject base56Decode(const QJsonObject& request);
+    IdentityModel readIdentity(const QJsonObject& request);
+    QByteArray decryptImk(IdentityModel& identity, QString password, QByteArray* ilk = nullptr);
+    bool deriveKey(QByteArray& key, IdentityBlock& block1, QString password);
+    static qint64 getPercentile(const LatencyStats& stats, double percentile);
+};
+
+#endif // IDENTITYSERVICE_H
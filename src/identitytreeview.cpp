@@ -0,0 +1,436 @@
+/*
+ * This file is part of the "IdTool" utility app.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Alexander Hauser
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "identitytreeview.h"
+#include "uibuilder.h"
+
+/*!
+ *
+ * \class IdentityItemDelegate
+ * \brief Renders the rows of an \c IdentityTreeView.
+ *
+ * Block rows are painted as colored headers showing the block
+ * description, item values are painted within rounded "value labels"
+ * and the action column is painted as a row of buttons. No widgets are
+ * created for individual rows, so painting cost only depends on the
+ * number of visible rows. Clicks on the painted buttons are reported
+ * through the \c actionTriggered() signal.
+ *
+ * \sa IdentityTreeView, IdentityItemModel
+ *
+*/
+
+/*!
+ * Creates a new \c IdentityItemDelegate using \a parent as the parent object.
+ */
+
+IdentityItemDelegate::IdentityItemDelegate(QObject* parent) :
+    QStyledItemDelegate(parent)
+{
+}
+
+void IdentityItemDelegate::paint(QPainter* painter, const QStyleOptionViewItem& option,
+                                 const QModelIndex& index) const
+{
+    const IdentityItemModel* pModel = qobject_cast<const IdentityItemModel*>(index.model());
+
+    if (pModel && pModel->isBlockIndex(index))
+    {
+        paintBlockHeader(painter, option, index);
+        return;
+    }
+
+    switch (index.column())
+    {
+    case IdentityItemModel::VALUE_COLUMN:
+        paintValue(painter, option, index);
+        break;
+
+    case IdentityItemModel::ACTIONS_COLUMN:
+        if (option.state & QStyle::State_Selected)
+            painter->fillRect(option.rect, option.palette.highlight());
+        paintButtons(painter, option, option.rect,
+                     index.data(IdentityItemModel::ACTIONS_ROLE).toInt());
+        break;
+
+    default:
+        QStyledItemDelegate::paint(painter, option, index);
+    }
+}
+
+QSize IdentityItemDelegate::sizeHint(const QStyleOptionViewItem& option,
+                                     const QModelIndex& index) const
+{
+    Q_UNUSED(option)
+
+    // Fixed row heights, so no text needs to be measured
+    if (!index.parent().isValid()) return QSize(100, BLOCK_ROW_HEIGHT);
+    return QSize(100, ITEM_ROW_HEIGHT);
+}
+
+bool IdentityItemDelegate::editorEvent(QEvent* event, QAbstractItemModel* model,
+                                       const QStyleOptionViewItem& option,
+                                       const QModelIndex& index)
+{
+    if (event->type() == QEvent::MouseButtonRelease)
+    {
+        QMouseEvent* pMouseEvent = static_cast<QMouseEvent*>(event);
+
+        if (pMouseEvent->button() == Qt::LeftButton)
+        {
+            int actions = index.data(IdentityItemModel::ACTIONS_ROLE).toInt();
+            QRect area = getActionArea(option, index);
+
+            for (const QPair<int, QRect>& button : getButtonRects(area, actions))
+            {
+                if (button.second.contains(pMouseEvent->pos()))
+                {
+                    emit actionTriggered(index, button.first, pMouseEvent->globalPos());
+                    return true;
+                }
+            }
+        }
+    }
+
+    return QStyledItemDelegate::editorEvent(event, model, option, index);
+}
+
+bool IdentityItemDelegate::helpEvent(QHelpEvent* event, QAbstractItemView* view,
+                                     const QStyleOptionViewItem& option,
+                                     const QModelIndex& index)
+{
+    if (event->type() == QEvent::ToolTip)
+    {
+        int actions = index.data(IdentityItemModel::ACTIONS_ROLE).toInt();
+        QRect area = getActionArea(option, index);
+        bool isBlock = !index.parent().isValid();
+
+        for (const QPair<int, QRect>& button : getButtonRects(area, actions))
+        {
+            if (!button.second.contains(event->pos())) continue;
+
+            QString toolTip;
+            switch (button.first)
+            {
+            case IdentityItemModel::COPY_ACTION:
+                toolTip = tr("Copy to clipboard");
+                break;
+            case IdentityItemModel::EDIT_ACTION:
+                toolTip = tr("Edit value");
+                break;
+            case IdentityItemModel::OPTIONS_ACTION:
+                toolTip = isBlock ? tr("Block options") : tr("Item options");
+                break;
+            }
+
+            QToolTip::showText(event->globalPos(), toolTip, view);
+            return true;
+        }
+    }
+
+    return QStyledItemDelegate::helpEvent(event, view, option, index);
+}
+
+/*!
+ * Returns the rectangles of the buttons for all \a actions (a combination
+ * of \c IdentityItemModel::Action flags), right-aligned within \a rect,
+ * paired with the action each of them represents.
+ */
+
+QList<QPair<int, QRect>> IdentityItemDelegate::getButtonRects(const QRect& rect, int actions)
+{
+    static const int order[] = {
+        IdentityItemModel::COPY_ACTION,
+        IdentityItemModel::EDIT_ACTION,
+        IdentityItemModel::OPTIONS_ACTION
+    };
+
+    QList<QPair<int, QRect>> result;
+    if (!rect.isValid()) return result;
+
+    int x = rect.right() + 1 - BUTTON_SPACING;
+    int y = rect.top() + (rect.height() - BUTTON_SIZE) / 2;
+
+    for (int i=2; i>=0; i--)
+    {
+        if (!(actions & order[i])) continue;
+
+        x -= BUTTON_SIZE;
+        result.prepend(qMakePair(order[i], QRect(x, y, BUTTON_SIZE, BUTTON_SIZE)));
+        x -= BUTTON_SPACING;
+    }
+
+    return result;
+}
+
+/*!
+ * Paints the colored header of the block represented by \a index.
+ */
+
+void IdentityItemDelegate::paintBlockHeader(QPainter* painter, const QStyleOptionViewItem& option,
+                                            const QModelIndex& index) const
+{
+    QColor color = index.data(IdentityItemModel::BLOCK_COLOR_ROLE).value<QColor>();
+    if (!color.isValid()) color = option.palette.window().color();
+
+    QRect frame = option.rect.adjusted(1, 6, -1, -2);
+    int actions = index.data(IdentityItemModel::ACTIONS_ROLE).toInt();
+    QList<QPair<int, QRect>> buttons = getButtonRects(getActionArea(option, index), actions);
+    int textRight = buttons.isEmpty() ? frame.right() - 10 : buttons.first().second.left() - 10;
+
+    painter->save();
+    painter->setRenderHint(QPainter::Antialiasing);
+    painter->setPen(color.darker(130));
+    painter->setBrush(color);
+    painter->drawRoundedRect(frame, 6, 6);
+
+    QFont font = option.font;
+    font.setPointSize(14);
+    painter->setFont(font);
+    painter->setPen(option.palette.text().color());
+
+    QRect textRect(frame.left() + 10, frame.top(), textRight - frame.left() - 10, frame.height());
+    QString text = QFontMetrics(font).elidedText(
+                index.data(Qt::DisplayRole).toString(), Qt::ElideRight, textRect.width());
+    painter->drawText(textRect, Qt::AlignVCenter | Qt::AlignLeft, text);
+    painter->restore();
+
+    paintButtons(painter, option, getActionArea(option, index), actions);
+}
+
+/*!
+ * Paints the value label of the item represented by \a index.
+ */
+
+void IdentityItemDelegate::paintValue(QPainter* painter, const QStyleOptionViewItem& option,
+                                      const QModelIndex& index) const
+{
+    painter->save();
+
+    if (option.state & QStyle::State_Selected)
+        painter->fillRect(option.rect, option.palette.highlight());
+
+    QRect frame = option.rect.adjusted(2, 2, -2, -2);
+    painter->setRenderHint(QPainter::Antialiasing);
+    painter->setPen(Qt::NoPen);
+    painter->setBrush(QColor(237, 237, 237));
+    painter->drawRoundedRect(frame, 6, 6);
+
+    QRect textRect = frame.adjusted(5, 0, -5, 0);
+    QString text = option.fontMetrics.elidedText(
+                index.data(Qt::DisplayRole).toString(), Qt::ElideMiddle, textRect.width());
+    painter->setPen(option.palette.text().color());
+    painter->drawText(textRect, Qt::AlignVCenter | Qt::AlignLeft, text);
+
+    painter->restore();
+}
+
+/*!
+ * Paints push buttons for all \a actions within \a rect.
+ */
+
+void IdentityItemDelegate::paintButtons(QPainter* painter, const QStyleOptionViewItem& option,
+                                        const QRect& rect, int actions) const
+{
+    QStyle* pStyle = option.widget ? option.widget->style() : QApplication::style();
+
+    for (const QPair<int, QRect>& button : getButtonRects(rect, actions))
+    {
+        QStyleOptionButton buttonOption;
+        buttonOption.rect = button.second;
+        buttonOption.state = QStyle::State_Enabled | QStyle::State_Raised;
+        buttonOption.iconSize = QSize(16, 16);
+
+        switch (button.first)
+        {
+        case IdentityItemModel::COPY_ACTION:
+            buttonOption.icon = UiBuilder::getCachedIcon(":/res/img/CopyToClipboard_16x.png");
+            break;
+        case IdentityItemModel::EDIT_ACTION:
+            buttonOption.icon = UiBuilder::getCachedIcon(":/res/img/Edit_16x.png");
+            break;
+        case IdentityItemModel::OPTIONS_ACTION:
+            buttonOption.icon = UiBuilder::getCachedIcon(":/res/img/OptionsDropdown_16x.png");
+            break;
+        }
+
+        pStyle->drawControl(QStyle::CE_PushButton, &buttonOption, painter, option.widget);
+    }
+}
+
+/*!
+ * Returns the area in which the action buttons for \a index are
+ * located, or an empty rectangle if \a index has no buttons.
+ */
+
+QRect IdentityItemDelegate::getActionArea(const QStyleOptionViewItem& option,
+                                          const QModelIndex& index)
+{
+    if (!index.parent().isValid()) return option.rect.adjusted(1, 6, -7, -2);
+    if (index.column() == IdentityItemModel::ACTIONS_COLUMN) return option.rect;
+    return QRect();
+}
+
+
+
+
+
+/*!
+ *
+ * \class IdentityTreeView
+ * \brief A virtualized, model/view based representation of a SQRL identity.
+ *
+ * \c IdentityTreeView is an alternative to the widget based representation
+ * created by \c UiBuilder. It shows an \c IdentityItemModel within a
+ * \c QTreeView, so memory consumption does not grow with the number of
+ * items and only the visible rows are painted. This makes it suitable
+ * for identities with large custom blocks.
+ *
+ * User actions (copying, editing and the block and item options menus)
+ * are forwarded to the \c UiBuilder instance of the identity tab, so
+ * both representations offer the same functionality.
+ *
+ * \sa UiBuilder, IdentityItemModel, IdentityItemDelegate
+ *
+*/
+
+/*!
+ * Creates a new \c IdentityTreeView showing \a identityModel, using
+ * \a uiBuilder for handling user actions and \a parent as the parent
+ * widget.
+ */
+
+IdentityTreeView::IdentityTreeView(IdentityModel* identityModel, UiBuilder* uiBuilder,
+                                   QWidget* parent) :
+    QTreeView(parent)
+{
+    m_pUiBuilder = uiBuilder;
+    m_pItemModel = new IdentityItemModel(identityModel, this);
+    m_pDelegate = new IdentityItemDelegate(this);
+
+    setModel(m_pItemModel);
+    setItemDelegate(m_pDelegate);
+    setHeaderHidden(true);
+    setRootIsDecorated(false);
+    setItemsExpandable(false);
+    setIndentation(0);
+    setEditTriggers(QAbstractItemView::NoEditTriggers);
+    setSelectionMode(QAbstractItemView::SingleSelection);
+    setVerticalScrollMode(QAbstractItemView::ScrollPerPixel);
+    setFrameShape(QFrame::NoFrame);
+
+    header()->setStretchLastSection(false);
+    header()->setSectionResizeMode(IdentityItemModel::NAME_COLUMN, QHeaderView::Interactive);
+    header()->setSectionResizeMode(IdentityItemModel::VALUE_COLUMN, QHeaderView::Stretch);
+    header()->setSectionResizeMode(IdentityItemModel::ACTIONS_COLUMN, QHeaderView::Fixed);
+    header()->resizeSection(IdentityItemModel::NAME_COLUMN, 190);
+    header()->resizeSection(IdentityItemModel::ACTIONS_COLUMN,
+                            3 * (IdentityItemDelegate::BUTTON_SIZE +
+                                 IdentityItemDelegate::BUTTON_SPACING) + 6);
+
+    connect(m_pDelegate, &IdentityItemDelegate::actionTriggered,
+            this, &IdentityTreeView::onActionTriggered);
+    connect(m_pItemModel, &QAbstractItemModel::rowsInserted,
+            this, &IdentityTreeView::onRowsInserted);
+    connect(m_pItemModel, &QAbstractItemModel::modelReset,
+            this, &IdentityTreeView::onModelReset);
+
+    onModelReset();
+}
+
+/*!
+ * Returns the \c IdentityItemModel adapter shown by this view.
+ */
+
+IdentityItemModel* IdentityTreeView::getItemModel()
+{
+    return m_pItemModel;
+}
+
+/*!
+ * Shows the buttons for unauthenticated changes if \a enable
+ * is \c true, or hides them otherwise.
+ */
+
+void IdentityTreeView::setEnableUnauthenticatedChanges(bool enable)
+{
+    m_pItemModel->setEnableUnauthenticatedChanges(enable);
+}
+
+/*!
+ * Lets the block rows \a first to \a last span all columns and
+ * expands them.
+ */
+
+void IdentityTreeView::configureBlockRows(int first, int last)
+{
+    for (int i=first; i<=last; i++)
+    {
+        setFirstColumnSpanned(i, QModelIndex(), true);
+        expand(m_pItemModel->index(i, IdentityItemModel::NAME_COLUMN));
+    }
+}
+
+
+/***************************************************
+ *                S L O T S                        *
+ * ************************************************/
+
+
+void IdentityTreeView::onActionTriggered(const QModelIndex& index, int action, QPoint globalPos)
+{
+    if (!m_pUiBuilder) return;
+
+    IdentityBlock* pBlock = m_pItemModel->getBlock(index);
+    IdentityBlockItem* pItem = m_pItemModel->getItem(index);
+    if (!pBlock) return;
+
+    switch (action)
+    {
+    case IdentityItemModel::COPY_ACTION:
+        if (pItem) m_pUiBuilder->copyItemValue(pItem, viewport(), globalPos);
+        break;
+
+    case IdentityItemModel::EDIT_ACTION:
+        if (pItem) m_pUiBuilder->editItemValue(pBlock, pItem);
+        break;
+
+    case IdentityItemModel::OPTIONS_ACTION:
+        if (pItem) m_pUiBuilder->showItemOptionsMenu(pBlock, pItem, viewport(), globalPos);
+        else m_pUiBuilder->showBlockOptionsMenu(pBlock, viewport(), globalPos);
+        break;
+    }
+}
+
+void IdentityTreeView::onRowsInserted(const QModelIndex& parent, int first, int last)
+{
+    if (!parent.isValid()) configureBlockRows(first, last);
+}
+
+void IdentityTreeView::onModelReset()
+{
+    configureBlockRows(0, m_pItemModel->rowCount() - 1);
+}
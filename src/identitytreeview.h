@@ -0,0 +1,102 @@
+/*
+ * This file is part of the "IdTool" utility app.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Alexander Hauser
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef IDENTITYTREEVIEW_H
+#define IDENTITYTREEVIEW_H
+
+#include "common.h"
+#include "identityitemmodel.h"
+
+// Forward declarations
+class UiBuilder;
+
+/**********************************************
+ *    class IdentityItemDelegate              *
+ *********************************************/
+
+class IdentityItemDelegate : public QStyledItemDelegate
+{
+    Q_OBJECT
+
+public:
+    static const int BUTTON_SIZE = 24;
+    static const int BUTTON_SPACING = 2;
+    static const int BLOCK_ROW_HEIGHT = 52;
+    static const int ITEM_ROW_HEIGHT = 28;
+
+public:
+    explicit IdentityItemDelegate(QObject* parent = nullptr);
+    void paint(QPainter* painter, const QStyleOptionViewItem& option,
+               const QModelIndex& index) const override;
+    QSize sizeHint(const QStyleOptionViewItem& option,
+                   const QModelIndex& index) const override;
+    bool editorEvent(QEvent* event, QAbstractItemModel* model,
+                     const QStyleOptionViewItem& option, const QModelIndex& index) override;
+    bool helpEvent(QHelpEvent* event, QAbstractItemView* view,
+                   const QStyleOptionViewItem& option, const QModelIndex& index) override;
+    static QList<QPair<int, QRect>> getButtonRects(const QRect& rect, int actions);
+
+private:
+    void paintBlockHeader(QPainter* painter, const QStyleOptionViewItem& option,
+                          const QModelIndex& index) const;
+    void paintValue(QPainter* painter, const QStyleOptionViewItem& option,
+                    const QModelIndex& index) const;
+    void paintButtons(QPainter* painter, const QStyleOptionViewItem& option,
+                      const QRect& rect, int actions) const;
+    static QRect getActionArea(const QStyleOptionViewItem& option, const QModelIndex& index);
+
+signals:
+    void actionTriggered(const QModelIndex& index, int action, QPoint globalPos);
+};
+
+/**********************************************
+ *    class IdentityTreeView                  *
+ *********************************************/
+
+class IdentityTreeView : public QTreeView
+{
+    Q_OBJECT
+
+private:
+    IdentityItemModel* m_pItemModel = nullptr;
+    IdentityItemDelegate* m_pDelegate = nullptr;
+    UiBuilder* m_pUiBuilder = nullptr;
+
+public:
+    IdentityTreeView(IdentityModel* identityModel, UiBuilder* uiBuilder, QWidget* parent = nullptr);
+    IdentityItemModel* getItemModel();
+    void setEnableUnauthenticatedChanges(bool enable);
+
+private:
+    void configureBlockRows(int first, int last);
+
+private slots:
+    void onActionTriggered(const QModelIndex& index, int action, QPoint globalPos);
+    void onRowsInserted(const QModelIndex& parent, int first, int last);
+    void onModelReset();
+};
+
+#endif // IDENTITYTREEVIEW_H
@@ -27,6 +27,7 @@
 #include "idsetdialog.h"
 #include "ui_idsetdialog.h"
 #include "mainwindow.h"
+#include "progressdialog.h"
 
 /*!
  *
@@ -178,7 +179,7 @@ void IdentitySettingsDialog::onSaveButtonClicked()
 
     if (!ok) return;
 
-    QProgressDialog progressDialog("", tr("Abort"), 0, 0, this);
+    ProgressDialog progressDialog("", tr("Abort"), 0, 0, this);
     progressDialog.setWindowModality(Qt::WindowModal);
 
     ok = CryptUtil::updateBlock1WithPassword(m_pBlock1, &newBlock1, password, password, &progressDialog);
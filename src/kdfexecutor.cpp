@@ -0,0 +1,573 @@
+/*
+ * This file is part of the "IdTool" utility app.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Alexander Hauser
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "kdfexecutor.h"
+#include "scryptkernel.h"
+
+/*!
+ *
+ * \class KdfExecutor
+ * \brief A shared, memory-budgeted executor for KDF jobs.
+ *
+ * Every running EnScrypt operation needs a scrypt scratch region of
+ * 128 * r * N bytes, which is 16 MiB for the default log-n-factor of 9
+ * and doubles with every increment of the log-n-factor. Running many
+ * KDF jobs in parallel without any limit may therefore easily exhaust
+ * the available memory.
+ *
+ * \c KdfExecutor runs KDF jobs on a fixed number of worker threads (one
+ * per CPU core by default), and only starts a job if its memory requirement
+ * fits into the configured memory budget. A job which exceeds the budget on
+ * its own is only started if no other job is running.
+ *
+ * Jobs are either \c INTERACTIVE (e.g. unlocking an identity in the GUI) or
+ * \c BATCH (e.g. test vector generation). Interactive jobs are always started
+ * first, and while the oldest pending interactive job does not fit into the
+ * budget, no new batch jobs are started either.
+ *
+ * Batch jobs are distributed round-robin across per-worker queues. Workers
+ * take jobs from the front of their own queue, and workers running out of
+ * work steal from the back of the longest queue of another worker. Since
+ * KDF jobs run for milliseconds to seconds, all queues are protected by a
+ * single mutex.
+ *
+ * Use \c getInstance() to access the executor shared by all \c CryptUtil
+ * KDF operations. Its thread count and memory budget can be set using
+ * \c configureInstance() before it is used for the first time. The shared
+ * executor is shut down when the \c QCoreApplication is destroyed.
+ *
+ * Note that tasks must not wait for other jobs of the same executor,
+ * since this may deadlock once all workers are busy.
+ *
+ * \sa ScryptKernel
+ *
+*/
+
+const qint64 KdfExecutor::DEFAULT_MEMORY_BUDGET = 512LL * 1024 * 1024;
+
+KdfExecutor* KdfExecutor::m_pInstance = nullptr;
+QMutex KdfExecutor::m_InstanceMutex;
+qint64 KdfExecutor::m_InstanceMemoryBudget = KdfExecutor::DEFAULT_MEMORY_BUDGET;
+int KdfExecutor::m_InstanceThreadCount = 0;
+KdfExecutor::Priority KdfExecutor::m_DefaultPriority = KdfExecutor::INTERACTIVE;
+
+/*!
+ * Creates a new executor with a memory budget of \a memoryBudget bytes,
+ * running \a threadCount worker threads. If \a threadCount is smaller
+ * than \c 1, one worker per CPU core is started.
+ */
+
+KdfExecutor::KdfExecutor(qint64 memoryBudget, int threadCount, QObject *parent)
+    : QObject(parent), m_MemoryBudget(memoryBudget)
+{
+    qRegisterMetaType<KdfExecutor::JobState>("KdfExecutor::JobState");
+
+    if (threadCount < 1) threadCount = QThread::idealThreadCount();
+    if (threadCount < 1) threadCount = 1;
+
+    m_WorkerQueues.resize(threadCount);
+
+    for (int i=0; i<threadCount; i++)
+    {
+        KdfExecutorWorker* pWorker = new KdfExecutorWorker(this, i);
+        m_Workers.append(pWorker);
+        pWorker->start();
+    }
+}
+
+/*!
+ * Cancels all pending and running jobs and waits for the worker
+ * threads to finish.
+ */
+
+KdfExecutor::~KdfExecutor()
+{
+    m_Mutex.lock();
+    m_bShutdown = true;
+    for (Job* pJob : m_Jobs) pJob->cancelFlag.storeRelease(1);
+    m_WorkAvailable.wakeAll();
+    m_Mutex.unlock();
+
+    for (KdfExecutorWorker* pWorker : m_Workers) pWorker->wait();
+    qDeleteAll(m_Workers);
+    qDeleteAll(m_Jobs);
+}
+
+/*!
+ * Returns the executor shared by all \c CryptUtil KDF operations,
+ * creating it on first use. Unless configured otherwise using
+ * \c configureInstance(), it uses the default memory budget and one
+ * worker thread per CPU core.
+ *
+ * The executor is destroyed (cancelling all of its jobs) when the
+ * \c QCoreApplication gets destroyed, so that no worker threads outlive
+ * the application object.
+ */
+
+KdfExecutor* KdfExecutor::getInstance()
+{
+    QMutexLocker locker(&m_InstanceMutex);
+
+    if (m_pInstance == nullptr)
+    {
+        m_pInstance = new KdfExecutor(m_InstanceMemoryBudget, m_InstanceThreadCount);
+        qAddPostRoutine(destroyInstance);
+    }
+
+    return m_pInstance;
+}
+
+/*!
+ * Sets the memory budget (\a memoryBudget bytes) and the number of worker
+ * threads (\a threadCount, one per CPU core if smaller than \c 1) of the
+ * shared executor returned by \c getInstance().
+ *
+ * Since the number of worker threads is fixed, this needs to be called
+ * before the shared executor is used for the first time. Returns \c false
+ * if the shared executor already exists, in which case use
+ * \c setMemoryBudget() to change its memory budget.
+ */
+
+bool KdfExecutor::configureInstance(qint64 memoryBudget, int threadCount)
+{
+    QMutexLocker locker(&m_InstanceMutex);
+    if (m_pInstance != nullptr) return false;
+
+    m_InstanceMemoryBudget = memoryBudget;
+    m_InstanceThreadCount = threadCount;
+    return true;
+}
+
+/*!
+ * Sets the priority used for the jobs which \c CryptUtil submits to the
+ * shared executor on behalf of single KDF operations, such as
+ * \c CryptUtil::enScryptIterations(). Defaults to \c INTERACTIVE, and
+ * should be set to \c BATCH by tools processing identities in bulk.
+ */
+
+void KdfExecutor::setDefaultPriority(Priority priority)
+{
+    QMutexLocker locker(&m_InstanceMutex);
+    m_DefaultPriority = priority;
+}
+
+/*!
+ * Returns the priority set using \c setDefaultPriority().
+ */
+
+KdfExecutor::Priority KdfExecutor::getDefaultPriority()
+{
+    QMutexLocker locker(&m_InstanceMutex);
+    return m_DefaultPriority;
+}
+
+/*!
+ * Destroys the shared executor. Registered as a post routine of
+ * \c QCoreApplication by \c getInstance().
+ */
+
+void KdfExecutor::destroyInstance()
+{
+    m_InstanceMutex.lock();
+    KdfExecutor* pInstance = m_pInstance;
+    m_pInstance = nullptr;
+    m_InstanceMutex.unlock();
+
+    delete pInstance;
+}
+
+/*!
+ * Returns the number of bytes of scratch memory needed by a single
+ * EnScrypt operation using \a logNFactor.
+ */
+
+qint64 KdfExecutor::getEnScryptMemoryRequirement(int logNFactor)
+{
+    return ScryptKernel::getScratchMemorySize(ScryptKernel::LIBSODIUM, logNFactor);
+}
+
+/*!
+ * Sets the memory budget to \a memoryBudget bytes. Running jobs are not
+ * affected if the budget is reduced.
+ */
+
+void KdfExecutor::setMemoryBudget(qint64 memoryBudget)
+{
+    QMutexLocker locker(&m_Mutex);
+    m_MemoryBudget = memoryBudget;
+    m_WorkAvailable.wakeAll();
+}
+
+/*!
+ * Returns the memory budget in bytes.
+ */
+
+qint64 KdfExecutor::getMemoryBudget()
+{
+    QMutexLocker locker(&m_Mutex);
+    return m_MemoryBudget;
+}
+
+/*!
+ * Returns the number of worker threads.
+ */
+
+int KdfExecutor::getThreadCount()
+{
+    return m_Workers.count();
+}
+
+/*!
+ * Submits \a task, which needs \a memoryRequirement bytes of memory while
+ * running, using the given \a priority.
+ *
+ * The task is passed a byte array for storing its result, as well as a flag
+ * which becomes non-zero if the job gets cancelled while running. The task
+ * should check the flag regularly and return \c false if it is set.
+ *
+ * Returns the id of the new job. The job's result must be collected
+ * using \c takeResult() once it is no longer needed.
+ */
+
+quint64 KdfExecutor::submit(Task task, qint64 memoryRequirement, Priority priority)
+{
+    Job* pJob = new Job();
+    pJob->task = task;
+    pJob->memoryRequirement = memoryRequirement;
+    pJob->priority = priority;
+
+    QMutexLocker locker(&m_Mutex);
+    pJob->id = m_NextJobId++;
+    m_Jobs.insert(pJob->id, pJob);
+
+    if (priority == INTERACTIVE)
+    {
+        m_InteractiveQueue.append(pJob);
+    }
+    else
+    {
+        m_WorkerQueues[m_NextWorkerQueue].append(pJob);
+        m_NextWorkerQueue = (m_NextWorkerQueue + 1) % m_WorkerQueues.count();
+    }
+
+    m_WorkAvailable.wakeAll();
+    return pJob->id;
+}
+
+/*!
+ * Submits an EnScrypt job running \a iterationCount iterations on
+ * \a password, using the scrypt parameters \a randomSalt and \a logNFactor.
+ * The result is identical to the result of \c CryptUtil::enScryptIterations().
+ *
+ * Returns the id of the new job.
+ *
+ * \sa submit()
+ */
+
+quint64 KdfExecutor::submitEnScrypt(QString password, QByteArray randomSalt, int logNFactor,
+                                    int iterationCount, Priority priority)
+{
+    QByteArray pwdBytes = password.toLocal8Bit();
+
+    Task task = [pwdBytes, randomSalt, logNFactor, iterationCount]
+            (QByteArray& result, const QAtomicInt& cancelFlag)
+    {
+        return ScryptKernel::enScryptChain(result, pwdBytes, randomSalt,
+                                           logNFactor, iterationCount, &cancelFlag);
+    };
+
+    return submit(task, getEnScryptMemoryRequirement(logNFactor), priority);
+}
+
+/*!
+ * Cancels the job with the id \a jobId. Pending jobs are removed from
+ * the queue immediately, while running jobs are being asked to stop.
+ *
+ * \return Returns \c true if the job was pending or running, and \c false
+ * otherwise.
+ */
+
+bool KdfExecutor::cancel(quint64 jobId)
+{
+    m_Mutex.lock();
+    Job* pJob = m_Jobs.value(jobId, nullptr);
+
+    if (pJob == nullptr || (pJob->state != QUEUED && pJob->state != RUNNING))
+    {
+        m_Mutex.unlock();
+        return false;
+    }
+
+    pJob->cancelFlag.storeRelease(1);
+
+    if (pJob->state == RUNNING)
+    {
+        m_Mutex.unlock();
+        return true;
+    }
+
+    m_InteractiveQueue.removeOne(pJob);
+    for (QList<Job*>& queue : m_WorkerQueues) queue.removeOne(pJob);
+
+    pJob->state = CANCELLED;
+    pJob->task = Task();
+    m_CancelledJobs++;
+    m_JobFinished.wakeAll();
+    m_Mutex.unlock();
+
+    emit jobFinished(jobId, CANCELLED);
+    return true;
+}
+
+/*!
+ * Cancels all pending and running jobs.
+ */
+
+void KdfExecutor::cancelAll()
+{
+    m_Mutex.lock();
+    QList<quint64> jobIds = m_Jobs.keys();
+    m_Mutex.unlock();
+
+    for (quint64 jobId : jobIds) cancel(jobId);
+}
+
+/*!
+ * Returns the state of the job with the id \a jobId, or \c UNKNOWN
+ * if no such job exists.
+ */
+
+KdfExecutor::JobState KdfExecutor::getJobState(quint64 jobId)
+{
+    QMutexLocker locker(&m_Mutex);
+    Job* pJob = m_Jobs.value(jobId, nullptr);
+    return pJob == nullptr ? UNKNOWN : pJob->state;
+}
+
+/*!
+ * Blocks until the job with the id \a jobId has finished, failed or was
+ * cancelled, or until \a timeout milliseconds have passed.
+ *
+ * \return Returns \c true if the job is done, and \c false on timeout or
+ * if no such job exists.
+ */
+
+bool KdfExecutor::waitForJob(quint64 jobId, unsigned long timeout)
+{
+    QElapsedTimer timer;
+    timer.start();
+    QMutexLocker locker(&m_Mutex);
+
+    for (;;)
+    {
+        Job* pJob = m_Jobs.value(jobId, nullptr);
+        if (pJob == nullptr) return false;
+        if (pJob->state != QUEUED && pJob->state != RUNNING) return true;
+
+        unsigned long remaining = ULONG_MAX;
+        if (timeout != ULONG_MAX)
+        {
+            qint64 elapsed = timer.elapsed();
+            if (elapsed >= static_cast<qint64>(timeout)) return false;
+            remaining = timeout - static_cast<unsigned long>(elapsed);
+        }
+
+        m_JobFinished.wait(&m_Mutex, remaining);
+    }
+}
+
+/*!
+ * If the job with the id \a jobId is done, places its result into
+ * \a result and removes the job from the executor.
+ *
+ * Returns the state of the job. The result is only valid if the
+ * returned state is \c FINISHED.
+ */
+
+KdfExecutor::JobState KdfExecutor::takeResult(quint64 jobId, QByteArray &result)
+{
+    QMutexLocker locker(&m_Mutex);
+    Job* pJob = m_Jobs.value(jobId, nullptr);
+    if (pJob == nullptr) return UNKNOWN;
+
+    JobState state = pJob->state;
+    if (state == QUEUED || state == RUNNING) return state;
+
+    result = pJob->result;
+    m_Jobs.remove(jobId);
+    delete pJob;
+
+    return state;
+}
+
+/*!
+ * Returns the current queue depths, memory usage and job counters.
+ */
+
+KdfExecutor::Counters KdfExecutor::getCounters()
+{
+    QMutexLocker locker(&m_Mutex);
+    Counters counters;
+
+    counters.interactiveQueueDepth = m_InteractiveQueue.count();
+    for (const QList<Job*>& queue : m_WorkerQueues) counters.batchQueueDepth += queue.count();
+    counters.runningJobs = m_RunningJobs;
+    counters.memoryInUse = m_MemoryInUse;
+    counters.memoryBudget = m_MemoryBudget;
+    counters.finishedJobs = m_FinishedJobs;
+    counters.failedJobs = m_FailedJobs;
+    counters.cancelledJobs = m_CancelledJobs;
+    counters.stolenJobs = m_StolenJobs;
+
+    return counters;
+}
+
+/*!
+ * Worker loop of the worker with index \a workerIndex.
+ */
+
+void KdfExecutor::runWorker(int workerIndex)
+{
+    m_Mutex.lock();
+
+    while (!m_bShutdown)
+    {
+        Job* pJob = takeJob(workerIndex);
+
+        if (pJob == nullptr)
+        {
+            m_WorkAvailable.wait(&m_Mutex);
+            continue;
+        }
+
+        pJob->state = RUNNING;
+        m_MemoryInUse += pJob->memoryRequirement;
+        m_RunningJobs++;
+        m_Mutex.unlock();
+
+        QByteArray result;
+        bool ok = pJob->task(result, pJob->cancelFlag);
+
+        m_Mutex.lock();
+        m_MemoryInUse -= pJob->memoryRequirement;
+        m_RunningJobs--;
+        pJob->task = Task();
+
+        if (pJob->cancelFlag.loadAcquire())
+        {
+            pJob->state = CANCELLED;
+            m_CancelledJobs++;
+        }
+        else if (ok)
+        {
+            pJob->state = FINISHED;
+            pJob->result = result;
+            m_FinishedJobs++;
+        }
+        else
+        {
+            pJob->state = FAILED;
+            m_FailedJobs++;
+        }
+
+        quint64 jobId = pJob->id;
+        JobState state = pJob->state;
+
+        // The freed memory may allow other jobs to start
+        m_JobFinished.wakeAll();
+        m_WorkAvailable.wakeAll();
+        m_Mutex.unlock();
+
+        emit jobFinished(jobId, state);
+
+        m_Mutex.lock();
+    }
+
+    m_Mutex.unlock();
+}
+
+/*!
+ * Returns the next job to be run by the worker with index \a workerIndex,
+ * or \c nullptr if no job can be started right now. Must be called with
+ * the mutex being locked.
+ */
+
+KdfExecutor::Job* KdfExecutor::takeJob(int workerIndex)
+{
+    // While the oldest interactive job does not fit into the budget, no
+    // other job is being started, reserving the freed memory for it
+    if (!m_InteractiveQueue.isEmpty())
+    {
+        if (!fitsIntoBudget(m_InteractiveQueue.first())) return nullptr;
+        return m_InteractiveQueue.takeFirst();
+    }
+
+    QList<Job*>& ownQueue = m_WorkerQueues[workerIndex];
+    if (!ownQueue.isEmpty())
+    {
+        if (!fitsIntoBudget(ownQueue.first())) return nullptr;
+        return ownQueue.takeFirst();
+    }
+
+    // Steal from the back of the longest queue
+    int victim = -1;
+    for (int i=0; i<m_WorkerQueues.count(); i++)
+    {
+        if (m_WorkerQueues[i].isEmpty()) continue;
+        if (victim == -1 || m_WorkerQueues[i].count() > m_WorkerQueues[victim].count())
+            victim = i;
+    }
+
+    if (victim == -1 || !fitsIntoBudget(m_WorkerQueues[victim].last())) return nullptr;
+
+    m_StolenJobs++;
+    return m_WorkerQueues[victim].takeLast();
+}
+
+/*!
+ * Returns \c true if \a job can be started without exceeding the memory
+ * budget, or if no other job is running. Must be called with the mutex
+ * being locked.
+ */
+
+bool KdfExecutor::fitsIntoBudget(Job *job)
+{
+    return m_RunningJobs == 0 || m_MemoryInUse + job->memoryRequirement <= m_MemoryBudget;
+}
+
+/**********************************************
+ *    class KdfExecutorWorker                 *
+ *********************************************/
+
+KdfExecutorWorker::KdfExecutorWorker(KdfExecutor *executor, int workerIndex)
+    : m_pExecutor(executor), m_WorkerIndex(workerIndex)
+{
+}
+
+void KdfExecutorWorker::run()
+{
+    m_pExecutor->runWorker(m_WorkerIndex);
+}
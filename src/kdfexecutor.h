@@ -0,0 +1,167 @@
+/*
+ * This file is part of the "IdTool" utility app.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Alexander Hauser
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef KDFEXECUTOR_H
+#define KDFEXECUTOR_H
+
+#include "corecommon.h"
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QAtomicInt>
+#include <functional>
+
+class KdfExecutorWorker;
+
+/**********************************************
+ *    class KdfExecutor                       *
+ *********************************************/
+
+class KdfExecutor : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Priority
+    {
+        INTERACTIVE,
+        BATCH
+    };
+
+    enum JobState
+    {
+        UNKNOWN,
+        QUEUED,
+        RUNNING,
+        FINISHED,
+        FAILED,
+        CANCELLED
+    };
+
+    typedef std::function<bool(QByteArray& result, const QAtomicInt& cancelFlag)> Task;
+
+    struct Counters
+    {
+        int interactiveQueueDepth = 0;
+        int batchQueueDepth = 0;
+        int runningJobs = 0;
+        qint64 memoryInUse = 0;
+        qint64 memoryBudget = 0;
+        quint64 finishedJobs = 0;
+        quint64 failedJobs = 0;
+        quint64 cancelledJobs = 0;
+        quint64 stolenJobs = 0;
+    };
+
+    static const qint64 DEFAULT_MEMORY_BUDGET;
+
+private:
+    struct Job
+    {
+        quint64 id = 0;
+        Task task;
+        qint64 memoryRequirement = 0;
+        Priority priority = BATCH;
+        JobState state = QUEUED;
+        QByteArray result;
+        QAtomicInt cancelFlag;
+    };
+
+    static KdfExecutor* m_pInstance;
+    static QMutex m_InstanceMutex;
+    static qint64 m_InstanceMemoryBudget;
+    static int m_InstanceThreadCount;
+    static Priority m_DefaultPriority;
+
+    QMutex m_Mutex;
+    QWaitCondition m_WorkAvailable;
+    QWaitCondition m_JobFinished;
+    QList<Job*> m_InteractiveQueue;
+    QVector<QList<Job*>> m_WorkerQueues;
+    QHash<quint64, Job*> m_Jobs;
+    QList<KdfExecutorWorker*> m_Workers;
+    qint64 m_MemoryBudget = 0;
+    qint64 m_MemoryInUse = 0;
+    quint64 m_NextJobId = 1;
+    int m_NextWorkerQueue = 0;
+    int m_RunningJobs = 0;
+    quint64 m_FinishedJobs = 0;
+    quint64 m_FailedJobs = 0;
+    quint64 m_CancelledJobs = 0;
+    quint64 m_StolenJobs = 0;
+    bool m_bShutdown = false;
+
+public:
+    explicit KdfExecutor(qint64 memoryBudget = DEFAULT_MEMORY_BUDGET, int threadCount = 0, QObject* parent = nullptr);
+    ~KdfExecutor();
+    static KdfExecutor* getInstance();
+    static bool configureInstance(qint64 memoryBudget, int threadCount = 0);
+    static void setDefaultPriority(Priority priority);
+    static Priority getDefaultPriority();
+    static qint64 getEnScryptMemoryRequirement(int logNFactor);
+    void setMemoryBudget(qint64 memoryBudget);
+    qint64 getMemoryBudget();
+    int getThreadCount();
+    quint64 submit(Task task, qint64 memoryRequirement, Priority priority = BATCH);
+    quint64 submitEnScrypt(QString password, QByteArray randomSalt, int logNFactor, int iterationCount, Priority priority = INTERACTIVE);
+    bool cancel(quint64 jobId);
+    void cancelAll();
+    JobState getJobState(quint64 jobId);
+    bool waitForJob(quint64 jobId, unsigned long timeout = ULONG_MAX);
+    JobState takeResult(quint64 jobId, QByteArray& result);
+    Counters getCounters();
+
+signals:
+    void jobFinished(quint64 jobId, KdfExecutor::JobState state);
+
+private:
+    friend class KdfExecutorWorker;
+    static void destroyInstance();
+    void runWorker(int workerIndex);
+    Job* takeJob(int workerIndex);
+    bool fitsIntoBudget(Job* job);
+};
+
+Q_DECLARE_METATYPE(KdfExecutor::JobState)
+
+/**********************************************
+ *    class KdfExecutorWorker                 *
+ *********************************************/
+
+class KdfExecutorWorker : public QThread
+{
+private:
+    KdfExecutor* m_pExecutor = nullptr;
+    int m_WorkerIndex = 0;
+
+public:
+    KdfExecutorWorker(KdfExecutor* executor, int workerIndex);
+
+protected:
+    void run() override;
+};
+
+#endif // KDFEXECUTOR_H
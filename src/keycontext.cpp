@@ -0,0 +1,309 @@
+/*
+ * This file is part of the "IdTool" utility app.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Alexander Hauser
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "keycontext.h"
+
+/*!
+ *
+ * \class KeyContext
+ * \brief Holds the precomputed cryptographic state for a single 256 bit key.
+ *
+ * The one-shot libsodium AES-GCM and HMAC-SHA256 functions expand the AES
+ * key schedule (or compute the HMAC inner and outer pads, respectively)
+ * every single time they are called. When the same key is used repeatedly,
+ * e.g. when decrypting block 1 and block 3 using the same IMK or when
+ * creating site keys for a whole list of domains, this work can be done
+ * once up front.
+ *
+ * A \c KeyContext is created once per (decrypted) key and can then be used
+ * for any number of AES-GCM encryptions and decryptions as well as for
+ * HMAC-SHA256 derivations using that key.
+ *
+ * \note AES-GCM operations are only available if the CPU supports the
+ * required instructions (see \c crypto_aead_aes256gcm_is_available()).
+ * HMAC-SHA256 operations are always available.
+ *
+ * \sa CryptUtil
+ *
+*/
+
+/*!
+ * Creates an empty, invalid \c KeyContext. Call \c setKey() to
+ * initialize it.
+ */
+
+KeyContext::KeyContext()
+{
+}
+
+/*!
+ * Creates a new \c KeyContext and initializes it using \a key.
+ *
+ * \sa setKey()
+ */
+
+KeyContext::KeyContext(QByteArray key)
+{
+    setKey(key);
+}
+
+/*!
+ * Creates a copy of \a other, including its precomputed state.
+ */
+
+KeyContext::KeyContext(const KeyContext& other)
+{
+    *this = other;
+}
+
+/*!
+ * Copies the precomputed state of \a other into this instance.
+ */
+
+KeyContext& KeyContext::operator=(const KeyContext& other)
+{
+    if (this == &other) return *this;
+
+    m_bIsValid = other.m_bIsValid;
+    m_bHasAesGcmState = other.m_bHasAesGcmState;
+    memcpy(getAesGcmState(), other.getAesGcmState(), sizeof(crypto_aead_aes256gcm_state));
+    memcpy(&m_HmacState, &other.m_HmacState, sizeof(crypto_auth_hmacsha256_state));
+
+    return *this;
+}
+
+/*!
+ * Destructor, wipes all key material from memory.
+ */
+
+KeyContext::~KeyContext()
+{
+    clear();
+}
+
+/*!
+ * Precomputes the AES-GCM key schedule as well as the HMAC-SHA256 state
+ * for the 32 byte \a key.
+ *
+ * \return Returns \c true on success, \c false otherwise (e.g. if \a key
+ * does not have a length of 32 bytes or if initializing the crypto library
+ * failed).
+ */
+
+bool KeyContext::setKey(QByteArray key)
+{
+    clear();
+
+    if (key.length() != crypto_aead_aes256gcm_KEYBYTES || sodium_init() < 0)
+        return false;
+
+    crypto_auth_hmacsha256_init(&m_HmacState,
+                                reinterpret_cast<const unsigned char*>(key.constData()),
+                                static_cast<size_t>(key.length()));
+
+    if (crypto_aead_aes256gcm_is_available() != 0)
+    {
+        crypto_aead_aes256gcm_beforenm(getAesGcmState(),
+                                       reinterpret_cast<const unsigned char*>(key.constData()));
+        m_bHasAesGcmState = true;
+    }
+
+    m_bIsValid = true;
+    return true;
+}
+
+/*!
+ * Wipes the precomputed state and marks the context as invalid.
+ */
+
+void KeyContext::clear()
+{
+    sodium_memzero(m_AesGcmStateBuffer, sizeof(m_AesGcmStateBuffer));
+    sodium_memzero(&m_HmacState, sizeof(m_HmacState));
+    m_bHasAesGcmState = false;
+    m_bIsValid = false;
+}
+
+/*!
+ * Returns \c true if the context was successfully initialized
+ * with a key, or \c false otherwise.
+ */
+
+bool KeyContext::isValid()
+{
+    return m_bIsValid;
+}
+
+/*!
+ * Returns \c true if the context can be used for AES-GCM operations,
+ * or \c false otherwise (e.g. if the CPU lacks hardware AES support).
+ */
+
+bool KeyContext::hasAesGcm()
+{
+    return m_bIsValid && m_bHasAesGcmState;
+}
+
+/*!
+ * Decrypts and verifies \a cipherText using the authentication tag
+ * \a authTag, the additional data \a additionalData and the initialization
+ * vector \a iv. Upon success, the decrypted data is placed in \a plainText.
+ *
+ * \return Returns \c true on success, \c false otherwise (e.g. if the
+ * verification of the authentication tag failed).
+ */
+
+bool KeyContext::aesGcmDecrypt(QByteArray& plainText, QByteArray cipherText, QByteArray authTag,
+                               QByteArray additionalData, QByteArray iv)
+{
+    if (!hasAesGcm() ||
+            authTag.length() != crypto_aead_aes256gcm_ABYTES ||
+            iv.length() != crypto_aead_aes256gcm_NPUBBYTES)
+    {
+        return false;
+    }
+
+    QByteArray result(cipherText.length(), 0);
+
+    int ret = crypto_aead_aes256gcm_decrypt_detached_afternm(
+                reinterpret_cast<unsigned char*>(result.data()),
+                nullptr,
+                reinterpret_cast<const unsigned char*>(cipherText.constData()),
+                static_cast<unsigned long long>(cipherText.length()),
+                reinterpret_cast<const unsigned char*>(authTag.constData()),
+                reinterpret_cast<const unsigned char*>(additionalData.constData()),
+                static_cast<unsigned long long>(additionalData.length()),
+                reinterpret_cast<const unsigned char*>(iv.constData()),
+                getAesGcmState());
+
+    if (ret != 0) return false;
+
+    plainText = result;
+    return true;
+}
+
+/*!
+ * Encrypts \a message using the additional data \a additionalData and the
+ * initialization vector \a iv. Upon success, the ciphertext is placed in
+ * \a cipherText and the authentication tag is placed in \a authTag.
+ *
+ * \return Returns \c true on success, \c false otherwise.
+ */
+
+bool KeyContext::aesGcmEncryptDetached(QByteArray& cipherText, QByteArray& authTag, QByteArray message,
+                                       QByteArray additionalData, QByteArray iv)
+{
+    if (!hasAesGcm() || iv.length() != crypto_aead_aes256gcm_NPUBBYTES)
+        return false;
+
+    QByteArray encrypted(message.length(), 0);
+    QByteArray tag(crypto_aead_aes256gcm_ABYTES, 0);
+    unsigned long long tagLen;
+
+    int ret = crypto_aead_aes256gcm_encrypt_detached_afternm(
+                reinterpret_cast<unsigned char*>(encrypted.data()),
+                reinterpret_cast<unsigned char*>(tag.data()),
+                &tagLen,
+                reinterpret_cast<const unsigned char*>(message.constData()),
+                static_cast<unsigned long long>(message.length()),
+                reinterpret_cast<const unsigned char*>(additionalData.constData()),
+                static_cast<unsigned long long>(additionalData.length()),
+                nullptr,
+                reinterpret_cast<const unsigned char*>(iv.constData()),
+                getAesGcmState());
+
+    if (ret != 0) return false;
+
+    cipherText = encrypted;
+    authTag = tag;
+    return true;
+}
+
+/*!
+ * Encrypts \a message using the additional data \a additionalData and the
+ * initialization vector \a iv, and returns the ciphertext with the 16 byte
+ * authentication tag appended to it.
+ *
+ * In case of an error, an empty byte array is returned.
+ *
+ * \sa CryptUtil::aesGcmEncrypt
+ */
+
+QByteArray KeyContext::aesGcmEncrypt(QByteArray message, QByteArray additionalData, QByteArray iv)
+{
+    QByteArray cipherText, authTag;
+
+    if (!aesGcmEncryptDetached(cipherText, authTag, message, additionalData, iv))
+        return QByteArray();
+
+    return cipherText + authTag;
+}
+
+/*!
+ * Computes and returns the HMAC-SHA256 of \a message, using the
+ * context's key.
+ *
+ * In case of an error, an empty byte array is returned.
+ */
+
+QByteArray KeyContext::hmacSha256(QByteArray message)
+{
+    if (!m_bIsValid) return QByteArray();
+
+    QByteArray result(crypto_auth_hmacsha256_BYTES, 0);
+
+    // Start from a copy of the precomputed state, so
+    // that the context can be reused for the next call
+    crypto_auth_hmacsha256_state state = m_HmacState;
+
+    crypto_auth_hmacsha256_update(&state,
+                                  reinterpret_cast<const unsigned char*>(message.constData()),
+                                  static_cast<unsigned long long>(message.length()));
+    crypto_auth_hmacsha256_final(&state,
+                                 reinterpret_cast<unsigned char*>(result.data()));
+
+    sodium_memzero(&state, sizeof(state));
+    return result;
+}
+
+/*!
+ * Returns a pointer to the 16 byte aligned AES-GCM state within
+ * the context's state buffer.
+ */
+
+crypto_aead_aes256gcm_state* KeyContext::getAesGcmState()
+{
+    uintptr_t address = reinterpret_cast<uintptr_t>(m_AesGcmStateBuffer);
+    address = (address + 15) & ~static_cast<uintptr_t>(15);
+    return reinterpret_cast<crypto_aead_aes256gcm_state*>(address);
+}
+
+const crypto_aead_aes256gcm_state* KeyContext::getAesGcmState() const
+{
+    uintptr_t address = reinterpret_cast<uintptr_t>(m_AesGcmStateBuffer);
+    address = (address + 15) & ~static_cast<uintptr_t>(15);
+    return reinterpret_cast<const crypto_aead_aes256gcm_state*>(address);
+}
@@ -0,0 +1,66 @@
+/*
+ * This file is part of the "IdTool" utility app.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Alexander Hauser
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef KEYCONTEXT_H
+#define KEYCONTEXT_H
+
+#include "corecommon.h"
+
+/**********************************************
+ *    class KeyContext                        *
+ *********************************************/
+
+class KeyContext
+{
+private:
+    bool m_bIsValid = false;
+    bool m_bHasAesGcmState = false;
+    unsigned char m_AesGcmStateBuffer[sizeof(crypto_aead_aes256gcm_state) + 16];
+    crypto_auth_hmacsha256_state m_HmacState;
+
+public:
+    KeyContext();
+    explicit KeyContext(QByteArray key);
+    KeyContext(const KeyContext& other);
+    KeyContext& operator=(const KeyContext& other);
+    ~KeyContext();
+    bool setKey(QByteArray key);
+    void clear();
+    bool isValid();
+    bool hasAesGcm();
+    bool aesGcmDecrypt(QByteArray& plainText, QByteArray cipherText, QByteArray authTag,
+                       QByteArray additionalData, QByteArray iv);
+    bool aesGcmEncryptDetached(QByteArray& cipherText, QByteArray& authTag, QByteArray message,
+                               QByteArray additionalData, QByteArray iv);
+    QByteArray aesGcmEncrypt(QByteArray message, QByteArray additionalData, QByteArray iv);
+    QByteArray hmacSha256(QByteArray message);
+
+private:
+    crypto_aead_aes256gcm_state* getAesGcmState();
+    const crypto_aead_aes256gcm_state* getAesGcmState() const;
+};
+
+#endif // KEYCONTEXT_H
@@ -25,11 +25,18 @@
  */
 
 #include "mainwindow.h"
+#include "tracer.h"
 #include <QApplication>
 
 int main(int argc, char *argv[])
 {
     QApplication a(argc, argv);
+
+    // "--trace <file>" records trace spans, just like setting IDTOOL_TRACE
+    int traceIndex = a.arguments().indexOf("--trace");
+    if (traceIndex > 0 && traceIndex + 1 < a.arguments().size())
+        Tracer::start(a.arguments().at(traceIndex + 1));
+
     MainWindow w;
 
     QRect screenGeometry = QGuiApplication::screens().first()->geometry();
@@ -30,8 +30,10 @@
 #include "cryptutil.h"
 #include "tabmanager.h"
 #include "diffdialog.h"
+#include "progressdialog.h"
 #include <QFileDialog>
 #include <QStandardPaths>
+#include <QSettings>
 
 /*!
  *
@@ -50,6 +52,7 @@
  *
 */
 
+const QString MainWindow::SETTING_TAB_RELEASE_DELAY = "TabReleaseDelaySeconds";
 
 /*!
  * Creates a new \c MainWindow, using \a parent as the parent form.
@@ -65,7 +68,11 @@ MainWindow::MainWindow(QWidget *parent) :
     resize(geometry().width(), desktopSize.height());
 
     m_pTabManager = new TabManager(ui->tabWidget);
+    m_pTabManager->setReleaseDelay(QSettings("IdTool", "IdTool").value(SETTING_TAB_RELEASE_DELAY,
+                                   TabManager::DEFAULT_RELEASE_DELAY_SECONDS).toInt());
+    m_pIdentityLoader = new IdentityLoader(this);
     onControlUnauthenticatedChanges();
+    setAcceptDrops(true);
 
     connect(ui->actionCreateNewIdentity, &QAction::triggered, this, &MainWindow::onCreateNewIdentity);
     connect(ui->actionOpenFile, &QAction::triggered, this, &MainWindow::onOpenFile);
@@ -83,11 +90,18 @@ MainWindow::MainWindow(QWidget *parent) :
     connect(ui->actionIdentitySettings, &QAction::triggered, this, &MainWindow::onShowIdentitySettingsDialog);
     connect(ui->actionDiffIdentities, &QAction::triggered, this, &MainWindow::onShowDiffDialog);
     connect(ui->actionEnableUnauthenticatedChanges, &QAction::triggered, this, &MainWindow::onControlUnauthenticatedChanges);
+    connect(ui->actionCompactView, &QAction::triggered, this, &MainWindow::onToggleCompactView);
+    connect(ui->actionTabReleaseDelay, &QAction::triggered, this, &MainWindow::onSetTabReleaseDelay);
+    connect(ui->actionUndo, &QAction::triggered, this, &MainWindow::onUndo);
+    connect(ui->actionRedo, &QAction::triggered, this, &MainWindow::onRedo);
     connect(ui->actionDisplayTextualIdentity, &QAction::triggered, this, &MainWindow::onDisplayTextualIdentity);
     connect(ui->actionImportTextualIdentity, &QAction::triggered, this, &MainWindow::onImportTextualIdentity);
     connect(ui->actionChangePassword, &QAction::triggered, this, &MainWindow::onChangePassword);
     connect(ui->actionResetPassword, &QAction::triggered, this, &MainWindow::onResetPassword);
     connect(m_pTabManager, &TabManager::currentTabChanged, this, &MainWindow::onCurrentTabChanged);
+    connect(m_pTabManager, &TabManager::currentIdentityChanged, this, &MainWindow::configureMenuItems);
+    connect(m_pIdentityLoader, &IdentityLoader::identityLoaded, this, &MainWindow::onIdentityLoaded);
+    connect(m_pIdentityLoader, &IdentityLoader::finished, this, &MainWindow::onIdentityLoadingFinished);
 
     configureMenuItems();
 }
@@ -128,6 +142,53 @@ QString MainWindow::showChooseIdentityFileDialog(QWidget* parent)
         tr("Open identity file"), dir, tr("SQRL identity files (*.sqrl *.sqrc)"));
 }
 
+/*!
+ * Displays a file dialog, setting \a parent as the dialog's parent widget,
+ * which lets the user choose one or more identity files.
+ *
+ * Returns the chosen file names, or an empty list if the dialog was
+ * cancelled.
+ */
+
+QStringList MainWindow::showChooseIdentityFilesDialog(QWidget* parent)
+{
+    QString dir = nullptr;
+
+    const QStringList dirs = QStandardPaths::standardLocations(
+                QStandardPaths::DocumentsLocation);
+    if (dirs.count() > 0)
+    {
+        dir = QDir(dirs[0]).filePath("SQRL/");
+    }
+
+    return QFileDialog::getOpenFileNames(parent,
+        tr("Open identity files"), dir, tr("SQRL identity files (*.sqrl *.sqrc)"));
+}
+
+/*!
+ * Opens all identity files within \a paths, which may also contain
+ * directories. The files are parsed in the background and a tab is
+ * added for each identity as soon as it has been loaded. The first
+ * loaded identity becomes the current tab.
+ *
+ * \sa IdentityLoader
+ */
+
+void MainWindow::openFiles(const QStringList& paths)
+{
+    QStringList fileNames = IdentityLoader::collectIdentityFiles(paths);
+
+    if (fileNames.isEmpty())
+    {
+        QMessageBox::information(this, tr("Open identity files"),
+            tr("No identity files were found!"));
+        return;
+    }
+
+    if (!m_pIdentityLoader->isLoading()) m_bActivateNextLoadedTab = true;
+    m_pIdentityLoader->load(fileNames);
+}
+
 /*!
  * Displays an error message-box, telling the user that an identity
  * needs to be loaded to complete the operation.
@@ -139,6 +200,34 @@ void MainWindow::showNoIdentityLoadedError()
                                                 "in order to complete this operation!"));
 }
 
+/*!
+ * Displays a single message-box listing all identity files within
+ * \a errors that could not be opened, along with the reason.
+ */
+
+void MainWindow::showLoadErrorSummary(QList<IdentityLoader::Error> errors)
+{
+    if (errors.isEmpty()) return;
+
+    if (errors.size() == 1)
+    {
+        QMessageBox::critical(this, tr("Error"),
+            tr("The identity file \"%1\" could not be opened:\n%2")
+                .arg(QFileInfo(errors[0].fileName).fileName(), errors[0].message));
+        return;
+    }
+
+    QStringList details;
+    for (const IdentityLoader::Error& error : errors)
+        details.append(error.fileName + ": " + error.message);
+
+    QMessageBox messageBox(QMessageBox::Critical, tr("Error"),
+        tr("%1 identity files could not be opened.").arg(errors.size()),
+        QMessageBox::Ok, this);
+    messageBox.setDetailedText(details.join("\n"));
+    messageBox.exec();
+}
+
 /*!
  * Displays a dialog window containing the currently loaded itentity's textual
  * representation along with some descriptive information.
@@ -182,16 +271,25 @@ void MainWindow::configureMenuItems()
     int currentIndex = m_pTabManager->getCurrentTabIndex();
     bool enable = currentIndex != -1 ? true : false;
     bool enableBlock3Ops = false;
+    bool enableUndo = false;
+    bool enableRedo = false;
 
     if (currentIndex != -1)
     {
-        if (m_pTabManager->getCurrentTab()
-                .getIdentityModel().hasBlockType(3))
+        IdentityTab& tab = m_pTabManager->getCurrentTab();
+
+        if (tab.getIdentityModel().hasBlockType(3))
         {
             enableBlock3Ops = true;
         }
+
+        enableUndo = tab.canUndo();
+        enableRedo = tab.canRedo();
     }
 
+    ui->actionUndo->setEnabled(enableUndo);
+    ui->actionRedo->setEnabled(enableRedo);
+
     ui->actionDecryptIuk->setEnabled(enable);
     ui->actionDecryptImkIlk->setEnabled(enable);
     ui->actionChangePassword->setEnabled(enable);
@@ -337,6 +435,31 @@ void MainWindow::closeEvent(QCloseEvent *event)
     event->accept();
 }
 
+void MainWindow::dragEnterEvent(QDragEnterEvent* event)
+{
+    for (const QUrl& url : event->mimeData()->urls())
+    {
+        if (url.isLocalFile())
+        {
+            event->acceptProposedAction();
+            return;
+        }
+    }
+}
+
+void MainWindow::dropEvent(QDropEvent* event)
+{
+    QStringList paths;
+
+    for (const QUrl& url : event->mimeData()->urls())
+        if (url.isLocalFile()) paths.append(url.toLocalFile());
+
+    if (paths.isEmpty()) return;
+
+    event->acceptProposedAction();
+    openFiles(paths);
+}
+
 
 /***************************************************
  *                S L O T S                        *
@@ -353,8 +476,8 @@ void MainWindow::onCreateNewIdentity()
     ok = showGetNewPasswordDialog(password);
     if (!ok) return;
 
-    QProgressDialog progressDialog(tr("Generating and encrypting identity..."),
-                                   tr("Abort"), 0, 0, this);
+    ProgressDialog progressDialog(tr("Generating and encrypting identity..."),
+                                  tr("Abort"), 0, 0, this);
     progressDialog.setWindowModality(Qt::WindowModal);
 
     ok = CryptUtil::createIdentity(*pIidentity, rescueCode, password,
@@ -421,8 +544,8 @@ void MainWindow::onImportTextualIdentity()
         if (!ok) return;
 
         QByteArray decryptedIuk(32, 0);
-        QProgressDialog progressDialog(tr("Decrypting IUK..."),
-                                       tr("Abort"), 0, 0, this);
+        ProgressDialog progressDialog(tr("Decrypting IUK..."),
+                                      tr("Abort"), 0, 0, this);
         progressDialog.setWindowModality(Qt::WindowModal);
         CryptUtil::decryptBlock2(decryptedIuk, pBlock2, rescueCode, &progressDialog);
 
@@ -442,20 +565,10 @@ void MainWindow::onImportTextualIdentity()
 
 void MainWindow::onOpenFile()
 {
-    QString fileName = showChooseIdentityFileDialog(this);
-    if (fileName.isEmpty()) return;
+    QStringList fileNames = showChooseIdentityFilesDialog(this);
+    if (fileNames.isEmpty()) return;
 
-    try
-    {
-        IdentityModel* pModel = new IdentityModel();
-        IdentityParser parser;
-        parser.parseFile(fileName, pModel);
-        m_pTabManager->addTab(*pModel, QFileInfo(fileName));
-    }
-    catch (std::exception& e)
-    {
-        QMessageBox::critical(this, tr("Error"), e.what());
-    }
+    openFiles(fileNames);
 }
 
 void MainWindow::onSaveFile()
@@ -518,7 +631,7 @@ void MainWindow::onChangePassword()
     if (block1 == nullptr) return;
     IdentityBlock newBlock1 = *block1;
 
-    QProgressDialog progressDialog("", tr("Abort"), 0, 0, this);
+    ProgressDialog progressDialog("", tr("Abort"), 0, 0, this);
     progressDialog.setWindowModality(Qt::WindowModal);
 
     ok = CryptUtil::updateBlock1WithPassword(block1, &newBlock1, password, newPassword, &progressDialog);
@@ -529,8 +642,8 @@ void MainWindow::onChangePassword()
         return;
     }
 
-    *block1 = newBlock1;
-    m_pTabManager->getCurrentTab().rebuild();
+    m_pTabManager->getCurrentTab().getIdentityModel()
+            .updateBlock(block1, newBlock1);
     m_pTabManager->setCurrentTabDirty(true);
 }
 
@@ -548,8 +661,8 @@ void MainWindow::onResetPassword()
             .getIdentityModel().getBlock(2);
     if (pBlock2 == nullptr) return;
 
-    QProgressDialog progressDialog(tr("Decrypting block 2..."),
-                                   tr("Abort"), 0, 0, this);
+    ProgressDialog progressDialog(tr("Decrypting block 2..."),
+                                  tr("Abort"), 0, 0, this);
     progressDialog.setWindowModality(Qt::WindowModal);
 
     QByteArray decryptedIuk(32, 0);
@@ -580,9 +693,8 @@ void MainWindow::onResetPassword()
         return;
     }
 
-    *pBlock1 = updatedBlock1;
-
-    m_pTabManager->getCurrentTab().rebuild();
+    m_pTabManager->getCurrentTab().getIdentityModel()
+            .updateBlock(pBlock1, updatedBlock1);
     m_pTabManager->setCurrentTabDirty(true);
 
     QMessageBox::information(this, tr("Success"),
@@ -597,7 +709,7 @@ void MainWindow::onShowIdentitySettingsDialog()
     IdentitySettingsDialog dialog(this, &currentIdentity);
     if (dialog.exec() == QDialog::Accepted)
     {
-        m_pTabManager->getCurrentTab().rebuild();
+        currentIdentity.notifyModelReset();
         m_pTabManager->setCurrentTabDirty(true);
     }
 }
@@ -637,6 +749,44 @@ void MainWindow::onControlUnauthenticatedChanges()
     m_pTabManager->setEnableUnauthenticatedChanges(enable);
 }
 
+void MainWindow::onToggleCompactView()
+{
+    m_pTabManager->setCompactView(ui->actionCompactView->isChecked());
+}
+
+void MainWindow::onSetTabReleaseDelay()
+{
+    bool ok = false;
+    int seconds = QInputDialog::getInt(
+                this,
+                tr("Tab release delay"),
+                tr("Seconds a background tab keeps its widgets\n"
+                   "(0 = release immediately, -1 = never release):"),
+                m_pTabManager->getReleaseDelay(),
+                -1, 86400, 10, &ok);
+
+    if (!ok) return;
+
+    m_pTabManager->setReleaseDelay(seconds);
+    QSettings("IdTool", "IdTool").setValue(SETTING_TAB_RELEASE_DELAY, seconds);
+}
+
+void MainWindow::onUndo()
+{
+    if (!m_pTabManager->hasTabs()) return;
+
+    if (m_pTabManager->getCurrentTab().undo())
+        m_pTabManager->setCurrentTabDirty(true);
+}
+
+void MainWindow::onRedo()
+{
+    if (!m_pTabManager->hasTabs()) return;
+
+    if (m_pTabManager->getCurrentTab().redo())
+        m_pTabManager->setCurrentTabDirty(true);
+}
+
 void MainWindow::onPasteIdentityText()
 {
     bool ok = false;
@@ -736,8 +886,8 @@ void MainWindow::onCreateSiteKeys()
     ok = showGetPasswordDialog(password, this);
     if (!ok) return;
 
-    QProgressDialog progressDialog(tr("Decrypting identity keys..."),
-                                   tr("Abort"), 0, 0, this);
+    ProgressDialog progressDialog(tr("Decrypting identity keys..."),
+                                  tr("Abort"), 0, 0, this);
     progressDialog.setWindowModality(Qt::WindowModal);
 
     QByteArray key;
@@ -811,8 +961,8 @@ void MainWindow::onDecryptImkIlk()
     ok = showGetPasswordDialog(password, this);
     if (!ok) return;
 
-    QProgressDialog progressDialog(tr("Decrypting identity keys..."),
-                                   tr("Abort"), 0, 0, this);
+    ProgressDialog progressDialog(tr("Decrypting identity keys..."),
+                                  tr("Abort"), 0, 0, this);
     progressDialog.setWindowModality(Qt::WindowModal);
 
     QByteArray key;
@@ -870,8 +1020,8 @@ void MainWindow::onDecryptIuk()
 
     QByteArray decryptedIuk(32, 0);
 
-    QProgressDialog progressDialog(tr("Decrypting identity unlock key..."),
-                                   tr("Abort"), 0, 0, this);
+    ProgressDialog progressDialog(tr("Decrypting identity unlock key..."),
+                                  tr("Abort"), 0, 0, this);
     progressDialog.setWindowModality(Qt::WindowModal);
 
     ok = CryptUtil::decryptBlock2(
@@ -942,8 +1092,8 @@ void MainWindow::onDecryptPreviousIuks()
         ok = showGetPasswordDialog(password, this);
         if (!ok) return;
 
-        QProgressDialog progressDialog(tr("Decrypting identity keys..."),
-                                       tr("Abort"), 0, 0, this);
+        ProgressDialog progressDialog(tr("Decrypting identity keys..."),
+                                      tr("Abort"), 0, 0, this);
         progressDialog.setWindowModality(Qt::WindowModal);
 
         QByteArray key;
@@ -976,7 +1126,7 @@ void MainWindow::onDecryptPreviousIuks()
         ok = showGetRescueCodeDialog(rescueCode, this);
         if (!ok) return;
 
-        QProgressDialog progressDialog(tr("Decrypting identity unlock key..."),
+        ProgressDialog progressDialog(tr("Decrypting identity unlock key..."),
                 tr("Abort"), 0, 0, this);
         progressDialog.setWindowModality(Qt::WindowModal);
 
@@ -1045,7 +1195,7 @@ void MainWindow::onCheckIntegrity()
     if (pBlock1 == nullptr || pBlock2 == nullptr) return;
 
     // Derive key from password
-    QProgressDialog progressDialog("", tr("Abort"), 0, 0, this);
+    ProgressDialog progressDialog("", tr("Abort"), 0, 0, this);
     progressDialog.setWindowModality(Qt::WindowModal);
     QByteArray key(32, 0);
     bool ok = CryptUtil::createKeyFromPassword(key, *pBlock1, password, &progressDialog);
@@ -1108,6 +1258,20 @@ void MainWindow::onCurrentTabChanged(int index)
     configureMenuItems();
 }
 
+void MainWindow::onIdentityLoaded(IdentityModel* model, QString fileName)
+{
+    m_pTabManager->addTab(*model, QFileInfo(fileName), m_bActivateNextLoadedTab);
+    m_bActivateNextLoadedTab = false;
+}
+
+void MainWindow::onIdentityLoadingFinished()
+{
+    QList<IdentityLoader::Error> errors = m_pIdentityLoader->getErrors();
+    m_pIdentityLoader->clearErrors();
+
+    showLoadErrorSummary(errors);
+}
+
 void MainWindow::onQuit()
 {
 
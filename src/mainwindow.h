@@ -35,6 +35,7 @@
 #include "idsetdialog.h"
 #include "cryptutil.h"
 #include "tabmanager.h"
+#include "identityloader.h"
 
 namespace Ui {
 class MainWindow;
@@ -48,10 +49,15 @@ class MainWindow : public QMainWindow
 {
     Q_OBJECT
 
+public:
+    static const QString SETTING_TAB_RELEASE_DELAY;
+
 private:
     Ui::MainWindow *ui;
     QTabWidget* m_pTabWidget = nullptr;
     TabManager* m_pTabManager = nullptr;
+    IdentityLoader* m_pIdentityLoader = nullptr;
+    bool m_bActivateNextLoadedTab = false;
 
 public:
     explicit MainWindow(QWidget *parent = nullptr);
@@ -62,15 +68,20 @@ public:
     static bool showGetPasswordDialog(QString& password, QWidget* parent = nullptr);
     static bool showGetNewPasswordDialog(QString& password, QWidget* parent = nullptr);
     static QString showChooseIdentityFileDialog(QWidget* parent);
+    static QStringList showChooseIdentityFilesDialog(QWidget* parent);
+    void openFiles(const QStringList& paths);
 
 private:
     void showNoIdentityLoadedError();
+    void showLoadErrorSummary(QList<IdentityLoader::Error> errors);
     void showTextualIdentityInfoDialog(QString rescueCode = nullptr);
     void configureMenuItems();
     bool canDiscardChanges();
 
 private: // Overrides
     void closeEvent(QCloseEvent* event);
+    void dragEnterEvent(QDragEnterEvent* event);
+    void dropEvent(QDropEvent* event);
 
 private slots:
     void onCreateNewIdentity();
@@ -84,6 +95,10 @@ private slots:
     void onShowIdentitySettingsDialog();
     void onShowDiffDialog();
     void onControlUnauthenticatedChanges();
+    void onToggleCompactView();
+    void onSetTabReleaseDelay();
+    void onUndo();
+    void onRedo();
     void onPasteIdentityText();
     void onBuildNewIdentity();
     void onShowBlockDesigner();
@@ -93,6 +108,8 @@ private slots:
     void onDecryptPreviousIuks();
     void onCheckIntegrity();
     void onCurrentTabChanged(int index);
+    void onIdentityLoaded(IdentityModel* model, QString fileName);
+    void onIdentityLoadingFinished();
     void onQuit();
 };
 
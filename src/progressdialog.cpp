@@ -0,0 +1,116 @@
+/*
+ * This file is part of the "IdTool" utility app.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Alexander Hauser
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "progressdialog.h"
+
+/*!
+ *
+ * \class ProgressDialog
+ * \brief A \c QProgressDialog acting as a \c ProgressSink.
+ *
+ * \c ProgressDialog can be used like a plain \c QProgressDialog, and
+ * passed to operations expecting a \c ProgressSink, such as the PBKDF
+ * operations of \c CryptUtil.
+ *
+ * Progress values published through the \c ProgressSink interface are
+ * throttled, as every update of a modal progress dialog processes pending
+ * events and repaints the dialog.
+ *
+ * The operation may run on any thread. Updates published from another
+ * thread than the dialog's are queued to the dialog's thread, and
+ * clicking the cancel button requests cancellation of the operation
+ * through \c ThrottledProgressSink::requestCancellation(), which the
+ * operation checks without accessing the dialog. Updates published from
+ * the dialog's own thread are applied right away, since the operation
+ * blocks its event loop.
+ *
+ * \sa ProgressSink, ThrottledProgressSink
+ *
+*/
+
+/*!
+ * Creates a new \c ProgressDialog showing \a labelText and a cancel
+ * button labeled \a cancelButtonText, with a progress range from
+ * \a minimum to \a maximum and \a parent as its parent widget.
+ */
+
+ProgressDialog::ProgressDialog(const QString& labelText, const QString& cancelButtonText,
+                               int minimum, int maximum, QWidget* parent) :
+    QProgressDialog(labelText, cancelButtonText, minimum, maximum, parent),
+    m_ProgressText(labelText)
+{
+    connect(this, &QProgressDialog::canceled, this, [this]() { requestCancellation(); });
+}
+
+void ProgressDialog::setProgressText(const QString& text)
+{
+    m_TextMutex.lock();
+    m_ProgressText = text;
+    m_TextMutex.unlock();
+
+    invokeOnDialogThread("setLabelText", Q_ARG(QString, text));
+}
+
+QString ProgressDialog::getProgressText() const
+{
+    // The label might have been changed using setLabelText() directly
+    if (isDialogThread()) return labelText();
+
+    QMutexLocker locker(&m_TextMutex);
+    return m_ProgressText;
+}
+
+void ProgressDialog::reportProgressMaximum(int maximum)
+{
+    invokeOnDialogThread("setMaximum", Q_ARG(int, maximum));
+}
+
+void ProgressDialog::reportProgressValue(int value)
+{
+    invokeOnDialogThread("setValue", Q_ARG(int, value));
+}
+
+/*!
+ * Returns \c true if called from the thread the dialog lives in.
+ */
+
+bool ProgressDialog::isDialogThread() const
+{
+    return QThread::currentThread() == thread();
+}
+
+/*!
+ * Invokes the slot \a method with \a argument right away when called
+ * from the dialog's thread, or queues the call to the dialog's thread
+ * otherwise.
+ */
+
+void ProgressDialog::invokeOnDialogThread(const char* method, QGenericArgument argument)
+{
+    QMetaObject::invokeMethod(this, method,
+                              isDialogThread() ? Qt::DirectConnection : Qt::QueuedConnection,
+                              argument);
+}
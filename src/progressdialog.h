@@ -0,0 +1,63 @@
+/*
+ * This file is part of the "IdTool" utility app.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Alexander Hauser
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef PROGRESSDIALOG_H
+#define PROGRESSDIALOG_H
+
+#include "common.h"
+#include "progresssink.h"
+
+/**********************************************
+ *    class ProgressDialog                    *
+ *********************************************/
+
+class ProgressDialog : public QProgressDialog, public ThrottledProgressSink
+{
+    Q_OBJECT
+
+public:
+    ProgressDialog(const QString& labelText, const QString& cancelButtonText,
+                   int minimum, int maximum, QWidget* parent = nullptr);
+
+    // ProgressSink
+    void setProgressText(const QString& text) override;
+    QString getProgressText() const override;
+
+protected:
+    // ThrottledProgressSink
+    void reportProgressMaximum(int maximum) override;
+    void reportProgressValue(int value) override;
+
+private:
+    bool isDialogThread() const;
+    void invokeOnDialogThread(const char* method, QGenericArgument argument);
+
+private:
+    mutable QMutex m_TextMutex;
+    QString m_ProgressText;
+};
+
+#endif // PROGRESSDIALOG_H
@@ -0,0 +1,238 @@
+/*
+ * This file is part of the "IdTool" utility app.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Alexander Hauser
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "progresssink.h"
+
+/*!
+ *
+ * \class ProgressSink
+ * \brief An abstract receiver for the progress of long-running operations.
+ *
+ * Long-running operations, such as the PBKDF operations of \c CryptUtil,
+ * publish their progress (a descriptive text and a value within a range)
+ * to a \c ProgressSink and query it for cancellation requests.
+ *
+ * The interface does not depend on any GUI classes, so the crypto and
+ * parsing code can be used within headless builds. GUI code uses the
+ * \c ProgressDialog implementation, command line tools use
+ * \c ConsoleProgressSink. Both are based on \c ThrottledProgressSink.
+ *
+ * \sa ThrottledProgressSink, ProgressDialog, ConsoleProgressSink
+ *
+*/
+
+ProgressSink::~ProgressSink()
+{
+}
+
+/*!
+ * \fn void ProgressSink::setProgressText(const QString& text)
+ *
+ * Sets the text describing the current step of the operation to \a text.
+ */
+
+/*!
+ * \fn QString ProgressSink::getProgressText() const
+ *
+ * Returns the text describing the current step of the operation.
+ */
+
+/*!
+ * \fn void ProgressSink::setProgressMaximum(int maximum)
+ *
+ * Sets the value representing a completed operation to \a maximum.
+ */
+
+/*!
+ * \fn void ProgressSink::setProgressValue(int value)
+ *
+ * Sets the current progress of the operation to \a value.
+ */
+
+/*!
+ * \fn bool ProgressSink::isCanceled() const
+ *
+ * Returns \c true if the operation should be canceled, or \c false
+ * otherwise.
+ */
+
+
+
+/*!
+ *
+ * \class ThrottledProgressSink
+ * \brief A \c ProgressSink limiting the rate at which progress values
+ * are reported, and which can be canceled from any thread.
+ *
+ * PBKDF operations publish their progress after every scrypt iteration,
+ * which can be hundreds of times per second. Reporting each of these
+ * values (e.g. repainting a progress dialog) slows down the operation
+ * without any visible benefit. A \c ThrottledProgressSink only passes
+ * a value on to \c reportProgressValue() if the last reported value is
+ * at least the reporting interval (50 ms by default) old, or if the
+ * value completes the operation. Setting a new maximum restarts the
+ * interval, so the first value of the next operation is always reported.
+ *
+ * Progress texts are not throttled, so subclasses implement
+ * \c setProgressText() and \c getProgressText() themselves.
+ *
+ * The operation can be canceled by calling \c requestCancellation(),
+ * which is safe to do from any thread, while the operation is running on
+ * another one. Subclasses may additionally report cancellation requests
+ * of their own (e.g. a cancel button) by reimplementing \c pollCanceled().
+ * The latest progress value and maximum can likewise be read from any
+ * thread.
+ *
+ * Progress itself must only be reported from a single thread at a time,
+ * i.e. \c setProgressMaximum(), \c setProgressValue() and
+ * \c flushProgress() are not thread-safe. This is the thread running
+ * the operation, subclasses are responsible for passing the reported
+ * values on to other threads if needed.
+ *
+ * \sa ProgressDialog, ConsoleProgressSink
+ *
+*/
+
+const int ThrottledProgressSink::DEFAULT_INTERVAL_MS = 50;
+
+/*!
+ * Creates a new \c ThrottledProgressSink reporting progress values at
+ * most once every \a intervalMs milliseconds.
+ */
+
+ThrottledProgressSink::ThrottledProgressSink(int intervalMs) :
+    m_IntervalMs(intervalMs),
+    m_Maximum(0),
+    m_Value(0),
+    m_ReportedValue(-1),
+    m_Canceled(0)
+{
+}
+
+/*!
+ * Reports the new \a maximum right away and restarts the reporting interval.
+ */
+
+void ThrottledProgressSink::setProgressMaximum(int maximum)
+{
+    m_Maximum.storeRelease(maximum);
+    m_Timer.invalidate();
+    reportProgressMaximum(maximum);
+}
+
+/*!
+ * Records \a value as the current progress, and reports it if the reporting
+ * interval has passed or \a value completes the operation.
+ */
+
+void ThrottledProgressSink::setProgressValue(int value)
+{
+    m_Value.storeRelease(value);
+
+    int maximum = m_Maximum.loadAcquire();
+    bool completed = maximum > 0 && value >= maximum;
+    if (!completed && m_Timer.isValid() && !m_Timer.hasExpired(m_IntervalMs)) return;
+
+    m_Timer.start();
+    m_ReportedValue = value;
+    reportProgressValue(value);
+}
+
+/*!
+ * Returns \c true if \c requestCancellation() was called or
+ * \c pollCanceled() reports a cancellation request, or \c false otherwise.
+ */
+
+bool ThrottledProgressSink::isCanceled() const
+{
+    return m_Canceled.loadAcquire() != 0 || pollCanceled();
+}
+
+/*!
+ * Requests the operation to be canceled. Can be called from any thread.
+ */
+
+void ThrottledProgressSink::requestCancellation()
+{
+    m_Canceled.storeRelease(1);
+}
+
+/*!
+ * Reports the current progress value if it was held back by the
+ * reporting interval, e.g. once the operation has finished.
+ */
+
+void ThrottledProgressSink::flushProgress()
+{
+    int value = m_Value.loadAcquire();
+    if (value == m_ReportedValue) return;
+
+    m_Timer.start();
+    m_ReportedValue = value;
+    reportProgressValue(value);
+}
+
+/*!
+ * Returns the latest progress maximum. Can be called from any thread.
+ */
+
+int ThrottledProgressSink::getProgressMaximum() const
+{
+    return m_Maximum.loadAcquire();
+}
+
+/*!
+ * Returns the latest progress value, whether it was reported yet or not.
+ * Can be called from any thread.
+ */
+
+int ThrottledProgressSink::getProgressValue() const
+{
+    return m_Value.loadAcquire();
+}
+
+/*!
+ * \fn void ThrottledProgressSink::reportProgressMaximum(int maximum)
+ *
+ * Implemented by subclasses to display the progress \a maximum.
+ */
+
+/*!
+ * \fn void ThrottledProgressSink::reportProgressValue(int value)
+ *
+ * Implemented by subclasses to display the progress \a value. Called at
+ * most once per reporting interval.
+ */
+
+/*!
+ * Returns \c true if the subclass received a cancellation request of its
+ * own. The default implementation returns \c false.
+ */
+
+bool ThrottledProgressSink::pollCanceled() const
+{
+    return false;
+}
@@ -0,0 +1,83 @@
+/*
+ * This file is part of the "IdTool" utility app.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Alexander Hauser
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef PROGRESSSINK_H
+#define PROGRESSSINK_H
+
+#include "corecommon.h"
+
+/**********************************************
+ *    class ProgressSink                      *
+ *********************************************/
+
+class ProgressSink
+{
+public:
+    virtual ~ProgressSink();
+    virtual void setProgressText(const QString& text) = 0;
+    virtual QString getProgressText() const = 0;
+    virtual void setProgressMaximum(int maximum) = 0;
+    virtual void setProgressValue(int value) = 0;
+    virtual bool isCanceled() const = 0;
+};
+
+
+
+/**********************************************
+ *    class ThrottledProgressSink             *
+ *********************************************/
+
+class ThrottledProgressSink : public ProgressSink
+{
+public:
+    static const int DEFAULT_INTERVAL_MS;
+
+    explicit ThrottledProgressSink(int intervalMs = DEFAULT_INTERVAL_MS);
+
+    void setProgressMaximum(int maximum) override;
+    void setProgressValue(int value) override;
+    bool isCanceled() const override;
+
+    void requestCancellation();
+    void flushProgress();
+    int getProgressMaximum() const;
+    int getProgressValue() const;
+
+protected:
+    virtual void reportProgressMaximum(int maximum) = 0;
+    virtual void reportProgressValue(int value) = 0;
+    virtual bool pollCanceled() const;
+
+private:
+    int m_IntervalMs;
+    QElapsedTimer m_Timer;
+    QAtomicInt m_Maximum;
+    QAtomicInt m_Value;
+    int m_ReportedValue;
+    QAtomicInt m_Canceled;
+};
+
+#endif // PROGRESSSINK_H
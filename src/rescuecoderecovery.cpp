@@ -0,0 +1,620 @@
+/*
+ * This file is part of the "IdTool" utility app.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Alexander Hauser
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "rescuecoderecovery.h"
+#include "cryptutil.h"
+
+/*!
+ *
+ * \class RescueCodeRecovery
+ * \brief Recovers a partially known rescue code for a type 2 identity block.
+ *
+ * \c RescueCodeRecovery is meant to help users who own an identity but
+ * can only read parts of their rescue code (e.g. because some digits are
+ * smudged). Given the identity's type 2 block and a rescue code pattern in
+ * which the unknown digits are replaced by wildcards (\c ?, \c *, \c x or
+ * \c _), it tries every possible candidate until the AES-GCM verification
+ * tag of the encrypted IUK matches.
+ *
+ * Since every candidate requires a full EnScrypt run, the search space
+ * is split into chunks which are processed by one worker thread per core.
+ * Each worker owns a contiguous range of chunks, and workers running out
+ * of work steal the back half of the largest remaining range of another
+ * worker. All workers stop as soon as the rescue code was found.
+ *
+ * The keys of all candidates of a chunk are derived at once using
+ * \c CryptUtil::enScryptIterationsBatch(), which runs them on the SIMD
+ * scrypt kernel within the memory budget of the shared \c KdfExecutor.
+ * \c stop() cancels the EnScrypt operations which are still running.
+ *
+ * If a checkpoint file is set, the completed chunks are periodically
+ * written to it, allowing an interrupted search to be resumed later.
+ *
+ * \sa CryptUtil::decryptBlock2()
+ *
+*/
+
+const int RescueCodeRecovery::RESCUE_CODE_LENGTH = 24;
+const int RescueCodeRecovery::CANDIDATES_PER_CHUNK = 10;
+const int RescueCodeRecovery::CHECKPOINT_INTERVAL_SECONDS = 30;
+
+/*!
+ * Creates a new \c RescueCodeRecovery object for the type 2 identity
+ * block \a block2 and the rescue code pattern \a pattern.
+ *
+ * Use \c isValid() to check whether both the block and the pattern
+ * could be parsed successfully.
+ *
+ * \sa parsePattern()
+ */
+
+RescueCodeRecovery::RescueCodeRecovery(IdentityBlock block2, QString pattern, QObject *parent)
+    : QObject(parent)
+{
+    qRegisterMetaType<RescueCodeRecovery::Statistics>();
+
+    m_ThreadCount = QThread::idealThreadCount();
+    if (m_ThreadCount < 1) m_ThreadCount = 1;
+
+    if (!parsePattern(pattern, m_Pattern, m_WildcardPositions)) return;
+    if (block2.blockType != 2 || block2.items.count() < 7) return;
+
+    m_ScryptSalt = QByteArray::fromHex(block2.items[2].value.toLocal8Bit());
+    m_ScryptLogNFactor = block2.items[3].value.toInt();
+    m_ScryptIterationCount = block2.items[4].value.toInt();
+    m_EncryptedIuk = QByteArray::fromHex(block2.items[5].value.toLocal8Bit());
+    m_VerificationTag = QByteArray::fromHex(block2.items[6].value.toLocal8Bit());
+    for (int i=0; i<5; i++) m_AdditionalData.append(block2.items[i].toByteArray());
+
+    if (m_ScryptLogNFactor < 1 || m_ScryptIterationCount < 1 ||
+            m_EncryptedIuk.length() != 32 || m_VerificationTag.length() != 16)
+    {
+        return;
+    }
+
+    m_bIsValid = true;
+}
+
+RescueCodeRecovery::~RescueCodeRecovery()
+{
+    qDeleteAll(m_WorkQueues);
+    m_WorkQueues.clear();
+}
+
+/*!
+ * Parses the rescue code pattern \a pattern, ignoring dashes and
+ * whitespace. Unknown digits can be marked using \c ?, \c *, \c x or \c _.
+ *
+ * Upon success, the normalized pattern (24 characters, with all wildcards
+ * replaced by \c ?) is placed in \a normalizedPattern, and the positions
+ * of the wildcards are placed in \a wildcardPositions.
+ *
+ * \return Returns \c true on success, or \c false if \a pattern is not a
+ * valid rescue code pattern or contains more than 18 wildcards.
+ */
+
+bool RescueCodeRecovery::parsePattern(QString pattern, QString &normalizedPattern, QList<int> &wildcardPositions)
+{
+    QString result;
+    QList<int> positions;
+
+    for (QChar c : pattern)
+    {
+        if (c == '-' || c.isSpace()) continue;
+
+        if (c == '?' || c == '*' || c == 'x' || c == 'X' || c == '_')
+        {
+            positions.append(result.length());
+            result.append('?');
+        }
+        else if (c >= '0' && c <= '9') result.append(c);
+        else return false;
+    }
+
+    // 10^18 candidates is the largest search space fitting into 64 bits
+    if (result.length() != RESCUE_CODE_LENGTH || positions.count() > 18) return false;
+
+    normalizedPattern = result;
+    wildcardPositions = positions;
+    return true;
+}
+
+/*!
+ * Returns \c true if both the identity block and the rescue code pattern
+ * given in the constructor are valid, and \c false otherwise.
+ */
+
+bool RescueCodeRecovery::isValid()
+{
+    return m_bIsValid;
+}
+
+/*!
+ * Returns the total number of rescue code candidates matching the pattern.
+ */
+
+quint64 RescueCodeRecovery::getSearchSpaceSize()
+{
+    quint64 result = 1;
+    for (int i=0; i<m_WildcardPositions.count(); i++) result *= 10;
+    return result;
+}
+
+/*!
+ * Returns the number of chunks the search space is split into.
+ */
+
+quint64 RescueCodeRecovery::getChunkCount()
+{
+    return (getSearchSpaceSize() + CANDIDATES_PER_CHUNK - 1) / CANDIDATES_PER_CHUNK;
+}
+
+/*!
+ * Returns the rescue code candidate number \a index, with the last wildcard
+ * of the pattern representing the least significant digit of \a index.
+ */
+
+QString RescueCodeRecovery::getCandidate(quint64 index)
+{
+    QString result = m_Pattern;
+
+    for (int i=m_WildcardPositions.count()-1; i>=0; i--)
+    {
+        result[m_WildcardPositions[i]] = QChar('0' + static_cast<char>(index % 10));
+        index /= 10;
+    }
+
+    return result;
+}
+
+/*!
+ * Sets the number of worker threads to \a threadCount. A value smaller
+ * than \c 1 selects one thread per available CPU core.
+ */
+
+void RescueCodeRecovery::setThreadCount(int threadCount)
+{
+    if (threadCount < 1) threadCount = QThread::idealThreadCount();
+    m_ThreadCount = threadCount < 1 ? 1 : threadCount;
+}
+
+/*!
+ * Returns the number of worker threads being used.
+ */
+
+int RescueCodeRecovery::getThreadCount()
+{
+    return m_ThreadCount;
+}
+
+/*!
+ * Sets the checkpoint file to \a fileName. If a checkpoint file is set,
+ * \c run() resumes from it and periodically updates it.
+ */
+
+void RescueCodeRecovery::setCheckpointFile(QString fileName)
+{
+    m_CheckpointFileName = fileName;
+}
+
+/*!
+ * Loads the list of already completed chunks from the checkpoint file.
+ * Checkpoints belonging to a different pattern or identity are ignored.
+ *
+ * \return Returns \c true if a matching checkpoint was loaded, and
+ * \c false otherwise.
+ */
+
+bool RescueCodeRecovery::loadCheckpoint()
+{
+    if (m_CheckpointFileName.isEmpty()) return false;
+
+    QFile file(m_CheckpointFileName);
+    if (!file.open(QIODevice::ReadOnly)) return false;
+    QJsonDocument doc = QJsonDocument::fromJson(file.readAll());
+    file.close();
+
+    QJsonObject json = doc.object();
+    if (json["pattern"].toString() != m_Pattern ||
+            json["salt"].toString() != QString(m_ScryptSalt.toHex()) ||
+            json["chunk_size"].toInt() != CANDIDATES_PER_CHUNK)
+    {
+        return false;
+    }
+
+    QSet<quint64> chunks;
+    quint64 candidates = 0;
+    quint64 chunkCount = getChunkCount();
+
+    // Ranges are stored as "first-last" strings, since JSON numbers
+    // cannot represent all 64 bit integers
+    for (QJsonValue value : json["completed_chunks"].toArray())
+    {
+        QStringList range = value.toString().split('-');
+        if (range.count() != 2) return false;
+
+        bool ok1 = false, ok2 = false;
+        quint64 first = range[0].toULongLong(&ok1);
+        quint64 last = range[1].toULongLong(&ok2);
+        if (!ok1 || !ok2 || first > last || last >= chunkCount) return false;
+
+        for (quint64 chunk=first; chunk<=last; chunk++)
+        {
+            chunks.insert(chunk);
+            candidates += std::min<quint64>(CANDIDATES_PER_CHUNK,
+                                            getSearchSpaceSize() - chunk * CANDIDATES_PER_CHUNK);
+        }
+    }
+
+    m_ResumedChunks = chunks;
+    m_ResumedCandidates = candidates;
+    m_ResumedMilliseconds = static_cast<qint64>(json["elapsed_ms"].toDouble());
+    return true;
+}
+
+/*!
+ * Writes the list of completed chunks to the checkpoint file.
+ *
+ * \return Returns \c true on success, and \c false otherwise.
+ */
+
+bool RescueCodeRecovery::saveCheckpoint()
+{
+    if (m_CheckpointFileName.isEmpty()) return false;
+
+    m_ResultMutex.lock();
+    QList<quint64> chunks = (m_ResumedChunks + m_CompletedChunks).values();
+    m_ResultMutex.unlock();
+    std::sort(chunks.begin(), chunks.end());
+
+    QJsonArray ranges;
+    for (int i=0; i<chunks.count(); i++)
+    {
+        quint64 first = chunks[i];
+        while (i+1 < chunks.count() && chunks[i+1] == chunks[i] + 1) i++;
+        ranges.append(QString("%1-%2").arg(first).arg(chunks[i]));
+    }
+
+    QJsonObject json;
+    json["pattern"] = m_Pattern;
+    json["salt"] = QString(m_ScryptSalt.toHex());
+    json["chunk_size"] = CANDIDATES_PER_CHUNK;
+    json["completed_chunks"] = ranges;
+    json["elapsed_ms"] = static_cast<double>(getStatistics().elapsedMilliseconds);
+
+    QSaveFile file(m_CheckpointFileName);
+    if (!file.open(QIODevice::WriteOnly)) return false;
+    file.write(QJsonDocument(json).toJson());
+    return file.commit();
+}
+
+/*!
+ * Runs the recovery, blocking until either the rescue code was found,
+ * the whole search space has been tested or \c stop() was called.
+ *
+ * While running, \c progressChanged() is emitted about once per second.
+ *
+ * \return Returns \c true if the rescue code was found, and \c false
+ * otherwise.
+ */
+
+bool RescueCodeRecovery::run()
+{
+    if (!m_bIsValid || sodium_init() < 0 || crypto_aead_aes256gcm_is_available() == 0)
+        return false;
+
+    loadCheckpoint();
+
+    m_bStopRequested.storeRelease(0);
+    m_TestedCandidates.storeRelease(0);
+    m_CompletedChunks.clear();
+    m_FoundRescueCode = "";
+    m_FoundIuk.clear();
+
+    // Split the search space evenly among the workers
+    qDeleteAll(m_WorkQueues);
+    m_WorkQueues.clear();
+    quint64 chunkCount = getChunkCount();
+    quint64 threadCount = static_cast<quint64>(m_ThreadCount);
+
+    for (quint64 i=0; i<threadCount; i++)
+    {
+        WorkQueue* pQueue = new WorkQueue();
+        pQueue->nextChunk = (chunkCount / threadCount) * i + std::min(i, chunkCount % threadCount);
+        pQueue->endChunk = (chunkCount / threadCount) * (i + 1) + std::min(i + 1, chunkCount % threadCount);
+        m_WorkQueues.append(pQueue);
+    }
+
+    m_Timer.start();
+    qint64 lastCheckpoint = 0;
+
+    QList<RescueCodeRecoveryWorker*> workers;
+    for (int i=0; i<m_ThreadCount; i++)
+    {
+        RescueCodeRecoveryWorker* pWorker = new RescueCodeRecoveryWorker(this, i);
+        workers.append(pWorker);
+        pWorker->start();
+    }
+
+    int i = 0;
+    while (i < workers.count())
+    {
+        if (workers[i]->wait(1000))
+        {
+            i++;
+            continue;
+        }
+
+        emit progressChanged(getStatistics());
+
+        if (!m_CheckpointFileName.isEmpty() &&
+                m_Timer.elapsed() - lastCheckpoint >= CHECKPOINT_INTERVAL_SECONDS * 1000)
+        {
+            saveCheckpoint();
+            lastCheckpoint = m_Timer.elapsed();
+        }
+    }
+
+    qDeleteAll(workers);
+    emit progressChanged(getStatistics());
+
+    if (!m_CheckpointFileName.isEmpty())
+    {
+        if (wasFound()) QFile::remove(m_CheckpointFileName);
+        else saveCheckpoint();
+    }
+
+    return wasFound();
+}
+
+/*!
+ * Requests all workers to stop, cancelling the EnScrypt operations of
+ * the chunks being tested. Can be called from any thread.
+ */
+
+void RescueCodeRecovery::stop()
+{
+    m_bStopRequested.storeRelease(1);
+}
+
+/*!
+ * Returns \c true if the rescue code was found, and \c false otherwise.
+ */
+
+bool RescueCodeRecovery::wasFound()
+{
+    QMutexLocker locker(&m_ResultMutex);
+    return !m_FoundRescueCode.isEmpty();
+}
+
+/*!
+ * Returns the recovered rescue code, or an empty string if the
+ * rescue code was not found.
+ */
+
+QString RescueCodeRecovery::getRescueCode()
+{
+    QMutexLocker locker(&m_ResultMutex);
+    return m_FoundRescueCode;
+}
+
+/*!
+ * Returns the decrypted IUK, or an empty byte array if the
+ * rescue code was not found.
+ */
+
+QByteArray RescueCodeRecovery::getIuk()
+{
+    QMutexLocker locker(&m_ResultMutex);
+    return m_FoundIuk;
+}
+
+/*!
+ * Returns the current progress, throughput and an estimate of the time
+ * needed for testing the remaining search space.
+ */
+
+RescueCodeRecovery::Statistics RescueCodeRecovery::getStatistics()
+{
+    Statistics statistics;
+    quint64 testedThisRun = m_TestedCandidates.loadAcquire();
+    qint64 elapsedThisRun = m_Timer.isValid() ? m_Timer.elapsed() : 0;
+
+    statistics.totalCandidates = getSearchSpaceSize();
+    statistics.testedCandidates = std::min(statistics.totalCandidates,
+                                           m_ResumedCandidates + testedThisRun);
+    statistics.remainingCandidates = statistics.totalCandidates - statistics.testedCandidates;
+    statistics.elapsedMilliseconds = m_ResumedMilliseconds + elapsedThisRun;
+
+    if (testedThisRun > 0 && elapsedThisRun > 0)
+    {
+        statistics.candidatesPerSecond = testedThisRun * 1000.0 / elapsedThisRun;
+        statistics.estimatedRemainingMilliseconds = static_cast<qint64>(
+                    statistics.remainingCandidates * 1000.0 / statistics.candidatesPerSecond);
+    }
+
+    return statistics;
+}
+
+/*!
+ * Worker loop for the worker with index \a workerIndex. Takes chunks
+ * from the worker's own queue (or steals them from other workers) and
+ * tests all candidates of each chunk until a match was found, the search
+ * space is exhausted or a stop was requested.
+ */
+
+void RescueCodeRecovery::runWorker(int workerIndex)
+{
+    quint64 chunk = 0;
+    quint64 searchSpaceSize = getSearchSpaceSize();
+
+    while (!m_bStopRequested.loadAcquire() && takeChunk(workerIndex, chunk))
+    {
+        quint64 first = chunk * CANDIDATES_PER_CHUNK;
+        quint64 last = std::min<quint64>(first + CANDIDATES_PER_CHUNK, searchSpaceSize);
+        QStringList candidates;
+        QList<QByteArray> salts;
+        QList<int> iterationCounts;
+
+        for (quint64 index=first; index<last; index++)
+        {
+            candidates.append(getCandidate(index));
+            salts.append(m_ScryptSalt);
+            iterationCounts.append(m_ScryptIterationCount);
+        }
+
+        // Fails if a stop was requested while the batch was running
+        QList<QByteArray> keys;
+        bool completed = CryptUtil::enScryptIterationsBatch(
+                    keys, candidates, salts, m_ScryptLogNFactor, iterationCounts,
+                    &m_bStopRequested);
+
+        for (int i=0; completed && i<keys.count(); i++)
+        {
+            QByteArray decryptedIuk;
+            bool found = testCandidate(keys[i], decryptedIuk);
+            m_TestedCandidates.fetchAndAddRelaxed(1);
+
+            if (found)
+            {
+                m_ResultMutex.lock();
+                if (m_FoundRescueCode.isEmpty())
+                {
+                    m_FoundRescueCode = candidates[i];
+                    m_FoundIuk = decryptedIuk;
+                }
+                m_ResultMutex.unlock();
+
+                m_bStopRequested.storeRelease(1);
+                emit rescueCodeFound(candidates[i]);
+                completed = false;
+            }
+        }
+
+        if (completed)
+        {
+            m_ResultMutex.lock();
+            m_CompletedChunks.insert(chunk);
+            m_ResultMutex.unlock();
+        }
+    }
+}
+
+/*!
+ * Takes the next chunk to be processed by the worker with index
+ * \a workerIndex and places it in \a chunk. If the worker's own queue
+ * is empty, the back half of the largest queue of another worker is
+ * stolen. Chunks which were completed in a previous run are skipped.
+ *
+ * \return Returns \c true if a chunk was taken, or \c false if no
+ * work is left.
+ */
+
+bool RescueCodeRecovery::takeChunk(int workerIndex, quint64 &chunk)
+{
+    WorkQueue* pOwnQueue = m_WorkQueues[workerIndex];
+
+    for (;;)
+    {
+        pOwnQueue->mutex.lock();
+        while (pOwnQueue->nextChunk < pOwnQueue->endChunk)
+        {
+            chunk = pOwnQueue->nextChunk++;
+            if (m_ResumedChunks.contains(chunk)) continue;
+
+            pOwnQueue->mutex.unlock();
+            return true;
+        }
+        pOwnQueue->mutex.unlock();
+
+        // Find the victim with the most remaining work
+        WorkQueue* pVictim = nullptr;
+        quint64 largest = 0;
+
+        for (WorkQueue* pQueue : m_WorkQueues)
+        {
+            if (pQueue == pOwnQueue) continue;
+
+            pQueue->mutex.lock();
+            quint64 remaining = pQueue->endChunk > pQueue->nextChunk ?
+                        pQueue->endChunk - pQueue->nextChunk : 0;
+            pQueue->mutex.unlock();
+
+            if (remaining > largest)
+            {
+                largest = remaining;
+                pVictim = pQueue;
+            }
+        }
+
+        if (pVictim == nullptr) return false;
+
+        pVictim->mutex.lock();
+        quint64 remaining = pVictim->endChunk > pVictim->nextChunk ?
+                    pVictim->endChunk - pVictim->nextChunk : 0;
+        quint64 stolenEnd = pVictim->endChunk;
+        quint64 stolenBegin = stolenEnd - (remaining + 1) / 2;
+        pVictim->endChunk = stolenBegin;
+        pVictim->mutex.unlock();
+
+        if (stolenBegin == stolenEnd) continue;
+
+        pOwnQueue->mutex.lock();
+        pOwnQueue->nextChunk = stolenBegin;
+        pOwnQueue->endChunk = stolenEnd;
+        pOwnQueue->mutex.unlock();
+    }
+}
+
+/*!
+ * Tries to decrypt the IUK using \a key, which was derived from a rescue
+ * code candidate using EnScrypt. If the verification tag matches, the IUK
+ * is placed into \a decryptedIuk.
+ *
+ * \return Returns \c true if the candidate is the correct rescue code,
+ * and \c false otherwise.
+ */
+
+bool RescueCodeRecovery::testCandidate(QByteArray key, QByteArray &decryptedIuk)
+{
+    KeyContext keyContext(key);
+    return keyContext.aesGcmDecrypt(decryptedIuk, m_EncryptedIuk, m_VerificationTag,
+                                    m_AdditionalData, QByteArray(12, 0));
+}
+
+/**********************************************
+ *    class RescueCodeRecoveryWorker          *
+ *********************************************/
+
+RescueCodeRecoveryWorker::RescueCodeRecoveryWorker(RescueCodeRecovery *recovery, int workerIndex)
+    : m_pRecovery(recovery), m_WorkerIndex(workerIndex)
+{
+}
+
+void RescueCodeRecoveryWorker::run()
+{
+    m_pRecovery->runWorker(m_WorkerIndex);
+}
@@ -0,0 +1,145 @@
+/*
+ * This file is part of the "IdTool" utility app.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Alexander Hauser
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef RESCUECODERECOVERY_H
+#define RESCUECODERECOVERY_H
+
+#include "corecommon.h"
+#include "identitymodel.h"
+#include <QThread>
+#include <QMutex>
+#include <QAtomicInteger>
+
+/**********************************************
+ *    class RescueCodeRecovery                *
+ *********************************************/
+
+class RescueCodeRecovery : public QObject
+{
+    Q_OBJECT
+
+public:
+    static const int RESCUE_CODE_LENGTH;
+    static const int CANDIDATES_PER_CHUNK;
+    static const int CHECKPOINT_INTERVAL_SECONDS;
+
+    struct Statistics
+    {
+        quint64 totalCandidates = 0;
+        quint64 testedCandidates = 0;
+        quint64 remainingCandidates = 0;
+        double candidatesPerSecond = 0.0;
+        qint64 elapsedMilliseconds = 0;
+        qint64 estimatedRemainingMilliseconds = -1;
+    };
+
+private:
+    /* A range of chunks [nextChunk, endChunk) owned by one worker.
+     * The owner takes chunks from the front, idle workers steal
+     * the back half of the range. */
+    struct WorkQueue
+    {
+        QMutex mutex;
+        quint64 nextChunk = 0;
+        quint64 endChunk = 0;
+    };
+
+    QString m_Pattern;
+    QList<int> m_WildcardPositions;
+    bool m_bIsValid = false;
+    int m_ThreadCount = 0;
+    QString m_CheckpointFileName = "";
+
+    QByteArray m_ScryptSalt;
+    int m_ScryptLogNFactor = 0;
+    int m_ScryptIterationCount = 0;
+    QByteArray m_EncryptedIuk;
+    QByteArray m_VerificationTag;
+    QByteArray m_AdditionalData;
+
+    QList<WorkQueue*> m_WorkQueues;
+    QSet<quint64> m_ResumedChunks;
+    QSet<quint64> m_CompletedChunks;
+    QMutex m_ResultMutex;
+    QString m_FoundRescueCode = "";
+    QByteArray m_FoundIuk;
+    QAtomicInt m_bStopRequested;
+    QAtomicInteger<quint64> m_TestedCandidates;
+    quint64 m_ResumedCandidates = 0;
+    qint64 m_ResumedMilliseconds = 0;
+    QElapsedTimer m_Timer;
+
+public:
+    explicit RescueCodeRecovery(IdentityBlock block2, QString pattern, QObject* parent = nullptr);
+    ~RescueCodeRecovery();
+    static bool parsePattern(QString pattern, QString& normalizedPattern, QList<int>& wildcardPositions);
+    bool isValid();
+    quint64 getSearchSpaceSize();
+    quint64 getChunkCount();
+    QString getCandidate(quint64 index);
+    void setThreadCount(int threadCount);
+    int getThreadCount();
+    void setCheckpointFile(QString fileName);
+    bool loadCheckpoint();
+    bool saveCheckpoint();
+    bool run();
+    void stop();
+    bool wasFound();
+    QString getRescueCode();
+    QByteArray getIuk();
+    Statistics getStatistics();
+
+signals:
+    void progressChanged(RescueCodeRecovery::Statistics statistics);
+    void rescueCodeFound(QString rescueCode);
+
+private:
+    friend class RescueCodeRecoveryWorker;
+    void runWorker(int workerIndex);
+    bool takeChunk(int workerIndex, quint64& chunk);
+    bool testCandidate(QByteArray key, QByteArray& decryptedIuk);
+};
+
+Q_DECLARE_METATYPE(RescueCodeRecovery::Statistics)
+
+/**********************************************
+ *    class RescueCodeRecoveryWorker          *
+ *********************************************/
+
+class RescueCodeRecoveryWorker : public QThread
+{
+private:
+    RescueCodeRecovery* m_pRecovery = nullptr;
+    int m_WorkerIndex = 0;
+
+public:
+    RescueCodeRecoveryWorker(RescueCodeRecovery* recovery, int workerIndex);
+
+protected:
+    void run() override;
+};
+
+#endif // RESCUECODERECOVERY_H
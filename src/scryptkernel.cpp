@@ -0,0 +1,509 @@
+/*
+ * This file is part of the "IdTool" utility app.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Alexander Hauser
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "scryptkernel.h"
+#include "cryptutil.h"
+#include "scryptkernel_p.h"
+#include <QtEndian>
+
+#if defined(Q_CC_MSVC) && defined(Q_PROCESSOR_X86)
+#include <intrin.h>
+#endif
+
+/*!
+ *
+ * \class ScryptKernel
+ * \brief A multi-lane scrypt kernel for running many independent
+ * EnScrypt chains at once.
+ *
+ * A single EnScrypt chain is inherently sequential, but batch workloads
+ * (test vector generation, bulk identity creation, rescue code recovery)
+ * run many independent chains. \c ScryptKernel advances up to 8 (AVX2) or
+ * 16 (AVX-512) chains in the lanes of SIMD registers at once. As soon as a
+ * chain completes, its lane is refilled with the next job.
+ *
+ * The implementation is selected at runtime based on the features of the
+ * CPU. If no SIMD kernel is available, libsodium's scrypt implementation
+ * is used for running the jobs one after another.
+ *
+ * Note that every lane needs its own scrypt scratch memory, see
+ * \c getScratchMemorySize().
+ *
+ * \sa CryptUtil::enScryptIterationsBatch()
+ *
+*/
+
+const int ScryptKernel::SCRYPT_R = SCRYPT_KERNEL_R;
+const int ScryptKernel::BLOCK_WORDS = SCRYPT_KERNEL_BLOCK_WORDS;
+const int ScryptKernel::MAX_LOGN_FACTOR = 20;
+
+/*
+ * Portable four-lane operations, used for verifying the lane handling
+ * on any CPU. Compilers are usually able to auto-vectorize these.
+ */
+struct ScryptOpsGeneric
+{
+    struct Vector { quint32 v[4]; };
+    struct Index { qint64 offsets[4]; };
+    static const int LANES = 4;
+
+    static inline Index makeIndex(const qint64* offsets)
+    {
+        Index index;
+        for (int i=0; i<LANES; i++) index.offsets[i] = offsets[i];
+        return index;
+    }
+
+    static inline Vector gather(const quint32* base, const Index& index)
+    {
+        Vector result;
+        for (int i=0; i<LANES; i++) result.v[i] = base[index.offsets[i]];
+        return result;
+    }
+
+    static inline Vector add(Vector a, Vector b)
+    {
+        for (int i=0; i<LANES; i++) a.v[i] += b.v[i];
+        return a;
+    }
+
+    static inline Vector bitXor(Vector a, Vector b)
+    {
+        for (int i=0; i<LANES; i++) a.v[i] ^= b.v[i];
+        return a;
+    }
+
+    template <int N>
+    static inline Vector rotl(Vector a)
+    {
+        for (int i=0; i<LANES; i++) a.v[i] = (a.v[i] << N) | (a.v[i] >> (32 - N));
+        return a;
+    }
+};
+
+static void scryptRoMixGeneric(quint32* x, quint32* v, quint32* y, quint32 n)
+{
+    ScryptRoMix<ScryptOpsGeneric>::roMix(x, v, y, n);
+}
+
+/*!
+ * Returns the fastest implementation supported by the current CPU.
+ */
+
+ScryptKernel::Implementation ScryptKernel::detectImplementation()
+{
+    if (isSupported(AVX512)) return AVX512;
+    if (isSupported(AVX2)) return AVX2;
+    return LIBSODIUM;
+}
+
+/*!
+ * Returns \c true if \a implementation was compiled in and is supported
+ * by the current CPU, and \c false otherwise.
+ */
+
+bool ScryptKernel::isSupported(Implementation implementation)
+{
+    switch (implementation)
+    {
+    case AUTO:
+    case LIBSODIUM:
+    case GENERIC:
+        return true;
+    case AVX2:
+        return scryptRoMixAvx2Compiled() && cpuSupportsAvx2();
+    case AVX512:
+        return scryptRoMixAvx512Compiled() && cpuSupportsAvx512();
+    }
+
+    return false;
+}
+
+/*!
+ * Returns the number of chains being run in parallel by \a implementation.
+ */
+
+int ScryptKernel::getLaneCount(Implementation implementation)
+{
+    switch (implementation)
+    {
+    case AUTO: return getLaneCount(detectImplementation());
+    case LIBSODIUM: return 1;
+    case GENERIC: return ScryptOpsGeneric::LANES;
+    case AVX2: return 8;
+    case AVX512: return 16;
+    }
+
+    return 1;
+}
+
+/*!
+ * Returns a human-readable name for \a implementation.
+ */
+
+QString ScryptKernel::getImplementationName(Implementation implementation)
+{
+    switch (implementation)
+    {
+    case AUTO: return getImplementationName(detectImplementation());
+    case LIBSODIUM: return "libsodium";
+    case GENERIC: return "generic";
+    case AVX2: return "AVX2";
+    case AVX512: return "AVX-512";
+    }
+
+    return "";
+}
+
+/*!
+ * Returns the number of bytes of scratch memory needed for running
+ * \a implementation with the given \a logNFactor.
+ */
+
+qint64 ScryptKernel::getScratchMemorySize(Implementation implementation, int logNFactor)
+{
+    // One block of 128 * r bytes per lane for each of the N
+    // scratch entries, plus two working blocks
+    qint64 blockSize = 128LL * SCRYPT_R * getLaneCount(implementation);
+    return blockSize * ((1LL << logNFactor) + 2);
+}
+
+/*!
+ * Runs all EnScrypt \a jobs using the scrypt parameter \a logNFactor, placing
+ * the 32 byte result of each job within the job's \c result member. Every job
+ * runs \c iterationCount chained scrypt operations exactly like
+ * \c CryptUtil::enScryptIterations().
+ *
+ * If \a implementation is \c AUTO, the fastest implementation supported by
+ * the current CPU is used. If \a cancelFlag is given and becomes non-zero,
+ * the operation is aborted after the current scrypt round.
+ *
+ * \return Returns \c true on success, and \c false if \a implementation
+ * is not supported, \a logNFactor is out of range, memory could not
+ * be allocated or the operation was cancelled.
+ */
+
+bool ScryptKernel::enScryptBatch(QList<Job> &jobs, int logNFactor, Implementation implementation,
+                                 const QAtomicInt *cancelFlag)
+{
+    if (sodium_init() < 0) return false;
+    if (logNFactor < 1 || logNFactor > MAX_LOGN_FACTOR) return false;
+
+    if (implementation == AUTO) implementation = detectImplementation();
+    if (!isSupported(implementation)) return false;
+
+    switch (implementation)
+    {
+    case GENERIC:
+        return runLanes(jobs, logNFactor, getLaneCount(implementation), scryptRoMixGeneric, cancelFlag);
+    case AVX2:
+        return runLanes(jobs, logNFactor, getLaneCount(implementation), scryptRoMixAvx2, cancelFlag);
+    case AVX512:
+        return runLanes(jobs, logNFactor, getLaneCount(implementation), scryptRoMixAvx512, cancelFlag);
+    default:
+        break;
+    }
+
+    for (Job& job : jobs)
+    {
+        if (!enScryptChain(job.result, job.password, job.salt, logNFactor,
+                           job.iterationCount, cancelFlag))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*!
+ * Runs a single EnScrypt chain of \a iterationCount scrypt operations on
+ * \a password and \a salt using libsodium, and places the result into
+ * \a result.
+ *
+ * If \a cancelFlag is given and becomes non-zero, the operation is
+ * aborted after the current iteration. If \a progress is given, the
+ * number of completed iterations is stored into it after every iteration.
+ *
+ * \return Returns \c true on success, and \c false if scrypt failed
+ * or the operation was cancelled.
+ */
+
+bool ScryptKernel::enScryptChain(QByteArray &result, QByteArray password, QByteArray salt,
+                                 int logNFactor, int iterationCount, const QAtomicInt *cancelFlag,
+                                 QAtomicInt *progress)
+{
+    if (sodium_init() < 0) return false;
+
+    QByteArray key(32, 0);
+    QByteArray xorKey;
+
+    for (int i=0; i<std::max(iterationCount, 1); i++)
+    {
+        if (cancelFlag != nullptr && cancelFlag->loadAcquire()) return false;
+
+        int ret = crypto_pwhash_scryptsalsa208sha256_ll(
+                    reinterpret_cast<const unsigned char*>(password.constData()),
+                    static_cast<size_t>(password.length()),
+                    reinterpret_cast<const unsigned char*>(salt.constData()),
+                    static_cast<size_t>(salt.length()),
+                    1ULL << logNFactor,
+                    static_cast<uint32_t>(SCRYPT_R),
+                    1,
+                    reinterpret_cast<uint8_t*>(key.data()),
+                    static_cast<size_t>(key.length()));
+
+        if (ret != 0) return false;
+
+        xorKey = (i == 0) ? key : CryptUtil::xorByteArrays(xorKey, key);
+        salt = key;
+
+        if (progress != nullptr) progress->storeRelease(i + 1);
+    }
+
+    result = xorKey;
+    return true;
+}
+
+/*!
+ * Computes PBKDF2-HMAC-SHA256 of \a password and \a salt using a single
+ * iteration (as used within scrypt), and places \a length bytes of output
+ * into \a result.
+ */
+
+void ScryptKernel::pbkdf2Sha256(QByteArray &result, QByteArray password, QByteArray salt, int length)
+{
+    crypto_auth_hmacsha256_state passwordState;
+    crypto_auth_hmacsha256_init(&passwordState,
+                                reinterpret_cast<const unsigned char*>(password.constData()),
+                                static_cast<size_t>(password.length()));
+
+    result.resize(length);
+    pbkdf2Sha256(passwordState,
+                 reinterpret_cast<const unsigned char*>(salt.constData()),
+                 static_cast<size_t>(salt.length()),
+                 reinterpret_cast<unsigned char*>(result.data()),
+                 static_cast<size_t>(length));
+
+    sodium_memzero(&passwordState, sizeof(passwordState));
+}
+
+/*!
+ * Runs \a jobs through the multi-lane \a roMix kernel, which advances
+ * \a laneCount scrypt operations at once. Whenever a job completes, its
+ * lane is refilled with the next pending job. The operation is aborted
+ * between two rounds if \a cancelFlag becomes non-zero.
+ */
+
+bool ScryptKernel::runLanes(QList<Job> &jobs, int logNFactor, int laneCount, RoMixFunction roMix,
+                            const QAtomicInt *cancelFlag)
+{
+    struct Lane
+    {
+        int job = -1;
+        int remainingIterations = 0;
+        QByteArray salt;
+        QByteArray xorKey;
+        crypto_auth_hmacsha256_state passwordState;
+    };
+
+    const quint32 n = 1U << logNFactor;
+    const size_t blockWords = static_cast<size_t>(BLOCK_WORDS);
+    const size_t blockSize = blockWords * sizeof(quint32) * static_cast<size_t>(laneCount);
+
+    quint32* x = static_cast<quint32*>(qMallocAligned(blockSize, 64));
+    quint32* y = static_cast<quint32*>(qMallocAligned(blockSize, 64));
+    quint32* v = static_cast<quint32*>(qMallocAligned(blockSize * n, 64));
+
+    if (x == nullptr || y == nullptr || v == nullptr)
+    {
+        qFreeAligned(x);
+        qFreeAligned(y);
+        qFreeAligned(v);
+        return false;
+    }
+
+    std::memset(x, 0, blockSize);
+
+    QVector<Lane> lanes(laneCount);
+    QByteArray block(static_cast<int>(blockWords * sizeof(quint32)), 0);
+    unsigned char* pBlock = reinterpret_cast<unsigned char*>(block.data());
+    int nextJob = 0;
+    bool cancelled = false;
+
+    for (;;)
+    {
+        int activeLanes = 0;
+
+        for (int l=0; l<laneCount; l++)
+        {
+            Lane& lane = lanes[l];
+
+            // Refill idle lanes
+            if (lane.job == -1 && nextJob < jobs.count())
+            {
+                Job& job = jobs[nextJob];
+                lane.job = nextJob++;
+                lane.remainingIterations = std::max(job.iterationCount, 1);
+                lane.salt = job.salt;
+                lane.xorKey.clear();
+                crypto_auth_hmacsha256_init(&lane.passwordState,
+                                            reinterpret_cast<const unsigned char*>(job.password.constData()),
+                                            static_cast<size_t>(job.password.length()));
+            }
+
+            if (lane.job == -1) continue;
+            activeLanes++;
+
+            // B = PBKDF2(P, S, 1, 128 * r), scattered into lane l
+            pbkdf2Sha256(lane.passwordState,
+                         reinterpret_cast<const unsigned char*>(lane.salt.constData()),
+                         static_cast<size_t>(lane.salt.length()),
+                         pBlock, static_cast<size_t>(block.length()));
+
+            for (size_t w=0; w<blockWords; w++)
+                x[w * laneCount + l] = qFromLittleEndian<quint32>(pBlock + w * 4);
+        }
+
+        if (activeLanes == 0) break;
+        if (cancelFlag != nullptr && cancelFlag->loadAcquire())
+        {
+            cancelled = true;
+            break;
+        }
+
+        roMix(x, v, y, n);
+
+        for (int l=0; l<laneCount; l++)
+        {
+            Lane& lane = lanes[l];
+            if (lane.job == -1) continue;
+
+            for (size_t w=0; w<blockWords; w++)
+                qToLittleEndian<quint32>(x[w * laneCount + l], pBlock + w * 4);
+
+            // DK = PBKDF2(P, B', 1, 32)
+            QByteArray key(32, 0);
+            pbkdf2Sha256(lane.passwordState, pBlock, static_cast<size_t>(block.length()),
+                         reinterpret_cast<unsigned char*>(key.data()),
+                         static_cast<size_t>(key.length()));
+
+            lane.xorKey = lane.xorKey.isEmpty() ? key : CryptUtil::xorByteArrays(lane.xorKey, key);
+            lane.salt = key;
+
+            if (--lane.remainingIterations == 0)
+            {
+                jobs[lane.job].result = lane.xorKey;
+                lane.job = -1;
+                sodium_memzero(&lane.passwordState, sizeof(lane.passwordState));
+            }
+        }
+    }
+
+    sodium_memzero(pBlock, static_cast<size_t>(block.length()));
+    sodium_memzero(x, blockSize);
+    sodium_memzero(y, blockSize);
+    sodium_memzero(v, blockSize * n);
+    qFreeAligned(x);
+    qFreeAligned(y);
+    qFreeAligned(v);
+
+    return !cancelled;
+}
+
+/*!
+ * Computes PBKDF2-HMAC-SHA256 with a single iteration, using the
+ * precomputed HMAC state \a passwordState, and places \a resultLength
+ * bytes of output into \a result.
+ */
+
+void ScryptKernel::pbkdf2Sha256(const crypto_auth_hmacsha256_state &passwordState,
+                                const unsigned char *salt, size_t saltLength,
+                                unsigned char *result, size_t resultLength)
+{
+    crypto_auth_hmacsha256_state saltState = passwordState;
+    crypto_auth_hmacsha256_update(&saltState, salt, saltLength);
+
+    unsigned char digest[crypto_auth_hmacsha256_BYTES];
+
+    for (quint32 i=1; (i-1) * sizeof(digest) < resultLength; i++)
+    {
+        crypto_auth_hmacsha256_state state = saltState;
+        unsigned char blockIndex[4];
+        qToBigEndian<quint32>(i, blockIndex);
+
+        crypto_auth_hmacsha256_update(&state, blockIndex, sizeof(blockIndex));
+        crypto_auth_hmacsha256_final(&state, digest);
+
+        size_t offset = (i-1) * sizeof(digest);
+        std::memcpy(result + offset, digest, std::min(sizeof(digest), resultLength - offset));
+    }
+
+    sodium_memzero(digest, sizeof(digest));
+    sodium_memzero(&saltState, sizeof(saltState));
+}
+
+/*!
+ * Returns \c true if the CPU and the operating system support AVX2.
+ */
+
+bool ScryptKernel::cpuSupportsAvx2()
+{
+#if defined(Q_PROCESSOR_X86) && (defined(Q_CC_GNU) || defined(Q_CC_CLANG))
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#elif defined(Q_PROCESSOR_X86) && defined(Q_CC_MSVC)
+    int info[4];
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    if (!osxsave || (_xgetbv(0) & 0x6) != 0x6) return false;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    return false;
+#endif
+}
+
+/*!
+ * Returns \c true if the CPU and the operating system support AVX-512F.
+ */
+
+bool ScryptKernel::cpuSupportsAvx512()
+{
+#if defined(Q_PROCESSOR_X86) && (defined(Q_CC_GNU) || defined(Q_CC_CLANG))
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx512f");
+#elif defined(Q_PROCESSOR_X86) && defined(Q_CC_MSVC)
+    int info[4];
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    if (!osxsave || (_xgetbv(0) & 0xE6) != 0xE6) return false;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 16)) != 0;
+#else
+    return false;
+#endif
+}
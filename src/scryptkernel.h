@@ -0,0 +1,82 @@
+/*
+ * This file is part of the "IdTool" utility app.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Alexander Hauser
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef SCRYPTKERNEL_H
+#define SCRYPTKERNEL_H
+
+#include "corecommon.h"
+#include <QAtomicInt>
+
+/**********************************************
+ *    class ScryptKernel                      *
+ *********************************************/
+
+class ScryptKernel
+{
+public:
+    enum Implementation
+    {
+        AUTO,
+        LIBSODIUM,
+        GENERIC,
+        AVX2,
+        AVX512
+    };
+
+    struct Job
+    {
+        QByteArray password;
+        QByteArray salt;
+        int iterationCount = 1;
+        QByteArray result;
+    };
+
+    static const int SCRYPT_R;
+    static const int BLOCK_WORDS;
+    static const int MAX_LOGN_FACTOR;
+
+public:
+    static Implementation detectImplementation();
+    static bool isSupported(Implementation implementation);
+    static int getLaneCount(Implementation implementation);
+    static QString getImplementationName(Implementation implementation);
+    static qint64 getScratchMemorySize(Implementation implementation, int logNFactor);
+    static bool enScryptBatch(QList<Job>& jobs, int logNFactor, Implementation implementation = AUTO, const QAtomicInt* cancelFlag = nullptr);
+    static bool enScryptChain(QByteArray& result, QByteArray password, QByteArray salt, int logNFactor, int iterationCount, const QAtomicInt* cancelFlag = nullptr, QAtomicInt* progress = nullptr);
+    static void pbkdf2Sha256(QByteArray& result, QByteArray password, QByteArray salt, int length);
+
+private:
+    typedef void (*RoMixFunction)(quint32* x, quint32* v, quint32* y, quint32 n);
+
+    static bool runLanes(QList<Job>& jobs, int logNFactor, int laneCount, RoMixFunction roMix, const QAtomicInt* cancelFlag);
+    static void pbkdf2Sha256(const crypto_auth_hmacsha256_state& passwordState,
+                             const unsigned char* salt, size_t saltLength,
+                             unsigned char* result, size_t resultLength);
+    static bool cpuSupportsAvx2();
+    static bool cpuSupportsAvx512();
+};
+
+#endif // SCRYPTKERNEL_H
@@ -0,0 +1,95 @@
+/*
+ * This file is part of the "IdTool" utility app.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Alexander Hauser
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * AVX2 implementation of the multi-lane scrypt ROMix, advancing eight
+ * scrypt instances at once.
+ *
+ * This file needs to be compiled with support for the instruction set
+ * enabled (qmake takes care of this through CONFIG += simd and
+ * AVX2_SOURCES, see core/core.pro). Otherwise, an empty stub is compiled
+ * and the kernel is reported as unavailable.
+ */
+
+#include "scryptkernel_p.h"
+
+#if defined(__AVX2__) || (defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86)))
+#include <immintrin.h>
+
+struct ScryptOpsAvx2
+{
+    typedef __m256i Vector;
+    struct Index { __m256i low; __m256i high; };
+    static const int LANES = 8;
+
+    static inline Index makeIndex(const qint64* offsets)
+    {
+        Index index;
+        index.low = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(offsets));
+        index.high = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(offsets + 4));
+        return index;
+    }
+
+    static inline Vector gather(const quint32* base, const Index& index)
+    {
+        const int* pBase = reinterpret_cast<const int*>(base);
+        __m128i low = _mm256_i64gather_epi32(pBase, index.low, 4);
+        __m128i high = _mm256_i64gather_epi32(pBase, index.high, 4);
+        return _mm256_inserti128_si256(_mm256_castsi128_si256(low), high, 1);
+    }
+
+    static inline Vector add(Vector a, Vector b) { return _mm256_add_epi32(a, b); }
+    static inline Vector bitXor(Vector a, Vector b) { return _mm256_xor_si256(a, b); }
+
+    template <int N>
+    static inline Vector rotl(Vector a)
+    {
+        return _mm256_or_si256(_mm256_slli_epi32(a, N), _mm256_srli_epi32(a, 32 - N));
+    }
+};
+
+bool scryptRoMixAvx2Compiled()
+{
+    return true;
+}
+
+void scryptRoMixAvx2(quint32* x, quint32* v, quint32* y, quint32 n)
+{
+    ScryptRoMix<ScryptOpsAvx2>::roMix(x, v, y, n);
+}
+
+#else
+
+bool scryptRoMixAvx2Compiled()
+{
+    return false;
+}
+
+void scryptRoMixAvx2(quint32*, quint32*, quint32*, quint32)
+{
+}
+
+#endif
@@ -0,0 +1,94 @@
+/*
+ * This file is part of the "IdTool" utility app.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Alexander Hauser
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * AVX-512 implementation of the multi-lane scrypt ROMix, advancing sixteen
+ * scrypt instances at once using native 32 bit rotations.
+ *
+ * This file needs to be compiled with support for the instruction set
+ * enabled (qmake takes care of this through CONFIG += simd and
+ * AVX512F_SOURCES, see core/core.pro). Otherwise, an empty stub is compiled
+ * and the kernel is reported as unavailable.
+ */
+
+#include "scryptkernel_p.h"
+
+#if defined(__AVX512F__) || (defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86)))
+#include <immintrin.h>
+
+struct ScryptOpsAvx512
+{
+    typedef __m512i Vector;
+    struct Index { __m512i low; __m512i high; };
+    static const int LANES = 16;
+
+    static inline Index makeIndex(const qint64* offsets)
+    {
+        Index index;
+        index.low = _mm512_loadu_si512(offsets);
+        index.high = _mm512_loadu_si512(offsets + 8);
+        return index;
+    }
+
+    static inline Vector gather(const quint32* base, const Index& index)
+    {
+        __m256i low = _mm512_i64gather_epi32(index.low, base, 4);
+        __m256i high = _mm512_i64gather_epi32(index.high, base, 4);
+        return _mm512_inserti64x4(_mm512_castsi256_si512(low), high, 1);
+    }
+
+    static inline Vector add(Vector a, Vector b) { return _mm512_add_epi32(a, b); }
+    static inline Vector bitXor(Vector a, Vector b) { return _mm512_xor_si512(a, b); }
+
+    template <int N>
+    static inline Vector rotl(Vector a)
+    {
+        return _mm512_rol_epi32(a, N);
+    }
+};
+
+bool scryptRoMixAvx512Compiled()
+{
+    return true;
+}
+
+void scryptRoMixAvx512(quint32* x, quint32* v, quint32* y, quint32 n)
+{
+    ScryptRoMix<ScryptOpsAvx512>::roMix(x, v, y, n);
+}
+
+#else
+
+bool scryptRoMixAvx512Compiled()
+{
+    return false;
+}
+
+void scryptRoMixAvx512(quint32*, quint32*, quint32*, quint32)
+{
+}
+
+#endif
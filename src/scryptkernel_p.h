@@ -0,0 +1,198 @@
+/*
+ * This file is part of the "IdTool" utility app.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Alexander Hauser
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef SCRYPTKERNEL_P_H
+#define SCRYPTKERNEL_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is an implementation detail of ScryptKernel and is
+// shared between the scalar and the SIMD translation units only.
+//
+
+#include <QtGlobal>
+#include <cstring>
+#include <utility>
+
+// scrypt parameter r is fixed to 256 for EnScrypt, so every block
+// consists of 2*r = 512 Salsa20/8 sub-blocks of 16 words each
+#define SCRYPT_KERNEL_R 256
+#define SCRYPT_KERNEL_BLOCK_WORDS (32 * SCRYPT_KERNEL_R)
+
+// Entry points of the SIMD translation units. If a translation unit was
+// built without support for its instruction set, the corresponding
+// "compiled" function returns false and the kernel must not be called.
+bool scryptRoMixAvx2Compiled();
+void scryptRoMixAvx2(quint32* x, quint32* v, quint32* y, quint32 n);
+bool scryptRoMixAvx512Compiled();
+void scryptRoMixAvx512(quint32* x, quint32* v, quint32* y, quint32 n);
+
+/**********************************************
+ *    class ScryptRoMix                       *
+ *********************************************/
+
+/*
+ * Multi-lane scrypt ROMix, advancing Ops::LANES independent scrypt
+ * instances at once.
+ *
+ * All buffers use a word-sliced layout: word w of lane l is stored at
+ * index w * LANES + l, so that each Ops::Vector holds the same word of
+ * every lane and Salsa20/8 can be computed without any shuffling.
+ *
+ * Ops needs to provide the Vector type, the LANES constant as well as
+ * add(), bitXor() and rotl<N>() operations on 32 bit lanes. For reading
+ * the scratch memory, gather() loads one word per lane from the 64 bit
+ * per-lane offsets previously packed by makeIndex().
+ */
+
+template <typename Ops>
+class ScryptRoMix
+{
+public:
+    typedef typename Ops::Vector Vector;
+    static const int LANES = Ops::LANES;
+
+    /*
+     * Runs ROMix on the word-sliced block x for all lanes, using v
+     * (n blocks) as scratch memory and y (one block) as temporary
+     * storage. All buffers must be aligned to sizeof(Vector).
+     */
+    static void roMix(quint32* x, quint32* v, quint32* y, quint32 n)
+    {
+        const size_t blockVectors = SCRYPT_KERNEL_BLOCK_WORDS;
+        Vector* X = reinterpret_cast<Vector*>(x);
+        Vector* Y = reinterpret_cast<Vector*>(y);
+        Vector* V = reinterpret_cast<Vector*>(v);
+
+        // V[i+1] = BlockMix(V[i]), writing the output of each step
+        // directly into the scratch memory
+        std::memcpy(V, X, blockVectors * sizeof(Vector));
+        for (quint32 i=0; i<n; i++)
+            blockMix(&V[i * blockVectors], i + 1 < n ? &V[(i + 1) * blockVectors] : X);
+
+        for (quint32 i=0; i<n; i++)
+        {
+            // Integerify() differs between the lanes, so every lane
+            // reads its scratch block from a different offset
+            const quint32* pX = reinterpret_cast<const quint32*>(X);
+            qint64 offsets[LANES];
+
+            for (int lane=0; lane<LANES; lane++)
+            {
+                quint32 j = pX[(SCRYPT_KERNEL_BLOCK_WORDS - 16) * LANES + lane] & (n - 1);
+                offsets[lane] = static_cast<qint64>(j) * SCRYPT_KERNEL_BLOCK_WORDS * LANES + lane;
+            }
+
+            blockMixXor(X, reinterpret_cast<const quint32*>(V), Ops::makeIndex(offsets), Y);
+            std::swap(X, Y);
+        }
+
+        // n calls to blockMixXor() leave the result in the original buffer
+        // if n is even, which is the case for all valid log-n-factors
+    }
+
+private:
+    static inline void blockMix(const Vector* B, Vector* Y)
+    {
+        Vector X[16];
+        std::memcpy(X, &B[(2 * SCRYPT_KERNEL_R - 1) * 16], sizeof(X));
+
+        for (int i=0; i<2*SCRYPT_KERNEL_R; i++)
+        {
+            for (int k=0; k<16; k++) X[k] = Ops::bitXor(X[k], B[i * 16 + k]);
+            salsa20_8(X);
+
+            // Even sub-blocks go to the first half, odd ones to the second
+            int target = (i & 1) ? SCRYPT_KERNEL_R + i / 2 : i / 2;
+            std::memcpy(&Y[target * 16], X, sizeof(X));
+        }
+    }
+
+    /*
+     * Same as blockMix(), but uses B xor V[j] as input, where the word w
+     * of each lane is gathered from v at the lane's offset in index
+     * plus w * LANES.
+     */
+    static inline void blockMixXor(const Vector* B, const quint32* v,
+                                   typename Ops::Index index, Vector* Y)
+    {
+        const int last = (2 * SCRYPT_KERNEL_R - 1) * 16;
+        Vector X[16];
+
+        for (int k=0; k<16; k++)
+            X[k] = Ops::bitXor(B[last + k], Ops::gather(v + (last + k) * LANES, index));
+
+        for (int i=0; i<2*SCRYPT_KERNEL_R; i++)
+        {
+            for (int k=0; k<16; k++)
+            {
+                Vector input = Ops::bitXor(B[i * 16 + k], Ops::gather(v + (i * 16 + k) * LANES, index));
+                X[k] = Ops::bitXor(X[k], input);
+            }
+            salsa20_8(X);
+
+            int target = (i & 1) ? SCRYPT_KERNEL_R + i / 2 : i / 2;
+            std::memcpy(&Y[target * 16], X, sizeof(X));
+        }
+    }
+
+    static inline void salsa20_8(Vector* B)
+    {
+        Vector x[16];
+        std::memcpy(x, B, sizeof(x));
+
+#define SCRYPT_R(a, b, c, n) a = Ops::bitXor(a, Ops::template rotl<n>(Ops::add(b, c)))
+        for (int i=0; i<8; i+=2)
+        {
+            // Operate on columns
+            SCRYPT_R(x[ 4], x[ 0], x[12],  7);  SCRYPT_R(x[ 8], x[ 4], x[ 0],  9);
+            SCRYPT_R(x[12], x[ 8], x[ 4], 13);  SCRYPT_R(x[ 0], x[12], x[ 8], 18);
+            SCRYPT_R(x[ 9], x[ 5], x[ 1],  7);  SCRYPT_R(x[13], x[ 9], x[ 5],  9);
+            SCRYPT_R(x[ 1], x[13], x[ 9], 13);  SCRYPT_R(x[ 5], x[ 1], x[13], 18);
+            SCRYPT_R(x[14], x[10], x[ 6],  7);  SCRYPT_R(x[ 2], x[14], x[10],  9);
+            SCRYPT_R(x[ 6], x[ 2], x[14], 13);  SCRYPT_R(x[10], x[ 6], x[ 2], 18);
+            SCRYPT_R(x[ 3], x[15], x[11],  7);  SCRYPT_R(x[ 7], x[ 3], x[15],  9);
+            SCRYPT_R(x[11], x[ 7], x[ 3], 13);  SCRYPT_R(x[15], x[11], x[ 7], 18);
+
+            // Operate on rows
+            SCRYPT_R(x[ 1], x[ 0], x[ 3],  7);  SCRYPT_R(x[ 2], x[ 1], x[ 0],  9);
+            SCRYPT_R(x[ 3], x[ 2], x[ 1], 13);  SCRYPT_R(x[ 0], x[ 3], x[ 2], 18);
+            SCRYPT_R(x[ 6], x[ 5], x[ 4],  7);  SCRYPT_R(x[ 7], x[ 6], x[ 5],  9);
+            SCRYPT_R(x[ 4], x[ 7], x[ 6], 13);  SCRYPT_R(x[ 5], x[ 4], x[ 7], 18);
+            SCRYPT_R(x[11], x[10], x[ 9],  7);  SCRYPT_R(x[ 8], x[11], x[10],  9);
+            SCRYPT_R(x[ 9], x[ 8], x[11], 13);  SCRYPT_R(x[10], x[ 9], x[ 8], 18);
+            SCRYPT_R(x[12], x[15], x[14],  7);  SCRYPT_R(x[13], x[12], x[15],  9);
+            SCRYPT_R(x[14], x[13], x[12], 13);  SCRYPT_R(x[15], x[14], x[13], 18);
+        }
+#undef SCRYPT_R
+
+        for (int k=0; k<16; k++) B[k] = Ops::add(B[k], x[k]);
+    }
+};
+
+#endif // SCRYPTKERNEL_P_H
@@ -1,6 +1,11 @@
 #include "tabmanager.h"
 #include "uibuilder.h"
 #include "identityclipboard.h"
+#include "identitytreeview.h"
+#include "identityhistory.h"
+#include "identityloader.h"
+#include "identitymodel.h"
+#include "tracer.h"
 
 /*!
  *
@@ -12,6 +17,17 @@
  * displayed using a \c QTabWidget. It provides methods for adding, removing
  * and managing tabs/identities.
  *
+ * Tabs are materialized lazily: a tab only holds its \c IdentityModel
+ * until it becomes the current tab for the first time. Tabs moved to
+ * the background release their widgets after an idle period (see
+ * \c setReleaseDelay()), and global option changes only mark hidden
+ * tabs as stale instead of rebuilding them.
+ *
+ * The identity files of all tabs are being watched. If a file is changed
+ * on disk, it is reparsed in the background and only the blocks that
+ * differ are applied to the tab's identity. Tabs with unsaved changes are
+ * left untouched, and a warning is shown instead.
+ *
  * \sa IdentityTab
  *
 */
@@ -28,6 +44,16 @@ TabManager::TabManager(QTabWidget *tabWidget)
 
     connect(m_pTabWidget, SIGNAL(tabCloseRequested(int)), this, SLOT(onTabCloseRequested(int)));
     connect(m_pTabWidget, SIGNAL(currentChanged(int)), this, SLOT(onCurrentTabChanged(int)));
+
+    m_pFileReloader = new IdentityLoader(this);
+    m_pFileReloader->setMaxThreadCount(1);
+    m_FileChangeTimer.setSingleShot(true);
+    m_FileChangeTimer.setInterval(FILE_CHANGE_DELAY_MS);
+
+    connect(&m_FileWatcher, &QFileSystemWatcher::fileChanged, this, &TabManager::onWatchedFileChanged);
+    connect(&m_FileChangeTimer, &QTimer::timeout, this, &TabManager::onFileChangeTimerTimeout);
+    connect(m_pFileReloader, &IdentityLoader::identityLoaded, this, &TabManager::onFileReloaded);
+    connect(m_pFileReloader, &IdentityLoader::finished, this, &TabManager::onFileReloadingFinished);
 }
 
 /*!
@@ -42,10 +68,14 @@ TabManager::TabManager(QTabWidget *tabWidget)
 
 int TabManager::addTab(IdentityModel &identityModel, QFileInfo fileInfo, bool setActive)
 {
+    TRACE_SPAN("TabManager::addTab", "ui");
+
     IdentityTab* pTab= new IdentityTab(identityModel, fileInfo);
-    pTab->getUiBuilder().setEnableUnauthenticatedChanges(m_bEnableUnauthenticatedChanges);
+    pTab->setEnableUnauthenticatedChanges(m_bEnableUnauthenticatedChanges);
+    pTab->setCompactView(m_bCompactView);
 
     connect(&(pTab->getUiBuilder()), SIGNAL(identityChanged()), this, SLOT(onCurrentIdentityChanged()));
+    connect(pTab, &IdentityTab::fileInfoChanged, this, &TabManager::updateWatchedFiles);
 
     m_Tabs.append(pTab);
     m_pTabWidget->addTab(pTab, pTab->getTabText());
@@ -54,6 +84,7 @@ int TabManager::addTab(IdentityModel &identityModel, QFileInfo fileInfo, bool se
     m_pTabWidget->setTabToolTip(index, fileInfo.filePath());
     if (setActive) m_pTabWidget->setCurrentIndex(index);
 
+    updateWatchedFiles();
     return index;
 }
 
@@ -111,14 +142,19 @@ bool TabManager::hasDirtyTabs()
 
 /*!
  * If \a dirty is \c true, marks the currently active \c IdentityTab
- * object as dirty (changed but unsaved), or clean otherwise.
+ * object as dirty (changed but unsaved) and records its changes as a
+ * new undo step. Otherwise, the tab is marked clean.
  */
 
 void TabManager::setCurrentTabDirty(bool dirty)
 {
     if (!hasTabs()) return;
+    if (dirty) getCurrentTab().recordChange();
     getCurrentTab().setDirty(dirty);
+    if (!dirty) m_WarnedFiles.remove(getCurrentTab().getFileInfo().absoluteFilePath());
     updateCurrentTabText();
+
+    emit currentIdentityChanged();
 }
 
 /*!
@@ -133,11 +169,14 @@ bool TabManager::isCurrentTabDirty()
 }
 
 /*!
- * Rebuilds the visual representation of all tabs.
+ * Rebuilds the visual representation of the active tab and marks
+ * all other tabs as stale, so they get rebuilt upon activation.
  */
 
 void TabManager::rebuildAllTabs()
 {
+    TRACE_SPAN("TabManager::rebuildAllTabs", "ui");
+
     for (IdentityTab* pTab : m_Tabs)
         pTab->rebuild();
 }
@@ -171,7 +210,48 @@ void TabManager::setEnableUnauthenticatedChanges(bool enable, bool rebuild)
     m_bEnableUnauthenticatedChanges = enable;
 
     for (IdentityTab* pTab : m_Tabs)
-        pTab->getUiBuilder().setEnableUnauthenticatedChanges(enable, rebuild);
+        pTab->setEnableUnauthenticatedChanges(enable, rebuild);
+}
+
+/*!
+ * Switches all tabs to the compact, virtualized tree view if \a compact
+ * is \c true, or to the regular widget based view otherwise.
+ *
+ * \sa IdentityTab::setCompactView()
+ */
+
+void TabManager::setCompactView(bool compact)
+{
+    m_bCompactView = compact;
+
+    for (IdentityTab* pTab : m_Tabs)
+        pTab->setCompactView(compact);
+}
+
+/*!
+ * Sets the number of \a seconds a tab needs to stay in the background
+ * before its widgets are released. A value of \c 0 releases background
+ * tabs immediately, a negative value keeps their widgets forever.
+ *
+ * The new delay applies to tabs that are moved to the background
+ * from now on.
+ */
+
+void TabManager::setReleaseDelay(int seconds)
+{
+    m_ReleaseDelaySeconds = seconds;
+}
+
+/*!
+ * Returns the number of seconds after which the widgets of background
+ * tabs are released.
+ *
+ * \sa setReleaseDelay()
+ */
+
+int TabManager::getReleaseDelay()
+{
+    return m_ReleaseDelaySeconds;
 }
 
 /*!
@@ -202,6 +282,40 @@ void TabManager::updateCurrentTabText()
                              getCurrentTab().getTabToolTip());
 }
 
+/*!
+ * Updates the set of watched files to match the identity files of all
+ * open tabs.
+ */
+
+void TabManager::updateWatchedFiles()
+{
+    QStringList fileNames;
+
+    for (IdentityTab* pTab : m_Tabs)
+    {
+        QFileInfo fileInfo = pTab->getFileInfo();
+        if (fileInfo.filePath().isEmpty()) continue;
+
+        QString fileName = fileInfo.absoluteFilePath();
+        if (!fileNames.contains(fileName)) fileNames.append(fileName);
+    }
+
+    const QStringList watchedFiles = m_FileWatcher.files();
+
+    QStringList obsoleteFiles;
+    for (const QString& fileName : watchedFiles)
+        if (!fileNames.contains(fileName)) obsoleteFiles.append(fileName);
+    if (!obsoleteFiles.isEmpty()) m_FileWatcher.removePaths(obsoleteFiles);
+
+    QStringList newFiles;
+    for (const QString& fileName : fileNames)
+    {
+        if (!watchedFiles.contains(fileName) && QFileInfo::exists(fileName))
+            newFiles.append(fileName);
+    }
+    if (!newFiles.isEmpty()) m_FileWatcher.addPaths(newFiles);
+}
+
 
 /***************************************************
  *                S L O T S                        *
@@ -220,14 +334,31 @@ void TabManager::onTabCloseRequested(int index)
         if (reply == QMessageBox::No)  return;
     }
 
+    if (m_Tabs[index] == m_pActiveTab) m_pActiveTab = nullptr;
+
     delete m_Tabs[index];
     m_Tabs.removeAt(index);
+    updateWatchedFiles();
 
     emit currentTabChanged(getCurrentTabIndex());
 }
 
 void TabManager::onCurrentTabChanged(int index)
 {
+    TRACE_SPAN("TabManager::onCurrentTabChanged", "ui");
+
+    // Look the tab up through the tab widget, since m_Tabs is not yet
+    // updated if this is triggered by a tab being deleted
+    IdentityTab* pTab = index >= 0 ?
+                qobject_cast<IdentityTab*>(m_pTabWidget->widget(index)) : nullptr;
+
+    if (pTab != m_pActiveTab)
+    {
+        if (m_pActiveTab) m_pActiveTab->deactivate(m_ReleaseDelaySeconds);
+        m_pActiveTab = pTab;
+        if (m_pActiveTab) m_pActiveTab->activate();
+    }
+
     emit currentTabChanged(index);
 }
 
@@ -237,6 +368,82 @@ void TabManager::onCurrentIdentityChanged()
     setCurrentTabDirty(true);
 }
 
+void TabManager::onWatchedFileChanged(const QString& path)
+{
+    // Writers often replace or rewrite files in several steps,
+    // so wait for the file to settle before reparsing it
+    if (!m_ChangedFiles.contains(path)) m_ChangedFiles.append(path);
+    m_FileChangeTimer.start();
+}
+
+void TabManager::onFileChangeTimerTimeout()
+{
+    QStringList changedFiles;
+    changedFiles.swap(m_ChangedFiles);
+
+    // Files being replaced drop out of the watcher, so watch them again
+    updateWatchedFiles();
+
+    for (const QString& fileName : changedFiles)
+        if (QFileInfo::exists(fileName)) m_pFileReloader->load({ fileName });
+}
+
+void TabManager::onFileReloaded(IdentityModel* model, QString fileName)
+{
+    TRACE_SPAN("TabManager::onFileReloaded", "ui");
+
+    for (IdentityTab* pTab : m_Tabs)
+    {
+        if (pTab->getFileInfo().absoluteFilePath() != fileName) continue;
+
+        IdentityModel& identityModel = pTab->getIdentityModel();
+        if (identityModel.blocks == model->blocks) continue;
+
+        // Only warn once, until the tab gets saved or reloaded, since
+        // some tools keep rewriting the file
+        if (pTab->isDirty())
+        {
+            if (m_WarnedFiles.contains(fileName)) continue;
+            m_WarnedFiles.insert(fileName);
+
+            QMessageBox::warning(m_pTabWidget, tr("File changed"),
+                tr("The identity file \"%1\" was changed on disk, but its tab has "
+                   "unsaved changes. The changes on disk were not loaded.")
+                    .arg(pTab->getFileInfo().fileName()));
+            continue;
+        }
+
+        m_WarnedFiles.remove(fileName);
+
+        if (identityModel.applyChanges(*model) > 0)
+        {
+            pTab->recordChange();
+            if (pTab == m_pActiveTab) emit currentIdentityChanged();
+        }
+    }
+
+    delete model;
+}
+
+void TabManager::onFileReloadingFinished()
+{
+    QList<IdentityLoader::Error> errors = m_pFileReloader->getErrors();
+    m_pFileReloader->clearErrors();
+
+    for (const IdentityLoader::Error& error : errors)
+    {
+        // Files caught in the middle of being written will fail to parse,
+        // but they trigger another change notification once completed
+        if (m_ChangedFiles.contains(error.fileName)) continue;
+        if (m_WarnedFiles.contains(error.fileName)) continue;
+        m_WarnedFiles.insert(error.fileName);
+
+        QMessageBox::warning(m_pTabWidget, tr("File changed"),
+            tr("The identity file \"%1\" was changed on disk, but could not be reloaded:\n%2")
+                .arg(QFileInfo(error.fileName).fileName(), error.message));
+    }
+}
+
 
 
 /*!
@@ -252,6 +459,11 @@ void TabManager::onCurrentIdentityChanged()
  * of the identity, which is being used for displaying the tab's title text and
  * tooltip.
  *
+ * The visual representation is only created once the tab gets activated
+ * (see \c activate()) and can be released again while the tab is in the
+ * background (see \c releaseWidgets()). Requests to rebuild a tab that is
+ * not active only mark it as stale.
+ *
  * \sa TabManager, UiBuilder, IdentityModel
  *
 */
@@ -273,8 +485,21 @@ IdentityTab::IdentityTab(IdentityModel& identityModel,
     QVBoxLayout *mainLayout = new QVBoxLayout;
     mainLayout->setMargin(0);
     mainLayout->addWidget(m_pScrollArea);
-    rebuild();
     setLayout(mainLayout);
+
+    m_pHistory = new IdentityHistory(m_pIdentityModel);
+
+    m_ReleaseTimer.setSingleShot(true);
+    connect(&m_ReleaseTimer, &QTimer::timeout, this, &IdentityTab::onReleaseTimerTimeout);
+}
+
+/*!
+ * Destroys the \c IdentityTab object and its undo history.
+ */
+
+IdentityTab::~IdentityTab()
+{
+    delete m_pHistory;
 }
 
 /*!
@@ -319,15 +544,197 @@ UiBuilder &IdentityTab::getUiBuilder()
 
 /*!
  * Rebuilds (redraws) the identity visualisation on this
- * \c IdentityTab.
+ * \c IdentityTab. If the tab is not active, it is only marked as
+ * stale and rebuilt once it gets activated.
  */
 
 void IdentityTab::rebuild()
 {
-    m_pUiBuilder->rebuild();
+    m_bIsStale = true;
+    if (m_bIsActive) materialize();
+}
+
+/*!
+ * Records all changes made to the identity since the last call as a
+ * single undo step.
+ *
+ * \sa IdentityHistory::record()
+ */
+
+void IdentityTab::recordChange()
+{
+    m_pHistory->record();
+}
+
+/*!
+ * Reverts the identity to the previously recorded state.
+ * Returns \c true on success, or \c false if there is nothing to undo.
+ */
+
+bool IdentityTab::undo()
+{
+    return m_pHistory->undo();
+}
+
+/*!
+ * Reapplies the state that was undone last.
+ * Returns \c true on success, or \c false if there is nothing to redo.
+ */
+
+bool IdentityTab::redo()
+{
+    return m_pHistory->redo();
+}
+
+/*!
+ * Returns \c true if the identity has a state that \c undo() can
+ * restore, or \c false otherwise.
+ */
+
+bool IdentityTab::canUndo()
+{
+    return m_pHistory->canUndo();
+}
+
+/*!
+ * Returns \c true if the identity has a state that \c redo() can
+ * restore, or \c false otherwise.
+ */
+
+bool IdentityTab::canRedo()
+{
+    return m_pHistory->canRedo();
+}
+
+/*!
+ * Enables or disables the controls for unauthenticated changes within
+ * this tab's identity visualisation, depending on \a enable.
+ * If \a rebuild is \c true, the change is reflected immediately.
+ *
+ * \sa UiBuilder::setEnableUnauthenticatedChanges()
+ */
+
+void IdentityTab::setEnableUnauthenticatedChanges(bool enable, bool rebuild)
+{
+    m_bEnableUnauthenticatedChanges = enable;
+    m_pUiBuilder->setEnableUnauthenticatedChanges(enable, rebuild && m_bIsActive);
+    if (m_pTreeView) m_pTreeView->setEnableUnauthenticatedChanges(enable);
+    if (rebuild && !m_bIsActive) m_bIsStale = true;
+}
+
+/*!
+ * If \a compact is \c true, the identity is shown within a virtualized
+ * \c IdentityTreeView and the widgets created by the \c UiBuilder are
+ * released. Otherwise, the tree view is deleted and the widget based
+ * representation is used. The new representation is created right away
+ * if the tab is active, or upon its next activation otherwise.
+ *
+ * \sa IdentityTreeView
+ */
+
+void IdentityTab::setCompactView(bool compact)
+{
+    if (compact == m_bCompactView) return;
+
+    releaseWidgets();
+    m_bCompactView = compact;
+    m_pScrollArea->setVisible(!compact);
+
+    if (m_bIsActive) materialize();
+}
+
+/*!
+ * Returns \c true if the identity is currently shown within the
+ * compact tree view, or \c false otherwise.
+ */
+
+bool IdentityTab::isCompactView()
+{
+    return m_bCompactView;
 }
 
 
+/*!
+ * Marks the tab as active (visible) and creates or updates its
+ * visual representation if needed.
+ */
+
+void IdentityTab::activate()
+{
+    m_ReleaseTimer.stop();
+    m_bIsActive = true;
+
+    if (m_bIsStale || !isMaterialized()) materialize();
+}
+
+/*!
+ * Marks the tab as inactive (hidden). If \a releaseDelaySeconds is not
+ * negative, the tab's widgets are released after the tab has stayed
+ * inactive for the given number of seconds.
+ */
+
+void IdentityTab::deactivate(int releaseDelaySeconds)
+{
+    m_bIsActive = false;
+
+    if (releaseDelaySeconds >= 0)
+        m_ReleaseTimer.start(releaseDelaySeconds * 1000);
+}
+
+/*!
+ * Returns \c true if the widgets representing the identity currently
+ * exist, or \c false otherwise.
+ */
+
+bool IdentityTab::isMaterialized()
+{
+    if (m_bCompactView) return m_pTreeView != nullptr;
+    return m_pUiBuilder->isBuilt();
+}
+
+/*!
+ * Deletes all widgets representing the identity, keeping only the
+ * \c IdentityModel. The widgets are recreated on the next activation.
+ */
+
+void IdentityTab::releaseWidgets()
+{
+    m_pUiBuilder->release();
+
+    delete m_pTreeView;
+    m_pTreeView = nullptr;
+
+    m_bIsStale = true;
+}
+
+/*!
+ * Creates the visual representation for the current view mode, or
+ * refreshes it if it is stale.
+ */
+
+void IdentityTab::materialize()
+{
+    if (m_bCompactView)
+    {
+        if (!m_pTreeView)
+        {
+            m_pTreeView = new IdentityTreeView(m_pIdentityModel, m_pUiBuilder);
+            m_pTreeView->setEnableUnauthenticatedChanges(m_bEnableUnauthenticatedChanges);
+            layout()->addWidget(m_pTreeView);
+        }
+        else if (m_bIsStale)
+        {
+            m_pTreeView->getItemModel()->modelReset();
+        }
+    }
+    else if (m_bIsStale || !m_pUiBuilder->isBuilt())
+    {
+        m_pUiBuilder->rebuild();
+    }
+
+    m_bIsStale = false;
+}
+
 /*!
  * Returns a string representing the identity file's name.
  * If no file information is present, a name of "Untitled"
@@ -365,5 +772,27 @@ QString IdentityTab::getTabToolTip()
 void IdentityTab::updateFileInfo(QFileInfo fileInfo)
 {
     m_FileInfo = fileInfo;
+    emit fileInfoChanged();
 }
 
+/*!
+ * Returns information about the identity file represented by this tab.
+ * If the identity has no associated file, an empty \c QFileInfo object
+ * is returned.
+ */
+
+QFileInfo IdentityTab::getFileInfo()
+{
+    return m_FileInfo;
+}
+
+
+/***************************************************
+ *                S L O T S                        *
+ * ************************************************/
+
+
+void IdentityTab::onReleaseTimerTimeout()
+{
+    if (!m_bIsActive) releaseWidgets();
+}
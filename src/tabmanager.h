@@ -2,11 +2,15 @@
 #define TABMANAGER_H
 
 #include "common.h"
+#include <QFileSystemWatcher>
 
 // Forward declarations
 class IdentityModel;
 class UiBuilder;
 class IdentityTab;
+class IdentityTreeView;
+class IdentityHistory;
+class IdentityLoader;
 
 /**********************************************
  *    class TabManager                        *
@@ -16,10 +20,22 @@ class TabManager : public QObject
 {
     Q_OBJECT
 
+public:
+    static const int DEFAULT_RELEASE_DELAY_SECONDS = 120;
+    static const int FILE_CHANGE_DELAY_MS = 300;
+
 private:
     QTabWidget* m_pTabWidget;
     QList<IdentityTab*> m_Tabs;
+    IdentityTab* m_pActiveTab = nullptr;
     bool m_bEnableUnauthenticatedChanges = false;
+    bool m_bCompactView = false;
+    int m_ReleaseDelaySeconds = DEFAULT_RELEASE_DELAY_SECONDS;
+    QFileSystemWatcher m_FileWatcher;
+    QTimer m_FileChangeTimer;
+    QStringList m_ChangedFiles;
+    QSet<QString> m_WarnedFiles;
+    IdentityLoader* m_pFileReloader;
 
 public:
     explicit TabManager(QTabWidget* tabWidget);
@@ -34,15 +50,24 @@ public:
     bool isCurrentTabDirty();
     void rebuildAllTabs();
     void setEnableUnauthenticatedChanges(bool enable, bool rebuild = true);
+    void setCompactView(bool compact);
+    void setReleaseDelay(int seconds);
+    int getReleaseDelay();
     void updateCurrentTabText();
+    void updateWatchedFiles();
 
 signals:
     void currentTabChanged(int index);
+    void currentIdentityChanged();
 
 private slots:
     void onTabCloseRequested(int index);
     void onCurrentTabChanged(int index);
     void onCurrentIdentityChanged();
+    void onWatchedFileChanged(const QString& path);
+    void onFileChangeTimerTimeout();
+    void onFileReloaded(IdentityModel* model, QString fileName);
+    void onFileReloadingFinished();
 };
 
 /**********************************************
@@ -59,17 +84,47 @@ private:
     QScrollArea* m_pScrollArea;
     IdentityModel* m_pIdentityModel;
     UiBuilder* m_pUiBuilder;
+    IdentityTreeView* m_pTreeView = nullptr;
+    IdentityHistory* m_pHistory;
+    bool m_bEnableUnauthenticatedChanges = false;
+    bool m_bCompactView = false;
+    bool m_bIsActive = false;
+    bool m_bIsStale = true;
+    QTimer m_ReleaseTimer;
 
 public:
     explicit IdentityTab(IdentityModel& identityModel, QFileInfo fileInfo, QWidget *parent = nullptr);
+    ~IdentityTab() override;
     void setDirty(bool dirty = true);
     bool isDirty();
     IdentityModel& getIdentityModel();
     UiBuilder& getUiBuilder();
     void rebuild();
+    void recordChange();
+    bool undo();
+    bool redo();
+    bool canUndo();
+    bool canRedo();
+    void setEnableUnauthenticatedChanges(bool enable, bool rebuild = true);
+    void setCompactView(bool compact);
+    bool isCompactView();
+    void activate();
+    void deactivate(int releaseDelaySeconds = -1);
+    bool isMaterialized();
+    void releaseWidgets();
     QString getTabText();
     QString getTabToolTip();
+    QFileInfo getFileInfo();
     void updateFileInfo(QFileInfo fileInfo);
+
+signals:
+    void fileInfoChanged();
+
+private:
+    void materialize();
+
+private slots:
+    void onReleaseTimerTimeout();
 };
 
 #endif // TABMANAGER_H
@@ -0,0 +1,265 @@
+/*
+ * This file is part of the "IdTool" utility app.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Alexander Hauser
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "tracer.h"
+
+const char* Tracer::ENVIRONMENT_VARIABLE = "IDTOOL_TRACE";
+
+QAtomicInt Tracer::m_Enabled(0);
+QAtomicInt Tracer::m_NextThreadId(1);
+QMutex Tracer::m_Mutex;
+QElapsedTimer Tracer::m_Timer;
+QVector<Tracer::Event> Tracer::m_Events;
+QString Tracer::m_FileName;
+
+/*!
+ *
+ * \class Tracer
+ * \brief Records trace spans and writes them as Chrome trace-event JSON.
+ *
+ * Hot paths are instrumented using the \c TRACE_SPAN(name, category)
+ * macro, which records the time until the end of the enclosing scope.
+ * While tracing is disabled, a span costs a single atomic load, and
+ * defining \c IDTOOL_NO_TRACE compiles all spans out.
+ *
+ * Tracing is started by setting the \c IDTOOL_TRACE environment variable
+ * to the name of the output file (see \c startFromEnvironment(), which is
+ * run automatically when a \c QCoreApplication is created), or by calling
+ * \c start(), e.g. from a \c --trace command line option. The recorded
+ * spans are written when \c stop() is called or the application exits.
+ * The file can be opened with Perfetto (https://ui.perfetto.dev) or
+ * chrome://tracing.
+ *
+ * \sa TraceSpan
+ *
+*/
+
+/*!
+ * Starts recording spans, which will be written to \a fileName when
+ * tracing is stopped. Any spans recorded before are discarded.
+ *
+ * \return Returns \c true if tracing was started, \c false if
+ * \a fileName is empty.
+ */
+
+bool Tracer::start(QString fileName)
+{
+    if (fileName.isEmpty()) return false;
+
+    QMutexLocker locker(&m_Mutex);
+
+    static bool postRoutineAdded = false;
+    if (!postRoutineAdded)
+    {
+        // Write the trace when the application object is destroyed
+        qAddPostRoutine([]() { Tracer::stop(); });
+        postRoutineAdded = true;
+    }
+
+    m_FileName = fileName;
+    m_Events.clear();
+    m_Timer.start();
+    m_Enabled.store(1);
+    return true;
+}
+
+/*!
+ * Starts tracing if the \c IDTOOL_TRACE environment variable is set,
+ * using its value as the output file name.
+ *
+ * \return Returns \c true if tracing was started, \c false otherwise.
+ */
+
+bool Tracer::startFromEnvironment()
+{
+    return start(QString::fromLocal8Bit(qgetenv(ENVIRONMENT_VARIABLE)));
+}
+
+/*!
+ * Stops tracing and writes all recorded spans to the output file.
+ *
+ * \return Returns \c true if the trace was written, \c false if
+ * tracing was not running or the file could not be written.
+ */
+
+bool Tracer::stop()
+{
+    if (!isEnabled()) return false;
+    m_Enabled.store(0);
+
+    QByteArray json = QJsonDocument(toJson()).toJson(QJsonDocument::Compact);
+
+    QMutexLocker locker(&m_Mutex);
+    m_Events.clear();
+
+    QSaveFile file(m_FileName);
+    if (!file.open(QIODevice::WriteOnly) || file.write(json) != json.size() || !file.commit())
+    {
+        qWarning() << "Error writing trace file" << m_FileName;
+        return false;
+    }
+
+    return true;
+}
+
+/*!
+ * Returns the number of nanoseconds since tracing was started.
+ */
+
+qint64 Tracer::getTimestamp()
+{
+    return m_Timer.nsecsElapsed();
+}
+
+/*!
+ * Records a span named \a name of \a category, which started at
+ * \a startNsecs and lasted \a durationNsecs, on the current thread.
+ * Unless they are negative, the number of heap \a allocations and
+ * \a allocatedBytes within the span are added as arguments.
+ * \a name and \a category must remain valid until tracing is stopped,
+ * which is the case for string literals.
+ */
+
+void Tracer::addEvent(const char* name, const char* category,
+                      qint64 startNsecs, qint64 durationNsecs,
+                      qint64 allocations, qint64 allocatedBytes)
+{
+    Event event = { name, category, startNsecs, durationNsecs, getThreadId(),
+                    allocations, allocatedBytes };
+
+    QMutexLocker locker(&m_Mutex);
+    if (!isEnabled()) return;
+    m_Events.append(event);
+}
+
+/*!
+ * Returns all spans recorded so far in the Chrome trace-event format,
+ * as "complete" events with timestamps in microseconds.
+ */
+
+QJsonObject Tracer::toJson()
+{
+    QMutexLocker locker(&m_Mutex);
+
+    QJsonArray events;
+    qint64 pid = QCoreApplication::applicationPid();
+
+    for (const Event& event : qAsConst(m_Events))
+    {
+        QJsonObject json;
+        json["name"] = QString::fromLatin1(event.name);
+        json["cat"] = QString::fromLatin1(event.category);
+        json["ph"] = "X";
+        json["ts"] = event.startNsecs / 1000.0;
+        json["dur"] = event.durationNsecs / 1000.0;
+        json["pid"] = pid;
+        json["tid"] = event.threadId;
+
+        if (event.allocations >= 0)
+        {
+            QJsonObject args;
+            args["allocations"] = event.allocations;
+            args["allocated_bytes"] = event.allocatedBytes;
+            json["args"] = args;
+        }
+
+        events.append(json);
+    }
+
+    QJsonObject trace;
+    trace["traceEvents"] = events;
+    trace["displayTimeUnit"] = "ms";
+    return trace;
+}
+
+/*!
+ * Returns a small, stable number identifying the current thread.
+ */
+
+int Tracer::getThreadId()
+{
+    static thread_local int threadId = m_NextThreadId.fetchAndAddRelaxed(1);
+    return threadId;
+}
+
+static void startTracerFromEnvironment()
+{
+    Tracer::startFromEnvironment();
+}
+
+Q_COREAPP_STARTUP_FUNCTION(startTracerFromEnvironment)
+
+
+
+/*!
+ *
+ * \class TraceSpan
+ * \brief Records the lifetime of a scope as a span of the \c Tracer.
+ *
+ * Use the \c TRACE_SPAN(name, category) macro instead of creating
+ * spans directly.
+ *
+ * If an allocation hook is installed, the number of heap allocations
+ * within the span is recorded as well.
+ *
+ * \sa Tracer, AllocationTracker
+ *
+*/
+
+/*!
+ * Starts the span.
+ */
+
+void TraceSpan::begin()
+{
+    m_pCounters = AllocationTracker::getCounters();
+    if (m_pCounters)
+    {
+        m_StartAllocations = m_pCounters->allocations;
+        m_StartAllocatedBytes = m_pCounters->allocatedBytes;
+    }
+
+    m_StartNsecs = Tracer::getTimestamp();
+}
+
+/*!
+ * Ends the span and records it.
+ */
+
+void TraceSpan::end()
+{
+    qint64 durationNsecs = Tracer::getTimestamp() - m_StartNsecs;
+
+    if (!m_pCounters)
+    {
+        Tracer::addEvent(m_Name, m_Category, m_StartNsecs, durationNsecs);
+        return;
+    }
+
+    Tracer::addEvent(m_Name, m_Category, m_StartNsecs, durationNsecs,
+                     m_pCounters->allocations - m_StartAllocations,
+                     m_pCounters->allocatedBytes - m_StartAllocatedBytes);
+}
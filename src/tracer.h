@@ -0,0 +1,121 @@
+/*
+ * This file is part of the "IdTool" utility app.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Alexander Hauser
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef TRACER_H
+#define TRACER_H
+
+#include "corecommon.h"
+#include "allocationtracker.h"
+#include <QMutex>
+
+/**********************************************
+ *    class Tracer                            *
+ *********************************************/
+
+class Tracer
+{
+public:
+    static const char* ENVIRONMENT_VARIABLE;
+
+    struct Event
+    {
+        const char* name;
+        const char* category;
+        qint64 startNsecs;
+        qint64 durationNsecs;
+        int threadId;
+        qint64 allocations;
+        qint64 allocatedBytes;
+    };
+
+private:
+    static QAtomicInt m_Enabled;
+    static QAtomicInt m_NextThreadId;
+    static QMutex m_Mutex;
+    static QElapsedTimer m_Timer;
+    static QVector<Event> m_Events;
+    static QString m_FileName;
+
+public:
+    static bool start(QString fileName);
+    static bool startFromEnvironment();
+    static bool stop();
+    static inline bool isEnabled() { return m_Enabled.load() != 0; }
+    static qint64 getTimestamp();
+    static void addEvent(const char* name, const char* category, qint64 startNsecs, qint64 durationNsecs,
+                         qint64 allocations = -1, qint64 allocatedBytes = -1);
+    static QJsonObject toJson();
+
+private:
+    static int getThreadId();
+};
+
+/**********************************************
+ *    class TraceSpan                         *
+ *********************************************/
+
+class TraceSpan
+{
+private:
+    const char* m_Name;
+    const char* m_Category;
+    qint64 m_StartNsecs = -1;
+    AllocationTracker::Counters* m_pCounters = nullptr;
+    qint64 m_StartAllocations = 0;
+    qint64 m_StartAllocatedBytes = 0;
+
+public:
+    inline TraceSpan(const char* name, const char* category) :
+        m_Name(name),
+        m_Category(category)
+    {
+        if (Tracer::isEnabled()) begin();
+    }
+
+    inline ~TraceSpan()
+    {
+        if (m_StartNsecs >= 0) end();
+    }
+
+private:
+    void begin();
+    void end();
+
+private:
+    Q_DISABLE_COPY(TraceSpan)
+};
+
+// Records the rest of the enclosing scope as a span of the Tracer.
+// Define IDTOOL_NO_TRACE to compile all spans out.
+#ifdef IDTOOL_NO_TRACE
+#define TRACE_SPAN(name, category) do { } while (0)
+#else
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SPAN(name, category) TraceSpan TRACE_CONCAT(traceSpan, __LINE__)(name, category)
+#endif
+
+#endif // TRACER_H
@@ -26,6 +26,7 @@
 
 #include "uibuilder.h"
 #include "identityclipboard.h"
+#include "tracer.h"
 
 /*!
  *
@@ -38,7 +39,14 @@
  * all the necessary UI controls and stylesheets "on the fly" and
  * inserting them into the \c MainWindow GUI.
  *
- * \sa MainWindow, IdentityModel
+ * After the initial build, \c UiBuilder observes the model and only
+ * patches the widgets affected by a change (an inserted, removed or
+ * moved block or item, or a changed value) instead of rebuilding the
+ * whole representation. Widgets of removed blocks and items are kept
+ * in a small pool and reused for subsequent insertions, and icons and
+ * stylesheets are shared between all widgets.
+ *
+ * \sa MainWindow, IdentityModel, IdentityModelObserver
  *
 */
 
@@ -48,6 +56,8 @@
  * \c QScrollArea widget, which acts as the "canvas" onto which the identity
  * representation is being drawn, and the \a identityModel representing
  * the identity structure to be visualized.
+ *
+ * The \c UiBuilder registers itself as an observer of \a identityModel.
  */
 
 UiBuilder::UiBuilder(QScrollArea* contentRoot, IdentityModel* identityModel)
@@ -56,13 +66,34 @@ UiBuilder::UiBuilder(QScrollArea* contentRoot, IdentityModel* identityModel)
     m_pContentRoot->setStyleSheet("QScrollArea{border: 0px;}");
     m_pContentRoot->setWidgetResizable(true);
     m_pModel = identityModel;
+    if (m_pModel) m_pModel->addObserver(this);
+}
+
+/*!
+ * Unregisters the \c UiBuilder from the identity model and releases
+ * the widget bookkeeping structures. The widgets themselves are owned
+ * by the content root.
+ */
+
+UiBuilder::~UiBuilder()
+{
+    if (m_pModel) m_pModel->removeObserver(this);
+
+    for (BlockWidgets* pBlockWidgets : m_BlockWidgets + m_BlockPool)
+    {
+        qDeleteAll(pBlockWidgets->items);
+        delete pBlockWidgets;
+    }
+
+    qDeleteAll(m_ItemPool);
 }
 
 /*!
  * Rebuilds the visual representation of the stored identity model.
  *
- * \note This method is usually called if changes to the underlying
- * identity model should be reflected in the UI representation.
+ * \note This method is usually called if the underlying identity model
+ * was changed without notifying its observers. Changes made through the
+ * model's mutation methods are patched into the UI automatically.
  *
  * \throws A \c std::runtime_error is thrown if either the
  * parent widget onto which the identity should be drawn or the
@@ -71,6 +102,9 @@ UiBuilder::UiBuilder(QScrollArea* contentRoot, IdentityModel* identityModel)
 
 void UiBuilder::rebuild()
 {
+    TRACE_SPAN("UiBuilder::rebuild", "ui");
+    ALLOC_SCOPE("UiBuilder::rebuild");
+
     if (!m_pContentRoot || !m_pModel)
     {
         throw std::runtime_error(tr("Invalid container or model pointers!")
@@ -78,35 +112,64 @@ void UiBuilder::rebuild()
     }
 
     clearLayout();
-
-    QWidget* pWidget = new QWidget();
-    QVBoxLayout *pLayout = new QVBoxLayout();
-    pLayout->setSpacing(10);
+    ensureContainer();
 
     for (int i=0; i<m_pModel->blocks.size(); i++)
     {
-        QWidget* pBlock = createBlock(&m_pModel->blocks[i]);
-        pLayout->addWidget(pBlock);
+        BlockWidgets* pBlockWidgets = acquireBlockWidgets();
+        bindBlock(pBlockWidgets, &m_pModel->blocks[i]);
+        m_pLastLayout->insertWidget(i, pBlockWidgets->pFrame);
+        pBlockWidgets->pFrame->show();
+        m_BlockWidgets.append(pBlockWidgets);
     }
+}
 
-    pLayout->addStretch();
+/*!
+ * Removes all block widgets representing the identity from the UI.
+ * The removed widgets are kept for reuse by subsequent builds.
+ */
 
-    pWidget->setLayout(pLayout);
-    m_pContentRoot->setWidget(pWidget);
+void UiBuilder::clearLayout()
+{
+    while (!m_BlockWidgets.isEmpty())
+        recycleBlockWidgets(m_BlockWidgets.takeLast());
+}
 
-    m_pLastWidget = pWidget;
-    m_pLastLayout = pLayout;
+/*!
+ * Returns \c true if the widgets representing the identity currently
+ * exist, or \c false if they were never built or have been released.
+ *
+ * Model changes are only patched into the UI while it is built.
+ */
 
-    m_bNeedsRebuild = false;
+bool UiBuilder::isBuilt()
+{
+    return m_pLastWidget && m_pContentRoot->widget() == m_pLastWidget;
 }
 
 /*!
- * Deletes the layout representing the identity from the UI.
+ * Deletes all widgets representing the identity, including the pooled
+ * ones, to free their memory. The UI stays empty until \c rebuild()
+ * is called again.
  */
 
-void UiBuilder::clearLayout()
+void UiBuilder::release()
 {
-    if (m_pLastLayout) m_pLastLayout->deleteLater();
+    for (BlockWidgets* pBlockWidgets : m_BlockWidgets + m_BlockPool)
+    {
+        qDeleteAll(pBlockWidgets->items);
+        delete pBlockWidgets;
+    }
+
+    m_BlockWidgets.clear();
+    m_BlockPool.clear();
+    qDeleteAll(m_ItemPool);
+    m_ItemPool.clear();
+
+    if (isBuilt()) delete m_pContentRoot->takeWidget();
+
+    m_pLastWidget = nullptr;
+    m_pLastLayout = nullptr;
 }
 
 /*!
@@ -146,7 +209,7 @@ IdentityModel *UiBuilder::getModel()
 void UiBuilder::setEnableUnauthenticatedChanges(bool enable, bool rebuild)
 {
     m_bEnableUnauthenticatedChanges = enable;
-    if (rebuild) this->rebuild();
+    if (rebuild && isBuilt()) this->rebuild();
 }
 
 /*!
@@ -194,91 +257,180 @@ bool UiBuilder::showGetBlockTypeDialog(QString *result, bool allowEdit)
 }
 
 /*!
- * Creates a visual representation of the \c IdentityBlock \a block and returns
- * it as a pointer to a \c QWidget object.
+ * Returns the icon stored in the resource file \a fileName. Icons are
+ * loaded only once and shared between all widgets.
  */
 
-QWidget* UiBuilder::createBlock(IdentityBlock *block)
+QIcon UiBuilder::getCachedIcon(QString fileName)
 {
-    QString objectName = "obj_" + QUuid::createUuid().toByteArray().toHex();
+    static QHash<QString, QIcon> cache;
 
-    QFrame* pFrame = new QFrame();
-    pFrame->setObjectName(objectName);
-    pFrame->setFrameStyle(QFrame::Box | QFrame::Raised);
-    QString styleSheet = QString("QFrame#") + objectName +
-            " { background: " +
-            block->color +
-            "; border-radius: 6px; }";
-    pFrame->setStyleSheet(styleSheet);
-    QGridLayout* pFrameLayout = new QGridLayout();
-    pFrameLayout->setSpacing(1);
+    auto iter = cache.find(fileName);
+    if (iter == cache.end()) iter = cache.insert(fileName, QIcon(fileName));
 
-    QWidget* pBlockHeader = createBlockHeader(block);
-    pFrameLayout->addWidget(pBlockHeader);
+    return iter.value();
+}
 
-    // Add items
-    for (int i=0; i<block->items.size(); i++)
+/*!
+ * Returns the stylesheet for a block frame with a background
+ * color of \a color. Stylesheets are built only once per color
+ * and shared between all block frames.
+ */
+
+QString UiBuilder::getBlockStyleSheet(QString color)
+{
+    static QHash<QString, QString> cache;
+
+    auto iter = cache.find(color);
+    if (iter == cache.end())
     {
-        QWidget* pItemWidget = createBlockItem(&block->items[i], block);
-        pFrameLayout->addWidget(pItemWidget);
+        iter = cache.insert(color, QString("QFrame#wBlockFrame { background: ") +
+                            color + "; border-radius: 6px; }");
     }
 
-    pFrame->setLayout(pFrameLayout);
-
-    return pFrame;
+    return iter.value();
 }
 
 /*!
- * Creates a visual block header using the information provided
- * within \a block, displaying the block type and description as
- * well as user controls for block manipulation, and returns it
- * as a pointer to a \c QWidget object.
+ * Creates the scroll area's content widget and layout if they
+ * do not exist yet.
  */
 
-QWidget* UiBuilder::createBlockHeader(IdentityBlock *block)
+void UiBuilder::ensureContainer()
 {
+    if (isBuilt()) return;
+
+    // Any pooled widgets belonged to the previous container
+    for (BlockWidgets* pBlockWidgets : m_BlockPool)
+    {
+        qDeleteAll(pBlockWidgets->items);
+        delete pBlockWidgets;
+    }
+    m_BlockPool.clear();
+    qDeleteAll(m_ItemPool);
+    m_ItemPool.clear();
+
     QWidget* pWidget = new QWidget();
-    QHBoxLayout* pLayout = new QHBoxLayout();
+    QVBoxLayout *pLayout = new QVBoxLayout();
+    pLayout->setSpacing(10);
+    pLayout->addStretch();
 
-    pLayout->setContentsMargins(5,10,5,30);
+    pWidget->setLayout(pLayout);
+    m_pContentRoot->setWidget(pWidget);
 
-    QLabel* pBlockDescLabel = new QLabel(block->description);
-    QFont font = pBlockDescLabel->font();
-    font.setPointSize(14);
-    pBlockDescLabel->setFont(font);
-    pBlockDescLabel->setWordWrap(true);
-    pLayout->addWidget(pBlockDescLabel);
+    m_pLastWidget = pWidget;
+    m_pLastLayout = pLayout;
+}
+
+/*!
+ * Returns a block widget set taken from the pool, or a newly
+ * created one if the pool is empty.
+ */
 
-    if (m_bEnableUnauthenticatedChanges)
+BlockWidgets* UiBuilder::acquireBlockWidgets()
+{
+    if (!m_BlockPool.isEmpty()) return m_BlockPool.takeLast();
+    return createBlock();
+}
+
+/*!
+ * Returns an item widget set taken from the pool, or a newly
+ * created one if the pool is empty.
+ */
+
+ItemWidgets* UiBuilder::acquireItemWidgets()
+{
+    if (!m_ItemPool.isEmpty()) return m_ItemPool.takeLast();
+    return createBlockItem();
+}
+
+/*!
+ * Removes the block frame of \a blockWidgets from the UI and puts it
+ * into the pool, or deletes it if the pool is full.
+ */
+
+void UiBuilder::recycleBlockWidgets(BlockWidgets* blockWidgets)
+{
+    if (m_pLastLayout) m_pLastLayout->removeWidget(blockWidgets->pFrame);
+    blockWidgets->pFrame->hide();
+
+    if (m_BlockPool.size() < MAX_POOLED_BLOCKS)
     {
-        QPushButton* pBlockOptionsButton = new QPushButton();
-        pBlockOptionsButton->setToolTip(tr("Block options"));
-        pBlockOptionsButton->setMaximumWidth(30);
-        pBlockOptionsButton->setMinimumWidth(30);
-        pBlockOptionsButton->setIcon(QIcon(":/res/img/OptionsDropdown_16x.png"));
-        QVariant blockConnectorContainer = QVariant::fromValue(BlockConnector(block));
-        pBlockOptionsButton->setProperty("0", blockConnectorContainer );
-        connect(pBlockOptionsButton, SIGNAL(clicked()), this, SLOT(onBlockOptionsButtonClicked()));
-        pLayout->addWidget(pBlockOptionsButton);
+        m_BlockPool.append(blockWidgets);
+        return;
     }
 
-    pWidget->setLayout(pLayout);
+    blockWidgets->pFrame->deleteLater();
+    qDeleteAll(blockWidgets->items);
+    delete blockWidgets;
+}
 
-    return pWidget;
+/*!
+ * Removes the item row of \a itemWidgets from its block frame and
+ * puts it into the pool, or deletes it if the pool is full.
+ */
+
+void UiBuilder::recycleItemWidgets(ItemWidgets* itemWidgets)
+{
+    QWidget* pParent = itemWidgets->pWidget->parentWidget();
+    if (pParent && pParent->layout())
+        pParent->layout()->removeWidget(itemWidgets->pWidget);
+
+    if (m_ItemPool.size() < MAX_POOLED_ITEMS)
+    {
+        // Detach from the frame so the row survives if the frame gets deleted
+        itemWidgets->pWidget->setParent(m_pLastWidget);
+        itemWidgets->pWidget->hide();
+        m_ItemPool.append(itemWidgets);
+        return;
+    }
+
+    itemWidgets->pWidget->deleteLater();
+    delete itemWidgets;
 }
 
 /*!
- * Creates a visual representation of \a item, displaying the item name,
- * description and value as well as user controls for item manipulation,
- * and returns it as a pointer to a \c QWidget object.
- *
- * Within \a block, the item's parent \c IdentityBlock must be provided.
+ * Updates the block frame \a blockWidgets to represent \a block,
+ * adding, removing and updating item rows as needed.
  */
 
-QWidget* UiBuilder::createBlockItem(IdentityBlockItem* item, IdentityBlock* block)
+void UiBuilder::bindBlock(BlockWidgets* blockWidgets, IdentityBlock* block)
+{
+    if (blockWidgets->color != block->color)
+    {
+        blockWidgets->pFrame->setStyleSheet(getBlockStyleSheet(block->color));
+        blockWidgets->color = block->color;
+    }
+
+    blockWidgets->pDescLabel->setText(block->description);
+    blockWidgets->pOptionsButton->setVisible(m_bEnableUnauthenticatedChanges);
+    blockWidgets->pOptionsButton->setProperty(
+                "0", QVariant::fromValue(BlockConnector(block)));
+
+    while (blockWidgets->items.size() > block->items.size())
+        recycleItemWidgets(blockWidgets->items.takeLast());
+
+    while (blockWidgets->items.size() < block->items.size())
+    {
+        ItemWidgets* pItemWidgets = acquireItemWidgets();
+        blockWidgets->pLayout->addWidget(pItemWidgets->pWidget);
+        pItemWidgets->pWidget->show();
+        blockWidgets->items.append(pItemWidgets);
+    }
+
+    for (int i=0; i<block->items.size(); i++)
+    {
+        bindItem(blockWidgets->items[i], &block->items[i], block);
+    }
+}
+
+/*!
+ * Updates the item row \a itemWidgets to represent \a item, which
+ * is part of the \c IdentityBlock \a block.
+ */
+
+void UiBuilder::bindItem(ItemWidgets* itemWidgets, IdentityBlockItem* item, IdentityBlock* block)
 {
-    QWidget* pWidget = new QWidget();
-    QHBoxLayout* pLayout = new QHBoxLayout();
     QString value = item->value;
 
     if (value.length() > 50)
@@ -286,69 +438,333 @@ QWidget* UiBuilder::createBlockItem(IdentityBlockItem* item, IdentityBlock* bloc
         value = value.left(18) + "..." + value.right(18);
     }
 
+    itemWidgets->pDescImageLabel->setToolTip(item->description);
+    itemWidgets->pNameLabel->setText(item->name);
+    itemWidgets->pValueLineEdit->setText(value);
+    itemWidgets->pValueLineEdit->setToolTip(item->value);
+    if (item->value.length() > 0) itemWidgets->pValueLineEdit->setCursorPosition(0);
+
+    QVariant itemConnectorContainer = QVariant::fromValue(
+                ItemConnector(block, item, itemWidgets->pValueLineEdit));
+    itemWidgets->pCopyButton->setProperty("0", itemConnectorContainer);
+    itemWidgets->pEditButton->setProperty("0", itemConnectorContainer);
+    itemWidgets->pOptionsButton->setProperty("0", itemConnectorContainer);
+
+    itemWidgets->pNameLabel->setMinimumWidth(m_bEnableUnauthenticatedChanges ? 30 : 150);
+    itemWidgets->pEditButton->setVisible(m_bEnableUnauthenticatedChanges);
+    itemWidgets->pOptionsButton->setVisible(m_bEnableUnauthenticatedChanges);
+}
+
+/*!
+ * Creates an empty visual representation of an \c IdentityBlock,
+ * consisting of a frame, a block header displaying the block
+ * description and user controls for block manipulation.
+ *
+ * The returned widgets need to be bound to a block using
+ * \c bindBlock() before being displayed.
+ */
+
+BlockWidgets* UiBuilder::createBlock()
+{
+    BlockWidgets* pBlockWidgets = new BlockWidgets();
+
+    QFrame* pFrame = new QFrame(m_pLastWidget);
+    pFrame->setObjectName("wBlockFrame");
+    pFrame->setFrameStyle(QFrame::Box | QFrame::Raised);
+    QVBoxLayout* pFrameLayout = new QVBoxLayout();
+    pFrameLayout->setSpacing(1);
+
+    QWidget* pHeader = new QWidget();
+    QHBoxLayout* pHeaderLayout = new QHBoxLayout();
+    pHeaderLayout->setContentsMargins(5,10,5,30);
+
+    QLabel* pBlockDescLabel = new QLabel();
+    QFont font = pBlockDescLabel->font();
+    font.setPointSize(14);
+    pBlockDescLabel->setFont(font);
+    pBlockDescLabel->setWordWrap(true);
+    pHeaderLayout->addWidget(pBlockDescLabel);
+
+    QPushButton* pBlockOptionsButton = new QPushButton();
+    pBlockOptionsButton->setToolTip(tr("Block options"));
+    pBlockOptionsButton->setMaximumWidth(30);
+    pBlockOptionsButton->setMinimumWidth(30);
+    pBlockOptionsButton->setIcon(getCachedIcon(":/res/img/OptionsDropdown_16x.png"));
+    connect(pBlockOptionsButton, SIGNAL(clicked()), this, SLOT(onBlockOptionsButtonClicked()));
+    pHeaderLayout->addWidget(pBlockOptionsButton);
+
+    pHeader->setLayout(pHeaderLayout);
+    pFrameLayout->addWidget(pHeader);
+    pFrame->setLayout(pFrameLayout);
+
+    pBlockWidgets->pFrame = pFrame;
+    pBlockWidgets->pLayout = pFrameLayout;
+    pBlockWidgets->pDescLabel = pBlockDescLabel;
+    pBlockWidgets->pOptionsButton = pBlockOptionsButton;
+
+    return pBlockWidgets;
+}
+
+/*!
+ * Creates an empty visual representation of an \c IdentityBlockItem,
+ * consisting of labels for the item name, description and value as
+ * well as user controls for item manipulation.
+ *
+ * The returned widgets need to be bound to an item using
+ * \c bindItem() before being displayed.
+ */
+
+ItemWidgets* UiBuilder::createBlockItem()
+{
+    static const QString valueStyleSheet =
+            "QLineEdit#wDataLabel { background: rgb(237, 237, 237); border-radius: 6px; }";
+
+    ItemWidgets* pItemWidgets = new ItemWidgets();
+
+    QWidget* pWidget = new QWidget();
+    QHBoxLayout* pLayout = new QHBoxLayout();
     pLayout->setContentsMargins(0,0,0,0);
 
     QLabel* pDescImageLabel = new QLabel();
-    pDescImageLabel->setToolTip(item->description);
     pDescImageLabel->setMaximumWidth(30);
     pDescImageLabel->setMinimumWidth(30);
-    QPixmap mypix (":/res/img/InfoRule_16x.png");
-    pDescImageLabel->setPixmap(mypix);
+    pDescImageLabel->setPixmap(getCachedIcon(":/res/img/InfoRule_16x.png").pixmap(16, 16));
     pLayout->addWidget(pDescImageLabel);
 
-    QLabel* pNameLable = new QLabel(item->name);
+    QLabel* pNameLable = new QLabel();
     pNameLable->setWordWrap(true);
     pNameLable->setMaximumWidth(150);
     pNameLable->setMinimumWidth(150);
     pLayout->addWidget(pNameLable);
 
-    QLineEdit* pValueLineEdit = new QLineEdit(value);
-    pValueLineEdit->setToolTip(item->value);
+    QLineEdit* pValueLineEdit = new QLineEdit();
     pValueLineEdit->setToolTipDuration(-1);
     pValueLineEdit->setObjectName("wDataLabel");
-    pValueLineEdit->setStyleSheet("QLineEdit#wDataLabel { background: rgb(237, 237, 237); border-radius: 6px; }");
+    pValueLineEdit->setStyleSheet(valueStyleSheet);
     pValueLineEdit->setSizePolicy(QSizePolicy::Preferred, QSizePolicy::Preferred);
     pValueLineEdit->setTextMargins(5, 0, 5, 0);
     pValueLineEdit->setReadOnly(true);
-    if (item->value.length() > 0) pValueLineEdit->setCursorPosition(0);
     pLayout->addWidget(pValueLineEdit);
 
-    ItemConnector ic(block, item, pValueLineEdit);
-    QVariant itemConnectorContainer = QVariant::fromValue(ic);
-
     QPushButton* pCopyButton = new QPushButton();
     pCopyButton->setToolTip(tr("Copy to clipboard"));
     pCopyButton->setMaximumWidth(30);
     pCopyButton->setMinimumWidth(30);
-    pCopyButton->setIcon(QIcon(":/res/img/CopyToClipboard_16x.png"));
-    pCopyButton->setProperty("0", itemConnectorContainer);
+    pCopyButton->setIcon(getCachedIcon(":/res/img/CopyToClipboard_16x.png"));
     connect(pCopyButton, SIGNAL(clicked()), this, SLOT(onCopyButtonClicked()));
     pLayout->addWidget(pCopyButton);
 
-    if (m_bEnableUnauthenticatedChanges)
+    QPushButton* pEditButton = new QPushButton();
+    pEditButton->setToolTip(tr("Edit value"));
+    pEditButton->setMaximumWidth(30);
+    pEditButton->setIcon(getCachedIcon(":/res/img/Edit_16x.png"));
+    connect(pEditButton, SIGNAL(clicked()), this, SLOT(onEditButtonClicked()));
+    pLayout->addWidget(pEditButton);
+
+    QPushButton* pOptionsButton = new QPushButton();
+    pOptionsButton->setToolTip(tr("Item options"));
+    pOptionsButton->setMaximumWidth(30);
+    pOptionsButton->setMinimumWidth(30);
+    pOptionsButton->setIcon(getCachedIcon(":/res/img/OptionsDropdown_16x.png"));
+    connect(pOptionsButton, SIGNAL(clicked()), this, SLOT(onItemOptionsButtonClicked()));
+    pLayout->addWidget(pOptionsButton);
+
+    pWidget->setLayout(pLayout);
+
+    pItemWidgets->pWidget = pWidget;
+    pItemWidgets->pDescImageLabel = pDescImageLabel;
+    pItemWidgets->pNameLabel = pNameLable;
+    pItemWidgets->pValueLineEdit = pValueLineEdit;
+    pItemWidgets->pCopyButton = pCopyButton;
+    pItemWidgets->pEditButton = pEditButton;
+    pItemWidgets->pOptionsButton = pOptionsButton;
+
+    return pItemWidgets;
+}
+
+/*!
+ * Returns \c true if \a blockIndex (and \a itemIndex, if it is not
+ * negative) refer to existing widgets, or \c false if the UI is out
+ * of sync with the model and needs a full rebuild.
+ */
+
+bool UiBuilder::isIndexValid(int blockIndex, int itemIndex)
+{
+    if (blockIndex < 0 || blockIndex >= m_BlockWidgets.size()) return false;
+    if (itemIndex < 0) return true;
+    return itemIndex < m_BlockWidgets[blockIndex]->items.size();
+}
+
+/*!
+ * Creates and displays the widgets for the block inserted into the
+ * model at \a blockIndex.
+ */
+
+void UiBuilder::blockInserted(int blockIndex)
+{
+    if (!isBuilt()) return;
+
+    if (m_BlockWidgets.size() != m_pModel->blocks.size() - 1)
     {
-        QPushButton* pEditButton = new QPushButton();
-        pEditButton->setToolTip(tr("Edit value"));
-        pEditButton->setMaximumWidth(30);
-        pNameLable->setMinimumWidth(30);
-        pEditButton->setIcon(QIcon(":/res/img/Edit_16x.png"));
-        pEditButton->setProperty("0", itemConnectorContainer);
-        connect(pEditButton, SIGNAL(clicked()), this, SLOT(onEditButtonClicked()));
-        pLayout->addWidget(pEditButton);
-
-        QPushButton* pOptionsButton = new QPushButton();
-        pOptionsButton->setToolTip(tr("Item options"));
-        pOptionsButton->setMaximumWidth(30);
-        pOptionsButton->setMinimumWidth(30);
-        pOptionsButton->setIcon(QIcon(":/res/img/OptionsDropdown_16x.png"));
-        pOptionsButton->setProperty("0", itemConnectorContainer);
-        connect(pOptionsButton, SIGNAL(clicked()), this, SLOT(onItemOptionsButtonClicked()));
-        pLayout->addWidget(pOptionsButton);
+        rebuild();
+        return;
     }
 
-    pWidget->setLayout(pLayout);
+    BlockWidgets* pBlockWidgets = acquireBlockWidgets();
+    bindBlock(pBlockWidgets, &m_pModel->blocks[blockIndex]);
+    m_pLastLayout->insertWidget(blockIndex, pBlockWidgets->pFrame);
+    pBlockWidgets->pFrame->show();
+    m_BlockWidgets.insert(blockIndex, pBlockWidgets);
+}
+
+/*!
+ * Removes the widgets of the block formerly located at \a blockIndex.
+ */
+
+void UiBuilder::blockRemoved(int blockIndex)
+{
+    if (!isBuilt()) return;
+
+    if (!isIndexValid(blockIndex))
+    {
+        rebuild();
+        return;
+    }
+
+    recycleBlockWidgets(m_BlockWidgets.takeAt(blockIndex));
+}
+
+/*!
+ * Moves the widgets of the block at \a fromIndex to \a toIndex.
+ */
+
+void UiBuilder::blockMoved(int fromIndex, int toIndex)
+{
+    if (!isBuilt()) return;
+
+    if (!isIndexValid(fromIndex) || !isIndexValid(toIndex))
+    {
+        rebuild();
+        return;
+    }
 
-    return pWidget;
+    BlockWidgets* pBlockWidgets = m_BlockWidgets.takeAt(fromIndex);
+    m_BlockWidgets.insert(toIndex, pBlockWidgets);
+    m_pLastLayout->removeWidget(pBlockWidgets->pFrame);
+    m_pLastLayout->insertWidget(toIndex, pBlockWidgets->pFrame);
+}
+
+/*!
+ * Updates the widgets of the block at \a blockIndex.
+ */
+
+void UiBuilder::blockChanged(int blockIndex)
+{
+    if (!isBuilt()) return;
+
+    if (!isIndexValid(blockIndex))
+    {
+        rebuild();
+        return;
+    }
+
+    bindBlock(m_BlockWidgets[blockIndex], &m_pModel->blocks[blockIndex]);
+}
+
+/*!
+ * Creates and displays the row for the item inserted at \a itemIndex
+ * into the block at \a blockIndex.
+ */
+
+void UiBuilder::itemInserted(int blockIndex, int itemIndex)
+{
+    if (!isBuilt()) return;
+
+    if (!isIndexValid(blockIndex))
+    {
+        rebuild();
+        return;
+    }
+
+    BlockWidgets* pBlockWidgets = m_BlockWidgets[blockIndex];
+    IdentityBlock* pBlock = &m_pModel->blocks[blockIndex];
+    ItemWidgets* pItemWidgets = acquireItemWidgets();
+
+    bindItem(pItemWidgets, &pBlock->items[itemIndex], pBlock);
+    // Index 0 of the frame layout is the block header
+    pBlockWidgets->pLayout->insertWidget(itemIndex + 1, pItemWidgets->pWidget);
+    pItemWidgets->pWidget->show();
+    pBlockWidgets->items.insert(itemIndex, pItemWidgets);
+}
+
+/*!
+ * Removes the row of the item formerly located at \a itemIndex within
+ * the block at \a blockIndex.
+ */
+
+void UiBuilder::itemRemoved(int blockIndex, int itemIndex)
+{
+    if (!isBuilt()) return;
+
+    if (!isIndexValid(blockIndex, itemIndex))
+    {
+        rebuild();
+        return;
+    }
+
+    recycleItemWidgets(m_BlockWidgets[blockIndex]->items.takeAt(itemIndex));
+}
+
+/*!
+ * Moves the row of the item at \a fromIndex to \a toIndex within
+ * the block at \a blockIndex.
+ */
+
+void UiBuilder::itemMoved(int blockIndex, int fromIndex, int toIndex)
+{
+    if (!isBuilt()) return;
+
+    if (!isIndexValid(blockIndex, fromIndex) ||
+            !isIndexValid(blockIndex, toIndex))
+    {
+        rebuild();
+        return;
+    }
+
+    BlockWidgets* pBlockWidgets = m_BlockWidgets[blockIndex];
+    ItemWidgets* pItemWidgets = pBlockWidgets->items.takeAt(fromIndex);
+    pBlockWidgets->items.insert(toIndex, pItemWidgets);
+    pBlockWidgets->pLayout->removeWidget(pItemWidgets->pWidget);
+    pBlockWidgets->pLayout->insertWidget(toIndex + 1, pItemWidgets->pWidget);
+}
+
+/*!
+ * Updates the row of the item at \a itemIndex within the block
+ * at \a blockIndex.
+ */
+
+void UiBuilder::itemChanged(int blockIndex, int itemIndex)
+{
+    if (!isBuilt()) return;
+
+    if (!isIndexValid(blockIndex, itemIndex))
+    {
+        rebuild();
+        return;
+    }
+
+    IdentityBlock* pBlock = &m_pModel->blocks[blockIndex];
+    bindItem(m_BlockWidgets[blockIndex]->items[itemIndex],
+             &pBlock->items[itemIndex], pBlock);
+}
+
+/*!
+ * Rebuilds the whole representation after a model reset.
+ */
+
+void UiBuilder::modelReset()
+{
+    if (isBuilt()) rebuild();
 }
 
 /*!
@@ -379,68 +795,69 @@ bool UiBuilder::showGetRepeatCountDialog(QString itemName, int* result)
 }
 
 
-/***************************************************
- *                S L O T S                        *
- * ************************************************/
-
+/*!
+ * Displays a dialog for editing the value of \a item, which is part
+ * of \a block, and applies the new value to the identity model.
+ *
+ * \return Returns \c true if the value was changed, or \c false if
+ * the dialog was cancelled.
+ */
 
-void UiBuilder::onEditButtonClicked()
+bool UiBuilder::editItemValue(IdentityBlock* block, IdentityBlockItem* item)
 {
-    ItemConnector connector =
-            sender()->property("0").value<ItemConnector>();
-
-    bool ok = false;    
+    bool ok = false;
     QString result = QInputDialog::getMultiLineText(
                 nullptr,
                 tr("Edit value"),
-                tr("New value for \"%1\":").arg(connector.item->name),
-                connector.item->value, &ok);
+                tr("New value for \"%1\":").arg(item->name),
+                item->value, &ok);
 
-    if (ok)
+    if (ok && m_pModel->setItemValue(block, item, result))
     {
-        connector.item->value = result;
-        connector.valueLabel->setText(result);
-
         identityChanged();
+        return true;
     }
+
+    return false;
 }
 
-void UiBuilder::onCopyButtonClicked()
-{
-    ItemConnector connector =
-            sender()->property("0").value<ItemConnector>();
+/*!
+ * Copies the value of \a item to the system clipboard and shows a
+ * confirmation tooltip at \a globalPos for the widget \a anchor.
+ */
 
-        QClipboard* pClipboard = QApplication::clipboard();
-        pClipboard->setText(connector.item->value);
+void UiBuilder::copyItemValue(IdentityBlockItem* item, QWidget* anchor, QPoint globalPos)
+{
+    QClipboard* pClipboard = QApplication::clipboard();
+    pClipboard->setText(item->value);
 
-        QToolTip::showText(
-                    static_cast<QWidget*>(sender())->mapToGlobal(QPoint(0,0)),
-                    tr("Value copied to clipboard!"),
-                    static_cast<QWidget*>(sender()));
+    QToolTip::showText(globalPos, tr("Value copied to clipboard!"), anchor);
 }
 
-void UiBuilder::onBlockOptionsButtonClicked()
-{
-    BlockConnector connector =
-            sender()->property("0").value<BlockConnector>();
+/*!
+ * Shows the options menu (move, copy, paste, add, delete) for \a block
+ * at \a globalPos, using \a parent as the menu's parent widget.
+ */
 
+void UiBuilder::showBlockOptionsMenu(IdentityBlock* block, QWidget* parent, QPoint globalPos)
+{
     QAction* pActionMoveBlockUp = new QAction(QIcon(":/res/img/DoubleUp_24x.png"), tr("Move up"));
-    QVariant upBlockConnectorContainer = QVariant::fromValue(BlockConnector(connector.block, true));
+    QVariant upBlockConnectorContainer = QVariant::fromValue(BlockConnector(block, true));
     pActionMoveBlockUp->setProperty("0", upBlockConnectorContainer);
 
     QAction* pActionMoveBlockDown = new QAction(QIcon(":/res/img/DoubleDown_24x.png"), tr("Move down"));
-    QVariant downBlockConnectorContainer = QVariant::fromValue(BlockConnector(connector.block, false));
+    QVariant downBlockConnectorContainer = QVariant::fromValue(BlockConnector(block, false));
     pActionMoveBlockDown->setProperty("0", downBlockConnectorContainer);
 
     QAction* pActionSeparator = new QAction();
     pActionSeparator->setSeparator(true);
 
     QAction* pActionCopyBlock = new QAction(QIcon(":/res/img/CopyItem_16x.png"), tr("Copy block"));
-    QVariant copyBlockConnectorContainer = QVariant::fromValue(BlockConnector(connector.block));
+    QVariant copyBlockConnectorContainer = QVariant::fromValue(BlockConnector(block));
     pActionCopyBlock->setProperty("0", copyBlockConnectorContainer);
 
     QAction* pActionPasteBlock = new QAction(QIcon(":/res/img/Paste_16x.png"), tr("Paste block"));
-    QVariant pasteBlockConnectorContainer = QVariant::fromValue(BlockConnector(connector.block));
+    QVariant pasteBlockConnectorContainer = QVariant::fromValue(BlockConnector(block));
     pActionPasteBlock->setProperty("0", pasteBlockConnectorContainer);
     pActionPasteBlock->setEnabled(IdentityClipboard::getInstance()->hasBlock());
 
@@ -448,14 +865,14 @@ void UiBuilder::onBlockOptionsButtonClicked()
     pActionSeparator2->setSeparator(true);
 
     QAction* pActionAddBlock = new QAction(QIcon(":/res/img/Add_16x.png"), tr("Add block"));
-    QVariant addBlockConnectorContainer = QVariant::fromValue(BlockConnector(connector.block));
+    QVariant addBlockConnectorContainer = QVariant::fromValue(BlockConnector(block));
     pActionAddBlock->setProperty("0", addBlockConnectorContainer);
 
     QAction* pActionDeleteBlock = new QAction(QIcon(":/res/img/DeleteBlock_16x.png"), tr("Delete block"));
-    QVariant deleteBlockConnectorContainer = QVariant::fromValue(BlockConnector(connector.block));
+    QVariant deleteBlockConnectorContainer = QVariant::fromValue(BlockConnector(block));
     pActionDeleteBlock->setProperty("0", deleteBlockConnectorContainer);
 
-    QMenu* menu = new QMenu(static_cast<QWidget*>(sender()));
+    QMenu* menu = new QMenu(parent);
     menu->addAction(pActionMoveBlockUp);
     menu->addAction(pActionMoveBlockDown);
     menu->addAction(pActionSeparator);
@@ -472,10 +889,90 @@ void UiBuilder::onBlockOptionsButtonClicked()
     connect(pActionCopyBlock, &QAction::triggered, this, &UiBuilder::onCopyBlock);
     connect(pActionPasteBlock, &QAction::triggered, this, &UiBuilder::onPasteBlock);
 
-    menu->exec(static_cast<QWidget*>(sender())->mapToGlobal(
-                    QPoint(0, 0)));
+    menu->exec(globalPos);
+
+    // The parent widget is long-lived, so don't let menus pile up
+    menu->deleteLater();
+}
+
+/*!
+ * Shows the options menu (move, add, delete) for \a item within \a block
+ * at \a globalPos, using \a parent as the menu's parent widget.
+ */
+
+void UiBuilder::showItemOptionsMenu(IdentityBlock* block, IdentityBlockItem* item,
+                                    QWidget* parent, QPoint globalPos)
+{
+    QAction* pActionMoveItemUp = new QAction(QIcon(":/res/img/DoubleUp_24x.png"), tr("Move up"));
+    QVariant upItemConnectorContainer = QVariant::fromValue(
+                ItemConnector(block, item, nullptr, true));
+    pActionMoveItemUp->setProperty("0", upItemConnectorContainer);
+
+    QAction* pActionMoveItemDown = new QAction(QIcon(":/res/img/DoubleDown_24x.png"), tr("Move down"));
+    QVariant downItemConnectorContainer = QVariant::fromValue(
+               ItemConnector(block, item, nullptr, false));
+    pActionMoveItemDown->setProperty("0", downItemConnectorContainer);
+
+    QAction* pActionSeparator = new QAction();
+    pActionSeparator->setSeparator(true);
+
+    QAction* pActionAddItem = new QAction(QIcon(":/res/img/Add_16x.png"), tr("Add item"));
+    QVariant addItemConnectorContainer = QVariant::fromValue(
+                ItemConnector(block, item, nullptr));
+    pActionAddItem->setProperty("0", addItemConnectorContainer);
+
+    QAction* pActionDeleteItem = new QAction(QIcon(":/res/img/DeleteBlock_16x.png"), tr("Delete item"));
+    QVariant deleteItemConnectorContainer = QVariant::fromValue(
+                ItemConnector(block, item, nullptr));
+    pActionDeleteItem->setProperty("0", deleteItemConnectorContainer);
+
+    QMenu* menu = new QMenu(parent);
+    menu->addAction(pActionMoveItemUp);
+    menu->addAction(pActionMoveItemDown);
+    menu->addAction(pActionSeparator);
+    menu->addAction(pActionAddItem);
+    menu->addAction(pActionDeleteItem);
+
+    connect(pActionMoveItemUp, &QAction::triggered, this, &UiBuilder::onMoveItem);
+    connect(pActionMoveItemDown, &QAction::triggered, this, &UiBuilder::onMoveItem);
+    connect(pActionAddItem, &QAction::triggered, this, &UiBuilder::onInsertItem);
+    connect(pActionDeleteItem, &QAction::triggered, this, &UiBuilder::onDeleteItem);
+
+    menu->exec(globalPos);
+
+    // The parent widget is long-lived, so don't let menus pile up
+    menu->deleteLater();
+}
+
+/***************************************************
+ *                S L O T S                        *
+ * ************************************************/
+
+
+void UiBuilder::onEditButtonClicked()
+{
+    ItemConnector connector =
+            sender()->property("0").value<ItemConnector>();
+
+    editItemValue(connector.block, connector.item);
+}
+
+void UiBuilder::onCopyButtonClicked()
+{
+    ItemConnector connector =
+            sender()->property("0").value<ItemConnector>();
+    QWidget* pSender = static_cast<QWidget*>(sender());
 
-    if (m_bNeedsRebuild) rebuild();
+    copyItemValue(connector.item, pSender, pSender->mapToGlobal(QPoint(0,0)));
+}
+
+void UiBuilder::onBlockOptionsButtonClicked()
+{
+    BlockConnector connector =
+            sender()->property("0").value<BlockConnector>();
+    QWidget* pSender = static_cast<QWidget*>(sender());
+
+    showBlockOptionsMenu(connector.block, pSender, pSender->mapToGlobal(QPoint(0,0)));
 }
 
 void UiBuilder::onDeleteBlock()
@@ -485,7 +982,6 @@ void UiBuilder::onDeleteBlock()
 
     if (m_pModel->deleteBlock(connector.block))
     {
-        m_bNeedsRebuild = true;
         identityChanged();
     }
 }
@@ -497,7 +993,6 @@ void UiBuilder::onMoveBlock()
 
     if (m_pModel->moveBlock(connector.block, connector.moveUp))
     {
-        m_bNeedsRebuild = true;
         identityChanged();
     }
 }
@@ -522,7 +1017,6 @@ void UiBuilder::onPasteBlock()
 
     if (m_pModel->insertBlock(block, connector.block))
     {
-        m_bNeedsRebuild = true;
         identityChanged();
     }
 }
@@ -544,7 +1038,6 @@ void UiBuilder::onInsertBlock()
 
     if (m_pModel->insertBlock(block, connector.block))
     {
-        m_bNeedsRebuild = true;
         identityChanged();
     }
 }
@@ -553,46 +1046,10 @@ void UiBuilder::onItemOptionsButtonClicked()
 {
     ItemConnector connector =
             sender()->property("0").value<ItemConnector>();
+    QWidget* pSender = static_cast<QWidget*>(sender());
 
-    QAction* pActionMoveItemUp = new QAction(QIcon(":/res/img/DoubleUp_24x.png"), tr("Move up"));
-    QVariant upItemConnectorContainer = QVariant::fromValue(
-                ItemConnector(connector.block, connector.item, nullptr, true));
-    pActionMoveItemUp->setProperty("0", upItemConnectorContainer);
-
-    QAction* pActionMoveItemDown = new QAction(QIcon(":/res/img/DoubleDown_24x.png"), tr("Move down"));
-    QVariant downItemConnectorContainer = QVariant::fromValue(
-               ItemConnector(connector.block, connector.item, nullptr, false));
-    pActionMoveItemDown->setProperty("0", downItemConnectorContainer);
-
-    QAction* pActionSeparator = new QAction();
-    pActionSeparator->setSeparator(true);
-
-    QAction* pActionAddItem = new QAction(QIcon(":/res/img/Add_16x.png"), tr("Add item"));
-    QVariant addItemConnectorContainer = QVariant::fromValue(
-                ItemConnector(connector.block, connector.item, nullptr));
-    pActionAddItem->setProperty("0", addItemConnectorContainer);
-
-    QAction* pActionDeleteItem = new QAction(QIcon(":/res/img/DeleteBlock_16x.png"), tr("Delete item"));
-    QVariant deleteItemConnectorContainer = QVariant::fromValue(
-                ItemConnector(connector.block, connector.item, nullptr));
-    pActionDeleteItem->setProperty("0", deleteItemConnectorContainer);
-
-    QMenu* menu = new QMenu(static_cast<QWidget*>(sender()));
-    menu->addAction(pActionMoveItemUp);
-    menu->addAction(pActionMoveItemDown);
-    menu->addAction(pActionSeparator);
-    menu->addAction(pActionAddItem);
-    menu->addAction(pActionDeleteItem);
-
-    connect(pActionMoveItemUp, &QAction::triggered, this, &UiBuilder::onMoveItem);
-    connect(pActionMoveItemDown, &QAction::triggered, this, &UiBuilder::onMoveItem);
-    connect(pActionAddItem, &QAction::triggered, this, &UiBuilder::onInsertItem);
-    connect(pActionDeleteItem, &QAction::triggered, this, &UiBuilder::onDeleteItem);
-
-    menu->exec(static_cast<QWidget*>(sender())->mapToGlobal(
-                    QPoint(0, 0)));
-
-    if (m_bNeedsRebuild) rebuild();
+    showItemOptionsMenu(connector.block, connector.item, pSender,
+                        pSender->mapToGlobal(QPoint(0,0)));
 }
 
 void UiBuilder::onDeleteItem()
@@ -600,11 +1057,10 @@ void UiBuilder::onDeleteItem()
     ItemConnector connector =
             sender()->property("0").value<ItemConnector>();
 
-    bool ok = connector.block->deleteItem(connector.item);
+    bool ok = m_pModel->deleteItem(connector.block, connector.item);
 
     if (ok)
     {
-        m_bNeedsRebuild = true;
         identityChanged();
     }
 }
@@ -614,9 +1070,8 @@ void UiBuilder::onMoveItem()
     ItemConnector connector =
             sender()->property("0").value<ItemConnector>();
 
-    if (connector.block->moveItem(connector.item, connector.moveUp))
+    if (m_pModel->moveItem(connector.block, connector.item, connector.moveUp))
     {
-        m_bNeedsRebuild = true;
         identityChanged();
     }
 }
@@ -682,9 +1137,8 @@ void UiBuilder::onInsertItem()
     IdentityBlockItem item = IdentityParser::createEmptyItem(
                 sName, sDescription, dataType, nrOfBytes);
 
-    if (connector.block->insertItem(item, connector.item))
+    if (m_pModel->insertItem(connector.block, item, connector.item))
     {
-        m_bNeedsRebuild = true;
         identityChanged();
     }
 }
@@ -35,35 +35,98 @@ namespace Ui {
     class MainWindow;
 }
 
+/**********************************************
+ *    struct ItemWidgets                      *
+ *********************************************/
+
+struct ItemWidgets
+{
+    QWidget* pWidget = nullptr;
+    QLabel* pDescImageLabel = nullptr;
+    QLabel* pNameLabel = nullptr;
+    QLineEdit* pValueLineEdit = nullptr;
+    QPushButton* pCopyButton = nullptr;
+    QPushButton* pEditButton = nullptr;
+    QPushButton* pOptionsButton = nullptr;
+};
+
+/**********************************************
+ *    struct BlockWidgets                     *
+ *********************************************/
+
+struct BlockWidgets
+{
+    QFrame* pFrame = nullptr;
+    QVBoxLayout* pLayout = nullptr;
+    QLabel* pDescLabel = nullptr;
+    QPushButton* pOptionsButton = nullptr;
+    QString color;
+    QList<ItemWidgets*> items;
+};
+
 /**********************************************
  *    class UiBuilder                         *
  *********************************************/
 
-class UiBuilder : public QObject
+class UiBuilder : public QObject, public IdentityModelObserver
 {    
     Q_OBJECT
 
+public:
+    static const int MAX_POOLED_BLOCKS = 16;
+    static const int MAX_POOLED_ITEMS = 128;
+
 private:
     QScrollArea* m_pContentRoot = nullptr;
     QWidget* m_pLastWidget = nullptr;
-    QLayout* m_pLastLayout = nullptr;
+    QVBoxLayout* m_pLastLayout = nullptr;
     IdentityModel* m_pModel = nullptr;
-    bool m_bNeedsRebuild = false;
     bool m_bEnableUnauthenticatedChanges = false;
+    QList<BlockWidgets*> m_BlockWidgets;
+    QList<BlockWidgets*> m_BlockPool;
+    QList<ItemWidgets*> m_ItemPool;
 
 public:
     UiBuilder(QScrollArea* contentRoot, IdentityModel* identityModel);
+    ~UiBuilder() override;
     void rebuild();
     void clearLayout();
+    bool isBuilt();
+    void release();
     IdentityModel* getModel();
     void setEnableUnauthenticatedChanges(bool enable, bool rebuild = true);
     static bool showGetBlockTypeDialog(QString* result, bool allowEdit = false);
     static bool showGetRepeatCountDialog(QString itemName, int* result);
+    static QIcon getCachedIcon(QString fileName);
+    static QString getBlockStyleSheet(QString color);
+    bool editItemValue(IdentityBlock* block, IdentityBlockItem* item);
+    void copyItemValue(IdentityBlockItem* item, QWidget* anchor, QPoint globalPos);
+    void showBlockOptionsMenu(IdentityBlock* block, QWidget* parent, QPoint globalPos);
+    void showItemOptionsMenu(IdentityBlock* block, IdentityBlockItem* item,
+                             QWidget* parent, QPoint globalPos);
+
+    // IdentityModelObserver
+    void blockInserted(int blockIndex) override;
+    void blockRemoved(int blockIndex) override;
+    void blockMoved(int fromIndex, int toIndex) override;
+    void blockChanged(int blockIndex) override;
+    void itemInserted(int blockIndex, int itemIndex) override;
+    void itemRemoved(int blockIndex, int itemIndex) override;
+    void itemMoved(int blockIndex, int fromIndex, int toIndex) override;
+    void itemChanged(int blockIndex, int itemIndex) override;
+    void modelReset() override;
 
 private:
-    QWidget* createBlock(IdentityBlock* block);
-    QWidget* createBlockHeader(IdentityBlock *block);
-    QWidget* createBlockItem(IdentityBlockItem* item, IdentityBlock* block = nullptr);
+    void ensureContainer();
+    BlockWidgets* acquireBlockWidgets();
+    ItemWidgets* acquireItemWidgets();
+    void recycleBlockWidgets(BlockWidgets* blockWidgets);
+    void recycleItemWidgets(ItemWidgets* itemWidgets);
+    void bindBlock(BlockWidgets* blockWidgets, IdentityBlock* block);
+    void bindItem(ItemWidgets* itemWidgets, IdentityBlockItem* item, IdentityBlock* block);
+    BlockWidgets* createBlock();
+    ItemWidgets* createBlockItem();
+    bool isIndexValid(int blockIndex, int itemIndex = -1);
 
 signals:
     void identityChanged();
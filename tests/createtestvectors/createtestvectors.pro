@@ -2,9 +2,7 @@
 # Automatically generated by qmake (3.1) Mon Dec 23 18:41:41 2019
 ######################################################################
 
-QT += core gui
-
-greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
+QT = core
 
 CONFIG += console 
 
@@ -19,46 +17,17 @@ INCLUDEPATH += .
 # You can also select to disable deprecated APIs only up to a certain version of Qt.
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
-DEFINES += \
-    SODIUM_STATIC
-
 # Input
 SOURCES += \
-    ../../src/cryptutil.cpp \
-    ../../src/identitymodel.cpp \
-    ../../src/identityparser.cpp \
-    ../../inc/bigint/BigInteger.cc \
-    ../../inc/bigint/BigIntegerAlgorithms.cc \
-    ../../inc/bigint/BigIntegerUtils.cc \
-    ../../inc/bigint/BigUnsigned.cc \
-    ../../inc/bigint/BigUnsignedInABase.cc \
     ../testutils.cpp \
     createtestvectors.cpp
 
 HEADERS += \
-    ../../src/cryptutil.h \
-    ../../src/identitymodel.h \
-    ../../src/identityparser.h \
-    ../../inc/bigint/BigInteger.hh \
-    ../../inc/bigint/BigIntegerAlgorithms.hh \
-    ../../inc/bigint/BigIntegerLibrary.hh \
-    ../../inc/bigint/BigIntegerUtils.hh \
-    ../../inc/bigint/BigUnsigned.hh \
-    ../../inc/bigint/BigUnsignedInABase.hh \
-    ../../inc/bigint/NumberlikeArray.hh  \
     ../testutils.h
 	
 DISTFILES += \
     $$PWD/../../lib/sodium/lib/libsodium.lib \
     $$PWD/../../lib/sodium/lib/libsodium.so \
-    $$PWD/../../lib/sodium/lib/libsodiumd.lib 
-
-win32:CONFIG(release, debug|release): LIBS += -L$$PWD/../../lib/sodium/lib/ -llibsodium
-else:win32:CONFIG(debug, debug|release): LIBS += -L$$PWD/../../lib/sodium/lib/ -llibsodiumd
-else:unix: LIBS += -L$$PWD/../../lib/sodium/lib/ -lsodium
-
-INCLUDEPATH += $$PWD/../../lib/sodium/include
-DEPENDPATH += $$PWD/../../lib/sodium/include
+    $$PWD/../../lib/sodium/lib/libsodiumd.lib
 
-QMAKE_LFLAGS_WINDOWS += /NODEFAULTLIB:LIBCMTD \
-    /NODEFAULTLIB:LIBCMT
+include(../../core/idtoolcore.pri)
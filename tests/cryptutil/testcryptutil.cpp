@@ -26,7 +26,30 @@
 
 #include "testcryptutil.h"
 #include "../testutils.h"
+#include "../../src/allocationtracker.h"
+#include "../../src/consoleprogresssink.h"
 #include "../../src/cryptutil.h"
+#include "../../src/diffitemmodel.h"
+#include "../../src/enscryptcalibration.h"
+#include "../../src/identityconverter.h"
+#include "../../src/identitydiff.h"
+#include "../../src/identitygenerator.h"
+#include "../../src/identityhistory.h"
+#include "../../src/identitylineage.h"
+#include "../../src/identityitemmodel.h"
+#include "../../src/identityjson.h"
+#include "../../src/identityloader.h"
+#include "../../src/identityparser.h"
+#include "../../src/identityservice.h"
+#include "../../src/kdfexecutor.h"
+#include "../../src/rescuecoderecovery.h"
+#include "../../src/scryptkernel.h"
+#include "../../src/tracer.h"
+#if QT_VERSION >= QT_VERSION_CHECK(5, 11, 0)
+#include <QAbstractItemModelTester>
+#endif
+#include <sstream>
+#include <thread>
 
 
 void TestCryptUtil::reverseByteArray()
@@ -113,6 +136,146 @@ void TestCryptUtil::enScryptIterations()
     }
 }
 
+void TestCryptUtil::enScryptBatch()
+{
+    QList<QList<QByteArray>> vectors = TestUtils::parseVectorsCsv("vectors/enscrypt-vectors.txt");
+    if (vectors.count() < 1) QFAIL("No vectors found!");
+
+    // Only use the vectors with few iterations to keep the runtime reasonable
+    QList<ScryptKernel::Job> jobs;
+    QList<QByteArray> expectedResults;
+    QStringList passwords;
+    QList<QByteArray> randomSalts;
+    QList<int> iterationCounts;
+
+    for (QList<QByteArray> vector : vectors)
+    {
+        int iterationCount = vector.at(2).toInt();
+        if (iterationCount > 2) continue;
+
+        ScryptKernel::Job job;
+        job.password = vector.at(0);
+        job.salt = vector.at(1);
+        job.iterationCount = iterationCount;
+        jobs.append(job);
+        expectedResults.append(QByteArray::fromHex(vector.at(4)));
+
+        passwords.append(QString::fromLocal8Bit(vector.at(0).data()));
+        randomSalts.append(vector.at(1));
+        iterationCounts.append(iterationCount);
+    }
+
+    QList<ScryptKernel::Implementation> implementations({
+        ScryptKernel::LIBSODIUM, ScryptKernel::GENERIC,
+        ScryptKernel::AVX2, ScryptKernel::AVX512 });
+
+    for (ScryptKernel::Implementation implementation : implementations)
+    {
+        if (!ScryptKernel::isSupported(implementation)) continue;
+
+        QList<ScryptKernel::Job> results = jobs;
+        QVERIFY(ScryptKernel::enScryptBatch(results, 9, implementation));
+
+        for (int i=0; i<results.count(); i++)
+            QCOMPARE(results[i].result, expectedResults[i]);
+    }
+
+    QList<QByteArray> results;
+    QVERIFY(CryptUtil::enScryptIterationsBatch(results, passwords, randomSalts, 9, iterationCounts));
+    QCOMPARE(results, expectedResults);
+
+    QVERIFY(!CryptUtil::enScryptIterationsBatch(results, passwords, randomSalts, 9, QList<int>()));
+}
+
+void TestCryptUtil::kdfExecutor()
+{
+    const qint64 JOB_MEMORY = 1024;
+    KdfExecutor executor(2 * JOB_MEMORY, 4);
+    QCOMPARE(executor.getThreadCount(), 4);
+
+    // EnScrypt jobs yield the same results as CryptUtil
+    QByteArray result;
+    quint64 jobId = executor.submitEnScrypt("", "", 9, 1);
+    QVERIFY(executor.waitForJob(jobId));
+    QCOMPARE(executor.takeResult(jobId, result), KdfExecutor::FINISHED);
+    QCOMPARE(result.toHex(), QByteArray("a8ea62a6e1bfd20e4275011595307aa302645c1801600ef5cd79bf9d884d911c"));
+    QCOMPARE(executor.getJobState(jobId), KdfExecutor::UNKNOWN);
+
+    // No more jobs than the memory budget allows may run concurrently
+    QAtomicInt running, maxRunning;
+    KdfExecutor::Task task = [&running, &maxRunning](QByteArray& taskResult, const QAtomicInt&)
+    {
+        int current = running.fetchAndAddOrdered(1) + 1;
+        int max = maxRunning.loadAcquire();
+        while (current > max && !maxRunning.testAndSetOrdered(max, current))
+            max = maxRunning.loadAcquire();
+
+        QThread::msleep(30);
+        running.fetchAndAddOrdered(-1);
+        taskResult = "done";
+        return true;
+    };
+
+    QList<quint64> jobIds;
+    for (int i=0; i<8; i++)
+    {
+        jobIds.append(executor.submit(task, JOB_MEMORY, i % 2 ? KdfExecutor::BATCH
+                                                              : KdfExecutor::INTERACTIVE));
+    }
+
+    for (quint64 id : jobIds)
+    {
+        QVERIFY(executor.waitForJob(id));
+        QCOMPARE(executor.takeResult(id, result), KdfExecutor::FINISHED);
+        QCOMPARE(result, QByteArray("done"));
+    }
+
+    QVERIFY(maxRunning.loadAcquire() <= 2);
+    QCOMPARE(executor.getCounters().memoryInUse, 0LL);
+
+    // A job exceeding the whole budget still runs, but on its own
+    jobId = executor.submit(task, 10 * JOB_MEMORY);
+    QVERIFY(executor.waitForJob(jobId));
+    QCOMPARE(executor.takeResult(jobId, result), KdfExecutor::FINISHED);
+
+    // Cancel a running job, and a job which is still queued behind it
+    KdfExecutor::Task blockingTask = [](QByteArray&, const QAtomicInt& cancelFlag)
+    {
+        while (!cancelFlag.loadAcquire()) QThread::msleep(5);
+        return false;
+    };
+
+    quint64 runningJobId = executor.submit(blockingTask, 2 * JOB_MEMORY);
+    quint64 queuedJobId = executor.submit(task, JOB_MEMORY);
+    while (executor.getJobState(runningJobId) != KdfExecutor::RUNNING) QThread::msleep(5);
+
+    QCOMPARE(executor.getJobState(queuedJobId), KdfExecutor::QUEUED);
+    QCOMPARE(executor.getCounters().memoryInUse, 2 * JOB_MEMORY);
+    QVERIFY(executor.cancel(queuedJobId));
+    QCOMPARE(executor.getJobState(queuedJobId), KdfExecutor::CANCELLED);
+    QVERIFY(executor.cancel(runningJobId));
+    QVERIFY(executor.waitForJob(runningJobId, 5000));
+    QCOMPARE(executor.takeResult(runningJobId, result), KdfExecutor::CANCELLED);
+    QCOMPARE(executor.takeResult(queuedJobId, result), KdfExecutor::CANCELLED);
+
+    KdfExecutor::Counters counters = executor.getCounters();
+    QCOMPARE(counters.cancelledJobs, 2ULL);
+    QCOMPARE(counters.finishedJobs, 10ULL);
+    QCOMPARE(counters.runningJobs, 0);
+    QCOMPARE(counters.interactiveQueueDepth + counters.batchQueueDepth, 0);
+
+    // The shared executor can only be configured before its first use
+    QVERIFY(KdfExecutor::getInstance() != nullptr);
+    QVERIFY(!KdfExecutor::configureInstance(JOB_MEMORY, 1));
+    QVERIFY(KdfExecutor::getInstance()->getThreadCount() >= 1);
+
+    // Single KDF operations run as jobs of the shared executor
+    QCOMPARE(KdfExecutor::getDefaultPriority(), KdfExecutor::INTERACTIVE);
+    quint64 finishedJobs = KdfExecutor::getInstance()->getCounters().finishedJobs;
+    QVERIFY(CryptUtil::enScryptIterations(result, "password", QByteArray(32, 1), 9, 2));
+    QCOMPARE(KdfExecutor::getInstance()->getCounters().finishedJobs, finishedJobs + 1);
+}
+
 void TestCryptUtil::getHostLowercase()
 {
     QCOMPARE(CryptUtil::getHostLowercase("www.Example.com"), "www.example.com");
@@ -249,4 +412,1269 @@ void TestCryptUtil::identityKeys()
     }
 }
 
+void TestCryptUtil::keyContext()
+{
+    QList<QList<QByteArray>> vectors = TestUtils::parseVectorsCsv("vectors/identity-vectors.txt");
+    if (vectors.count() < 1) QFAIL("No vectors found!");
+
+    // Site keys and indexed secrets derived through a (reused)
+    // key context must match the one-shot results
+    for (QList<QByteArray> vector : vectors)
+    {
+        if (vector.isEmpty()) continue;
+
+        QByteArray imk = QByteArray::fromBase64(vector.at(2), QByteArray::Base64UrlEncoding);
+        QByteArray domain = vector.at(3);
+        QByteArray altId = vector.at(4);
+        QByteArray idk = QByteArray::fromBase64(vector.at(5), QByteArray::Base64UrlEncoding);
+
+        KeyContext imkContext(imk);
+        QVERIFY(imkContext.isValid());
+
+        for (int i=0; i<2; i++)
+        {
+            QByteArray pubKey(crypto_sign_PUBLICKEYBYTES, 0);
+            QByteArray privKey(crypto_sign_SECRETKEYBYTES, 0);
+            QVERIFY(CryptUtil::createSiteKeys(pubKey, privKey, domain, altId, imkContext));
+            QCOMPARE(pubKey, idk);
+
+            QCOMPARE(CryptUtil::createIndexedSecret(imkContext, domain, altId, "secret"),
+                     CryptUtil::createIndexedSecret(imk, domain, altId, "secret"));
+        }
+    }
+
+    QVERIFY(!KeyContext(QByteArray(16, 0)).isValid());
+
+    if (crypto_aead_aes256gcm_is_available() == 0)
+        QSKIP("AES-GCM is not supported on this CPU. Skipping...");
+
+    QByteArray key(32, 0), iv(12, 0), message(64, 0);
+    CryptUtil::getRandomBytes(key);
+    CryptUtil::getRandomBytes(iv);
+    CryptUtil::getRandomBytes(message);
+    QByteArray additionalData("additional data");
+
+    KeyContext keyContext(key);
+    QVERIFY(keyContext.hasAesGcm());
+
+    QByteArray cipherText = CryptUtil::aesGcmEncrypt(message, additionalData, iv, keyContext);
+    QCOMPARE(cipherText.length(), message.length() + 16);
+
+    KeyContext copiedContext(keyContext);
+
+    for (int i=0; i<2; i++)
+    {
+        QByteArray plainText;
+        QVERIFY(copiedContext.aesGcmDecrypt(plainText, cipherText.left(64), cipherText.right(16),
+                                            additionalData, iv));
+        QCOMPARE(plainText, message);
+    }
+
+    QByteArray plainText;
+    QVERIFY(!keyContext.aesGcmDecrypt(plainText, cipherText.left(64), cipherText.right(16),
+                                      "tampered", iv));
+}
+
+void TestCryptUtil::enScryptCalibration()
+{
+    // Start from a well-defined state, ignoring any on-disk cache
+    EnScryptCalibration::loadCache();
+    EnScryptCalibration::clearCache();
+
+    // 20 iterations per second at logN 9
+    EnScryptCalibration::addMeasurement(9, 20, 1000);
+    QCOMPARE(EnScryptCalibration::getIterationsPerSecond(9, false), 20.0);
+    QCOMPARE(EnScryptCalibration::estimateMilliseconds(9, 40, false), 2000LL);
+
+    // Other log-n-factors are extrapolated, doubling the cost per step
+    QCOMPARE(EnScryptCalibration::estimateMilliseconds(10, 20, false), 2000LL);
+    QCOMPARE(EnScryptCalibration::estimateMilliseconds(8, 20, false), 500LL);
+
+    // Runs that are too short to be meaningful are ignored
+    EnScryptCalibration::addMeasurement(9, 1, 10);
+    QCOMPARE(EnScryptCalibration::getIterationsPerSecond(9, false), 20.0);
+
+    int logNFactor = 0, iterationCount = 0;
+    QVERIFY(EnScryptCalibration::recommendParameters(logNFactor, iterationCount, 5));
+    QCOMPARE(logNFactor, 9);
+    QCOMPARE(iterationCount, 100);
+
+    QCOMPARE(EnScryptCalibration::formatDuration(200), QString("< 1 s"));
+    QCOMPARE(EnScryptCalibration::formatDuration(4600), QString("5 s"));
+    QCOMPARE(EnScryptCalibration::formatDuration(72000), QString("1 min 12 s"));
+
+    EnScryptCalibration::clearCache();
+}
+
+void TestCryptUtil::rescueCodeRecovery()
+{
+    if (crypto_aead_aes256gcm_is_available() == 0)
+        QSKIP("AES-GCM is not available on this CPU");
+
+    QString normalizedPattern;
+    QList<int> wildcardPositions;
+    QVERIFY(RescueCodeRecovery::parsePattern("1234-5678-9?12-3456-7890-12x4",
+                                             normalizedPattern, wildcardPositions));
+    QCOMPARE(normalizedPattern, QString("1234567891?23456789012?4"));
+    QCOMPARE(wildcardPositions, QList<int>({ 10, 22 }));
+    QVERIFY(!RescueCodeRecovery::parsePattern("1234-5678", normalizedPattern, wildcardPositions));
+    QVERIFY(!RescueCodeRecovery::parsePattern("1234-5678-9a12-3456-7890-1234",
+                                              normalizedPattern, wildcardPositions));
+
+    // Create a type 2 block using cheap EnScrypt parameters
+    IdentityBlock block2;
+    block2.blockType = 2;
+    block2.items.append(IdentityParser::createEmptyItem("Length", "", UINT_16, 2));
+    block2.items.append(IdentityParser::createEmptyItem("Type", "", UINT_16, 2));
+    block2.items.append(IdentityParser::createEmptyItem("Salt", "", BYTE_ARRAY, 16));
+    block2.items.append(IdentityParser::createEmptyItem("LogN", "", UINT_8, 1));
+    block2.items.append(IdentityParser::createEmptyItem("Iterations", "", UINT_32, 4));
+    block2.items.append(IdentityParser::createEmptyItem("IUK", "", BYTE_ARRAY, 32));
+    block2.items.append(IdentityParser::createEmptyItem("Tag", "", BYTE_ARRAY, 16));
+    block2.items[0].value = "73";
+    block2.items[1].value = "2";
+    block2.items[3].value = "1";
+    block2.items[4].value = "2";
+
+    QString rescueCode = CryptUtil::createNewRescueCode();
+    QByteArray iuk = CryptUtil::createIuk();
+    QVERIFY(CryptUtil::updateBlock2(&block2, iuk, rescueCode));
+
+    QString pattern = rescueCode;
+    pattern[3] = '?';
+    pattern[17] = '?';
+
+    RescueCodeRecovery recovery(block2, pattern);
+    QVERIFY(recovery.isValid());
+    QCOMPARE(recovery.getSearchSpaceSize(), 100ULL);
+    QString lastCandidate = rescueCode;
+    lastCandidate[3] = '9';
+    lastCandidate[17] = '9';
+    QCOMPARE(recovery.getCandidate(99), lastCandidate);
+
+    recovery.setThreadCount(4);
+    QVERIFY(recovery.run());
+    QCOMPARE(recovery.getRescueCode(), rescueCode);
+    QCOMPARE(recovery.getIuk(), iuk);
+
+    RescueCodeRecovery::Statistics statistics = recovery.getStatistics();
+    QCOMPARE(statistics.totalCandidates, 100ULL);
+    QVERIFY(statistics.testedCandidates >= 1);
+
+    // A wrong known digit must exhaust the search space without a match
+    pattern[0] = rescueCode[0] == '0' ? '1' : '0';
+    RescueCodeRecovery failingRecovery(block2, pattern);
+    failingRecovery.setThreadCount(3);
+    QVERIFY(!failingRecovery.run());
+    QCOMPARE(failingRecovery.getStatistics().remainingCandidates, 0ULL);
+}
+
+class RecordingObserver : public IdentityModelObserver
+{
+public:
+    QStringList events;
+
+    void blockInserted(int blockIndex) override { events.append(QString("bi%1").arg(blockIndex)); }
+    void blockRemoved(int blockIndex) override { events.append(QString("br%1").arg(blockIndex)); }
+    void blockMoved(int fromIndex, int toIndex) override { events.append(QString("bm%1-%2").arg(fromIndex).arg(toIndex)); }
+    void blockChanged(int blockIndex) override { events.append(QString("bc%1").arg(blockIndex)); }
+    void itemInserted(int blockIndex, int itemIndex) override { events.append(QString("ii%1.%2").arg(blockIndex).arg(itemIndex)); }
+    void itemRemoved(int blockIndex, int itemIndex) override { events.append(QString("ir%1.%2").arg(blockIndex).arg(itemIndex)); }
+    void itemMoved(int blockIndex, int fromIndex, int toIndex) override { events.append(QString("im%1.%2-%3").arg(blockIndex).arg(fromIndex).arg(toIndex)); }
+    void itemChanged(int blockIndex, int itemIndex) override { events.append(QString("ic%1.%2").arg(blockIndex).arg(itemIndex)); }
+    void modelReset() override { events.append("reset"); }
+};
+
+void TestCryptUtil::identityModelObserver()
+{
+    IdentityModel model;
+    RecordingObserver observer;
+    model.addObserver(&observer);
+
+    IdentityBlock block;
+    block.blockType = 1;
+    block.items.append(IdentityParser::createEmptyItem("A", "", UINT_8, 1));
+    block.items.append(IdentityParser::createEmptyItem("B", "", UINT_8, 1));
+    model.blocks.append(block);
+    model.notifyModelReset();
+
+    IdentityBlock* pFirst = &model.blocks[0];
+    block.blockType = 2;
+    QVERIFY(model.insertBlock(block, pFirst));
+    IdentityBlock* pSecond = &model.blocks[1];
+
+    // Moved blocks and items must keep their addresses
+    QVERIFY(model.moveBlock(pSecond, true));
+    QCOMPARE(model.indexOfBlock(pSecond), 0);
+    QCOMPARE(pSecond->blockType, 2);
+    QVERIFY(!model.moveBlock(pSecond, true));
+
+    IdentityBlockItem* pItemB = &pFirst->items[1];
+    QVERIFY(model.moveItem(pFirst, pItemB, true));
+    QCOMPARE(pFirst->indexOfItem(pItemB), 0);
+    QCOMPARE(pItemB->name, QString("B"));
+
+    QVERIFY(model.setItemValue(pFirst, pItemB, "7"));
+    QVERIFY(model.insertItem(pFirst, IdentityParser::createEmptyItem("C", "", UINT_8, 1), pItemB));
+    QVERIFY(model.deleteItem(pFirst, pItemB));
+    QVERIFY(model.updateBlock(pFirst, block));
+    QVERIFY(model.deleteBlock(pSecond));
+    QVERIFY(!model.deleteBlock(pSecond));
+
+    QCOMPARE(observer.events, QStringList({ "reset", "bi1", "bm1-0", "im1.1-0",
+                                            "ic1.0", "ii1.1", "ir1.0", "bc1", "br0" }));
+
+    model.removeObserver(&observer);
+    model.clear();
+    QCOMPARE(observer.events.size(), 9);
+}
+
+void TestCryptUtil::identityItemModel()
+{
+    IdentityModel model;
+    IdentityBlock block;
+    block.blockType = 1;
+    block.description = "Block 1";
+    block.items.append(IdentityParser::createEmptyItem("A", "First", UINT_8, 1));
+    block.items.append(IdentityParser::createEmptyItem("B", "Second", UINT_8, 1));
+    model.blocks.append(block);
+
+    IdentityItemModel itemModel(&model);
+    QCOMPARE(itemModel.rowCount(), 1);
+    QCOMPARE(itemModel.columnCount(), int(IdentityItemModel::COLUMN_COUNT));
+
+    QModelIndex blockIndex = itemModel.index(0, IdentityItemModel::NAME_COLUMN);
+    QVERIFY(itemModel.isBlockIndex(blockIndex));
+    QCOMPARE(itemModel.rowCount(blockIndex), 2);
+    QCOMPARE(blockIndex.data().toString(), QString("Block 1"));
+    QCOMPARE(blockIndex.data(IdentityItemModel::BLOCK_COLOR_ROLE).value<QColor>(),
+             QColor(214, 201, 163));
+    QCOMPARE(blockIndex.data(IdentityItemModel::ACTIONS_ROLE).toInt(),
+             int(IdentityItemModel::NO_ACTION));
+
+    QModelIndex itemIndex = itemModel.index(1, IdentityItemModel::VALUE_COLUMN, blockIndex);
+    QCOMPARE(itemIndex.parent(), blockIndex);
+    QCOMPARE(itemModel.getItem(itemIndex)->name, QString("B"));
+    QCOMPARE(itemModel.index(1, IdentityItemModel::ACTIONS_COLUMN, blockIndex)
+             .data(IdentityItemModel::ACTIONS_ROLE).toInt(),
+             int(IdentityItemModel::COPY_ACTION));
+
+    itemModel.setEnableUnauthenticatedChanges(true);
+    QCOMPARE(blockIndex.data(IdentityItemModel::ACTIONS_ROLE).toInt(),
+             int(IdentityItemModel::OPTIONS_ACTION));
+
+    // Model changes must be translated into fine-grained row signals
+    QSignalSpy insertSpy(&itemModel, &QAbstractItemModel::rowsInserted);
+    QSignalSpy removeSpy(&itemModel, &QAbstractItemModel::rowsRemoved);
+    QSignalSpy moveSpy(&itemModel, &QAbstractItemModel::rowsMoved);
+    QSignalSpy changeSpy(&itemModel, &QAbstractItemModel::dataChanged);
+    QSignalSpy resetSpy(&itemModel, &QAbstractItemModel::modelReset);
+
+    IdentityBlock* pBlock = &model.blocks[0];
+    QPersistentModelIndex persistentItem(itemModel.index(1, 0, blockIndex));
+
+    QVERIFY(model.insertItem(pBlock, IdentityParser::createEmptyItem("C", "", UINT_8, 1),
+                             &pBlock->items[1]));
+    QCOMPARE(insertSpy.count(), 1);
+    QCOMPARE(itemModel.rowCount(blockIndex), 3);
+
+    QVERIFY(model.moveItem(pBlock, &pBlock->items[1], true));
+    QCOMPARE(moveSpy.count(), 1);
+    QCOMPARE(persistentItem.row(), 0);
+    QCOMPARE(persistentItem.data().toString(), QString("B"));
+
+    QVERIFY(model.setItemValue(pBlock, &pBlock->items[0], "42"));
+    QCOMPARE(changeSpy.count(), 1);
+    QCOMPARE(itemModel.index(0, IdentityItemModel::VALUE_COLUMN, blockIndex).data().toString(),
+             QString("42"));
+
+    QVERIFY(model.deleteItem(pBlock, &pBlock->items[2]));
+    QCOMPARE(removeSpy.count(), 1);
+    QCOMPARE(itemModel.rowCount(blockIndex), 2);
+
+    block.blockType = 2;
+    QVERIFY(model.insertBlock(block, pBlock));
+    QCOMPARE(insertSpy.count(), 2);
+    QCOMPARE(itemModel.rowCount(), 2);
+    QVERIFY(model.deleteBlock(&model.blocks[1]));
+    QCOMPARE(removeSpy.count(), 2);
+
+    QCOMPARE(resetSpy.count(), 0);
+    model.clear();
+    QCOMPARE(resetSpy.count(), 1);
+    QCOMPARE(itemModel.rowCount(), 0);
+}
+
+void TestCryptUtil::identityItemModelTester()
+{
+#if QT_VERSION >= QT_VERSION_CHECK(5, 11, 0)
+    IdentityModel model;
+    IdentityBlock block;
+    block.blockType = 1;
+    block.items.append(IdentityParser::createEmptyItem("A", "", UINT_8, 1));
+    block.items.append(IdentityParser::createEmptyItem("B", "", UINT_8, 1));
+    model.blocks.append(block);
+
+    IdentityItemModel itemModel(&model);
+    QAbstractItemModelTester tester(&itemModel,
+                                    QAbstractItemModelTester::FailureReportingMode::QtTest);
+
+    // Every change below is verified by the tester against the
+    // begin/end contract of QAbstractItemModel
+    IdentityBlock* pBlock = &model.blocks[0];
+    QVERIFY(model.insertItem(pBlock, IdentityParser::createEmptyItem("C", "", UINT_8, 1),
+                             &pBlock->items[0]));
+    QVERIFY(model.moveItem(pBlock, &pBlock->items[2], true));
+    QVERIFY(model.moveItem(pBlock, &pBlock->items[0], false));
+    QVERIFY(model.setItemValue(pBlock, &pBlock->items[1], "3"));
+    QVERIFY(model.deleteItem(pBlock, &pBlock->items[1]));
+
+    block.blockType = 2;
+    QVERIFY(model.insertBlock(block, pBlock));
+    QVERIFY(model.moveBlock(&model.blocks[1], true));
+    QVERIFY(model.moveBlock(&model.blocks[0], false));
+
+    // Updating a block must announce added and removed items as rows
+    QSignalSpy resetSpy(&itemModel, &QAbstractItemModel::modelReset);
+    QSignalSpy insertSpy(&itemModel, &QAbstractItemModel::rowsInserted);
+    QSignalSpy removeSpy(&itemModel, &QAbstractItemModel::rowsRemoved);
+
+    IdentityBlock grownBlock = block;
+    grownBlock.items.append(IdentityParser::createEmptyItem("D", "", UINT_8, 1));
+    QVERIFY(model.updateBlock(&model.blocks[0], grownBlock));
+    QCOMPARE(insertSpy.count(), 1);
+    QCOMPARE(itemModel.rowCount(itemModel.index(0, IdentityItemModel::NAME_COLUMN)), 3);
+
+    IdentityBlock shrunkBlock = block;
+    shrunkBlock.items.removeLast();
+    QVERIFY(model.updateBlock(&model.blocks[0], shrunkBlock));
+    QCOMPARE(removeSpy.count(), 2);
+    QCOMPARE(itemModel.rowCount(itemModel.index(0, IdentityItemModel::NAME_COLUMN)), 1);
+
+    shrunkBlock.description = "Changed";
+    QVERIFY(model.updateBlock(&model.blocks[0], shrunkBlock));
+    QCOMPARE(itemModel.index(0, IdentityItemModel::NAME_COLUMN).data().toString(),
+             QString("Changed"));
+    QCOMPARE(resetSpy.count(), 0);
+
+    QVERIFY(model.deleteBlock(&model.blocks[1]));
+    QVERIFY(model.deleteBlock(&model.blocks[0]));
+    QCOMPARE(itemModel.rowCount(), 0);
+#else
+    QSKIP("QAbstractItemModelTester requires Qt 5.11 or newer");
+#endif
+}
+
+void TestCryptUtil::identityApplyChanges()
+{
+    IdentityModel model;
+    IdentityBlock block;
+    block.items.append(IdentityParser::createEmptyItem("A", "", UINT_8, 1));
+    for (int blockType : { 1, 2, 3 })
+    {
+        block.blockType = blockType;
+        model.blocks.append(block);
+    }
+
+    IdentityBlock* pFirst = &model.blocks[0];
+    IdentityBlock* pLast = &model.blocks[2];
+    RecordingObserver observer;
+    model.addObserver(&observer);
+
+    // Changed and inserted blocks in the middle are applied, while
+    // equal leading and trailing blocks stay untouched
+    IdentityModel changedModel(model);
+    changedModel.blocks[1].items[0].value = "5";
+    block.blockType = 4;
+    changedModel.blocks.insert(2, block);
+
+    QCOMPARE(model.applyChanges(changedModel), 2);
+    QCOMPARE(observer.events, QStringList({ "bc1", "bi2" }));
+    QVERIFY(model.blocks == changedModel.blocks);
+    QCOMPARE(&model.blocks[0], pFirst);
+    QCOMPARE(&model.blocks[3], pLast);
+
+    observer.events.clear();
+    QCOMPARE(model.applyChanges(changedModel), 0);
+    QVERIFY(observer.events.isEmpty());
+
+    IdentityModel shrunkModel;
+    shrunkModel.blocks.append(model.blocks[0]);
+    shrunkModel.blocks.append(model.blocks[3]);
+    QCOMPARE(model.applyChanges(shrunkModel), 2);
+    QCOMPARE(observer.events, QStringList({ "br1", "br1" }));
+    QVERIFY(model.blocks == shrunkModel.blocks);
+
+    model.removeObserver(&observer);
+}
+
+void TestCryptUtil::identityHistory()
+{
+    IdentityModel model;
+    IdentityBlock block;
+    block.blockType = 1;
+    block.items.append(IdentityParser::createEmptyItem("A", "", UINT_8, 1));
+    model.blocks.append(block);
+    block.blockType = 2;
+    model.blocks.append(block);
+
+    IdentityHistory history(&model);
+    QVERIFY(!history.canUndo());
+    QVERIFY(!history.canRedo());
+    QVERIFY(!history.record());
+
+    // Only changed blocks are copied, unchanged blocks stay shared
+    IdentityBlock* pSecond = &model.blocks[1];
+    IdentityBlockItem* pItem = &pSecond->items[0];
+    QVERIFY(model.setItemValue(pSecond, pItem, "1"));
+    QVERIFY(history.record());
+    QCOMPARE(history.getStepCount(), 2);
+    QCOMPARE(history.getSnapshot(1)[0], history.getSnapshot(0)[0]);
+    QVERIFY(history.getSnapshot(1)[1] != history.getSnapshot(0)[1]);
+
+    // Recording must not detach the live items
+    QCOMPARE(&pSecond->items[0], pItem);
+
+    QVERIFY(model.moveBlock(pSecond, true));
+    QVERIFY(history.record());
+    QCOMPARE(history.getSnapshot(2)[0], history.getSnapshot(1)[1]);
+    QCOMPARE(history.getSnapshot(2)[1], history.getSnapshot(1)[0]);
+
+    QVERIFY(model.deleteBlock(&model.blocks[1]));
+    QVERIFY(history.canUndo());
+
+    // Unrecorded changes are recorded before undoing
+    QVERIFY(history.undo());
+    QCOMPARE(history.getStepCount(), 4);
+    QCOMPARE(model.blocks.size(), 2);
+    QCOMPARE(model.blocks[0].blockType, 2);
+
+    QVERIFY(history.undo());
+    QVERIFY(history.undo());
+    QCOMPARE(model.blocks[0].blockType, 1);
+    QCOMPARE(model.blocks[1].items[0].value, QString(""));
+    QVERIFY(!history.canUndo());
+
+    QVERIFY(history.redo());
+    QCOMPARE(model.blocks[1].items[0].value, QString("1"));
+
+    // A new change discards the redo steps
+    QVERIFY(model.setItemValue(&model.blocks[0], &model.blocks[0].items[0], "2"));
+    QVERIFY(history.canUndo());
+    QVERIFY(!history.canRedo());
+    QVERIFY(history.record());
+    QCOMPARE(history.getStepCount(), 3);
+    QVERIFY(!history.canRedo());
+
+    // The number of steps is bounded
+    IdentityHistory boundedHistory(&model, 2);
+    for (int i=0; i<5; i++)
+    {
+        QVERIFY(model.setItemValue(&model.blocks[0], &model.blocks[0].items[0],
+                                   QString::number(i)));
+        QVERIFY(boundedHistory.record());
+    }
+    QCOMPARE(boundedHistory.getStepCount(), 3);
+    QVERIFY(boundedHistory.undo());
+    QVERIFY(boundedHistory.undo());
+    QVERIFY(!boundedHistory.undo());
+    QCOMPARE(model.blocks[0].items[0].value, QString("2"));
+}
+
+void TestCryptUtil::identityLoader()
+{
+    QTemporaryDir tempDir;
+    QVERIFY(tempDir.isValid());
+    QDir dir(tempDir.path());
+    QVERIFY(dir.mkdir("sub"));
+
+    // A header without any blocks is a valid (empty) identity
+    QStringList validFiles = { dir.filePath("a.sqrl"), dir.filePath("sub/b.sqrc"),
+                               dir.filePath("c.sqrl") };
+    for (const QString& fileName : validFiles)
+    {
+        QFile file(fileName);
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        file.write(IdentityParser::HEADER.toUtf8());
+    }
+
+    QFile invalidFile(dir.filePath("invalid.sqrl"));
+    QVERIFY(invalidFile.open(QIODevice::WriteOnly));
+    invalidFile.write("invalid");
+    invalidFile.close();
+
+    QFile ignoredFile(dir.filePath("ignored.txt"));
+    QVERIFY(ignoredFile.open(QIODevice::WriteOnly));
+    ignoredFile.close();
+
+    QStringList fileNames = IdentityLoader::collectIdentityFiles(
+                { tempDir.path(), dir.filePath("a.sqrl"), dir.filePath("missing.sqrl") });
+    QCOMPARE(fileNames.size(), 5);
+    QVERIFY(!fileNames.contains(dir.absoluteFilePath("ignored.txt")));
+    QCOMPARE(IdentityLoader::collectIdentityFiles({ tempDir.path() }, false).size(), 3);
+
+    IdentityLoader loader;
+    loader.setMaxThreadCount(2);
+    QSignalSpy loadedSpy(&loader, &IdentityLoader::identityLoaded);
+    QSignalSpy finishedSpy(&loader, &IdentityLoader::finished);
+
+    QCOMPARE(loader.load(fileNames), 5);
+    QVERIFY(loader.isLoading());
+    QVERIFY(finishedSpy.wait(10000));
+    QVERIFY(!loader.isLoading());
+    QCOMPARE(finishedSpy.count(), 1);
+    QCOMPARE(loadedSpy.count(), 3);
+
+    QStringList loadedFiles;
+    for (const QList<QVariant>& arguments : loadedSpy)
+    {
+        IdentityModel* pModel = arguments.at(0).value<IdentityModel*>();
+        QVERIFY(pModel != nullptr);
+        QVERIFY(!pModel->hasBlocks());
+        loadedFiles.append(QFileInfo(arguments.at(1).toString()).fileName());
+        delete pModel;
+    }
+    loadedFiles.sort();
+    QCOMPARE(loadedFiles, QStringList({ "a.sqrl", "b.sqrc", "c.sqrl" }));
+
+    // All errors are collected instead of aborting the remaining loads
+    QList<IdentityLoader::Error> errors = loader.getErrors();
+    QCOMPARE(errors.size(), 2);
+    loader.clearErrors();
+    QVERIFY(loader.getErrors().isEmpty());
+}
+
+void TestCryptUtil::identityConverter()
+{
+    QByteArray block1 = QByteArray::fromHex("0600010007ff");
+    QByteArray block2 = QByteArray::fromHex("080002000102a3f4");
+    QByteArray rawIdentity = IdentityParser::HEADER.toLatin1() + block1 + block2;
+
+    // Binary -> base64 -> text -> binary, text only keeps blocks 2 and 3
+    QByteArray base64 = IdentityConverter::encode(rawIdentity, IdentityConverter::BASE64);
+    QByteArray text = IdentityConverter::encode(rawIdentity, IdentityConverter::TEXT);
+    QCOMPARE(IdentityConverter::detectFormat(rawIdentity), IdentityConverter::BINARY);
+    QCOMPARE(IdentityConverter::detectFormat(base64 + "\n"), IdentityConverter::BASE64);
+    QCOMPARE(IdentityConverter::detectFormat(CryptUtil::formatTextualIdentity(text).toLatin1()),
+             IdentityConverter::TEXT);
+    QCOMPARE(IdentityConverter::detectFormat("not an identity"), IdentityConverter::UNKNOWN_FORMAT);
+    QCOMPARE(IdentityConverter::decode(base64 + "\n", IdentityConverter::BASE64), rawIdentity);
+    QCOMPARE(IdentityConverter::decode(text, IdentityConverter::TEXT),
+             IdentityParser::HEADER.toLatin1() + block2);
+    QVERIFY_EXCEPTION_THROWN(IdentityConverter::encode(IdentityParser::HEADER.toLatin1() + block1,
+                                                       IdentityConverter::TEXT), std::runtime_error);
+    QVERIFY_EXCEPTION_THROWN(IdentityConverter::encode(rawIdentity.left(rawIdentity.size() - 1),
+                                                       IdentityConverter::TEXT), std::runtime_error);
+
+    // Batches keep their order, failures don't affect other jobs
+    IdentityConverter converter(IdentityConverter::BINARY);
+    converter.setMaxThreadCount(4);
+    QVector<IdentityConverter::Job> jobs(100);
+    for (int i=0; i<jobs.size(); i++)
+    {
+        jobs[i].name = QString::number(i);
+        jobs[i].input = i % 3 == 0 ? text : base64;
+    }
+    jobs[50].input = "invalid!";
+    converter.convert(jobs);
+
+    for (int i=0; i<jobs.size(); i++)
+    {
+        if (i == 50) continue;
+        QCOMPARE(jobs[i].name, QString::number(i));
+        QVERIFY(jobs[i].errorMessage.isEmpty());
+        QCOMPARE(jobs[i].output, i % 3 == 0 ? IdentityParser::HEADER.toLatin1() + block2 : rawIdentity);
+        QCOMPARE(jobs[i].inputFormat, i % 3 == 0 ? IdentityConverter::TEXT : IdentityConverter::BASE64);
+        QVERIFY(jobs[i].input.isEmpty());
+    }
+    QVERIFY(jobs[50].output.isEmpty());
+    QVERIFY(!jobs[50].errorMessage.isEmpty());
+
+    QCOMPARE(converter.getStageStats(IdentityConverter::DECODE_STAGE).count, Q_INT64_C(99));
+    QCOMPARE(converter.getStageStats(IdentityConverter::READ_STAGE).count, Q_INT64_C(0));
+    QJsonObject stats = converter.getStatsJson(1000000);
+    QCOMPARE(stats["stages"].toArray().size(), static_cast<int>(IdentityConverter::STAGE_COUNT));
+    QCOMPARE(stats["threads"].toInt(), 4);
+}
+
+void TestCryptUtil::identityDiff()
+{
+    IdentityModel id1;
+    IdentityBlock block;
+    block.blockType = 1;
+    block.items.append(IdentityParser::createEmptyItem("A", "", UINT_16, 2));
+    block.items.append(IdentityParser::createEmptyItem("B", "", BYTE_ARRAY, 2));
+    block.items[0].value = "7";
+    block.items[1].value = "0a0b";
+    id1.blocks.append(block);
+    block.blockType = 2;
+    id1.blocks.append(block);
+
+    // Values are compared on their binary representation
+    IdentityModel id2(id1);
+    id2.blocks[0].items[1].value = "0A0B";
+    id2.blocks[1].items[0].value = "8";
+    id2.blocks[1].items.append(IdentityParser::createEmptyItem("C", "", UINT_8, 1));
+    block.blockType = 3;
+    id2.blocks.append(block);
+
+    IdentityDiff::Result result = IdentityDiff::compare(id1, id2);
+    QCOMPARE(result.blocks.size(), 3);
+    QCOMPARE(result.blocks[0].diffType, IdentityDiff::EQUAL);
+    QCOMPARE(result.blocks[1].diffType, IdentityDiff::CHANGED);
+    QCOMPARE(result.itemDiffType(1, 0), IdentityDiff::CHANGED);
+    QCOMPARE(result.itemDiffType(1, 1), IdentityDiff::EQUAL);
+    QCOMPARE(result.itemDiffType(1, 2), IdentityDiff::ONLY_IN_SECOND);
+    QCOMPARE(result.blocks[2].diffType, IdentityDiff::ONLY_IN_SECOND);
+    QCOMPARE(result.blocks[2].blockIndex1, -1);
+    QCOMPARE(result.changedBlockCount, 2);
+    QCOMPARE(result.changedItemCount, 4);
+    QVERIFY(!result.isEqual());
+    QCOMPARE(result.relationship, IdentityDiff::UNKNOWN_RELATIONSHIP);
+    QVERIFY(IdentityDiff::compare(id1, id1).isEqual());
+
+    QJsonObject json = IdentityDiff::toJson(result, id1, id2);
+    QCOMPARE(json["changed_blocks"].toInt(), 2);
+    QJsonArray blocks = json["blocks"].toArray();
+    QCOMPARE(blocks.size(), 2);
+    QCOMPARE(blocks[0].toObject()["items"].toArray().size(), 2);
+    QCOMPARE(blocks[0].toObject()["items"].toArray()[0].toObject()["value2"].toString(),
+             QString("8"));
+
+    // Relationships are derived from current and previous IMKs
+    IdentityDiff::KeyInfo keys1, keys2;
+    keys1.imk = QByteArray(32, 1);
+    keys2.imk = QByteArray(32, 2);
+    QCOMPARE(IdentityDiff::relate(keys1, keys2), IdentityDiff::UNRELATED);
+    keys2.previousIuks.append(QByteArray(32, 3));
+    keys2.previousImks.append(keys1.imk);
+    bool firstPrecedesSecond = false;
+    QCOMPARE(IdentityDiff::relate(keys1, keys2, &firstPrecedesSecond), IdentityDiff::SAME_LINEAGE);
+    QVERIFY(firstPrecedesSecond);
+
+    IdentityDiff::Result keyResult = IdentityDiff::compare(id1, id1, &keys1, &keys2);
+    QCOMPARE(keyResult.relationship, IdentityDiff::SAME_LINEAGE);
+    QVERIFY(!keyResult.isEqual());
+    QCOMPARE(keyResult.keys.size(), 3);
+    QCOMPARE(keyResult.keys[2].keyType, IdentityDiff::PREVIOUS_IUK);
+    QCOMPARE(keyResult.keys[2].diffType, IdentityDiff::ONLY_IN_SECOND);
+
+    // Parallel comparison yields the same results, in order
+    QList<IdentityDiff::ModelPair> pairs;
+    for (int i=0; i<50; i++)
+        pairs.append(i % 2 ? IdentityDiff::ModelPair(&id1, &id2) : IdentityDiff::ModelPair(&id1, &id1));
+
+    QList<IdentityDiff::Result> results = IdentityDiff::compareAll(pairs, 4);
+    QCOMPARE(results.size(), pairs.size());
+    for (int i=0; i<results.size(); i++)
+    {
+        QCOMPARE(results[i].isEqual(), i % 2 == 0);
+        if (i % 2) QCOMPARE(results[i].changedItemCount, 4);
+    }
+}
+
+void TestCryptUtil::identityJson()
+{
+    IdentityModel identity;
+    IdentityBlock block;
+    block.blockType = 1;
+    block.description = "Block 1";
+    block.items.append(IdentityParser::createEmptyItem("A", "Length", UINT_16, 2));
+    block.items.append(IdentityParser::createEmptyItem("B", "", UINT_32, 4));
+    block.items.append(IdentityParser::createEmptyItem("C", "", BYTE_ARRAY, 3));
+    block.items.append(IdentityParser::createEmptyItem("D", "", UINT_8, 1));
+    block.items[0].value = "125";
+    block.items[1].value = "4294967295";
+    block.items[2].value = "0a0b0c";
+    block.items[3].value = "07"; // Not canonical, must be kept as-is
+    block.items[3].repeatIndex = 0;
+    block.items[3].repeatCount = 2;
+    identity.blocks.append(block);
+
+    // Typed values
+    QJsonObject json = IdentityJson::toJson(identity, "a.sqrl");
+    QCOMPARE(json["format_version"].toInt(), IdentityJson::FORMAT_VERSION);
+    QCOMPARE(json["source"].toString(), QString("a.sqrl"));
+    QJsonArray items = json["blocks"].toArray()[0].toObject()["items"].toArray();
+    QCOMPARE(items[0].toObject()["value"].toInt(), 125);
+    QCOMPARE(items[1].toObject()["value"].toDouble(), 4294967295.0);
+    QCOMPARE(items[2].toObject()["value"].toString(), QString("0a0b0c"));
+    QCOMPARE(items[3].toObject()["value"].toString(), QString("07"));
+
+    // Streaming round trip, byte-exact
+    QBuffer buffer;
+    buffer.open(QIODevice::WriteOnly);
+    IdentityJsonWriter writer(&buffer);
+    QVERIFY(writer.write(identity, "a.sqrl"));
+    buffer.write("\n");
+    QVERIFY(writer.write(IdentityModel()));
+    QCOMPARE(writer.getCount(), Q_INT64_C(2));
+    buffer.write("{\"blocks\": []}\n");
+    buffer.close();
+    QCOMPARE(buffer.data().count('\n'), 4);
+
+    buffer.open(QIODevice::ReadOnly);
+    IdentityJsonReader reader(&buffer);
+    IdentityModel result;
+    QVERIFY(reader.readNext(result));
+    QCOMPARE(reader.getSource(), QString("a.sqrl"));
+    QVERIFY(result.blocks == identity.blocks);
+    QCOMPARE(result.getRawBytes(), identity.getRawBytes());
+    QVERIFY(reader.readNext(result));
+    QCOMPARE(result.blocks.size(), 0);
+    QVERIFY(reader.getSource().isEmpty());
+    QCOMPARE(reader.getLineNumber(), Q_INT64_C(3));
+    QVERIFY_EXCEPTION_THROWN(reader.readNext(result), std::runtime_error);
+    QVERIFY(!reader.readNext(result));
+    QCOMPARE(reader.getCount(), Q_INT64_C(2));
+
+    // Numbers out of the range of the item type are rejected
+    QJsonObject invalidJson = IdentityJson::toJson(identity);
+    QJsonArray blocks = invalidJson["blocks"].toArray();
+    QJsonObject blockObject = blocks[0].toObject();
+    for (double value : { 65536.0, -1.0, 1.5, 1e300 })
+    {
+        QJsonObject itemObject = items[0].toObject();
+        itemObject["value"] = value;
+        items[0] = itemObject;
+        blockObject["items"] = items;
+        blocks[0] = blockObject;
+        invalidJson["blocks"] = blocks;
+        QVERIFY_EXCEPTION_THROWN(IdentityJson::fromJson(invalidJson), std::runtime_error);
+    }
+}
+
+static bool copyBlockDefinitions(const QString& blockDefDir, const QString& targetDir)
+{
+    QDir dir(targetDir);
+    if (blockDefDir.isEmpty() || !dir.mkdir("blockdef")) return false;
+
+    for (int i=1; i<=3; i++)
+    {
+        QString fileName = QString::number(i) + ".json";
+        if (!QFile::copy(QDir(blockDefDir).filePath(fileName), dir.filePath("blockdef/" + fileName)))
+            return false;
+    }
+
+    return true;
+}
+
+void TestCryptUtil::identityGenerator()
+{
+    // Random streams only depend on the seed and stream id
+    DeterministicRandom random1(DeterministicRandom::createSeed("seed"), 1);
+    DeterministicRandom random2(DeterministicRandom::createSeed("seed"), 1);
+    DeterministicRandom random3(DeterministicRandom::createSeed("seed"), 2);
+    QByteArray bytes = random1.getBytes(100) + random1.getBytes(300);
+    QCOMPARE(random2.getBytes(400), bytes);
+    QVERIFY(random3.getBytes(400) != bytes);
+    QVERIFY(random3.getUniform(56) < 56);
+
+    // Block definitions are needed for creating blocks
+    QTemporaryDir tempDir;
+    QVERIFY(tempDir.isValid());
+    QVERIFY(copyBlockDefinitions(QFINDTESTDATA("../../blockdef"), tempDir.path()));
+    QString previousDir = QDir::currentPath();
+    QVERIFY(QDir::setCurrent(tempDir.path()));
+
+    IdentityGenerator generator(DeterministicRandom::createSeed("corpus"), 9, 2);
+    generator.setPreviousIukCount(2);
+    generator.setMaxThreadCount(2);
+    QVector<IdentityGenerator::Identity> identities = generator.generate(0, 3);
+    QCOMPARE(identities.size(), 3);
+
+    // The result doesn't depend on the batch or thread
+    IdentityGenerator::Identity identity = generator.generateIdentity(1);
+    QVERIFY(identity.errorMessage.isEmpty());
+    QCOMPARE(identities[1].index, 1);
+    QCOMPARE(identities[1].rawIdentity, identity.rawIdentity);
+    QCOMPARE(identities[1].password, identity.password);
+    QCOMPARE(identities[1].rescueCode, identity.rescueCode);
+    QVERIFY(identities[0].rawIdentity != identity.rawIdentity);
+    QCOMPARE(identity.password.length(), IdentityGenerator::PASSWORD_LENGTH);
+    QCOMPARE(identity.rescueCode.length(), 24);
+
+    // The identity can be unlocked using the password and rescue code
+    IdentityModel model;
+    IdentityParser parser;
+    parser.parseIdentityData(identity.rawIdentity, &model);
+    QCOMPARE(model.getAvailableBlockTypes(), QList<int>({ 1, 2, 3 }));
+    QCOMPARE(model.getBlock(1)->items[6].value, QString("2"));
+
+    QByteArray key, imk, ilk, iuk;
+    QList<QByteArray> previousIuks;
+    QVERIFY(CryptUtil::createKeyFromPassword(key, *model.getBlock(1), identity.password));
+    QVERIFY(CryptUtil::decryptBlock1(imk, ilk, model.getBlock(1), key));
+    QVERIFY(CryptUtil::decryptBlock2(iuk, model.getBlock(2), identity.rescueCode));
+    QCOMPARE(CryptUtil::createImkFromIuk(iuk), imk);
+    QVERIFY(CryptUtil::decryptBlock3(previousIuks, model.getBlock(3), imk));
+    QCOMPARE(previousIuks.size(), 2);
+
+    // A fixed password keeps the keys, a different seed changes them
+    generator.setPassword("fixed password");
+    IdentityGenerator::Identity fixedIdentity = generator.generateIdentity(1);
+    QCOMPARE(fixedIdentity.password, QString("fixed password"));
+    QCOMPARE(fixedIdentity.rescueCode, identity.rescueCode);
+    int block2Offset = IdentityParser::HEADER.length() + 125;
+    QCOMPARE(fixedIdentity.rawIdentity.mid(block2Offset), identity.rawIdentity.mid(block2Offset));
+
+    IdentityGenerator otherGenerator(DeterministicRandom::createSeed("other"), 9, 2);
+    QVERIFY(otherGenerator.generateIdentity(1).rescueCode != identity.rescueCode);
+
+    QVERIFY(QDir::setCurrent(previousDir));
+}
+
+void TestCryptUtil::identityService()
+{
+    QTemporaryDir tempDir;
+    QVERIFY(tempDir.isValid());
+    QDir dir(tempDir.path());
+    QVERIFY(dir.mkdir("blockdef"));
+    QString previousDir = QDir::currentPath();
+    QVERIFY(QDir::setCurrent(tempDir.path()));
+
+    QFile blockDefFile(dir.filePath("blockdef/7.json"));
+    QVERIFY(blockDefFile.open(QIODevice::WriteOnly));
+    blockDefFile.write("{\"block_type\": 7, \"description\": \"Cached\", \"items\": ["
+                       "{\"name\": \"Length\", \"type\": \"UINT_16\", \"bytes\": 2},"
+                       "{\"name\": \"Type\", \"type\": \"UINT_16\", \"bytes\": 2},"
+                       "{\"name\": \"Data\", \"type\": \"BYTE_ARRAY\", \"bytes\": 2}]}");
+    blockDefFile.close();
+
+    IdentityService service;
+    service.warmUp();
+    service.setKeyCacheCapacity(4);
+
+    // Block definitions are only read once while being cached
+    QVERIFY(blockDefFile.remove());
+    QByteArray rawIdentity = IdentityParser::HEADER.toLatin1() + QByteArray::fromHex("06000700a1b2");
+    QString base64Identity = QString::fromLatin1(
+                IdentityConverter::encode(rawIdentity, IdentityConverter::BASE64));
+
+    QJsonObject request;
+    request["id"] = 42;
+    request["op"] = "parse";
+    request["identity"] = base64Identity;
+    QJsonObject response = service.handleRequest(request);
+    QVERIFY(response["ok"].toBool());
+    QCOMPARE(response["id"].toInt(), 42);
+    QJsonObject block = response["identity"].toObject()["blocks"].toArray()[0].toObject();
+    QCOMPARE(block["description"].toString(), QString("Cached"));
+    QCOMPARE(block["items"].toArray()[2].toObject()["value"].toString(), QString("a1b2"));
+
+    request["op"] = "serialize";
+    request["format"] = "binary";
+    response = service.handleRequest(request);
+    QVERIFY(response["ok"].toBool());
+    QCOMPARE(QByteArray::fromBase64(response["data"].toString().toLatin1()), rawIdentity);
+
+    // Failures are reported within the response
+    request["format"] = "text";
+    response = service.handleRequest(request);
+    QVERIFY(!response["ok"].toBool());
+    QVERIFY(!response["error"].toString().isEmpty());
+    QCOMPARE(response["id"].toInt(), 42);
+
+    request = QJsonObject();
+    request["op"] = "validate";
+    request["identity"] = "not an identity";
+    response = service.handleRequest(request);
+    QVERIFY(response["ok"].toBool());
+    QVERIFY(!response["valid"].toBool());
+
+    request = QJsonObject();
+    request["op"] = "base56-encode";
+    request["data"] = "0102030405";
+    response = service.handleRequest(request);
+    request["op"] = "base56-decode";
+    request["text"] = response["text"];
+    QCOMPARE(service.handleRequest(request)["data"].toString(), QString("0102030405"));
+
+    request = QJsonObject();
+    request["op"] = "decrypt";
+    request["identity"] = base64Identity;
+    QVERIFY(!service.handleRequest(request)["ok"].toBool());
+    request["op"] = "unknown";
+    QVERIFY(!service.handleRequest(request)["ok"].toBool());
+
+    // Latency statistics
+    QCOMPARE(service.getLatencyStats("serialize").count, Q_INT64_C(2));
+    QCOMPARE(service.getLatencyStats("serialize").errors, Q_INT64_C(1));
+    QCOMPARE(service.getLatencyStats("invalid").count, Q_INT64_C(1));
+    request["op"] = "stats";
+    response = service.handleRequest(request);
+    QJsonObject parseStats = response["operations"].toObject()["parse"].toObject();
+    QCOMPARE(parseStats["count"].toInt(), 1);
+    QVERIFY(parseStats["p99_us"].toDouble() >= parseStats["p50_us"].toDouble());
+    QVERIFY(parseStats["p99_us"].toDouble() <= parseStats["max_us"].toDouble());
+    QCOMPARE(response["key_cache"].toObject()["capacity"].toInt(), 4);
+    QCOMPARE(response["block_definitions"].toInt(), 1);
+
+    IdentityParser::setBlockDefinitionCacheEnabled(false);
+    QVERIFY(QDir::setCurrent(previousDir));
+}
+
+void TestCryptUtil::identityLineage()
+{
+    QByteArray imkA(32, 1), imkB(32, 2), imkC(32, 3), imkD(32, 4), imkX(32, 9);
+
+    // A was re-keyed into B, B and its copy share the same IMK,
+    // C and D descend from X, which is not part of the corpus
+    IdentityLineage lineage;
+    lineage.addIdentity("b", imkB, QList<QByteArray>() << imkA);
+    lineage.addIdentity("c", imkC, QList<QByteArray>() << imkX);
+    lineage.addIdentity("a", imkA, QList<QByteArray>());
+    lineage.addFailedIdentity("broken", "Decryption failed");
+    lineage.addIdentity("b copy", imkB, QList<QByteArray>() << imkA);
+    lineage.addIdentity("d", imkD, QList<QByteArray>() << imkX);
+    lineage.addIdentity("e", QByteArray(32, 5), QList<QByteArray>());
+    lineage.cluster();
+
+    const QList<QList<int>>& clusters = lineage.getClusters();
+    QCOMPARE(clusters.size(), 3);
+    QCOMPARE(clusters[0], QList<int>() << 0 << 2 << 4);
+    QCOMPARE(clusters[1], QList<int>() << 1 << 5);
+    QCOMPARE(clusters[2], QList<int>() << 6);
+    QCOMPARE(lineage.getMembers()[3].cluster, -1);
+
+    const QList<IdentityLineage::Edge>& edges = lineage.getEdges();
+    QCOMPARE(edges.size(), 4);
+    QCOMPARE(edges[0].relation, IdentityLineage::SAME_IDENTITY);
+    QCOMPARE(edges[0].from, 0);
+    QCOMPARE(edges[0].to, 4);
+    QCOMPARE(edges[1].relation, IdentityLineage::PRECEDES);
+    QCOMPARE(edges[1].from, 2);
+    QCOMPARE(edges[1].to, 0);
+    QCOMPARE(edges[3].relation, IdentityLineage::SHARES_PREVIOUS);
+    QCOMPARE(edges[3].from, 1);
+    QCOMPARE(edges[3].to, 5);
+
+    QJsonObject json = lineage.toJson();
+    QCOMPARE(json["identities"].toArray().size(), 7);
+    QCOMPARE(json["identities"].toArray()[3].toObject()["error"].toString(), QString("Decryption failed"));
+    QCOMPARE(json["clusters"].toArray().size(), 3);
+    QCOMPARE(json["edges"].toArray()[1].toObject()["relation"].toString(), QString("precedes"));
+
+    // Identities without password or block 1 are reported as errors
+    QList<IdentityModel> identities;
+    identities.append(IdentityModel());
+    identities.append(IdentityModel());
+    QList<QByteArray> imks;
+    QList<QList<QByteArray>> previousImks;
+    QStringList errors;
+    int decryptedCount = IdentityLineage::decryptIdentities(identities, QStringList() << "" << "password",
+                                                            imks, previousImks, errors);
+    QCOMPARE(decryptedCount, 0);
+    QCOMPARE(imks.size(), 2);
+    QCOMPARE(previousImks.size(), 2);
+    QCOMPARE(errors.size(), 2);
+    QVERIFY(!errors[0].isEmpty());
+    QVERIFY(!errors[1].isEmpty());
+}
+
+void TestCryptUtil::diffItemModel()
+{
+    QVector<DiffItemModel::Row> rows;
+    DiffItemModel::Row row;
+    row.name = "Block type 1";
+    row.diffType = IdentityDiff::CHANGED;
+    row.isBlockHeader = true;
+    rows.append(row);
+    row.isBlockHeader = false;
+    row.name = "Value";
+    row.value1 = row.value2 = QString(64, 'a');
+    row.diffType = IdentityDiff::EQUAL;
+    rows.append(row);
+    row.value2 = QString(64, 'b');
+    row.diffType = IdentityDiff::CHANGED;
+    rows.append(row);
+    row.value2 = "";
+    row.diffType = IdentityDiff::ONLY_IN_FIRST;
+    rows.append(row);
+
+    DiffItemModel model;
+    model.setRows(rows);
+    QCOMPARE(model.rowCount(), 4);
+    QCOMPARE(model.getDifferenceCount(), 2);
+
+    // Navigation skips block headers and equal rows and wraps around
+    QCOMPARE(model.findDifference(-1, true), 2);
+    QCOMPARE(model.findDifference(2, true), 3);
+    QCOMPARE(model.findDifference(3, true), 2);
+    QCOMPARE(model.findDifference(-1, false), 3);
+    QCOMPARE(model.findDifference(2, false), 3);
+
+    // Values are shortened on display only
+    QModelIndex index = model.index(1, DiffItemModel::VALUE1_COLUMN);
+    QCOMPARE(model.data(index).toString().length(), 23);
+    QCOMPARE(model.data(index, Qt::ToolTipRole).toString(), QString(64, 'a'));
+    QCOMPARE(model.getMaxTextLength(DiffItemModel::VALUE1_COLUMN), 23);
+    model.setShortenValues(false);
+    QCOMPARE(model.data(index).toString(), QString(64, 'a'));
+    QCOMPARE(model.getMaxTextLength(DiffItemModel::VALUE1_COLUMN), 64);
+    QCOMPARE(model.getMaxTextLength(DiffItemModel::NAME_COLUMN), 5);
+
+    model.setRows(QVector<DiffItemModel::Row>());
+    QCOMPARE(model.findDifference(-1, true), -1);
+}
+
+class CancelingProgressSink : public ProgressSink
+{
+public:
+    QString text;
+    int maximum = 0;
+    int value = 0;
+    int cancelAtValue = -1;
+
+    void setProgressText(const QString& text) override { this->text = text; }
+    QString getProgressText() const override { return text; }
+    void setProgressMaximum(int maximum) override { this->maximum = maximum; }
+    void setProgressValue(int value) override { this->value = value; }
+    bool isCanceled() const override { return cancelAtValue >= 0 && value >= cancelAtValue; }
+};
+
+void TestCryptUtil::progressSink()
+{
+    QByteArray salt(16, 0);
+    QByteArray result, resultWithSink;
+    CancelingProgressSink sink;
+
+    // Reporting progress does not alter the result
+    QVERIFY(CryptUtil::enScryptIterations(result, "password", salt, 9, 5));
+    QVERIFY(CryptUtil::enScryptIterations(resultWithSink, "password", salt, 9, 5, &sink));
+    QCOMPARE(resultWithSink, result);
+    QCOMPARE(sink.maximum, 5);
+    QVERIFY(!sink.text.isEmpty());
+
+    // Canceling through the sink aborts the operation
+    sink.cancelAtValue = 2;
+    QVERIFY(!CryptUtil::enScryptIterations(resultWithSink, "password", salt, 9, 50, &sink));
+    QCOMPARE(sink.value, 2);
+}
+
+class RecordingProgressSink : public ThrottledProgressSink
+{
+public:
+    QString text;
+    QList<int> reportedValues;
+
+    explicit RecordingProgressSink(int intervalMs) : ThrottledProgressSink(intervalMs) {}
+
+    void setProgressText(const QString& text) override { this->text = text; }
+    QString getProgressText() const override { return text; }
+
+protected:
+    void reportProgressMaximum(int maximum) override { Q_UNUSED(maximum); }
+    void reportProgressValue(int value) override { reportedValues.append(value); }
+};
+
+void TestCryptUtil::throttledProgressSink()
+{
+    // Within the interval, only the first value after setting the
+    // maximum and the completing value are reported
+    RecordingProgressSink sink(60000);
+    sink.setProgressMaximum(10);
+    for (int i=1; i<=10; i++)
+    {
+        sink.setProgressValue(i);
+        if (i == 9) sink.flushProgress();
+    }
+    QCOMPARE(sink.reportedValues, QList<int>({ 1, 9, 10 }));
+    QCOMPARE(sink.getProgressValue(), 10);
+
+    sink.setProgressMaximum(5);
+    sink.setProgressValue(0);
+    QCOMPARE(sink.reportedValues.last(), 0);
+
+    // Canceling from another thread aborts the PBKDF operation
+    QByteArray result;
+    QByteArray salt(16, 0);
+    QVERIFY(!sink.isCanceled());
+    std::thread thread([&sink]() { sink.requestCancellation(); });
+    thread.join();
+    QVERIFY(sink.isCanceled());
+    QVERIFY(!CryptUtil::enScryptIterations(result, "password", salt, 9, 50, &sink));
+
+    // The console sink prints a single line, which is finished on request
+    std::ostringstream stream;
+    {
+        ConsoleProgressSink consoleSink(stream);
+        consoleSink.setProgressText("Running PBKDF...\nRemaining: 1s");
+        consoleSink.setProgressMaximum(4);
+        consoleSink.setProgressValue(2);
+        consoleSink.setProgressValue(3);
+    }
+    QString output = QString::fromStdString(stream.str());
+    QVERIFY(output.startsWith("\rRunning PBKDF... Remaining: 1s"));
+    QVERIFY(output.contains("Remaining: 1s 75%"));
+    QVERIFY(output.endsWith("\n"));
+    QCOMPARE(output.count('\n'), 1);
+
+    // A canceled generator skips all identities not started yet
+    IdentityGenerator generator(DeterministicRandom::createSeed("seed"), 9, 1);
+    RecordingProgressSink generatorSink(0);
+    generatorSink.requestCancellation();
+    QVector<IdentityGenerator::Identity> identities = generator.generate(5, 4, &generatorSink);
+    QCOMPARE(identities.size(), 4);
+    QCOMPARE(generatorSink.getProgressMaximum(), 4);
+    QCOMPARE(generatorSink.getProgressValue(), 0);
+    QCOMPARE(identities[3].index, 8);
+    QVERIFY(identities[3].rawIdentity.isEmpty());
+    QVERIFY(!identities[3].errorMessage.isEmpty());
+}
+
+void TestCryptUtil::allocationTracker()
+{
+    if (!AllocationTracker::isAvailable())
+        QSKIP("The allocation hook is not part of this build.");
+    if (!AllocationTracker::isCountingMalloc())
+        QSKIP("The allocation hook does not count malloc() on this platform.");
+
+    {
+        AllocationScope outerScope("outer");
+        QByteArray data(1000, 'x');
+
+        AllocationTracker::Result result = outerScope.getResult();
+        QVERIFY(result.allocations >= 1);
+        QVERIFY(result.allocatedBytes >= 1000);
+        QVERIFY(result.peakBytes >= 1000);
+
+        AllocationScope innerScope("inner");
+        QCOMPARE(innerScope.getResult().allocations, Q_INT64_C(0));
+        data.clear();
+        QCOMPARE(innerScope.getResult().peakBytes, Q_INT64_C(0));
+    }
+
+    // Allocation budgets of small operations, passing arrays
+    // by value must not cause them to be copied
+    QByteArray a(32, 'a');
+    QByteArray b(32, 'b');
+    QByteArray result;
+
+    {
+        AllocationScope scope("xorByteArrays");
+        result = CryptUtil::xorByteArrays(a, b);
+        QCOMPARE(scope.getResult().allocations, Q_INT64_C(1));
+    }
+
+    {
+        AllocationScope scope("reverseByteArray");
+        result = CryptUtil::reverseByteArray(a);
+        QCOMPARE(scope.getResult().allocations, Q_INT64_C(1));
+    }
+
+    // Budgets of the model, codec and decryption operations. These are
+    // upper bounds with some headroom, growing linearly with the size of
+    // the input. Each operation runs once before being measured, so that
+    // one-time initialization (e.g. caches) is not accounted for.
+    QTemporaryDir tempDir;
+    QVERIFY(tempDir.isValid());
+    QVERIFY(copyBlockDefinitions(QFINDTESTDATA("../../blockdef"), tempDir.path()));
+    QString previousDir = QDir::currentPath();
+    QVERIFY(QDir::setCurrent(tempDir.path()));
+    IdentityParser::setBlockDefinitionCacheEnabled(true);
+
+    IdentityGenerator generator(DeterministicRandom::createSeed("allocations"), 9, 1);
+    IdentityGenerator::Identity identity = generator.generateIdentity(0);
+    QVERIFY(identity.errorMessage.isEmpty());
+
+    IdentityParser parser;
+    IdentityModel model;
+    parser.parseIdentityData(identity.rawIdentity, &model);
+    int itemCount = 0;
+    for (const IdentityBlock& block : model.blocks) itemCount += block.items.size();
+    QVERIFY(itemCount > 0);
+
+    {
+        IdentityModel parsedModel;
+        AllocationScope scope("parseIdentityData");
+        parser.parseIdentityData(identity.rawIdentity, &parsedModel);
+        QVERIFY(scope.getResult().allocations <= 32 * itemCount);
+    }
+
+    for (int i=0; i<2; i++)
+    {
+        AllocationScope scope("getRawBytes");
+        result = model.getRawBytes();
+        if (i) QVERIFY(scope.getResult().allocations <= 8 * itemCount + 8);
+    }
+    QCOMPARE(result, identity.rawIdentity);
+
+    QByteArray identityBytes = identity.rawIdentity.mid(IdentityParser::HEADER.length());
+    QString textualIdentity;
+
+    for (int i=0; i<2; i++)
+    {
+        AllocationScope scope("base56EncodeIdentity");
+        textualIdentity = CryptUtil::base56EncodeIdentity(identityBytes);
+        if (i) QVERIFY(scope.getResult().allocations <= 8 * textualIdentity.length());
+    }
+
+    for (int i=0; i<2; i++)
+    {
+        AllocationScope scope("base56DecodeIdentity");
+        result = CryptUtil::base56DecodeIdentity(textualIdentity);
+        if (i) QVERIFY(scope.getResult().allocations <= 8 * textualIdentity.length());
+    }
+    QCOMPARE(result, identityBytes);
+
+    QByteArray key, imk, ilk, iuk;
+    QVERIFY(CryptUtil::createKeyFromPassword(key, *model.getBlock(1), identity.password));
+
+    for (int i=0; i<2; i++)
+    {
+        AllocationScope scope("decryptBlock1");
+        QVERIFY(CryptUtil::decryptBlock1(imk, ilk, model.getBlock(1), key));
+        if (i) QVERIFY(scope.getResult().allocations <= 64);
+    }
+
+    for (int i=0; i<2; i++)
+    {
+        AllocationScope scope("decryptBlock2");
+        QVERIFY(CryptUtil::decryptBlock2(iuk, model.getBlock(2), identity.rescueCode));
+        if (i) QVERIFY(scope.getResult().allocations <= 128);
+    }
+    QCOMPARE(CryptUtil::createImkFromIuk(iuk), imk);
+
+    IdentityParser::setBlockDefinitionCacheEnabled(false);
+    QVERIFY(QDir::setCurrent(previousDir));
+}
+
+void TestCryptUtil::tracer()
+{
+    QTemporaryDir tempDir;
+    QVERIFY(tempDir.isValid());
+    QString fileName = QDir(tempDir.path()).filePath("trace.json");
+
+    // Nothing is being recorded while tracing is disabled
+    QVERIFY(!Tracer::isEnabled());
+    {
+        TRACE_SPAN("disabled", "test");
+    }
+    QVERIFY(Tracer::toJson()["traceEvents"].toArray().isEmpty());
+
+    QVERIFY(Tracer::start(fileName));
+    QVERIFY(Tracer::isEnabled());
+    {
+        TRACE_SPAN("outer", "test");
+        CryptUtil::base56EncodeIdentity(QByteArray(32, 'x'));
+    }
+
+    QJsonArray events = Tracer::toJson()["traceEvents"].toArray();
+    QCOMPARE(events.size(), 2);
+    QCOMPARE(events[0].toObject()["name"].toString(), QString("CryptUtil::base56EncodeIdentity"));
+    QCOMPARE(events[1].toObject()["name"].toString(), QString("outer"));
+    QCOMPARE(events[1].toObject()["ph"].toString(), QString("X"));
+    QVERIFY(events[1].toObject()["dur"].toDouble() >= events[0].toObject()["dur"].toDouble());
+    QCOMPARE(events[1].toObject()["tid"].toInt(), events[0].toObject()["tid"].toInt());
+
+    QVERIFY(Tracer::stop());
+    QVERIFY(!Tracer::isEnabled());
+
+    QFile file(fileName);
+    QVERIFY(file.open(QIODevice::ReadOnly));
+    QJsonObject trace = QJsonDocument::fromJson(file.readAll()).object();
+    QCOMPARE(trace["traceEvents"].toArray().size(), 2);
+}
+
 QTEST_MAIN(TestCryptUtil)
@@ -35,6 +35,8 @@ private slots:
     void createSiteKeys();
     void createIndexedSecret();
     void enScryptIterations();
+    void enScryptBatch();
+    void kdfExecutor();
     void getHostLowercase();
     void makeHostLowercase();
     void enHash();
@@ -42,5 +44,25 @@ private slots:
     void base56EncodeDecodeFullFormat();
     void base56EncodeDecodeRandomInput();
     void identityKeys();
+    void keyContext();
+    void enScryptCalibration();
+    void rescueCodeRecovery();
+    void identityModelObserver();
+    void identityItemModel();
+    void identityItemModelTester();
+    void identityApplyChanges();
+    void identityHistory();
+    void identityLoader();
+    void identityConverter();
+    void identityDiff();
+    void identityJson();
+    void identityGenerator();
+    void identityService();
+    void identityLineage();
+    void diffItemModel();
+    void progressSink();
+    void throttledProgressSink();
+    void allocationTracker();
+    void tracer();
 };
 
@@ -24,33 +24,16 @@ export(first.depends)
 export(copyvectors.commands)
 QMAKE_EXTRA_TARGETS += first copyvectors
 
-DEFINES += \
-    SODIUM_STATIC
-
 # Input
 SOURCES += \
-    ../../src/cryptutil.cpp \
-    ../../src/identitymodel.cpp \
-    ../../src/identityparser.cpp \
-    ../../inc/bigint/BigInteger.cc \
-    ../../inc/bigint/BigIntegerAlgorithms.cc \
-    ../../inc/bigint/BigIntegerUtils.cc \
-    ../../inc/bigint/BigUnsigned.cc \
-    ../../inc/bigint/BigUnsignedInABase.cc \
+    ../../src/diffitemmodel.cpp \
+    ../../src/identityitemmodel.cpp \
     ../testutils.cpp \
     testcryptutil.cpp
 
 HEADERS += \
-    ../../src/cryptutil.h \
-    ../../src/identitymodel.h \
-    ../../src/identityparser.h \
-    ../../inc/bigint/BigInteger.hh \
-    ../../inc/bigint/BigIntegerAlgorithms.hh \
-    ../../inc/bigint/BigIntegerLibrary.hh \
-    ../../inc/bigint/BigIntegerUtils.hh \
-    ../../inc/bigint/BigUnsigned.hh \
-    ../../inc/bigint/BigUnsignedInABase.hh \
-    ../../inc/bigint/NumberlikeArray.hh \
+    ../../src/diffitemmodel.h \
+    ../../src/identityitemmodel.h \
     ../testutils.h \
     testcryptutil.h
 
@@ -66,12 +49,8 @@ DISTFILES += \
     vectors/identity-vectors.txt \
     vectors/ins-vectors.txt
 
-win32:CONFIG(release, debug|release): LIBS += -L$$PWD/../../lib/sodium/lib/ -llibsodium
-else:win32:CONFIG(debug, debug|release): LIBS += -L$$PWD/../../lib/sodium/lib/ -llibsodiumd
-else:unix: LIBS += -L$$PWD/../../lib/sodium/lib/ -lsodium
-
-INCLUDEPATH += $$PWD/../../lib/sodium/include
-DEPENDPATH += $$PWD/../../lib/sodium/include
+# Count heap allocations for the allocation budget tests. Only the
+# glibc hook sees Qt's container allocations, elsewhere they are skipped.
+linux: CONFIG += idtool_alloc_hook
 
-QMAKE_LFLAGS_WINDOWS += /NODEFAULTLIB:LIBCMTD \
-    /NODEFAULTLIB:LIBCMT
+include(../../core/idtoolcore.pri)
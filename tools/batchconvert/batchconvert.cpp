@@ -0,0 +1,312 @@
+/*
+ * This file is part of the "IdTool" utility app.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Alexander Hauser
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <QtCore>
+#include <iostream>
+#include "../../src/identityconverter.h"
+#include "../../src/identityloader.h"
+
+/*
+ * Converts batches of identities between the binary ("sqrldata"),
+ * base64 ("SQRLDATA") and textual (base56) formats. The format of each
+ * input identity is detected automatically.
+ *
+ * Usage: batchconvert [options] <file or directory>...
+ *
+ * Directories are searched for identity files. With --packed, input
+ * files are treated as packed corpora containing one base64 or textual
+ * identity per line (empty lines and lines starting with '#' are
+ * ignored). The converted identities are either written to separate
+ * files within the --output directory, or, with --pack, one per line
+ * into a single packed corpus (--output file or stdout).
+ *
+ * Identities are converted in batches of --batch-size on all cores,
+ * so memory usage doesn't depend on the size of the corpus. The output
+ * keeps the order of the input. The throughput of the read, decode,
+ * encode and write stages is reported on stderr, and optionally
+ * written as JSON to the --stats file.
+ *
+ * Exit codes: 0 on success, 1 on usage or I/O errors, and 2 if any
+ * identity could not be converted.
+ */
+
+struct OutputState
+{
+    IdentityConverter::Format format;
+    bool pack = false;
+    QFile packFile;
+    QDir outputDir;
+    QSet<QString> usedNames;
+    int convertedCount = 0;
+    int failedCount = 0;
+};
+
+static QString getOutputFileName(OutputState& state, QString name)
+{
+    // "corpus.txt:12" becomes "corpus_12", "id.sqrl" becomes "id"
+    QString baseName = QFileInfo(name).completeBaseName();
+    int separator = name.lastIndexOf(':');
+    if (separator > 0 && !name.mid(separator + 1).contains('/'))
+        baseName = QFileInfo(name.left(separator)).completeBaseName() + "_" + name.mid(separator + 1);
+
+    QString extension = state.format == IdentityConverter::TEXT ? ".txt" : ".sqrl";
+    QString fileName = baseName + extension;
+    for (int i=2; state.usedNames.contains(fileName); i++)
+        fileName = baseName + "_" + QString::number(i) + extension;
+
+    state.usedNames.insert(fileName);
+    return state.outputDir.filePath(fileName);
+}
+
+static bool writeResults(IdentityConverter& converter, QVector<IdentityConverter::Job>& jobs,
+                         OutputState& state)
+{
+    QElapsedTimer timer;
+    timer.start();
+    qint64 count = 0, bytes = 0;
+
+    for (IdentityConverter::Job& job : jobs)
+    {
+        if (!job.errorMessage.isEmpty())
+        {
+            std::cerr << job.name.toStdString() << ": " << job.errorMessage.toStdString() << "\n";
+            state.failedCount++;
+            continue;
+        }
+
+        if (state.format != IdentityConverter::BINARY) job.output.append('\n');
+
+        if (state.pack)
+        {
+            if (state.packFile.write(job.output) != job.output.size()) return false;
+        }
+        else
+        {
+            QFile file(getOutputFileName(state, job.name));
+            if (!file.open(QIODevice::WriteOnly) || file.write(job.output) != job.output.size())
+            {
+                std::cerr << file.fileName().toStdString() << ": Error writing the file!\n";
+                return false;
+            }
+        }
+
+        count++;
+        bytes += job.output.size();
+        state.convertedCount++;
+    }
+
+    converter.recordStage(IdentityConverter::WRITE_STAGE, count, bytes, timer.nsecsElapsed());
+    return true;
+}
+
+static bool convertBatch(IdentityConverter& converter, QVector<IdentityConverter::Job>& jobs,
+                         OutputState& state)
+{
+    converter.convert(jobs);
+    bool ok = writeResults(converter, jobs, state);
+    jobs.clear();
+    return ok;
+}
+
+static void printStats(const QJsonObject& stats)
+{
+    std::cerr << QString("%1 ms, %2 identities/s on %3 threads\n")
+                 .arg(stats["elapsed_ms"].toDouble(), 0, 'f', 1)
+                 .arg(stats["items_per_second"].toDouble(), 0, 'f', 0)
+                 .arg(stats["threads"].toInt()).toStdString();
+
+    for (const QJsonValue& value : stats["stages"].toArray())
+    {
+        QJsonObject stage = value.toObject();
+        std::cerr << QString("  %1 %2 identities, %3 bytes, %4 ms busy, %5 identities/s, %6 MiB/s per thread\n")
+                     .arg(stage["stage"].toString(), -7)
+                     .arg(stage["count"].toInt())
+                     .arg(stage["bytes"].toDouble(), 0, 'f', 0)
+                     .arg(stage["busy_ms"].toDouble(), 0, 'f', 1)
+                     .arg(stage["items_per_second"].toDouble(), 0, 'f', 0)
+                     .arg(stage["mib_per_second"].toDouble(), 0, 'f', 2).toStdString();
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("IdTool");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Converts SQRL identities between the binary, base64 and textual formats.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("paths", "Identity files, directories or packed corpora (with --packed).", "<paths...>");
+    QCommandLineOption formatOption({"f", "format"}, "Output format: binary, base64 or text.", "format", "base64");
+    QCommandLineOption outputOption({"o", "output"}, "Output directory, or output file with --pack (default: stdout).", "path");
+    QCommandLineOption packedOption("packed", "Input files are packed corpora with one identity per line.");
+    QCommandLineOption packOption("pack", "Write one identity per line into a single output file.");
+    QCommandLineOption threadsOption({"j", "threads"}, "Number of worker threads (default: one per core).", "count", "0");
+    QCommandLineOption batchSizeOption({"b", "batch-size"}, "Number of identities converted at once.", "count", "4096");
+    QCommandLineOption statsOption({"s", "stats"}, "Write the stage statistics as JSON to this file.", "file");
+    parser.addOptions({ formatOption, outputOption, packedOption, packOption, threadsOption,
+                        batchSizeOption, statsOption });
+    parser.process(app);
+
+    QStringList args = parser.positionalArguments();
+    if (args.isEmpty()) parser.showHelp(1);
+
+    OutputState state;
+    state.format = IdentityConverter::formatFromString(parser.value(formatOption));
+    state.pack = parser.isSet(packOption);
+    int batchSize = qMax(1, parser.value(batchSizeOption).toInt());
+
+    if (state.format == IdentityConverter::UNKNOWN_FORMAT)
+    {
+        std::cerr << "Unknown format: " << parser.value(formatOption).toStdString() << "\n";
+        return 1;
+    }
+
+    if (state.pack)
+    {
+        if (state.format == IdentityConverter::BINARY)
+        {
+            std::cerr << "Binary identities cannot be packed, use base64 or text!\n";
+            return 1;
+        }
+
+        bool ok = false;
+        if (!parser.isSet(outputOption))
+        {
+            ok = state.packFile.open(stdout, QIODevice::WriteOnly);
+        }
+        else
+        {
+            state.packFile.setFileName(parser.value(outputOption));
+            ok = state.packFile.open(QIODevice::WriteOnly);
+        }
+
+        if (!ok)
+        {
+            std::cerr << "Error opening the output file!\n";
+            return 1;
+        }
+    }
+    else
+    {
+        if (!parser.isSet(outputOption) || !QDir().mkpath(parser.value(outputOption)))
+        {
+            std::cerr << "An existing or creatable --output directory is required!\n";
+            return 1;
+        }
+        state.outputDir = QDir(parser.value(outputOption));
+    }
+
+    QStringList fileNames = parser.isSet(packedOption) ? args : IdentityLoader::collectIdentityFiles(args);
+
+    IdentityConverter converter(state.format);
+    converter.setMaxThreadCount(parser.value(threadsOption).toInt());
+
+    QElapsedTimer totalTimer;
+    totalTimer.start();
+    QVector<IdentityConverter::Job> jobs;
+    jobs.reserve(batchSize);
+
+    for (const QString& fileName : fileNames)
+    {
+        if (!parser.isSet(packedOption))
+        {
+            IdentityConverter::Job job;
+            job.name = fileName;
+            job.fileName = fileName;
+            jobs.append(job);
+
+            if (jobs.size() >= batchSize && !convertBatch(converter, jobs, state)) return 1;
+            continue;
+        }
+
+        QFile file(fileName);
+        if (!file.open(QIODevice::ReadOnly))
+        {
+            std::cerr << fileName.toStdString() << ": Error opening the file!\n";
+            return 1;
+        }
+
+        // Reading packed corpora happens on this thread, so its time
+        // is recorded here instead of by the converter
+        QElapsedTimer readTimer;
+        readTimer.start();
+        qint64 readCount = 0, readBytes = 0;
+        int lineNumber = 0;
+
+        for (;;)
+        {
+            QByteArray line = file.readLine();
+            if (line.isEmpty()) break;
+
+            lineNumber++;
+            readBytes += line.size();
+            line = line.trimmed();
+            if (line.isEmpty() || line.startsWith('#')) continue;
+
+            IdentityConverter::Job job;
+            job.name = fileName + ":" + QString::number(lineNumber);
+            job.input = line;
+            jobs.append(job);
+            readCount++;
+
+            if (jobs.size() >= batchSize)
+            {
+                converter.recordStage(IdentityConverter::READ_STAGE, readCount, readBytes,
+                                      readTimer.nsecsElapsed());
+                if (!convertBatch(converter, jobs, state)) return 1;
+
+                readCount = readBytes = 0;
+                readTimer.restart();
+            }
+        }
+
+        converter.recordStage(IdentityConverter::READ_STAGE, readCount, readBytes,
+                              readTimer.nsecsElapsed());
+    }
+
+    if (!convertBatch(converter, jobs, state)) return 1;
+    state.packFile.close();
+
+    std::cerr << state.convertedCount << " identities converted, " << state.failedCount << " failed\n";
+
+    QJsonObject stats = converter.getStatsJson(totalTimer.nsecsElapsed());
+    printStats(stats);
+
+    if (parser.isSet(statsOption))
+    {
+        QFile statsFile(parser.value(statsOption));
+        QByteArray json = QJsonDocument(stats).toJson();
+        if (!statsFile.open(QIODevice::WriteOnly) || statsFile.write(json) != json.size())
+        {
+            std::cerr << "Error writing the stats file!\n";
+            return 1;
+        }
+    }
+
+    return state.failedCount > 0 ? 2 : 0;
+}
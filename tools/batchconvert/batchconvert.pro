@@ -0,0 +1,30 @@
+######################################################################
+# Batch identity format converter
+######################################################################
+
+QT = core
+
+CONFIG += console 
+
+TEMPLATE = app
+CONFIG += c++11
+TARGET = batchconvert
+INCLUDEPATH += .
+
+# You can make your code fail to compile if you use deprecated APIs.
+# In order to do so, uncomment the following line.
+# Please consult the documentation of the deprecated API in order to know
+# how to port your code away from it.
+# You can also select to disable deprecated APIs only up to a certain version of Qt.
+#DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
+
+# Input
+SOURCES += \
+    batchconvert.cpp
+
+DISTFILES += \
+    $$PWD/../../lib/sodium/lib/libsodium.lib \
+    $$PWD/../../lib/sodium/lib/libsodium.so \
+    $$PWD/../../lib/sodium/lib/libsodiumd.lib
+
+include(../../core/idtoolcore.pri)
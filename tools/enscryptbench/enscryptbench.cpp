@@ -0,0 +1,81 @@
+/*
+ * This file is part of the "IdTool" utility app.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Alexander Hauser
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <QtCore>
+#include <iostream>
+#include "../../src/enscryptcalibration.h"
+#include "../../src/scryptkernel.h"
+
+/*
+ * Measures the EnScrypt throughput of the current machine for a range of
+ * log-n-factors and prints a table showing the iteration counts needed for
+ * hitting common unlock times.
+ *
+ * Usage: enscryptbench [minLogN] [maxLogN] [milliseconds per measurement]
+ */
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("IdTool");
+
+    QStringList args = app.arguments();
+    int minLogNFactor = args.length() > 1 ? args.at(1).toInt() : 9;
+    int maxLogNFactor = args.length() > 2 ? args.at(2).toInt() : 12;
+    int milliseconds = args.length() > 3 ? args.at(3).toInt() :
+                                           EnScryptCalibration::DEFAULT_MEASURE_MILLISECONDS;
+
+    if (minLogNFactor < EnScryptCalibration::MIN_LOGN_FACTOR ||
+            maxLogNFactor > EnScryptCalibration::MAX_LOGN_FACTOR ||
+            minLogNFactor > maxLogNFactor || milliseconds < 1)
+    {
+        std::cerr << "Usage: enscryptbench [minLogN] [maxLogN] [milliseconds]\n";
+        return 1;
+    }
+
+    QList<int> logNFactors;
+    for (int i=minLogNFactor; i<=maxLogNFactor; i++) logNFactors.append(i);
+
+    std::cout << "Batch kernel: "
+              << ScryptKernel::getImplementationName(ScryptKernel::AUTO).toStdString()
+              << " (" << ScryptKernel::getLaneCount(ScryptKernel::AUTO) << " lanes)\n";
+    std::cout << "Calibrating EnScrypt (r=256, p=1)...\n";
+    EnScryptCalibration::calibrate(logNFactors, milliseconds);
+
+    std::cout << EnScryptCalibration::createThroughputTable(logNFactors).toStdString();
+    std::cout << "Results cached in " <<
+                 EnScryptCalibration::getCacheFileName().toStdString() << "\n";
+
+    int logNFactor = 0, iterationCount = 0;
+    if (EnScryptCalibration::recommendParameters(logNFactor, iterationCount, 5,
+                                                 minLogNFactor, maxLogNFactor))
+    {
+        std::cout << "Recommended for a 5 s unlock time: logN " << logNFactor
+                  << ", " << iterationCount << " iterations\n";
+    }
+
+    return 0;
+}
@@ -0,0 +1,283 @@
+/*
+ * This file is part of the "IdTool" utility app.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Alexander Hauser
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <QtCore>
+#include <iostream>
+#include "../../src/cryptutil.h"
+#include "../../src/identityconverter.h"
+#include "../../src/identitygenerator.h"
+#include "../../src/identityparser.h"
+#include "../../src/kdfexecutor.h"
+#include "../../src/scryptkernel.h"
+
+/*
+ * Generates reproducible SQRL identities in bulk, e.g. for test corpora.
+ *
+ * Usage: identitygen [options] -n <count> -o <path>
+ *
+ * All random values are derived from the --seed phrase, and EnScrypt
+ * runs a fixed number of --iterations with a fixed --log-n factor
+ * instead of running for five seconds per block. The --log-n factor is
+ * lowered (with a warning) if the scrypt scratch memory of one batch of
+ * EnScrypt operations would exceed the memory budget of the KDF executor. The same options
+ * therefore always produce the same identities, and low iteration
+ * counts produce large corpora quickly. Identity n only depends on the
+ * seed and parameters, so a corpus can be extended using --start.
+ *
+ * Each identity gets blocks 1 and 2, plus a block 3 with previous IUKs
+ * if --previous-iuks is given. Identities are either written to separate
+ * files within the --output directory, or, with --pack, one per line
+ * into a single packed corpus. The password and rescue code of every
+ * identity are written to a JSON Lines --manifest (by default
+ * "manifest.jsonl" within the output directory).
+ *
+ * The generated identities are only as secret as the seed and must never
+ * be used as real identities.
+ *
+ * Exit codes: 0 on success, 1 on usage or I/O errors, and 2 if any
+ * identity could not be generated.
+ */
+
+struct OutputState
+{
+    IdentityConverter::Format format;
+    bool pack = false;
+    QFile packFile;
+    QFile manifestFile;
+    QDir outputDir;
+    int fieldWidth = 1;
+    int lineNumber = 0;
+    int generatedCount = 0;
+    int failedCount = 0;
+};
+
+static bool writeIdentities(const QVector<IdentityGenerator::Identity>& identities,
+                            OutputState& state)
+{
+    for (const IdentityGenerator::Identity& identity : identities)
+    {
+        if (!identity.errorMessage.isEmpty())
+        {
+            std::cerr << "Identity " << identity.index << ": "
+                      << identity.errorMessage.toStdString() << "\n";
+            state.failedCount++;
+            continue;
+        }
+
+        QByteArray output = IdentityConverter::encode(identity.rawIdentity, state.format);
+        QString name;
+
+        if (state.pack)
+        {
+            output.append('\n');
+            if (state.packFile.write(output) != output.size()) return false;
+            name = QString::number(++state.lineNumber);
+        }
+        else
+        {
+            if (state.format != IdentityConverter::BINARY) output.append('\n');
+
+            name = QString("identity-%1%2")
+                    .arg(identity.index, state.fieldWidth, 10, QChar('0'))
+                    .arg(state.format == IdentityConverter::TEXT ? ".txt" : ".sqrl");
+
+            QFile file(state.outputDir.filePath(name));
+            if (!file.open(QIODevice::WriteOnly) || file.write(output) != output.size())
+            {
+                std::cerr << file.fileName().toStdString() << ": Error writing the file!\n";
+                return false;
+            }
+        }
+
+        QJsonObject entry;
+        entry["index"] = identity.index;
+        entry["name"] = name;
+        entry["password"] = identity.password;
+        entry["rescue_code"] = CryptUtil::formatRescueCode(identity.rescueCode);
+
+        QByteArray line = QJsonDocument(entry).toJson(QJsonDocument::Compact) + '\n';
+        if (state.manifestFile.write(line) != line.size())
+        {
+            std::cerr << "Error writing the manifest file!\n";
+            return false;
+        }
+
+        state.generatedCount++;
+    }
+
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("IdTool");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Generates reproducible SQRL identities for test corpora.");
+    parser.addHelpOption();
+    QCommandLineOption countOption({"n", "count"}, "Number of identities to generate.", "count", "1");
+    QCommandLineOption startOption("start", "Index of the first identity.", "index", "0");
+    QCommandLineOption seedOption("seed", "Seed phrase all random values are derived from.", "phrase", "idtool");
+    QCommandLineOption logNOption({"l", "log-n"}, "EnScrypt log-n-factor.", "factor", "9");
+    QCommandLineOption iterationsOption({"i", "iterations"}, "EnScrypt iterations per block.", "count", "1");
+    QCommandLineOption passwordOption({"p", "password"}, "Use this password instead of random passwords.", "password");
+    QCommandLineOption previousIuksOption("previous-iuks", "Add a block 3 with this many previous IUKs (0-4).", "count", "0");
+    QCommandLineOption formatOption({"f", "format"}, "Output format: binary, base64 or text.", "format", "binary");
+    QCommandLineOption outputOption({"o", "output"}, "Output directory, or output file with --pack.", "path");
+    QCommandLineOption packOption("pack", "Write one identity per line into a single output file.");
+    QCommandLineOption manifestOption({"m", "manifest"}, "Manifest file (default: manifest.jsonl in the output directory).", "file");
+    QCommandLineOption threadsOption({"j", "threads"}, "Number of worker threads (default: one per core).", "count", "0");
+    QCommandLineOption batchSizeOption({"b", "batch-size"}, "Number of identities generated at once.", "count", "256");
+    parser.addOptions({ countOption, startOption, seedOption, logNOption, iterationsOption,
+                        passwordOption, previousIuksOption, formatOption, outputOption, packOption,
+                        manifestOption, threadsOption, batchSizeOption });
+    parser.process(app);
+
+    OutputState state;
+    state.format = IdentityConverter::formatFromString(parser.value(formatOption));
+    state.pack = parser.isSet(packOption);
+    int count = parser.value(countOption).toInt();
+    int start = parser.value(startOption).toInt();
+    int logNFactor = parser.value(logNOption).toInt();
+    int iterationCount = parser.value(iterationsOption).toInt();
+    int previousIukCount = parser.value(previousIuksOption).toInt();
+    int batchSize = qMax(1, parser.value(batchSizeOption).toInt());
+
+    if (count < 1 || start < 0 || logNFactor < 1 || logNFactor > 20 || iterationCount < 1 ||
+            previousIukCount < 0 || previousIukCount > IdentityGenerator::MAX_PREVIOUS_IUKS)
+    {
+        std::cerr << "Invalid count, start, log-n, iterations or previous IUKs!\n";
+        return 1;
+    }
+
+    if (state.format == IdentityConverter::UNKNOWN_FORMAT)
+    {
+        std::cerr << "Unknown format: " << parser.value(formatOption).toStdString() << "\n";
+        return 1;
+    }
+
+    if (!parser.isSet(outputOption))
+    {
+        std::cerr << "An --output directory or file is required!\n";
+        return 1;
+    }
+
+    QString manifestFileName = parser.value(manifestOption);
+
+    if (state.pack)
+    {
+        if (state.format == IdentityConverter::BINARY)
+        {
+            std::cerr << "Binary identities cannot be packed, use base64 or text!\n";
+            return 1;
+        }
+
+        if (manifestFileName.isEmpty()) manifestFileName = parser.value(outputOption) + ".manifest.jsonl";
+
+        state.packFile.setFileName(parser.value(outputOption));
+        if (!state.packFile.open(QIODevice::WriteOnly))
+        {
+            std::cerr << "Error opening the output file!\n";
+            return 1;
+        }
+    }
+    else
+    {
+        if (!QDir().mkpath(parser.value(outputOption)))
+        {
+            std::cerr << "Error creating the output directory!\n";
+            return 1;
+        }
+
+        state.outputDir = QDir(parser.value(outputOption));
+        state.fieldWidth = QString::number(start + count - 1).length();
+        if (manifestFileName.isEmpty()) manifestFileName = state.outputDir.filePath("manifest.jsonl");
+    }
+
+    state.manifestFile.setFileName(manifestFileName);
+    if (!state.manifestFile.open(QIODevice::WriteOnly))
+    {
+        std::cerr << "Error opening the manifest file!\n";
+        return 1;
+    }
+
+    // Block definitions are looked up relative to the working
+    // directory, so fall back to the application directory if needed
+    if (!IdentityParser::hasBlockDefinition(2))
+        QDir::setCurrent(QCoreApplication::applicationDirPath());
+
+    // Bulk generation must not hold up interactive KDF jobs
+    KdfExecutor::setDefaultPriority(KdfExecutor::BATCH);
+
+    // Every batch job needs the scrypt scratch memory of all kernel lanes
+    // at once, which must fit into the memory budget of the KDF executor
+    ScryptKernel::Implementation implementation = ScryptKernel::detectImplementation();
+    qint64 memoryBudget = KdfExecutor::getInstance()->getMemoryBudget();
+    int maxLogNFactor = logNFactor;
+
+    while (maxLogNFactor > 1 &&
+           ScryptKernel::getScratchMemorySize(implementation, maxLogNFactor) > memoryBudget)
+    {
+        maxLogNFactor--;
+    }
+
+    if (maxLogNFactor < logNFactor)
+    {
+        std::cerr << "Warning: --log-n " << logNFactor << " exceeds the KDF memory budget, using "
+                  << maxLogNFactor << " instead!\n";
+        logNFactor = maxLogNFactor;
+    }
+
+    IdentityGenerator generator(DeterministicRandom::createSeed(parser.value(seedOption).toUtf8()),
+                                logNFactor, iterationCount);
+    generator.setPreviousIukCount(previousIukCount);
+    generator.setPassword(parser.value(passwordOption));
+    generator.setMaxThreadCount(parser.value(threadsOption).toInt());
+
+    QElapsedTimer timer;
+    timer.start();
+
+    for (int i=0; i<count; i+=batchSize)
+    {
+        QVector<IdentityGenerator::Identity> identities =
+                generator.generate(start + i, qMin(batchSize, count - i));
+        if (!writeIdentities(identities, state)) return 1;
+
+        std::cerr << "\r" << state.generatedCount + state.failedCount << "/" << count << std::flush;
+    }
+
+    state.packFile.close();
+    state.manifestFile.close();
+
+    double seconds = timer.nsecsElapsed() / 1e9;
+    std::cerr << "\r" << state.generatedCount << " identities generated, " << state.failedCount
+              << " failed, " << QString::number(seconds > 0 ? state.generatedCount / seconds : 0, 'f', 1).toStdString()
+              << " identities/s on " << generator.getMaxThreadCount() << " threads\n";
+
+    return state.failedCount > 0 ? 2 : 0;
+}
@@ -0,0 +1,37 @@
+######################################################################
+# Deterministic bulk identity generator
+######################################################################
+
+QT = core
+
+CONFIG += console 
+
+TEMPLATE = app
+CONFIG += c++11
+TARGET = identitygen
+INCLUDEPATH += .
+
+# You can make your code fail to compile if you use deprecated APIs.
+# In order to do so, uncomment the following line.
+# Please consult the documentation of the deprecated API in order to know
+# how to port your code away from it.
+# You can also select to disable deprecated APIs only up to a certain version of Qt.
+#DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
+
+# Copy the "blockdef" directory to the build directory
+copyblockdef.commands = $(COPY_DIR) \"$$shell_path($$PWD\\..\\..\\blockdef)\" \"$$shell_path($$OUT_PWD\\blockdef)\"
+first.depends = $(first) copyblockdef
+export(first.depends)
+export(copyblockdef.commands)
+QMAKE_EXTRA_TARGETS += first copyblockdef
+
+# Input
+SOURCES += \
+    identitygen.cpp
+
+DISTFILES += \
+    $$PWD/../../lib/sodium/lib/libsodium.lib \
+    $$PWD/../../lib/sodium/lib/libsodium.so \
+    $$PWD/../../lib/sodium/lib/libsodiumd.lib
+
+include(../../core/idtoolcore.pri)
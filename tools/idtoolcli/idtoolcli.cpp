@@ -0,0 +1,346 @@
+/*
+ * This file is part of the "IdTool" utility app.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Alexander Hauser
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <QtCore>
+#include <iostream>
+#include "../../src/consoleprogresssink.h"
+#include "../../src/cryptutil.h"
+#include "../../src/identityjson.h"
+#include "../../src/identityparser.h"
+#include "../../src/tracer.h"
+
+/*
+ * Headless command line interface to the identity parser, model and
+ * crypto routines, for scripted use (e.g. within CI pipelines). It only
+ * depends on QtCore and libsodium, so it starts up quickly.
+ *
+ * Usage: idtool-cli <command> [options] [identity file]
+ *
+ * The identity is read from the given file, or from stdin if no file
+ * (or "-") is given. It can be in binary ("sqrldata"), base64
+ * ("SQRLDATA"), textual (base56) or canonical JSON format (as written
+ * by "dump"). Results are written as a single line of JSON, except for
+ * "convert", which writes the converted identity. Errors are reported
+ * on stderr.
+ *
+ * With --trace (or the IDTOOL_TRACE environment variable), the time
+ * spent within the parser and crypto routines is written to a Chrome
+ * trace-event file.
+ *
+ * With --progress, the progress of the PBKDF operations needed for
+ * decrypting blocks 1 and 2 is shown on stderr.
+ *
+ * Exit codes: 0 on success, 1 on usage, input or parse errors, and
+ * 2 if a check failed or decryption was unsuccessful.
+ */
+
+static const int EXIT_ERROR = 1;
+static const int EXIT_CHECK_FAILED = 2;
+
+static int fail(int exitCode, QString message)
+{
+    std::cerr << message.toStdString() << "\n";
+    return exitCode;
+}
+
+static bool readInput(QString fileName, QByteArray& data)
+{
+    QFile file(fileName);
+    bool ok = fileName.isEmpty() || fileName == "-" ?
+                file.open(stdin, QIODevice::ReadOnly) : file.open(QIODevice::ReadOnly);
+    if (!ok) return false;
+
+    data = file.readAll();
+    return true;
+}
+
+static bool writeOutput(QString fileName, const QByteArray& data)
+{
+    QFile file(fileName);
+    bool ok = fileName.isEmpty() || fileName == "-" ?
+                file.open(stdout, QIODevice::WriteOnly) : file.open(QIODevice::WriteOnly);
+    if (!ok) return false;
+
+    return file.write(data) == data.size();
+}
+
+static bool writeJson(QString fileName, const QJsonObject& json)
+{
+    return writeOutput(fileName, QJsonDocument(json).toJson(QJsonDocument::Compact) + "\n");
+}
+
+static void parseIdentity(QByteArray data, IdentityModel& identity)
+{
+    IdentityParser parser;
+
+    if (data.startsWith(IdentityParser::HEADER.toLatin1()) ||
+            data.startsWith(IdentityParser::HEADER_BASE64.toLatin1()))
+    {
+        parser.parseIdentityData(data, &identity);
+        return;
+    }
+
+    if (data.trimmed().startsWith('{'))
+    {
+        QJsonParseError parseError;
+        QJsonDocument doc = QJsonDocument::fromJson(data, &parseError);
+        if (parseError.error != QJsonParseError::NoError || !doc.isObject())
+            throw std::runtime_error("Invalid JSON identity!");
+
+        identity = IdentityJson::fromJson(doc.object());
+        return;
+    }
+
+    // Anything else is considered to be a textual identity
+    QByteArray identityBytes = CryptUtil::base56DecodeIdentity(QString::fromUtf8(data));
+    if (identityBytes.isEmpty())
+        throw std::runtime_error("Unrecognized identity format or invalid textual identity!");
+
+    parser.parseIdentityData(IdentityParser::HEADER.toLatin1() + identityBytes, &identity);
+}
+
+static bool decryptImk(IdentityModel& identity, QString password, QByteArray& imk, QByteArray& ilk,
+                       ConsoleProgressSink* pProgressSink)
+{
+    IdentityBlock* pBlock1 = identity.getBlock(1);
+    if (pBlock1 == nullptr) return false;
+
+    if (pProgressSink != nullptr) pProgressSink->setProgressText("Decrypting block 1...");
+
+    QByteArray key;
+    bool ok = CryptUtil::createKeyFromPassword(key, *pBlock1, password, pProgressSink);
+    if (pProgressSink != nullptr) pProgressSink->finish();
+    if (!ok) return false;
+
+    imk = QByteArray(32, 0);
+    ilk = QByteArray(32, 0);
+    return CryptUtil::decryptBlock1(imk, ilk, pBlock1, key);
+}
+
+static bool decryptIuk(IdentityModel& identity, QString rescueCode, QByteArray& iuk,
+                       ConsoleProgressSink* pProgressSink)
+{
+    IdentityBlock* pBlock2 = identity.getBlock(2);
+    if (pBlock2 == nullptr) return false;
+
+    if (pProgressSink != nullptr) pProgressSink->setProgressText("Decrypting block 2...");
+
+    iuk = QByteArray(32, 0);
+    bool ok = CryptUtil::decryptBlock2(iuk, pBlock2, CryptUtil::stripWhitespace(rescueCode).remove('-'),
+                                       pProgressSink);
+    if (pProgressSink != nullptr) pProgressSink->finish();
+    return ok;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("IdTool");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(
+                "Headless SQRL identity tool.\n\n"
+                "Commands:\n"
+                "  dump         Writes the identity in canonical JSON format.\n"
+                "  convert      Converts the identity to --format.\n"
+                "  verify-text  Verifies the check characters of a textual identity.\n"
+                "  check        Checks whether blocks 1 and 2 belong to the same identity\n"
+                "               (requires --password and --rescue-code).\n"
+                "  decrypt      Decrypts the identity keys (using --password and/or --rescue-code).\n"
+                "  site-keys    Derives the site-specific key pair for --domain (requires --password).");
+    parser.addHelpOption();
+    parser.addPositionalArgument("command", "The command to run.");
+    parser.addPositionalArgument("file", "The identity file (default: stdin).", "[file]");
+    QCommandLineOption outputOption({"o", "output"}, "Output file (default: stdout).", "file");
+    QCommandLineOption formatOption({"f", "format"}, "Output format of \"convert\": binary, base64, text or json.", "format", "binary");
+    QCommandLineOption passwordOption({"p", "password"}, "The identity's password.", "password");
+    QCommandLineOption rescueCodeOption({"r", "rescue-code"}, "The identity's rescue code.", "code");
+    QCommandLineOption domainOption({"d", "domain"}, "The domain for \"site-keys\".", "domain");
+    QCommandLineOption altIdOption({"a", "alt-id"}, "The alternate id for \"site-keys\".", "altid");
+    QCommandLineOption traceOption("trace", "Write a Chrome trace-event file (like setting IDTOOL_TRACE).", "file");
+    QCommandLineOption progressOption("progress", "Show the progress of decryptions on stderr.");
+    parser.addOptions({ outputOption, formatOption, passwordOption, rescueCodeOption,
+                        domainOption, altIdOption, traceOption, progressOption });
+    parser.process(app);
+
+    if (parser.isSet(traceOption)) Tracer::start(parser.value(traceOption));
+
+    QStringList args = parser.positionalArguments();
+    if (args.isEmpty() || args.count() > 2) parser.showHelp(EXIT_ERROR);
+
+    QString command = args.at(0);
+    QString output = parser.value(outputOption);
+
+    QByteArray data;
+    if (!readInput(args.value(1), data)) return fail(EXIT_ERROR, "Error reading the input!");
+
+    if (command == "verify-text")
+    {
+        QJsonObject json;
+        json["valid"] = CryptUtil::verifyTextualIdentity(QString::fromUtf8(data));
+        if (!writeJson(output, json)) return fail(EXIT_ERROR, "Error writing the output!");
+        return json["valid"].toBool() ? 0 : EXIT_CHECK_FAILED;
+    }
+
+    // Block definitions are being looked up relative to the current
+    // directory, so fall back to the application directory if needed
+    if (!IdentityParser::hasBlockDefinition(2))
+        QDir::setCurrent(QCoreApplication::applicationDirPath());
+
+    QScopedPointer<ConsoleProgressSink> pProgressSink;
+    if (parser.isSet(progressOption)) pProgressSink.reset(new ConsoleProgressSink());
+
+    IdentityModel identity;
+
+    try
+    {
+        parseIdentity(data, identity);
+    }
+    catch (std::exception& e)
+    {
+        return fail(EXIT_ERROR, e.what());
+    }
+
+    if (command == "dump")
+    {
+        if (!writeJson(output, IdentityJson::toJson(identity))) return fail(EXIT_ERROR, "Error writing the output!");
+    }
+    else if (command == "convert")
+    {
+        QString format = parser.value(formatOption);
+        QByteArray rawBytes = identity.getRawBytes();
+        QByteArray result;
+
+        if (format == "binary")
+        {
+            result = rawBytes;
+        }
+        else if (format == "base64")
+        {
+            result = IdentityParser::HEADER_BASE64.toLatin1() +
+                    rawBytes.mid(IdentityParser::HEADER.length()).toBase64(
+                        QByteArray::Base64UrlEncoding | QByteArray::OmitTrailingEquals) + "\n";
+        }
+        else if (format == "text")
+        {
+            result = identity.getTextualVersion().toLatin1();
+            if (result.isEmpty()) return fail(EXIT_ERROR, "The identity does not contain a type 2 block!");
+            result += "\n";
+        }
+        else if (format == "json")
+        {
+            result = IdentityJson::toJsonLine(identity);
+        }
+        else
+        {
+            return fail(EXIT_ERROR, "Unknown format: " + format);
+        }
+
+        if (!writeOutput(output, result)) return fail(EXIT_ERROR, "Error writing the output!");
+    }
+    else if (command == "check")
+    {
+        if (!parser.isSet(passwordOption) || !parser.isSet(rescueCodeOption))
+            return fail(EXIT_ERROR, "Both --password and --rescue-code are required!");
+
+        QByteArray imk, ilk, iuk;
+        if (!decryptImk(identity, parser.value(passwordOption), imk, ilk, pProgressSink.data()))
+            return fail(EXIT_CHECK_FAILED, "Decryption of block 1 failed! Wrong password?");
+        if (!decryptIuk(identity, parser.value(rescueCodeOption), iuk, pProgressSink.data()))
+            return fail(EXIT_CHECK_FAILED, "Decryption of block 2 failed! Wrong rescue code?");
+
+        QJsonObject json;
+        json["match"] = CryptUtil::createImkFromIuk(iuk) == imk;
+        if (!writeJson(output, json)) return fail(EXIT_ERROR, "Error writing the output!");
+        return json["match"].toBool() ? 0 : EXIT_CHECK_FAILED;
+    }
+    else if (command == "decrypt")
+    {
+        if (!parser.isSet(passwordOption) && !parser.isSet(rescueCodeOption))
+            return fail(EXIT_ERROR, "Either --password or --rescue-code is required!");
+
+        QJsonObject json;
+        QByteArray imk, ilk, iuk;
+
+        if (parser.isSet(passwordOption))
+        {
+            if (!decryptImk(identity, parser.value(passwordOption), imk, ilk, pProgressSink.data()))
+                return fail(EXIT_CHECK_FAILED, "Decryption of block 1 failed! Wrong password?");
+            json["imk"] = QString(imk.toHex());
+            json["ilk"] = QString(ilk.toHex());
+        }
+
+        if (parser.isSet(rescueCodeOption))
+        {
+            if (!decryptIuk(identity, parser.value(rescueCodeOption), iuk, pProgressSink.data()))
+                return fail(EXIT_CHECK_FAILED, "Decryption of block 2 failed! Wrong rescue code?");
+            json["iuk"] = QString(iuk.toHex());
+            if (imk.isEmpty()) imk = CryptUtil::createImkFromIuk(iuk);
+        }
+
+        IdentityBlock* pBlock3 = identity.getBlock(3);
+        if (pBlock3 != nullptr)
+        {
+            QList<QByteArray> previousIuks;
+            if (!CryptUtil::decryptBlock3(previousIuks, pBlock3, imk))
+                return fail(EXIT_CHECK_FAILED, "Decryption of block 3 failed!");
+
+            QJsonArray previousIukArray;
+            for (const QByteArray& previousIuk : previousIuks)
+                previousIukArray.append(QString(previousIuk.toHex()));
+            json["previous_iuks"] = previousIukArray;
+        }
+
+        if (!writeJson(output, json)) return fail(EXIT_ERROR, "Error writing the output!");
+    }
+    else if (command == "site-keys")
+    {
+        if (!parser.isSet(passwordOption) || !parser.isSet(domainOption))
+            return fail(EXIT_ERROR, "Both --password and --domain are required!");
+
+        QByteArray imk, ilk;
+        if (!decryptImk(identity, parser.value(passwordOption), imk, ilk, pProgressSink.data()))
+            return fail(EXIT_CHECK_FAILED, "Decryption of block 1 failed! Wrong password?");
+
+        QByteArray publicKey(crypto_sign_PUBLICKEYBYTES, 0);
+        QByteArray privateKey(crypto_sign_SECRETKEYBYTES, 0);
+        if (!CryptUtil::createSiteKeys(publicKey, privateKey, parser.value(domainOption),
+                                       parser.value(altIdOption), imk))
+            return fail(EXIT_ERROR, "Creation of site keys failed!");
+
+        QJsonObject json;
+        json["public_key"] = QString(publicKey.toHex());
+        json["private_key"] = QString(privateKey.toHex());
+        if (!writeJson(output, json)) return fail(EXIT_ERROR, "Error writing the output!");
+    }
+    else
+    {
+        return fail(EXIT_ERROR, "Unknown command: " + command);
+    }
+
+    return 0;
+}
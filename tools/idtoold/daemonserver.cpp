@@ -0,0 +1,380 @@
+/*
+ * This file is part of the "IdTool" utility app.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Alexander Hauser
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "daemonserver.h"
+
+/*!
+ *
+ * \class DaemonServer
+ * \brief Accepts local socket connections for the \c idtoold daemon and
+ * runs their requests on a pool of worker threads.
+ *
+ * Messages are framed by a 4-byte big-endian length followed by the
+ * UTF-8 encoded, compact JSON message. Clients may send any number of
+ * requests without waiting for the responses. Since requests are
+ * handled concurrently, responses can arrive out of order and carry the
+ * \c id of their request.
+ *
+ * \sa DaemonConnection, IdentityService
+ *
+*/
+
+const quint32 DaemonServer::MAX_FRAME_SIZE = 16 * 1024 * 1024;
+const int DaemonServer::PROBE_TIMEOUT_MS = 500;
+
+/*!
+ * Creates a new server handling requests using \a service, running
+ * one worker thread per CPU core by default.
+ */
+
+DaemonServer::DaemonServer(IdentityService* service, QObject* parent) :
+    QObject(parent),
+    m_pService(service)
+{
+    m_ThreadPool.setMaxThreadCount(QThread::idealThreadCount());
+
+    // Requests may contain passwords, so only allow the current user
+    m_Server.setSocketOptions(QLocalServer::UserAccessOption);
+
+    connect(&m_Server, &QLocalServer::newConnection,
+            this, &DaemonServer::onNewConnection);
+}
+
+/*!
+ * Stops listening and waits for all running requests to finish.
+ */
+
+DaemonServer::~DaemonServer()
+{
+    m_Server.close();
+    m_ThreadPool.clear();
+    m_ThreadPool.waitForDone();
+}
+
+/*!
+ * Starts listening on the local socket \a name, which is either a name
+ * or a full path. Returns \c true on success, or \c false otherwise.
+ *
+ * If the socket already exists, the server first tries to connect to it
+ * for up to \c PROBE_TIMEOUT_MS milliseconds. The socket is only removed
+ * as a stale leftover of a crashed daemon if the connection is refused.
+ * If another daemon accepts the connection or does not answer in time,
+ * listening fails instead of taking over its socket.
+ */
+
+bool DaemonServer::listen(QString name)
+{
+    QLocalSocket probe;
+    probe.connectToServer(name);
+
+    if (probe.waitForConnected(PROBE_TIMEOUT_MS))
+    {
+        probe.abort();
+        m_ErrorString = tr("Another daemon is already running on this socket!");
+        return false;
+    }
+
+    switch (probe.error())
+    {
+    case QLocalSocket::ServerNotFoundError:
+        break;
+
+    case QLocalSocket::ConnectionRefusedError:
+        QLocalServer::removeServer(name);
+        break;
+
+    case QLocalSocket::SocketTimeoutError:
+        m_ErrorString = tr("Another daemon is already running on this socket!");
+        return false;
+
+    default:
+        m_ErrorString = probe.errorString();
+        return false;
+    }
+
+    if (m_Server.listen(name)) return true;
+
+    m_ErrorString = m_Server.errorString();
+    return false;
+}
+
+/*!
+ * Returns the description of the last error.
+ */
+
+QString DaemonServer::getErrorString()
+{
+    return m_ErrorString;
+}
+
+/*!
+ * Sets the maximum number of worker threads to \a threadCount. If
+ * \a threadCount is smaller than 1, one thread per CPU core is used.
+ */
+
+void DaemonServer::setMaxThreadCount(int threadCount)
+{
+    if (threadCount < 1) threadCount = QThread::idealThreadCount();
+    m_ThreadPool.setMaxThreadCount(threadCount);
+}
+
+/*!
+ * Returns the maximum number of worker threads.
+ */
+
+int DaemonServer::getMaxThreadCount()
+{
+    return m_ThreadPool.maxThreadCount();
+}
+
+/*!
+ * Returns the service handling the requests.
+ */
+
+IdentityService* DaemonServer::getService()
+{
+    return m_pService;
+}
+
+/*!
+ * Returns the pool of worker threads.
+ */
+
+QThreadPool* DaemonServer::getThreadPool()
+{
+    return &m_ThreadPool;
+}
+
+/*!
+ * Returns the frame for \a message.
+ */
+
+QByteArray DaemonServer::createFrame(const QJsonObject& message)
+{
+    QByteArray payload = QJsonDocument(message).toJson(QJsonDocument::Compact);
+    quint32 length = static_cast<quint32>(payload.size());
+
+    QByteArray frame;
+    frame.reserve(payload.size() + 4);
+    frame.append(static_cast<char>((length >> 24) & 0xFF));
+    frame.append(static_cast<char>((length >> 16) & 0xFF));
+    frame.append(static_cast<char>((length >> 8) & 0xFF));
+    frame.append(static_cast<char>(length & 0xFF));
+    frame.append(payload);
+    return frame;
+}
+
+/*!
+ * Removes the first complete frame from \a buffer and places its
+ * payload into \a payload. Returns \c true if a frame was taken, or
+ * \c false if \a buffer does not contain a complete frame yet. \a error
+ * is set to \c true if the frame exceeds \c MAX_FRAME_SIZE.
+ */
+
+bool DaemonServer::takeFrame(QByteArray& buffer, QByteArray& payload, bool& error)
+{
+    error = false;
+    if (buffer.size() < 4) return false;
+
+    const uchar* data = reinterpret_cast<const uchar*>(buffer.constData());
+    quint32 length = (static_cast<quint32>(data[0]) << 24) | (static_cast<quint32>(data[1]) << 16) |
+            (static_cast<quint32>(data[2]) << 8) | static_cast<quint32>(data[3]);
+
+    if (length > MAX_FRAME_SIZE)
+    {
+        error = true;
+        return false;
+    }
+
+    if (static_cast<quint32>(buffer.size()) < length + 4) return false;
+
+    payload = buffer.mid(4, static_cast<int>(length));
+    buffer.remove(0, static_cast<int>(length) + 4);
+    return true;
+}
+
+/*!
+ * Creates a \c DaemonConnection for each pending client connection.
+ */
+
+void DaemonServer::onNewConnection()
+{
+    while (m_Server.hasPendingConnections())
+    {
+        new DaemonConnection(this, m_Server.nextPendingConnection());
+    }
+}
+
+
+
+
+/*!
+ *
+ * \class DaemonConnection
+ * \brief A client connection of a \c DaemonServer.
+ *
+ * Splits the incoming data into requests and passes them to the
+ * server's worker threads, which report back using
+ * \c requestFinished(). A connection deletes itself once the client
+ * has disconnected and all of its requests have finished.
+ *
+ * \sa DaemonServer, DaemonRequestTask
+ *
+*/
+
+/*!
+ * Creates a new connection of \a server, taking ownership of \a socket.
+ */
+
+DaemonConnection::DaemonConnection(DaemonServer* server, QLocalSocket* socket) :
+    QObject(server),
+    m_pServer(server),
+    m_pSocket(socket)
+{
+    m_pSocket->setParent(this);
+
+    connect(m_pSocket, &QLocalSocket::readyRead,
+            this, &DaemonConnection::onReadyRead);
+    connect(m_pSocket, &QLocalSocket::disconnected,
+            this, &DaemonConnection::onDisconnected);
+}
+
+/*!
+ * Sends the response \a frame of a finished request to the client,
+ * unless it has disconnected in the meantime. Called on the
+ * connection's thread by \c DaemonRequestTask.
+ */
+
+void DaemonConnection::requestFinished(QByteArray frame)
+{
+    m_PendingCount--;
+    if (!m_bDisconnected) m_pSocket->write(frame);
+    deleteIfDone();
+}
+
+/*!
+ * Reads all complete requests and starts a \c DaemonRequestTask for
+ * each of them. Invalid requests are answered immediately, oversized
+ * frames abort the connection.
+ */
+
+void DaemonConnection::onReadyRead()
+{
+    m_Buffer.append(m_pSocket->readAll());
+
+    QByteArray payload;
+    bool error = false;
+
+    while (DaemonServer::takeFrame(m_Buffer, payload, error))
+    {
+        QElapsedTimer receivedTimer;
+        receivedTimer.start();
+
+        QJsonParseError parseError;
+        QJsonDocument doc = QJsonDocument::fromJson(payload, &parseError);
+        if (parseError.error != QJsonParseError::NoError || !doc.isObject())
+        {
+            QJsonObject response;
+            response["ok"] = false;
+            response["error"] = QObject::tr("Invalid request!");
+            m_pSocket->write(DaemonServer::createFrame(response));
+            continue;
+        }
+
+        m_PendingCount++;
+        m_pServer->getThreadPool()->start(new DaemonRequestTask(
+                                              m_pServer->getService(), this, doc.object(), receivedTimer));
+    }
+
+    if (error)
+    {
+        m_Buffer.clear();
+        m_pSocket->abort();
+    }
+}
+
+/*!
+ * Marks the connection as disconnected.
+ */
+
+void DaemonConnection::onDisconnected()
+{
+    m_bDisconnected = true;
+    deleteIfDone();
+}
+
+/*!
+ * Schedules the connection for deletion once the client has
+ * disconnected and no requests are pending anymore, since the
+ * worker threads report back to it.
+ */
+
+void DaemonConnection::deleteIfDone()
+{
+    if (m_bDisconnected && m_PendingCount == 0) deleteLater();
+}
+
+
+
+
+/*!
+ *
+ * \class DaemonRequestTask
+ * \brief A \c QRunnable handling a single request of a
+ * \c DaemonConnection.
+ *
+ * \sa DaemonConnection
+ *
+*/
+
+/*!
+ * Creates a task handling \a request using \a service and sending the
+ * response to \a connection. \a receivedTimer was started when the
+ * request was received, so that the recorded latency includes the
+ * time the request has been waiting for a worker thread.
+ */
+
+DaemonRequestTask::DaemonRequestTask(IdentityService* service, DaemonConnection* connection,
+                                     QJsonObject request, QElapsedTimer receivedTimer) :
+    m_pService(service),
+    m_pConnection(connection),
+    m_Request(request),
+    m_ReceivedTimer(receivedTimer)
+{
+}
+
+/*!
+ * Handles the request and passes the response to the connection's
+ * thread.
+ */
+
+void DaemonRequestTask::run()
+{
+    QJsonObject response = m_pService->handleRequest(m_Request, m_ReceivedTimer.nsecsElapsed());
+
+    QMetaObject::invokeMethod(m_pConnection, "requestFinished", Qt::QueuedConnection,
+                              Q_ARG(QByteArray, DaemonServer::createFrame(response)));
+}
@@ -0,0 +1,116 @@
+/*
+ * This file is part of the "IdTool" utility app.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Alexander Hauser
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef DAEMONSERVER_H
+#define DAEMONSERVER_H
+
+#include <QtCore>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include "../../src/identityservice.h"
+
+/**********************************************
+ *    class DaemonServer                      *
+ *********************************************/
+
+class DaemonServer : public QObject
+{
+    Q_OBJECT
+
+public:
+    static const quint32 MAX_FRAME_SIZE;
+    static const int PROBE_TIMEOUT_MS;
+
+private:
+    IdentityService* m_pService;
+    QLocalServer m_Server;
+    QThreadPool m_ThreadPool;
+    QString m_ErrorString;
+
+public:
+    DaemonServer(IdentityService* service, QObject* parent = nullptr);
+    ~DaemonServer() override;
+    bool listen(QString name);
+    QString getErrorString();
+    void setMaxThreadCount(int threadCount);
+    int getMaxThreadCount();
+    IdentityService* getService();
+    QThreadPool* getThreadPool();
+    static QByteArray createFrame(const QJsonObject& message);
+    static bool takeFrame(QByteArray& buffer, QByteArray& payload, bool& error);
+
+private slots:
+    void onNewConnection();
+};
+
+/**********************************************
+ *    class DaemonConnection                  *
+ *********************************************/
+
+class DaemonConnection : public QObject
+{
+    Q_OBJECT
+
+private:
+    DaemonServer* m_pServer;
+    QLocalSocket* m_pSocket;
+    QByteArray m_Buffer;
+    int m_PendingCount = 0;
+    bool m_bDisconnected = false;
+
+public:
+    DaemonConnection(DaemonServer* server, QLocalSocket* socket);
+
+public slots:
+    void requestFinished(QByteArray frame);
+
+private slots:
+    void onReadyRead();
+    void onDisconnected();
+
+private:
+    void deleteIfDone();
+};
+
+/**********************************************
+ *    class DaemonRequestTask                 *
+ *********************************************/
+
+class DaemonRequestTask : public QRunnable
+{
+private:
+    IdentityService* m_pService;
+    DaemonConnection* m_pConnection;
+    QJsonObject m_Request;
+    QElapsedTimer m_ReceivedTimer;
+
+public:
+    DaemonRequestTask(IdentityService* service, DaemonConnection* connection,
+                      QJsonObject request, QElapsedTimer receivedTimer);
+    void run() override;
+};
+
+#endif // DAEMONSERVER_H
@@ -0,0 +1,147 @@
+/*
+ * This file is part of the "IdTool" utility app.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Alexander Hauser
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <QtCore>
+#include <iostream>
+#include "daemonserver.h"
+#include "../../src/identityparser.h"
+
+/*
+ * Long-running daemon serving identity parsing and crypto requests over
+ * a local socket (a Unix domain socket on Linux and macOS, a named pipe
+ * on Windows), so that test harnesses don't pay for process startup,
+ * loading block definitions and initializing libsodium on every call.
+ *
+ * Usage: idtoold [options]
+ *        idtoold --request <json> [--socket <name>]
+ *
+ * Every message is framed by a 4-byte big-endian length, followed by
+ * a compact JSON object. Requests look like
+ *
+ *   {"id": 1, "op": "site-keys", "identity": "SQRLDATA...",
+ *    "password": "...", "domain": "example.com"}
+ *
+ * and are answered with the operation's result plus "id" and "ok"
+ * (and "error" if "ok" is false). See IdentityService for the supported
+ * operations. The "stats" operation returns per-operation latencies,
+ * which include the time a request has been waiting for a worker.
+ *
+ * With --request, idtoold acts as a client: it sends a single request
+ * to a running daemon and writes the response to stdout (exit code 2
+ * if the response is not "ok"), which is handy for scripts.
+ */
+
+static int sendRequest(QString socketName, QByteArray requestJson)
+{
+    QJsonParseError parseError;
+    QJsonDocument doc = QJsonDocument::fromJson(requestJson, &parseError);
+    if (parseError.error != QJsonParseError::NoError || !doc.isObject())
+    {
+        std::cerr << "The request is no valid JSON object!\n";
+        return 1;
+    }
+
+    QLocalSocket socket;
+    socket.connectToServer(socketName);
+    if (!socket.waitForConnected(5000))
+    {
+        std::cerr << "Error connecting to the daemon: " << socket.errorString().toStdString() << "\n";
+        return 1;
+    }
+
+    socket.write(DaemonServer::createFrame(doc.object()));
+
+    QByteArray buffer, payload;
+    bool error = false;
+    while (!DaemonServer::takeFrame(buffer, payload, error))
+    {
+        if (error || !socket.waitForReadyRead(-1))
+        {
+            std::cerr << "Error reading the response!\n";
+            return 1;
+        }
+        buffer.append(socket.readAll());
+    }
+
+    std::cout << payload.toStdString() << "\n";
+    return QJsonDocument::fromJson(payload).object()["ok"].toBool() ? 0 : 2;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("IdTool");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Serves SQRL identity parsing and crypto requests over a local socket.");
+    parser.addHelpOption();
+    QCommandLineOption socketOption({"s", "socket"}, "Socket name or path.", "name", "idtoold");
+    QCommandLineOption threadsOption({"j", "threads"}, "Number of worker threads (default: one per core).", "count", "0");
+    QCommandLineOption keyCacheOption({"k", "key-cache"}, "Number of password-derived keys to cache (default: 0, disabled).", "count", "0");
+    QCommandLineOption requestOption({"r", "request"}, "Send a single JSON request to a running daemon.", "json");
+    parser.addOptions({ socketOption, threadsOption, keyCacheOption, requestOption });
+    parser.process(app);
+
+    QString socketName = parser.value(socketOption);
+
+    if (parser.isSet(requestOption))
+        return sendRequest(socketName, parser.value(requestOption).toUtf8());
+
+    // Block definitions are being looked up relative to the current
+    // directory, so fall back to the application directory if needed
+    if (!IdentityParser::hasBlockDefinition(2))
+        QDir::setCurrent(QCoreApplication::applicationDirPath());
+
+    IdentityService service;
+
+    try
+    {
+        service.warmUp();
+    }
+    catch (std::exception& e)
+    {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+
+    service.setKeyCacheCapacity(parser.value(keyCacheOption).toInt());
+
+    DaemonServer server(&service);
+    server.setMaxThreadCount(parser.value(threadsOption).toInt());
+
+    if (!server.listen(socketName))
+    {
+        std::cerr << "Error listening on " << socketName.toStdString() << ": "
+                  << server.getErrorString().toStdString() << "\n";
+        return 1;
+    }
+
+    std::cerr << "Listening on " << socketName.toStdString() << " with "
+              << server.getMaxThreadCount() << " worker threads\n";
+
+    return app.exec();
+}
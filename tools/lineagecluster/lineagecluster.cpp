@@ -0,0 +1,180 @@
+/*
+ * This file is part of the "IdTool" utility app.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Alexander Hauser
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <QtCore>
+#include <iostream>
+#include "../../src/identitylineage.h"
+#include "../../src/identityloader.h"
+#include "../../src/identityparser.h"
+
+/*
+ * Groups a corpus of identity files into lineages, i.e. sets of
+ * identities related through their current and previous identity
+ * master keys, and writes the resulting lineage graph as JSON.
+ *
+ * Usage: lineagecluster [options] <file or directory>...
+ *
+ * Passwords are either given for all identities using --password,
+ * or per identity file using a credentials file containing lines of
+ * the form "<identity file>,<password>". Relative identity file paths
+ * within the credentials file are resolved relative to its location,
+ * and lines starting with '#' are ignored.
+ */
+
+static bool readCredentials(QString fileName, QHash<QString, QString>& passwords)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) return false;
+
+    QDir baseDir = QFileInfo(fileName).absoluteDir();
+    QTextStream stream(&file);
+
+    while (!stream.atEnd())
+    {
+        QString line = stream.readLine();
+        if (line.trimmed().isEmpty() || line.trimmed().startsWith('#')) continue;
+
+        int separator = line.indexOf(',');
+        if (separator < 0) continue;
+
+        QString path = QFileInfo(baseDir, line.left(separator).trimmed()).absoluteFilePath();
+        passwords.insert(path, line.mid(separator + 1));
+    }
+
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("IdTool");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Groups SQRL identities into lineages of related identities.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("paths", "Identity files or directories containing identity files.", "<paths...>");
+    QCommandLineOption passwordOption({"p", "password"}, "Password used for all identities.", "password");
+    QCommandLineOption credentialsOption({"c", "credentials"}, "File containing \"<identity file>,<password>\" lines.", "file");
+    QCommandLineOption outputOption({"o", "output"}, "Output file for the lineage graph (default: stdout).", "file");
+    parser.addOption(passwordOption);
+    parser.addOption(credentialsOption);
+    parser.addOption(outputOption);
+    parser.process(app);
+
+    QStringList args = parser.positionalArguments();
+    if (args.isEmpty()) parser.showHelp(1);
+
+    QHash<QString, QString> passwordsByFile;
+    if (parser.isSet(credentialsOption) &&
+            !readCredentials(parser.value(credentialsOption), passwordsByFile))
+    {
+        std::cerr << "Error reading the credentials file!\n";
+        return 1;
+    }
+
+    QStringList fileNames = IdentityLoader::collectIdentityFiles(args);
+    if (fileNames.isEmpty())
+    {
+        std::cerr << "No identity files found!\n";
+        return 1;
+    }
+
+    // Block definitions are being looked up relative to the current
+    // directory, so fall back to the application directory if needed
+    if (!IdentityParser::hasBlockDefinition(2))
+        QDir::setCurrent(QCoreApplication::applicationDirPath());
+
+    QList<IdentityModel> identities;
+    QStringList names;
+    QStringList passwords;
+    IdentityLineage lineage;
+    IdentityParser identityParser;
+
+    for (const QString& fileName : fileNames)
+    {
+        IdentityModel identity;
+
+        try
+        {
+            identityParser.parseFile(fileName, &identity);
+        }
+        catch (std::exception& e)
+        {
+            lineage.addFailedIdentity(fileName, e.what());
+            continue;
+        }
+
+        identities.append(identity);
+        names.append(fileName);
+        passwords.append(passwordsByFile.value(fileName, parser.value(passwordOption)));
+    }
+
+    std::cerr << "Decrypting " << identities.size() << " identities...\n";
+
+    QList<QByteArray> imks;
+    QList<QList<QByteArray>> previousImks;
+    QStringList errors;
+    IdentityLineage::decryptIdentities(identities, passwords, imks, previousImks, errors);
+
+    for (int i=0; i<identities.size(); i++)
+    {
+        if (errors.at(i).isEmpty()) lineage.addIdentity(names.at(i), imks.at(i), previousImks.at(i));
+        else lineage.addFailedIdentity(names.at(i), errors.at(i));
+    }
+
+    lineage.cluster();
+
+    int failedCount = 0;
+    for (const IdentityLineage::Member& member : lineage.getMembers())
+    {
+        if (member.error.isEmpty()) continue;
+        std::cerr << member.name.toStdString() << ": " << member.error.toStdString() << "\n";
+        failedCount++;
+    }
+
+    std::cerr << lineage.getMembers().size() << " identities, " << failedCount << " failed, "
+              << lineage.getClusters().size() << " lineages, "
+              << lineage.getEdges().size() << " relations\n";
+
+    QByteArray json = QJsonDocument(lineage.toJson()).toJson();
+
+    if (!parser.isSet(outputOption))
+    {
+        std::cout << json.toStdString();
+    }
+    else
+    {
+        QFile outputFile(parser.value(outputOption));
+        if (!outputFile.open(QIODevice::WriteOnly) || outputFile.write(json) != json.size())
+        {
+            std::cerr << "Error writing the output file!\n";
+            return 1;
+        }
+    }
+
+    return failedCount > 0 ? 2 : 0;
+}
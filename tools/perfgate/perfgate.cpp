@@ -0,0 +1,340 @@
+/*
+ * This file is part of the "IdTool" utility app.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Alexander Hauser
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <QtCore>
+#include <algorithm>
+#include <iostream>
+
+/*
+ * Performance regression gate for the benchcore microbenchmarks.
+ *
+ * Usage: perfgate [options] [benchmark functions...]
+ *
+ * Runs benchcore --trials times, each time in a fresh process, and
+ * collects the per-iteration result of every scenario ("function/tag").
+ * The median over all trials is compared against the median stored in
+ * the --baseline file. A scenario fails if it got slower by more than
+ * its tolerance, and if the slowdown is clearly larger than the noise
+ * between trials (--noise-factor times the scaled median absolute
+ * deviation). This keeps noisy CI machines from failing the gate, while
+ * still catching real regressions.
+ *
+ * The baseline is a JSON file of the form
+ *
+ *   {
+ *     "default_tolerance": 0.15,
+ *     "scenarios": {
+ *       "parseIdentityData/3 blocks": { "tolerance": 0.25, "median": 0.0123,
+ *                                        "metric": "WalltimeMilliseconds" },
+ *       ...
+ *     }
+ *   }
+ *
+ * Scenarios without a recorded median are reported as new. They only
+ * fail the gate if --require-baseline is given, which CI runs should
+ * use so that a missing or incomplete baseline doesn't silently turn
+ * the gate into a no-op. Run with --update on the reference machine to
+ * record the current medians, keeping all tolerances.
+ *
+ * Note that the baseline shipped in benchmarks/baseline.json only holds
+ * the tolerances so far. Until medians have been recorded on the
+ * reference machine, the gate compares nothing and warns about it.
+ *
+ * Exit codes: 0 if no scenario regressed, 1 on usage or benchmark
+ * errors, 2 if any scenario regressed, and 3 if --require-baseline is
+ * given and any scenario has no baseline median.
+ */
+
+static const int EXIT_ERROR = 1;
+static const int EXIT_REGRESSION = 2;
+static const int EXIT_MISSING_BASELINE = 3;
+
+// Scales the median absolute deviation to the standard deviation of
+// normally distributed samples
+static const double MAD_SCALE = 1.4826;
+
+struct Scenario
+{
+    QString metric;
+    QVector<double> values;
+};
+
+static double getMedian(QVector<double> values)
+{
+    if (values.isEmpty()) return 0;
+
+    std::sort(values.begin(), values.end());
+    int middle = values.size() / 2;
+    return values.size() % 2 ? values[middle] : (values[middle - 1] + values[middle]) / 2;
+}
+
+static double getMedianAbsoluteDeviation(const QVector<double>& values, double median)
+{
+    QVector<double> deviations;
+    for (double value : values) deviations.append(qAbs(value - median));
+    return getMedian(deviations);
+}
+
+static QString formatValue(double value, QString metric)
+{
+    if (metric != "WalltimeMilliseconds") return QString::number(value, 'g', 4) + " " + metric;
+
+    if (value >= 1000) return QString::number(value / 1000, 'f', 2) + " s";
+    if (value >= 1) return QString::number(value, 'f', 2) + " ms";
+    if (value >= 0.001) return QString::number(value * 1000, 'f', 2) + " us";
+    return QString::number(value * 1000000, 'f', 1) + " ns";
+}
+
+/*
+ * Runs the benchmark once and adds its results to \a scenarios.
+ * QtTest's XML output reports the value per iteration.
+ */
+
+static bool runTrial(QString benchmark, QStringList functions, QMap<QString, Scenario>& scenarios)
+{
+    QProcess process;
+    process.setWorkingDirectory(QFileInfo(benchmark).absolutePath());
+    process.setProcessChannelMode(QProcess::ForwardedErrorChannel);
+    process.start(benchmark, QStringList() << "-xml" << functions);
+
+    if (!process.waitForFinished(-1) || process.exitStatus() != QProcess::NormalExit ||
+            process.exitCode() != 0)
+    {
+        std::cerr << "Error running " << benchmark.toStdString() << "!\n";
+        return false;
+    }
+
+    QXmlStreamReader xml(process.readAllStandardOutput());
+    QString function;
+
+    while (!xml.atEnd())
+    {
+        if (xml.readNext() != QXmlStreamReader::StartElement) continue;
+
+        if (xml.name() == QLatin1String("TestFunction"))
+        {
+            function = xml.attributes().value("name").toString();
+        }
+        else if (xml.name() == QLatin1String("BenchmarkResult"))
+        {
+            QString tag = xml.attributes().value("tag").toString();
+            Scenario& scenario = scenarios[tag.isEmpty() ? function : function + "/" + tag];
+            scenario.metric = xml.attributes().value("metric").toString();
+            scenario.values.append(xml.attributes().value("value").toDouble());
+        }
+    }
+
+    if (xml.hasError())
+    {
+        std::cerr << "Error parsing the benchmark output: " << xml.errorString().toStdString() << "\n";
+        return false;
+    }
+
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("IdTool");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Compares the benchcore results against a stored baseline.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("functions", "Benchmark functions to run (default: all).", "[functions...]");
+    QCommandLineOption benchmarkOption("benchmark", "Path of the benchcore executable.", "file",
+                                       QCoreApplication::applicationDirPath() + "/../../benchmarks/benchcore");
+    QCommandLineOption baselineOption("baseline", "Baseline JSON file.", "file",
+                                      PERFGATE_BASELINE);
+    QCommandLineOption trialsOption({"t", "trials"}, "Number of benchmark runs.", "count", "5");
+    QCommandLineOption noiseFactorOption("noise-factor", "Required slowdown in units of the trial noise.", "factor", "3");
+    QCommandLineOption updateOption("update", "Record the current medians within the baseline file.");
+    QCommandLineOption reportOption({"r", "report"}, "Write the comparison as JSON to this file.", "file");
+    QCommandLineOption requireBaselineOption("require-baseline", "Fail if any scenario has no baseline median.");
+    parser.addOptions({ benchmarkOption, baselineOption, trialsOption, noiseFactorOption,
+                        updateOption, reportOption, requireBaselineOption });
+    parser.process(app);
+
+    int trials = qMax(1, parser.value(trialsOption).toInt());
+    double noiseFactor = parser.value(noiseFactorOption).toDouble();
+
+    QFile baselineFile(parser.value(baselineOption));
+    QJsonObject baseline;
+    if (baselineFile.open(QIODevice::ReadOnly))
+    {
+        QJsonParseError error;
+        baseline = QJsonDocument::fromJson(baselineFile.readAll(), &error).object();
+        baselineFile.close();
+
+        if (error.error != QJsonParseError::NoError)
+        {
+            std::cerr << "Error parsing the baseline: " << error.errorString().toStdString() << "\n";
+            return EXIT_ERROR;
+        }
+    }
+    else if (!parser.isSet(updateOption))
+    {
+        std::cerr << "Error opening the baseline " << baselineFile.fileName().toStdString() << "!\n";
+        return EXIT_ERROR;
+    }
+
+    QMap<QString, Scenario> scenarios;
+    for (int i=0; i<trials; i++)
+    {
+        std::cerr << "Trial " << i + 1 << "/" << trials << "...\n";
+        if (!runTrial(parser.value(benchmarkOption), parser.positionalArguments(), scenarios))
+            return EXIT_ERROR;
+    }
+
+    double defaultTolerance = baseline["default_tolerance"].toDouble(0.15);
+    QJsonObject baselineScenarios = baseline["scenarios"].toObject();
+    QJsonArray report;
+    int regressionCount = 0;
+    int newCount = 0;
+
+    for (auto it = scenarios.constBegin(); it != scenarios.constEnd(); ++it)
+    {
+        const Scenario& scenario = it.value();
+        double median = getMedian(scenario.values);
+        double noise = MAD_SCALE * getMedianAbsoluteDeviation(scenario.values, median);
+
+        QJsonObject expected = baselineScenarios[it.key()].toObject();
+        double tolerance = expected["tolerance"].toDouble(defaultTolerance);
+        double baselineMedian = expected["median"].toDouble(0);
+        bool comparable = baselineMedian > 0 && expected["metric"].toString(scenario.metric) == scenario.metric;
+
+        QString status = "new";
+        double change = 0;
+
+        if (!comparable)
+        {
+            newCount++;
+        }
+        else
+        {
+            change = median / baselineMedian - 1;
+
+            if (change > tolerance && median - baselineMedian > noiseFactor * noise)
+            {
+                status = "regressed";
+                regressionCount++;
+            }
+            else if (change < -tolerance && baselineMedian - median > noiseFactor * noise)
+            {
+                status = "improved";
+            }
+            else
+            {
+                status = "ok";
+            }
+        }
+
+        QString line = QString("%1 %2: %3 (noise %4)")
+                .arg(status.toUpper(), -9)
+                .arg(it.key())
+                .arg(formatValue(median, scenario.metric))
+                .arg(formatValue(noise, scenario.metric));
+
+        if (comparable)
+        {
+            line += QString(", baseline %1, %2%3% (tolerance %4%)")
+                    .arg(formatValue(baselineMedian, scenario.metric))
+                    .arg(change >= 0 ? "+" : "")
+                    .arg(change * 100, 0, 'f', 1)
+                    .arg(tolerance * 100, 0, 'f', 0);
+        }
+
+        std::cout << line.toStdString() << "\n";
+
+        QJsonObject result;
+        result["scenario"] = it.key();
+        result["status"] = status;
+        result["metric"] = scenario.metric;
+        result["median"] = median;
+        result["noise"] = noise;
+        result["baseline"] = baselineMedian;
+        result["change"] = change;
+        result["tolerance"] = tolerance;
+        result["trials"] = scenario.values.size();
+        report.append(result);
+
+        if (parser.isSet(updateOption))
+        {
+            expected["median"] = median;
+            expected["metric"] = scenario.metric;
+            baselineScenarios[it.key()] = expected;
+        }
+    }
+
+    std::cout << scenarios.size() << " scenarios, " << regressionCount << " regressed, "
+              << newCount << " without baseline\n";
+
+    if (parser.isSet(reportOption))
+    {
+        QFile reportFile(parser.value(reportOption));
+        QByteArray json = QJsonDocument(report).toJson();
+        if (!reportFile.open(QIODevice::WriteOnly) || reportFile.write(json) != json.size())
+        {
+            std::cerr << "Error writing the report!\n";
+            return EXIT_ERROR;
+        }
+    }
+
+    if (parser.isSet(updateOption))
+    {
+        if (!baseline.contains("default_tolerance")) baseline["default_tolerance"] = defaultTolerance;
+        baseline["scenarios"] = baselineScenarios;
+
+        QSaveFile saveFile(baselineFile.fileName());
+        QByteArray json = QJsonDocument(baseline).toJson();
+        if (!saveFile.open(QIODevice::WriteOnly) || saveFile.write(json) != json.size() || !saveFile.commit())
+        {
+            std::cerr << "Error writing the baseline!\n";
+            return EXIT_ERROR;
+        }
+
+        std::cerr << "Baseline updated.\n";
+        return 0;
+    }
+
+    if (regressionCount > 0) return EXIT_REGRESSION;
+
+    if (!scenarios.isEmpty() && newCount == scenarios.size())
+    {
+        std::cerr << "Warning: The baseline has no medians, so no scenario was compared. "
+                  << "Record them on the reference machine using --update!\n";
+    }
+
+    if (newCount > 0 && parser.isSet(requireBaselineOption))
+    {
+        std::cerr << "The baseline has no median for " << newCount << " scenarios, "
+                  << "record it using --update!\n";
+        return EXIT_MISSING_BASELINE;
+    }
+
+    return 0;
+}
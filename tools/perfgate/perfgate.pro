@@ -0,0 +1,29 @@
+######################################################################
+# Performance regression gate for the benchcore microbenchmarks
+######################################################################
+
+QT = core
+
+CONFIG += console 
+
+TEMPLATE = app
+CONFIG += c++11
+TARGET = perfgate
+INCLUDEPATH += .
+
+# You can make your code fail to compile if you use deprecated APIs.
+# In order to do so, uncomment the following line.
+# Please consult the documentation of the deprecated API in order to know
+# how to port your code away from it.
+# You can also select to disable deprecated APIs only up to a certain version of Qt.
+#DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
+
+# The baseline is kept within the source tree
+DEFINES += PERFGATE_BASELINE=\\\"$$PWD/../../benchmarks/baseline.json\\\"
+
+# Input
+SOURCES += \
+    perfgate.cpp
+
+DISTFILES += \
+    ../../benchmarks/baseline.json
@@ -0,0 +1,148 @@
+/*
+ * This file is part of the "IdTool" utility app.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2019 Alexander Hauser
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <QtCore>
+#include <iostream>
+#include <csignal>
+#include "../../src/cryptutil.h"
+#include "../../src/enscryptcalibration.h"
+#include "../../src/identityparser.h"
+#include "../../src/kdfexecutor.h"
+#include "../../src/rescuecoderecovery.h"
+
+/*
+ * Recovers a partially known rescue code for one's own identity file.
+ *
+ * Usage: rescuerecovery [options] <identity file> <rescue code pattern>
+ *
+ * Unknown digits within the pattern are marked with '?', e.g.
+ * "1234-5678-9?12-3456-7890-12?4".
+ */
+
+static RescueCodeRecovery* g_pRecovery = nullptr;
+
+static void onInterrupt(int)
+{
+    if (g_pRecovery != nullptr) g_pRecovery->stop();
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("IdTool");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Recovers a partially known SQRL rescue code.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("identity", "The SQRL identity file.");
+    parser.addPositionalArgument("pattern", "The rescue code, with unknown digits replaced by '?'.");
+    QCommandLineOption threadsOption({"t", "threads"}, "Number of worker threads (default: all cores).", "count", "0");
+    QCommandLineOption checkpointOption({"c", "checkpoint"}, "Checkpoint file for resuming an interrupted search.", "file");
+    parser.addOption(threadsOption);
+    parser.addOption(checkpointOption);
+    parser.process(app);
+
+    QStringList args = parser.positionalArguments();
+    if (args.count() != 2) parser.showHelp(1);
+
+    QString identityFile = QFileInfo(args.at(0)).absoluteFilePath();
+
+    // Block definitions are being looked up relative to the current
+    // directory, so fall back to the application directory if needed
+    if (!IdentityParser::hasBlockDefinition(2))
+        QDir::setCurrent(QCoreApplication::applicationDirPath());
+
+    IdentityModel identity;
+    IdentityParser identityParser;
+
+    try
+    {
+        identityParser.parseFile(identityFile, &identity);
+    }
+    catch (std::exception& e)
+    {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+
+    IdentityBlock* pBlock2 = identity.getBlock(2);
+    if (pBlock2 == nullptr)
+    {
+        std::cerr << "The identity does not contain a type 2 block!\n";
+        return 1;
+    }
+
+    RescueCodeRecovery recovery(*pBlock2, args.at(1));
+    if (!recovery.isValid())
+    {
+        std::cerr << "Invalid rescue code pattern or type 2 block!\n";
+        return 1;
+    }
+
+    // Testing candidates must not hold up interactive KDF jobs
+    KdfExecutor::setDefaultPriority(KdfExecutor::BATCH);
+    recovery.setThreadCount(parser.value(threadsOption).toInt());
+    if (parser.isSet(checkpointOption)) recovery.setCheckpointFile(parser.value(checkpointOption));
+
+    qint64 estimate = EnScryptCalibration::estimateMilliseconds(
+                pBlock2->items[3].value.toInt(), pBlock2->items[4].value.toInt(), false);
+
+    std::cout << "Search space: " << recovery.getSearchSpaceSize() << " candidates, "
+              << recovery.getThreadCount() << " threads";
+    if (estimate >= 0)
+        std::cout << ", ~" << EnScryptCalibration::formatDuration(estimate).toStdString()
+                  << " per candidate";
+    std::cout << "\n";
+
+    QObject::connect(&recovery, &RescueCodeRecovery::progressChanged,
+                     [](RescueCodeRecovery::Statistics statistics)
+    {
+        std::cout << "\rTested " << statistics.testedCandidates << "/" << statistics.totalCandidates
+                  << ", " << QString::number(statistics.candidatesPerSecond, 'f', 2).toStdString()
+                  << " candidates/s, " << statistics.remainingCandidates << " remaining";
+        if (statistics.estimatedRemainingMilliseconds >= 0)
+            std::cout << " (max. " << EnScryptCalibration::formatDuration(
+                             statistics.estimatedRemainingMilliseconds).toStdString() << ")";
+        std::cout << "      " << std::flush;
+    });
+
+    g_pRecovery = &recovery;
+    std::signal(SIGINT, onInterrupt);
+
+    bool found = recovery.run();
+    g_pRecovery = nullptr;
+    std::cout << "\n";
+
+    if (!found)
+    {
+        std::cout << "Rescue code not found.\n";
+        return 2;
+    }
+
+    std::cout << "Rescue code found: "
+              << CryptUtil::formatRescueCode(recovery.getRescueCode()).toStdString() << "\n";
+    return 0;
+}